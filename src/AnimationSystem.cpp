@@ -0,0 +1,245 @@
+/**
+ * @file AnimationSystem.cpp
+ *
+ * @brief Translation, rotation and scale tracks of the scene objects, advanced together every frame.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include "AnimationSystem.h"
+
+#include <glm/geometric.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "SceneObject.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ANIMATION_SSE2 1
+#endif
+
+namespace
+{
+	// Shortest duration, the progress of an instant track is 1 after its first frame
+	constexpr float MIN_DURATION = 1e-6f;
+
+	// Coefficients of t, t squared and t cubed for each easing
+	constexpr float CURVES[4][3] =
+	{
+		{ 1.0f, 0.0f, 0.0f },      // t
+		{ 0.0f, 0.0f, 1.0f },      // t^3
+		{ 3.0f, -3.0f, 1.0f },     // 1 - (1 - t)^3
+		{ 0.0f, 3.0f, -2.0f }      // Smoothstep
+	};
+}
+
+AnimationSystem::Settings& AnimationSystem::settings()
+{
+	static Settings settings;
+	return settings;
+}
+
+AnimationSystem::Statistics& AnimationSystem::statistics()
+{
+	static Statistics statistics;
+	return statistics;
+}
+
+AnimationSystem::TrackId AnimationSystem::translate(SceneObject& object, const glm::vec3& offset, float secondsOfDuration, Easing easing)
+{
+	return start(object, Channel::Translation, offset, secondsOfDuration, easing);
+}
+
+AnimationSystem::TrackId AnimationSystem::rotate(SceneObject& object, const glm::vec3& axis, float degrees, float secondsOfDuration, Easing easing)
+{
+	const float axisLength = glm::length(axis);
+	if (axisLength == 0.0f)
+	{
+		std::cerr << "Cannot rotate " << object.getName() << " around a null axis" << std::endl;
+		return NO_TRACK;
+	}
+	return start(object, Channel::Rotation, axis * (glm::radians(degrees) / axisLength), secondsOfDuration, easing);
+}
+
+AnimationSystem::TrackId AnimationSystem::scale(SceneObject& object, const glm::vec3& scaleChange, float secondsOfDuration, Easing easing)
+{
+	return start(object, Channel::Scale, scaleChange, secondsOfDuration, easing);
+}
+
+bool AnimationSystem::stop(TrackId track)
+{
+	const auto found = std::find(m_ids.begin(), m_ids.end(), track);
+	if (found == m_ids.end())
+	{
+		return false;
+	}
+	remove(static_cast<std::size_t>(found - m_ids.begin()));
+	return true;
+}
+
+void AnimationSystem::stop(const SceneObject& object)
+{
+	for (std::size_t i = 0; i < m_objects.size();)
+	{
+		if (m_objects[i] == &object)
+		{
+			remove(i);
+		}
+		else
+		{
+			++i;
+		}
+	}
+}
+
+bool AnimationSystem::isAnimating(const SceneObject& object) const
+{
+	return std::find(m_objects.begin(), m_objects.end(), &object) != m_objects.end();
+}
+
+void AnimationSystem::update(float deltaTime)
+{
+	auto& animationStatistics = statistics();
+	const auto startTime = std::chrono::steady_clock::now();
+
+	const auto& animationSettings = settings();
+	if (!animationSettings.paused && !m_objects.empty())
+	{
+		evaluate(deltaTime * animationSettings.timeScale);
+
+		// A finished track is replaced by the last one, already evaluated: the index is visited again
+		for (std::size_t i = 0; i < m_objects.size();)
+		{
+			SceneObject& object = *m_objects[i];
+			const float step = m_steps[i];
+			const glm::vec3& value = m_values[i];
+			switch (m_channels[i])
+			{
+			case Channel::Translation:
+				object.translation() += step * value;
+				break;
+			case Channel::Rotation:
+			{
+				// Around the axis of the parent: applied before the current orientation
+				const float angle = glm::length(value);
+				object.transform().orientation(glm::angleAxis(step * angle, value / angle) * object.orientation());
+				break;
+			}
+			case Channel::Scale:
+				object.scale() += step * value;
+				break;
+			}
+			object.dirtyGlobal();
+
+			if (m_progress[i] >= 1.0f)
+			{
+				m_events.push_back({ m_ids[i], m_objects[i], m_channels[i] });
+				++animationStatistics.finishedTracks;
+				remove(i);
+			}
+			else
+			{
+				++i;
+			}
+		}
+	}
+
+	animationStatistics.activeTracks = m_objects.size();
+	animationStatistics.updateMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+std::vector<AnimationSystem::Event> AnimationSystem::takeEvents()
+{
+	std::vector<Event> events;
+	events.swap(m_events);
+	return events;
+}
+
+AnimationSystem::TrackId AnimationSystem::start(SceneObject& object, Channel channel, const glm::vec3& value, float secondsOfDuration, Easing easing)
+{
+	const TrackId id = m_nextId++;
+	const auto& curve = CURVES[static_cast<int>(easing)];
+
+	m_elapsed.push_back(0.0f);
+	m_inverseDurations.push_back(1.0f / std::max(secondsOfDuration, MIN_DURATION));
+	for (int term = 0; term < 3; ++term)
+	{
+		m_curves[term].push_back(curve[term]);
+	}
+	m_eased.push_back(0.0f);
+	m_steps.push_back(0.0f);
+	m_progress.push_back(0.0f);
+
+	m_ids.push_back(id);
+	m_objects.push_back(&object);
+	m_channels.push_back(channel);
+	m_values.push_back(value);
+
+	++statistics().startedTracks;
+	return id;
+}
+
+void AnimationSystem::remove(std::size_t index)
+{
+	const auto removeAt = [index](auto& values)
+	{
+		values[index] = values.back();
+		values.pop_back();
+	};
+
+	removeAt(m_elapsed);
+	removeAt(m_inverseDurations);
+	for (auto& curve : m_curves)
+	{
+		removeAt(curve);
+	}
+	removeAt(m_eased);
+	removeAt(m_steps);
+	removeAt(m_progress);
+
+	removeAt(m_ids);
+	removeAt(m_objects);
+	removeAt(m_channels);
+	removeAt(m_values);
+}
+
+void AnimationSystem::evaluate(float deltaTime)
+{
+	const std::size_t end = m_objects.size();
+	std::size_t i = 0;
+#ifdef ANIMATION_SSE2
+	const __m128 delta = _mm_set1_ps(deltaTime);
+	const __m128 one = _mm_set1_ps(1.0f);
+	for (; i + 4 <= end; i += 4)
+	{
+		const __m128 elapsed = _mm_add_ps(_mm_loadu_ps(&m_elapsed[i]), delta);
+		const __m128 progress = _mm_min_ps(_mm_mul_ps(elapsed, _mm_loadu_ps(&m_inverseDurations[i])), one);
+
+		// Horner's rule, the same operations as the scalar loop
+		__m128 eased = _mm_add_ps(_mm_loadu_ps(&m_curves[1][i]), _mm_mul_ps(progress, _mm_loadu_ps(&m_curves[2][i])));
+		eased = _mm_add_ps(_mm_loadu_ps(&m_curves[0][i]), _mm_mul_ps(progress, eased));
+		eased = _mm_mul_ps(progress, eased);
+
+		_mm_storeu_ps(&m_steps[i], _mm_sub_ps(eased, _mm_loadu_ps(&m_eased[i])));
+		_mm_storeu_ps(&m_eased[i], eased);
+		_mm_storeu_ps(&m_progress[i], progress);
+		_mm_storeu_ps(&m_elapsed[i], elapsed);
+	}
+#endif
+	for (; i < end; ++i)
+	{
+		m_elapsed[i] += deltaTime;
+		const float progress = std::min(m_elapsed[i] * m_inverseDurations[i], 1.0f);
+		const float eased = progress * (m_curves[0][i] + progress * (m_curves[1][i] + progress * m_curves[2][i]));
+
+		m_steps[i] = eased - m_eased[i];
+		m_eased[i] = eased;
+		m_progress[i] = progress;
+	}
+}
@@ -0,0 +1,146 @@
+#pragma once
+#ifndef ANIMATIONSYSTEM_H
+#define ANIMATIONSYSTEM_H
+
+/**
+ * @file AnimationSystem.h
+ *
+ * @brief Translation, rotation and scale tracks of the scene objects, advanced together every frame.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include <glm/vec3.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class SceneObject;
+
+/**
+ * Only the running tracks are stored, in arrays of the same length with a finished track replaced by the last one:
+ * a frame costs the number of running tracks, whatever the size of the scene. The timers and the easing curves of
+ * all of them are evaluated first, four at a time with SSE2, then each track moves its object.
+ *
+ * A track adds its progress since the last frame to the transform instead of setting it, so any number of them
+ * run on the same object at once, and the transform can still be edited meanwhile. A rotation turns around an axis
+ * of the parent, as many turns as asked.
+ *
+ * Finished tracks are queued as events, taken by the window after the update. Stopped ones are not. The objects
+ * must outlive their tracks: stop them before deleting an object.
+ */
+class AnimationSystem
+{
+public:
+	using TrackId = uint32_t;
+	static constexpr TrackId NO_TRACK = 0;
+
+	enum class Channel : uint8_t
+	{
+		Translation,
+		Rotation,
+		Scale
+	};
+
+	// Cubic polynomials of the progress, reaching exactly 1 at the end
+	enum class Easing : uint8_t
+	{
+		Linear,
+		EaseIn,
+		EaseOut,
+		EaseInOut
+	};
+
+	struct Event
+	{
+		TrackId track = NO_TRACK;
+		SceneObject* object = nullptr;
+		Channel channel = Channel::Translation;
+	};
+
+	struct Settings
+	{
+		bool paused = false;
+		float timeScale = 1.0f;
+	};
+
+	struct Statistics
+	{
+		std::size_t activeTracks = 0;
+		std::size_t startedTracks = 0;     // Since the start
+		std::size_t finishedTracks = 0;
+		double updateMilliseconds = 0.0;
+	};
+
+	static Settings& settings();
+	static Statistics& statistics();
+
+	/**
+	 * Move the object by offset over the duration.
+	 */
+	TrackId translate(SceneObject& object, const glm::vec3& offset, float secondsOfDuration, Easing easing = Easing::EaseOut);
+
+	/**
+	 * Turn the object by degrees around an axis of its parent. Several turns are kept: 360 degrees spins it once.
+	 */
+	TrackId rotate(SceneObject& object, const glm::vec3& axis, float degrees, float secondsOfDuration, Easing easing = Easing::EaseOut);
+
+	/**
+	 * Add scaleChange to the scale of the object over the duration.
+	 */
+	TrackId scale(SceneObject& object, const glm::vec3& scaleChange, float secondsOfDuration, Easing easing = Easing::EaseOut);
+
+	/**
+	 * Leave the track where it is, without an event. Returns false when it already finished.
+	 */
+	bool stop(TrackId track);
+
+	/**
+	 * Stop every track of the object.
+	 */
+	void stop(const SceneObject& object);
+
+	bool isAnimating(const SceneObject& object) const;
+
+	/**
+	 * Advance the tracks and move their objects, queuing the events of those finishing.
+	 */
+	void update(float deltaTime);
+
+	/**
+	 * The events since the last call, in the order the tracks finished.
+	 */
+	std::vector<Event> takeEvents();
+
+	inline std::size_t activeTrackCount() const { return m_objects.size(); }
+
+private:
+	TrackId start(SceneObject& object, Channel channel, const glm::vec3& value, float secondsOfDuration, Easing easing);
+	void remove(std::size_t index);
+
+	// Progress, eased progress and its change over the frame, for all the tracks
+	void evaluate(float deltaTime);
+
+private:
+	TrackId m_nextId = 1;
+
+	// One entry per running track in every array, the timeline ones read by the batch
+	std::vector<float> m_elapsed;
+	std::vector<float> m_inverseDurations;
+	std::vector<float> m_curves[3];           // Coefficients of t, t squared and t cubed
+	std::vector<float> m_eased;               // Eased progress of the last frame
+	std::vector<float> m_steps;               // Eased progress gained this frame
+	std::vector<float> m_progress;
+
+	std::vector<TrackId> m_ids;
+	std::vector<SceneObject*> m_objects;
+	std::vector<Channel> m_channels;
+	std::vector<glm::vec3> m_values;          // Offset, change of scale, or axis times the angle in radians
+
+	std::vector<Event> m_events;
+};
+
+#endif
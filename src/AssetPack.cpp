@@ -0,0 +1,154 @@
+/**
+ * @file AssetPack.cpp
+ *
+ * @brief Single file holding every asset, mapped in memory once and read through a table of contents.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include "AssetPack.h"
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace AssetPack
+{
+	namespace
+	{
+		std::unique_ptr<Pack> s_mounted;
+
+		bool isInside(uint64_t offset, uint64_t size, std::size_t fileSize)
+		{
+			return offset <= fileSize && size <= fileSize - offset;
+		}
+	}
+
+	bool Pack::open(const std::string& path)
+	{
+		if (!m_file.open(path, true))
+		{
+			return false;
+		}
+
+		const Header expected;
+		if (m_file.size() < sizeof(Header))
+		{
+			std::cerr << "Invalid asset pack: " << path << std::endl;
+			return false;
+		}
+
+		Header header;
+		std::memcpy(&header, m_file.data(), sizeof(Header));
+		if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 || header.version != expected.version
+			|| header.fileSize != m_file.size()
+			|| !isInside(header.tocOffset, uint64_t(header.entryCount) * sizeof(Entry), m_file.size())
+			|| header.tocOffset % alignof(Entry) != 0
+			|| header.namesOffset > m_file.size())
+		{
+			std::cerr << "Invalid asset pack: " << path << std::endl;
+			return false;
+		}
+
+		// The mapping is page aligned and the table of contents is aligned in the file, it can be used in place
+		m_entries = reinterpret_cast<const Entry*>(m_file.data() + header.tocOffset);
+		m_entryCount = header.entryCount;
+		m_names = m_file.data() + header.namesOffset;
+
+		for (std::size_t i = 0; i < m_entryCount; ++i)
+		{
+			const Entry& entry = m_entries[i];
+			// An uncompressed entry is read in place for its full size
+			if (!isInside(entry.offset, entry.storedSize, m_file.size())
+				|| ((entry.flags & COMPRESSED) == 0 && entry.size != entry.storedSize)
+				|| !isInside(header.namesOffset + entry.nameOffset, entry.nameLength, m_file.size()))
+			{
+				std::cerr << "Corrupted entry " << i << " in asset pack: " << path << std::endl;
+				m_entries = nullptr;
+				m_entryCount = 0;
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	bool Pack::find(const std::string& name, Span& outSpan) const
+	{
+		const Entry* entry = findEntry(name);
+		if (entry == nullptr)
+		{
+			return false;
+		}
+
+		const char* stored = m_file.data() + entry->offset;
+		if ((entry->flags & COMPRESSED) == 0)
+		{
+			outSpan = { stored, static_cast<std::size_t>(entry->size) };
+			return true;
+		}
+
+		// Duplicates share the inflated copy as well
+		std::lock_guard<std::mutex> lock(m_inflatedMutex);
+		auto inflated = m_inflated.find(entry->contentHash);
+		if (inflated == m_inflated.end())
+		{
+			std::vector<char> buffer(static_cast<std::size_t>(entry->size));
+			const int length = stbi_zlib_decode_buffer(buffer.data(), static_cast<int>(buffer.size()), stored, static_cast<int>(entry->storedSize));
+			if (length != static_cast<int>(entry->size))
+			{
+				std::cerr << "Unable to inflate " << name << " from the asset pack" << std::endl;
+				return false;
+			}
+			inflated = m_inflated.emplace(entry->contentHash, std::move(buffer)).first;
+		}
+
+		outSpan = { inflated->second.data(), inflated->second.size() };
+		return true;
+	}
+
+	const Entry* Pack::findEntry(const std::string& name) const
+	{
+		const uint64_t nameHash = hash(name);
+		const Entry* end = m_entries + m_entryCount;
+		const Entry* entry = std::lower_bound(m_entries, end, nameHash,
+			[](const Entry& entry, uint64_t value) { return entry.nameHash < value; });
+
+		// Compare the names too, in case two of them share a hash
+		for (; entry != end && entry->nameHash == nameHash; ++entry)
+		{
+			if (entry->nameLength == name.size() && std::memcmp(m_names + entry->nameOffset, name.data(), name.size()) == 0)
+			{
+				return entry;
+			}
+		}
+		return nullptr;
+	}
+
+	bool mount(const std::string& path)
+	{
+		auto pack = std::make_unique<Pack>();
+		if (!pack->open(path))
+		{
+			return false;
+		}
+
+		std::cout << "Asset pack mounted: " << path << " (" << pack->entryCount() << " entries)" << std::endl;
+		s_mounted = std::move(pack);
+		return true;
+	}
+
+	const Pack* mounted()
+	{
+		return s_mounted.get();
+	}
+
+	bool findMounted(const std::string& path, Span& outSpan)
+	{
+		return s_mounted != nullptr && s_mounted->find(assetName(path), outSpan);
+	}
+}
@@ -0,0 +1,144 @@
+#pragma once
+#ifndef ASSETPACK_H
+#define ASSETPACK_H
+
+/**
+ * @file AssetPack.h
+ *
+ * @brief Single file holding every asset, mapped in memory once and read through a table of contents.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+
+// File layout (little endian), every section starts on an ALIGNMENT boundary:
+//   Header
+//   entryCount x Entry, sorted by name hash
+//   names, referenced by nameOffset/nameLength (not null terminated)
+//   data, one blob per distinct content: entries with the same content hash share it
+namespace AssetPack
+{
+	constexpr std::size_t ALIGNMENT = 64;
+	constexpr const char* EXTENSION = ".pack";
+
+	enum EntryFlags : uint32_t
+	{
+		COMPRESSED = 1 << 0 // zlib stream, inflated on first access
+	};
+
+	struct Header
+	{
+		char magic[4] = { 'O', 'G', 'S', 'P' };
+		uint32_t version = 1;
+		uint32_t entryCount = 0;
+		uint32_t reserved = 0;
+		uint64_t tocOffset = 0;
+		uint64_t namesOffset = 0;
+		uint64_t dataOffset = 0;
+		uint64_t fileSize = 0;
+	};
+
+	struct Entry
+	{
+		uint64_t nameHash = 0;
+		uint64_t contentHash = 0;
+		uint64_t offset = 0;     // from the start of the file
+		uint64_t storedSize = 0; // bytes in the pack
+		uint64_t size = 0;       // bytes once inflated
+		uint32_t nameOffset = 0; // from namesOffset
+		uint32_t nameLength = 0;
+		uint32_t flags = 0;
+		uint32_t reserved[3] = {};
+	};
+
+	static_assert(sizeof(Header) == 48, "AssetPack::Header layout changed");
+	static_assert(sizeof(Entry) == 64, "AssetPack::Entry layout changed");
+
+	/**
+	 * FNV-1a 64 bits, used for the names and to find duplicated contents.
+	 */
+	inline uint64_t hash(const void* data, std::size_t size)
+	{
+		uint64_t value = 14695981039346656037ull;
+		const auto* bytes = static_cast<const unsigned char*>(data);
+		for (std::size_t i = 0; i < size; ++i)
+		{
+			value ^= bytes[i];
+			value *= 1099511628211ull;
+		}
+		return value;
+	}
+
+	inline uint64_t hash(const std::string& name) { return hash(name.data(), name.size()); }
+
+	/**
+	 * Assets are looked up by file name only: "C:/.../src/wood_floor.jpg" gives "wood_floor.jpg".
+	 */
+	inline std::string assetName(const std::string& path) { return path.substr(path.find_last_of("/\\") + 1); }
+
+	/**
+	 * View on the bytes of an asset. Stays valid as long as the pack is mounted.
+	 */
+	struct Span
+	{
+		const char* data = nullptr;
+		std::size_t size = 0;
+
+		inline const unsigned char* bytes() const { return reinterpret_cast<const unsigned char*>(data); }
+	};
+
+	class Pack
+	{
+	public:
+		/**
+		 * Map the whole pack and ask the OS to read it ahead sequentially.
+		 */
+		bool open(const std::string& path);
+
+		/**
+		 * Find an asset by name. Stored entries point straight into the mapping,
+		 * compressed ones are inflated once and kept for the lifetime of the pack.
+		 * Can be called from several threads at once.
+		 */
+		bool find(const std::string& name, Span& outSpan) const;
+
+		inline std::size_t entryCount() const { return m_entryCount; }
+
+	private:
+		const Entry* findEntry(const std::string& name) const;
+
+	private:
+		MappedFile m_file;
+		const Entry* m_entries = nullptr;
+		const char* m_names = nullptr;
+		std::size_t m_entryCount = 0;
+
+		mutable std::mutex m_inflatedMutex;
+		mutable std::map<uint64_t, std::vector<char>> m_inflated;
+	};
+
+	/**
+	 * The pack used by the loaders, if any. They fall back to the loose files when it is null
+	 * or when the asset is not in it.
+	 */
+	bool mount(const std::string& path);
+	const Pack* mounted();
+
+	/**
+	 * Shortcut for mounted()->find(assetName(path), outSpan).
+	 */
+	bool findMounted(const std::string& path, Span& outSpan);
+}
+
+#endif
@@ -0,0 +1,71 @@
+#pragma once
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+/**
+ * @file BoundedQueue.h
+ *
+ * @brief Thread-safe FIFO with a maximum size: producers wait while it is full.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+template <class T>
+class BoundedQueue
+{
+public:
+	explicit BoundedQueue(std::size_t capacity) : m_capacity(capacity > 0 ? capacity : 1) {}
+
+	void push(T value)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_notFull.wait(lock, [this]() { return m_values.size() < m_capacity; });
+		m_values.push_back(std::move(value));
+		lock.unlock();
+		m_notEmpty.notify_one();
+	}
+
+	/**
+	 * Non-blocking pop, for a consumer that must not wait (the GL thread during a frame).
+	 */
+	bool tryPop(T& outValue)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (m_values.empty())
+		{
+			return false;
+		}
+		outValue = std::move(m_values.front());
+		m_values.pop_front();
+		lock.unlock();
+		m_notFull.notify_one();
+		return true;
+	}
+
+	T pop()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_notEmpty.wait(lock, [this]() { return !m_values.empty(); });
+		T value = std::move(m_values.front());
+		m_values.pop_front();
+		lock.unlock();
+		m_notFull.notify_one();
+		return value;
+	}
+
+private:
+	const std::size_t m_capacity;
+	std::deque<T> m_values;
+	std::mutex m_mutex;
+	std::condition_variable m_notFull;
+	std::condition_variable m_notEmpty;
+};
+
+#endif
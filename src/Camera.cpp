@@ -112,8 +112,9 @@ void Camera::viewportEvents(int width, int height)
 
 void Camera::computeTransformRotation()
 {
-	m_transform.rotation().y = -yaw;
-	m_transform.rotation().z = fmod(pitch, 360.f);
+	m_viewAngles.y = -yaw;
+	m_viewAngles.z = fmod(pitch, 360.f);
+	m_transform.rotation(m_viewAngles);
 	dirtyGlobal();
 }
 
@@ -62,6 +62,9 @@ public:
 	void showEntireScene();
 	const glm::vec3& position() const { return m_transform.translation(); }
 	float fieldOfView() const { return m_fov; }
+
+	// The angles given to the transform, which only keeps its orientation
+	const glm::vec3& viewAngles() const { return m_viewAngles; }
     
 protected:
 	void computeTransformRotation();
@@ -96,6 +99,7 @@ private:
 	const glm::vec3 m_up = glm::vec3(0, 1, 0);
 
 	glm::vec3 m_direction;
+	glm::vec3 m_viewAngles = glm::vec3(0.0f);
 	
 	// Projection matrix
 	const float m_fov = glm::radians(45.0f);
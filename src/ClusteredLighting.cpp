@@ -0,0 +1,243 @@
+/**
+ * @file ClusteredLighting.cpp
+ *
+ * @brief Point lights binned in a grid of view frustum cells, read by the fragment shader from storage buffers.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include "ClusteredLighting.h"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iterator>
+
+#include "Camera.h"
+#include "ThreadPool.h"
+
+namespace
+{
+	// Tile of a normalized device coordinate, clamped to the grid
+	int tileOf(float ndc, int tileCount)
+	{
+		const int tile = static_cast<int>(std::floor((ndc * 0.5f + 0.5f) * static_cast<float>(tileCount)));
+		return std::clamp(tile, 0, tileCount - 1);
+	}
+
+	// Smallest and largest of value / depth over [nearDepth, farDepth]: it is monotonic, one of the ends
+	void divideByDepthRange(float value, float nearDepth, float farDepth, float& minimum, float& maximum)
+	{
+		const float atNear = value / nearDepth;
+		const float atFar = value / farDepth;
+		minimum = std::min(atNear, atFar);
+		maximum = std::max(atNear, atFar);
+	}
+
+	std::size_t clusterIndex(int tileX, int tileY, int slice)
+	{
+		return static_cast<std::size_t>(tileX + LightClusters::TILES_X * (tileY + LightClusters::TILES_Y * slice));
+	}
+}
+
+LightClusters::Settings& LightClusters::settings()
+{
+	static Settings settings;
+	return settings;
+}
+
+LightClusters::Statistics& LightClusters::statistics()
+{
+	static Statistics statistics;
+	return statistics;
+}
+
+void LightClusters::update(const Camera& camera, int viewportWidth, int viewportHeight)
+{
+	const auto startTime = std::chrono::steady_clock::now();
+
+	auto& clusterStatistics = statistics();
+	clusterStatistics = Statistics();
+	clusterStatistics.lights = m_lights.size();
+
+	m_active = settings().enabled;
+	if (!m_active)
+	{
+		return;
+	}
+
+	const glm::mat4 view = camera.viewMatrix();
+	const glm::mat4 projection = camera.projectionMatrix();
+
+	// Planes of the perspective projection, the slices are spread between them
+	m_projectionScale = glm::vec2(projection[0][0], projection[1][1]);
+	m_near = projection[3][2] / (projection[2][2] - 1.0f);
+	m_far = projection[3][2] / (projection[2][2] + 1.0f);
+	m_clusterNear = std::max(m_near, MIN_CLUSTER_NEAR);
+	m_far = std::max(m_far, 2.0f * m_clusterNear);
+
+	const float logRatio = std::log(m_far / m_clusterNear);
+	m_depthScale = static_cast<float>(SLICES) / logRatio;
+	m_depthBias = -static_cast<float>(SLICES) * std::log(m_clusterNear) / logRatio;
+	m_tileSize = glm::vec2(static_cast<float>(std::max(viewportWidth, 1)) / TILES_X, static_cast<float>(std::max(viewportHeight, 1)) / TILES_Y);
+
+	auto sliceOf = [this](float depth)
+	{
+		if (depth <= m_clusterNear)
+			return 0;
+		return std::clamp(static_cast<int>(std::floor(std::log(depth) * m_depthScale + m_depthBias)), 0, SLICES - 1);
+	};
+
+	m_visibleLights.clear();
+	m_gpuLights.clear();
+	for (const auto& light : m_lights)
+	{
+		if (light.radius <= 0.0f || light.intensity <= 0.0f)
+			continue;
+
+		const glm::vec3 viewPosition = glm::vec3(view * glm::vec4(light.position, 1.0f));
+		const float depth = -viewPosition.z;
+		if (depth + light.radius < m_near || depth - light.radius > m_far)
+			continue;
+
+		// Bounding box of the sphere, projected over the depths it covers
+		const float nearDepth = std::max(depth - light.radius, m_near);
+		const float farDepth = std::min(depth + light.radius, m_far);
+		float minX, maxX, minY, maxY, unused;
+		divideByDepthRange(viewPosition.x - light.radius, nearDepth, farDepth, minX, unused);
+		divideByDepthRange(viewPosition.x + light.radius, nearDepth, farDepth, unused, maxX);
+		divideByDepthRange(viewPosition.y - light.radius, nearDepth, farDepth, minY, unused);
+		divideByDepthRange(viewPosition.y + light.radius, nearDepth, farDepth, unused, maxY);
+		minX *= m_projectionScale.x;
+		maxX *= m_projectionScale.x;
+		minY *= m_projectionScale.y;
+		maxY *= m_projectionScale.y;
+		if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f)
+			continue;
+
+		VisibleLight visibleLight;
+		visibleLight.viewPosition = viewPosition;
+		visibleLight.radius = light.radius;
+		visibleLight.minTileX = tileOf(minX, TILES_X);
+		visibleLight.maxTileX = tileOf(maxX, TILES_X);
+		visibleLight.minTileY = tileOf(minY, TILES_Y);
+		visibleLight.maxTileY = tileOf(maxY, TILES_Y);
+		visibleLight.minSlice = sliceOf(nearDepth);
+		visibleLight.maxSlice = sliceOf(farDepth);
+		m_visibleLights.push_back(visibleLight);
+
+		m_gpuLights.push_back({ glm::vec4(viewPosition, light.radius), glm::vec4(light.color, light.intensity) });
+	}
+
+	m_clusterLights.resize(CLUSTER_COUNT);
+	ThreadPool::instance().parallelFor(SLICES, 1, [this](std::size_t begin, std::size_t end)
+	{
+		for (std::size_t slice = begin; slice < end; ++slice)
+			binSlice(static_cast<int>(slice));
+	});
+
+	m_clusters.resize(CLUSTER_COUNT);
+	m_lightIndices.clear();
+	for (std::size_t i = 0; i < m_clusterLights.size(); ++i)
+	{
+		const auto& clusterLights = m_clusterLights[i];
+		m_clusters[i] = glm::uvec2(static_cast<uint32_t>(m_lightIndices.size()), static_cast<uint32_t>(clusterLights.size()));
+		m_lightIndices.insert(m_lightIndices.end(), clusterLights.begin(), clusterLights.end());
+
+		clusterStatistics.maxLightsPerCluster = std::max(clusterStatistics.maxLightsPerCluster, clusterLights.size());
+		if (!clusterLights.empty())
+			++clusterStatistics.occupiedClusters;
+	}
+
+	upload();
+
+	clusterStatistics.visibleLights = m_visibleLights.size();
+	clusterStatistics.lightIndices = m_lightIndices.size();
+	clusterStatistics.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void LightClusters::clear()
+{
+	if (m_buffers[0] != 0)
+	{
+		glDeleteBuffers(3, m_buffers);
+		std::fill(std::begin(m_buffers), std::end(m_buffers), 0u);
+	}
+	m_active = false;
+}
+
+float LightClusters::sliceDepth(int slice) const
+{
+	if (slice <= 0)
+		return m_near;
+	if (slice >= SLICES)
+		return m_far;
+	return std::exp((static_cast<float>(slice) - m_depthBias) / m_depthScale);
+}
+
+void LightClusters::binSlice(int slice)
+{
+	for (int tileY = 0; tileY < TILES_Y; ++tileY)
+	{
+		for (int tileX = 0; tileX < TILES_X; ++tileX)
+			m_clusterLights[clusterIndex(tileX, tileY, slice)].clear();
+	}
+
+	const float nearDepth = sliceDepth(slice);
+	const float farDepth = sliceDepth(slice + 1);
+	for (std::size_t i = 0; i < m_visibleLights.size(); ++i)
+	{
+		const auto& light = m_visibleLights[i];
+		if (slice < light.minSlice || slice > light.maxSlice)
+			continue;
+
+		const float radiusSquared = light.radius * light.radius;
+		const float dz = std::max({ -farDepth - light.viewPosition.z, 0.0f, light.viewPosition.z + nearDepth });
+		for (int tileY = light.minTileY; tileY <= light.maxTileY; ++tileY)
+		{
+			// Box of the cell in view space, the tile edges taken at both depths of the slice
+			const float bottom = (2.0f * static_cast<float>(tileY) / TILES_Y - 1.0f) / m_projectionScale.y;
+			const float top = (2.0f * static_cast<float>(tileY + 1) / TILES_Y - 1.0f) / m_projectionScale.y;
+			const float minY = std::min(bottom * nearDepth, bottom * farDepth);
+			const float maxY = std::max(top * nearDepth, top * farDepth);
+			const float dy = std::max({ minY - light.viewPosition.y, 0.0f, light.viewPosition.y - maxY });
+
+			for (int tileX = light.minTileX; tileX <= light.maxTileX; ++tileX)
+			{
+				const float left = (2.0f * static_cast<float>(tileX) / TILES_X - 1.0f) / m_projectionScale.x;
+				const float right = (2.0f * static_cast<float>(tileX + 1) / TILES_X - 1.0f) / m_projectionScale.x;
+				const float minX = std::min(left * nearDepth, left * farDepth);
+				const float maxX = std::max(right * nearDepth, right * farDepth);
+				const float dx = std::max({ minX - light.viewPosition.x, 0.0f, light.viewPosition.x - maxX });
+
+				if (dx * dx + dy * dy + dz * dz <= radiusSquared)
+					m_clusterLights[clusterIndex(tileX, tileY, slice)].push_back(static_cast<uint32_t>(i));
+			}
+		}
+	}
+}
+
+void LightClusters::upload()
+{
+	if (m_buffers[0] == 0)
+	{
+		glGenBuffers(3, m_buffers);
+	}
+
+	// Orphaned every frame, and never empty so the bindings always refer to storage
+	auto uploadBuffer = [](GLuint buffer, GLuint binding, const void* data, std::size_t size, std::size_t elementSize)
+	{
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(std::max(size, std::size_t(1)) * elementSize), size > 0 ? data : nullptr, GL_STREAM_DRAW);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffer);
+	};
+	uploadBuffer(m_buffers[0], LIGHTS_BINDING, m_gpuLights.data(), m_gpuLights.size(), sizeof(GpuLight));
+	uploadBuffer(m_buffers[1], CLUSTERS_BINDING, m_clusters.data(), m_clusters.size(), sizeof(glm::uvec2));
+	uploadBuffer(m_buffers[2], LIGHT_INDICES_BINDING, m_lightIndices.data(), m_lightIndices.size(), sizeof(uint32_t));
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
@@ -0,0 +1,147 @@
+#pragma once
+#ifndef CLUSTEREDLIGHTING_H
+#define CLUSTEREDLIGHTING_H
+
+/**
+ * @file ClusteredLighting.h
+ *
+ * @brief Point lights binned in a grid of view frustum cells, read by the fragment shader from storage buffers.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include <glad/glad.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Camera;
+
+struct PointLight
+{
+	glm::vec3 position = glm::vec3(0.0f);   // In world space
+	float radius = 4.0f;                    // Nothing is lit further than this
+	glm::vec3 color = glm::vec3(1.0f);
+	float intensity = 1.0f;
+};
+
+/**
+ * The view frustum is cut in TILES_X by TILES_Y tiles on the screen and SLICES slices in depth, the slices
+ * growing exponentially with the distance. Every frame, each light is added to the list of the cells its sphere
+ * touches, so a fragment only loops over the lights of its cell: the cost follows the number of lights around it,
+ * not the number of lights in the scene.
+ */
+class LightClusters
+{
+public:
+	static constexpr int TILES_X = 16;
+	static constexpr int TILES_Y = 9;
+	static constexpr int SLICES = 24;
+	static constexpr int CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+
+	// Binding points of the storage buffers, fixed in textureShader.frag
+	static constexpr GLuint LIGHTS_BINDING = 0;
+	static constexpr GLuint CLUSTERS_BINDING = 1;
+	static constexpr GLuint LIGHT_INDICES_BINDING = 2;
+
+	// The first slice starts at least this far, the closer fragments use it as well
+	static constexpr float MIN_CLUSTER_NEAR = 0.1f;
+
+	struct Settings
+	{
+		bool enabled = true;
+		bool showLightCount = false;   // Color the fragments by the number of lights of their cell
+	};
+
+	// Of the last update
+	struct Statistics
+	{
+		std::size_t lights = 0;
+		std::size_t visibleLights = 0;
+		std::size_t lightIndices = 0;
+		std::size_t maxLightsPerCluster = 0;
+		std::size_t occupiedClusters = 0;
+		double milliseconds = 0.0;
+	};
+
+	static Settings& settings();
+	static Statistics& statistics();
+
+	LightClusters() = default;
+	LightClusters(const LightClusters&) = delete;
+	LightClusters& operator=(const LightClusters&) = delete;
+
+	inline std::vector<PointLight>& lights() { return m_lights; }
+	inline const std::vector<PointLight>& lights() const { return m_lights; }
+
+	/**
+	 * Once per frame, before the scene is rendered: bin the lights for the camera, upload the lists and bind
+	 * the storage buffers.
+	 */
+	void update(const Camera& camera, int viewportWidth, int viewportHeight);
+
+	/**
+	 * Delete the buffers, while the context is still alive.
+	 */
+	void clear();
+
+	// For the shader uniforms: cell of a fragment from gl_FragCoord.xy / tileSize and log(depth) * depthScale + depthBias
+	inline glm::vec2 tileSize() const { return m_tileSize; }
+	inline float depthScale() const { return m_depthScale; }
+	inline float depthBias() const { return m_depthBias; }
+	inline bool active() const { return m_active; }
+
+private:
+	// A light in front of the camera and the range of cells its bounding box covers
+	struct VisibleLight
+	{
+		glm::vec3 viewPosition = glm::vec3(0.0f);
+		float radius = 0.0f;
+		int minTileX = 0;
+		int maxTileX = 0;
+		int minTileY = 0;
+		int maxTileY = 0;
+		int minSlice = 0;
+		int maxSlice = 0;
+	};
+
+	// As read by the shader (std430)
+	struct GpuLight
+	{
+		glm::vec4 positionRadius;    // View space
+		glm::vec4 colorIntensity;
+	};
+
+	float sliceDepth(int slice) const;
+	void binSlice(int slice);
+	void upload();
+
+private:
+	std::vector<PointLight> m_lights;
+
+	glm::vec2 m_projectionScale = glm::vec2(1.0f);   // x and y of the projection matrix diagonal
+	float m_near = MIN_CLUSTER_NEAR;
+	float m_clusterNear = MIN_CLUSTER_NEAR;
+	float m_far = 1.0f;
+	glm::vec2 m_tileSize = glm::vec2(1.0f);
+	float m_depthScale = 0.0f;
+	float m_depthBias = 0.0f;
+	bool m_active = false;
+
+	std::vector<VisibleLight> m_visibleLights;
+	std::vector<GpuLight> m_gpuLights;
+	std::vector<std::vector<uint32_t>> m_clusterLights;   // Per cell, reused from frame to frame
+	std::vector<glm::uvec2> m_clusters;                   // Offset and count in m_lightIndices
+	std::vector<uint32_t> m_lightIndices;
+
+	GLuint m_buffers[3] = {};
+};
+
+#endif
@@ -0,0 +1,156 @@
+/**
+ * @file CommandBuffer.cpp
+ *
+ * @brief Draw commands recorded on any thread and replayed on the one owning the GL context.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include "CommandBuffer.h"
+
+#include "Material.h"
+#include "Mesh.h"
+#include "Camera.h"
+
+RecordingView::RecordingView(const Camera& camera)
+	: viewMatrix(camera.viewMatrix()), projectionMatrix(camera.projectionMatrix()), cameraPosition(camera.position())
+{
+	viewProjection = projectionMatrix * viewMatrix;
+}
+
+void CommandBuffer::clear()
+{
+	m_commands.clear();
+	m_programs.clear();
+	m_vertexArrays.clear();
+	m_textures.clear();
+	m_uniforms.clear();
+	m_draws.clear();
+	m_ranges.clear();
+
+	m_material = nullptr;
+	m_vertexArray = 0;
+	m_texturesBound = false;
+	m_bakesView = false;
+}
+
+void CommandBuffer::bindProgram(const Material& material, const RecordingView& view)
+{
+	if (&material == m_material)
+	{
+		return;
+	}
+
+	m_material = &material;
+	add(CommandType::BindProgram, m_programs, { &material, view.viewMatrix, view.projectionMatrix });
+}
+
+void CommandBuffer::bindVertexArray(GLuint vertexArray)
+{
+	if (vertexArray == m_vertexArray)
+	{
+		return;
+	}
+
+	m_vertexArray = vertexArray;
+	add(CommandType::BindVertexArray, m_vertexArrays, { vertexArray });
+}
+
+void CommandBuffer::bindTextures(const Material& material, unsigned int texture, unsigned int normalsTexture)
+{
+	// The texture units are shared by the programs, a change of program keeps them
+	if (m_texturesBound && texture == m_texture && normalsTexture == m_normalsTexture)
+	{
+		return;
+	}
+
+	m_texturesBound = true;
+	m_texture = texture;
+	m_normalsTexture = normalsTexture;
+	add(CommandType::BindTextures, m_textures, { &material, texture, normalsTexture });
+}
+
+void CommandBuffer::setUniforms(const SetUniforms& uniforms)
+{
+	m_bakesView = m_bakesView || uniforms.objectIndex < 0;
+	add(CommandType::SetUniforms, m_uniforms, uniforms);
+}
+
+void CommandBuffer::drawLod(const Mesh& mesh, bool constant, std::size_t level)
+{
+	Draw draw;
+	draw.mesh = &mesh;
+	draw.constant = constant;
+	draw.lodLevel = static_cast<uint32_t>(level);
+	add(CommandType::Draw, m_draws, draw);
+}
+
+void CommandBuffer::drawRanges(const Mesh& mesh, bool constant, std::size_t firstRangeValue)
+{
+	Draw draw;
+	draw.mesh = &mesh;
+	draw.constant = constant;
+	draw.meshlets = true;
+	draw.firstRangeValue = static_cast<uint32_t>(firstRangeValue);
+	draw.rangeValueCount = static_cast<uint32_t>(m_ranges.size() - firstRangeValue);
+	add(CommandType::Draw, m_draws, draw);
+}
+
+void CommandBuffer::replay(const RecordingView* view) const
+{
+	Mesh::trackVertexArray(true);
+	for (const auto& command : m_commands)
+	{
+		switch (command.type)
+		{
+		case CommandType::BindProgram:
+		{
+			const auto& program = m_programs[command.index];
+			program.material->bind();
+			program.material->setViewMatrix(view != nullptr ? view->viewMatrix : program.viewMatrix);
+			program.material->setProjectionMatrix(view != nullptr ? view->projectionMatrix : program.projectionMatrix);
+			break;
+		}
+		case CommandType::BindVertexArray:
+			Mesh::bindVertexArray(m_vertexArrays[command.index].vertexArray);
+			break;
+		case CommandType::BindTextures:
+		{
+			const auto& textures = m_textures[command.index];
+			textures.material->setTexture(textures.texture);
+			textures.material->setNormalsTexture(textures.normalsTexture);
+			break;
+		}
+		case CommandType::SetUniforms:
+		{
+			const auto& uniforms = m_uniforms[command.index];
+			if (uniforms.objectIndex >= 0)
+			{
+				uniforms.material->setObjectIndex(uniforms.objectIndex);
+			}
+			else
+			{
+				uniforms.material->setModelViewMatrix(uniforms.modelViewMatrix);
+				uniforms.material->setNormalMatrix(uniforms.normalMatrix);
+			}
+			if (uniforms.appearance)
+				uniforms.material->setAppearance(uniforms.ambiantColor, uniforms.diffuseColor, uniforms.specularColor, uniforms.specularTerm);
+			break;
+		}
+		case CommandType::Draw:
+		{
+			const auto& draw = m_draws[command.index];
+			if (draw.meshlets)
+				draw.mesh->bindAndDrawRanges(draw.constant, m_ranges.data() + draw.firstRangeValue, draw.rangeValueCount);
+			else if (draw.constant)
+				draw.mesh->bindAndDrawConstantLod(draw.lodLevel);
+			else
+				draw.mesh->bindAndDrawLod(draw.lodLevel);
+			break;
+		}
+		}
+	}
+	Mesh::trackVertexArray(false);
+}
@@ -0,0 +1,161 @@
+#pragma once
+#ifndef COMMANDBUFFER_H
+#define COMMANDBUFFER_H
+
+/**
+ * @file CommandBuffer.h
+ *
+ * @brief Draw commands recorded on any thread and replayed on the one owning the GL context.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include <glad/glad.h>
+#include <glm/mat3x3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Camera;
+class Material;
+class Mesh;
+
+// Camera matrices of a recording, computed once for all its draws
+struct RecordingView
+{
+	explicit RecordingView(const Camera& camera);
+
+	glm::mat4 viewMatrix;
+	glm::mat4 projectionMatrix;
+	glm::mat4 viewProjection;
+	glm::vec3 cameraPosition;
+};
+
+/**
+ * Recording only writes plain structs: the matrices are multiplied, the uniforms packed and the meshlets culled
+ * without a single GL call, so several buffers can be recorded at the same time. The state commands are only
+ * added when the state changes since the last command of the buffer. replay() then issues the GL calls.
+ */
+class CommandBuffer
+{
+public:
+	struct BindProgram
+	{
+		const Material* material = nullptr;
+		glm::mat4 viewMatrix = glm::mat4(1.0f);
+		glm::mat4 projectionMatrix = glm::mat4(1.0f);
+	};
+
+	struct BindVertexArray
+	{
+		GLuint vertexArray = 0;
+	};
+
+	struct BindTextures
+	{
+		const Material* material = nullptr;
+		unsigned int texture = 0;
+		unsigned int normalsTexture = 0;
+	};
+
+	// Uniforms of one draw, for the program last bound
+	struct SetUniforms
+	{
+		const Material* material = nullptr;
+		int objectIndex = -1;        // Slot of ObjectDataBuffer, the matrices below are only set without one
+		glm::mat4 modelViewMatrix = glm::mat4(1.0f);
+		glm::mat3 normalMatrix = glm::mat3(1.0f);
+		bool appearance = false;     // Left as they are otherwise, like the color of the depth-only pass
+		glm::vec4 ambiantColor = glm::vec4(0.0f);
+		glm::vec4 diffuseColor = glm::vec4(0.0f);
+		glm::vec4 specularColor = glm::vec4(0.0f);
+		float specularTerm = 0.0f;
+	};
+
+	struct Draw
+	{
+		const Mesh* mesh = nullptr;
+		bool constant = false;
+		bool meshlets = false;          // The ranges of the buffer below, otherwise the whole level
+		uint32_t lodLevel = 0;
+		uint32_t firstRangeValue = 0;
+		uint32_t rangeValueCount = 0;
+	};
+
+	void clear();
+	inline bool empty() const { return m_commands.empty(); }
+	inline std::size_t commandCount() const { return m_commands.size(); }
+	inline std::size_t drawCount() const { return m_draws.size(); }
+
+	/**
+	 * True when a draw has its model-view matrix set as a uniform: replayed for another camera, it would be wrong.
+	 */
+	inline bool bakesView() const { return m_bakesView; }
+
+	void bindProgram(const Material& material, const RecordingView& view);
+	void bindVertexArray(GLuint vertexArray);
+	void bindTextures(const Material& material, unsigned int texture, unsigned int normalsTexture);
+	void setUniforms(const SetUniforms& uniforms);
+	void drawLod(const Mesh& mesh, bool constant, std::size_t level);
+
+	/**
+	 * Meshlets::cull appends the ranges of a draw here, drawRanges() then draws those added since firstRangeValue.
+	 */
+	inline std::vector<uint32_t>& ranges() { return m_ranges; }
+	void drawRanges(const Mesh& mesh, bool constant, std::size_t firstRangeValue);
+
+	/**
+	 * Issue the commands, on the thread owning the GL context. The buffer can be replayed several times, with the
+	 * camera of view instead of the one recorded when given.
+	 */
+	void replay(const RecordingView* view = nullptr) const;
+
+private:
+	enum class CommandType : uint8_t
+	{
+		BindProgram,
+		BindVertexArray,
+		BindTextures,
+		SetUniforms,
+		Draw
+	};
+
+	// Index in the array of its type
+	struct Command
+	{
+		CommandType type;
+		uint32_t index;
+	};
+
+	template <class T>
+	void add(CommandType type, std::vector<T>& commands, const T& command)
+	{
+		m_commands.push_back({ type, static_cast<uint32_t>(commands.size()) });
+		commands.push_back(command);
+	}
+
+private:
+	std::vector<Command> m_commands;
+	std::vector<BindProgram> m_programs;
+	std::vector<BindVertexArray> m_vertexArrays;
+	std::vector<BindTextures> m_textures;
+	std::vector<SetUniforms> m_uniforms;
+	std::vector<Draw> m_draws;
+	std::vector<uint32_t> m_ranges;
+
+	// State at the end of the recorded commands
+	const Material* m_material = nullptr;
+	GLuint m_vertexArray = 0;
+	bool m_texturesBound = false;
+	unsigned int m_texture = 0;
+	unsigned int m_normalsTexture = 0;
+	bool m_bakesView = false;
+};
+
+#endif
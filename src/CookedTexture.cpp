@@ -0,0 +1,115 @@
+/**
+ * @file CookedTexture.cpp
+ *
+ * @brief Block-compressed texture with its whole mip chain, as written by the TextureCooker tool.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include "CookedTexture.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+namespace CookedTexture
+{
+	std::string cookedFileName(const std::string& sourceFileName)
+	{
+		const auto extension = sourceFileName.find_last_of('.');
+		return sourceFileName.substr(0, extension) + EXTENSION;
+	}
+
+	bool read(const std::string& path, Texture& outTexture)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file.is_open())
+		{
+			return false;
+		}
+
+		std::vector<unsigned char> storage((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		if (!parse(storage.data(), storage.size(), outTexture, path))
+		{
+			return false;
+		}
+
+		// Moving the vector keeps its buffer, the levels still point in it
+		outTexture.storage = std::move(storage);
+		return true;
+	}
+
+	bool parse(const unsigned char* data, std::size_t size, Texture& outTexture, const std::string& name)
+	{
+		Header header;
+		const Header expected;
+		if (size < sizeof(Header))
+		{
+			std::cerr << "Invalid cooked texture: " << name << std::endl;
+			return false;
+		}
+		std::memcpy(&header, data, sizeof(Header));
+		if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 || header.version != expected.version)
+		{
+			std::cerr << "Invalid cooked texture: " << name << std::endl;
+			return false;
+		}
+
+		std::size_t offset = sizeof(Header);
+		outTexture.format = header.format;
+		outTexture.mipLevels.resize(header.mipCount);
+		for (auto& level : outTexture.mipLevels)
+		{
+			if (size - offset < 3 * sizeof(uint32_t))
+			{
+				std::cerr << "Truncated cooked texture: " << name << std::endl;
+				return false;
+			}
+			std::memcpy(&level.width, data + offset, sizeof(uint32_t));
+			std::memcpy(&level.height, data + offset + sizeof(uint32_t), sizeof(uint32_t));
+			std::memcpy(&level.byteSize, data + offset + 2 * sizeof(uint32_t), sizeof(uint32_t));
+			offset += 3 * sizeof(uint32_t);
+
+			if (level.byteSize != levelSize(header.format, level.width, level.height) || size - offset < level.byteSize)
+			{
+				std::cerr << "Truncated cooked texture: " << name << std::endl;
+				return false;
+			}
+
+			level.blocks = data + offset;
+			offset += level.byteSize;
+		}
+
+		return true;
+	}
+
+	bool write(const std::string& path, const Texture& texture)
+	{
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+		{
+			std::cerr << "Unable to open " << path << " for writing" << std::endl;
+			return false;
+		}
+
+		Header header;
+		header.format = texture.format;
+		header.width = texture.mipLevels.empty() ? 0 : texture.mipLevels.front().width;
+		header.height = texture.mipLevels.empty() ? 0 : texture.mipLevels.front().height;
+		header.mipCount = static_cast<uint32_t>(texture.mipLevels.size());
+		file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+
+		for (const auto& level : texture.mipLevels)
+		{
+			file.write(reinterpret_cast<const char*>(&level.width), sizeof(uint32_t));
+			file.write(reinterpret_cast<const char*>(&level.height), sizeof(uint32_t));
+			file.write(reinterpret_cast<const char*>(&level.byteSize), sizeof(uint32_t));
+			file.write(reinterpret_cast<const char*>(level.blocks), level.byteSize);
+		}
+
+		return static_cast<bool>(file);
+	}
+}
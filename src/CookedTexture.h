@@ -0,0 +1,87 @@
+#pragma once
+#ifndef COOKEDTEXTURE_H
+#define COOKEDTEXTURE_H
+
+/**
+ * @file CookedTexture.h
+ *
+ * @brief Block-compressed texture with its whole mip chain, as written by the TextureCooker tool.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// File layout (little endian):
+//   CookedTextureHeader
+//   mipCount x { uint32 width, uint32 height, uint32 byteSize, byteSize bytes of blocks }
+// The image is stored bottom row first, like the textures flipped at load time.
+namespace CookedTexture
+{
+	enum class Format : uint32_t
+	{
+		BC1 = 1, // RGB, 8 bytes per 4x4 block
+		BC3 = 2, // RGBA, 16 bytes per 4x4 block
+		BC5 = 3  // RG (tangent space normals), 16 bytes per 4x4 block
+	};
+
+	struct Header
+	{
+		char magic[4] = { 'C', 'T', 'E', 'X' };
+		uint32_t version = 1;
+		Format format = Format::BC1;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t mipCount = 0;
+	};
+
+	struct MipLevel
+	{
+		uint32_t width = 0;
+		uint32_t height = 0;
+		const unsigned char* blocks = nullptr;
+		uint32_t byteSize = 0;
+	};
+
+	struct Texture
+	{
+		Texture() = default;
+		Texture(Texture&&) = default;
+		Texture& operator=(Texture&&) = default;
+
+		// The levels point in storage, a copy would point in the original
+		Texture(const Texture&) = delete;
+		Texture& operator=(const Texture&) = delete;
+
+		Format format = Format::BC1;
+		std::vector<MipLevel> mipLevels;
+
+		// Owns the blocks when the texture was read from its own file, empty when it was parsed in place
+		std::vector<unsigned char> storage;
+	};
+
+	constexpr const char* EXTENSION = ".ctex";
+
+	inline uint32_t blockSize(Format format) { return format == Format::BC1 ? 8 : 16; }
+	inline uint32_t levelSize(Format format, uint32_t width, uint32_t height) { return ((width + 3) / 4) * ((height + 3) / 4) * blockSize(format); }
+
+	/**
+	 * Name of the cooked file for a source image: "wood_floor.jpg" gives "wood_floor.ctex".
+	 */
+	std::string cookedFileName(const std::string& sourceFileName);
+
+	bool read(const std::string& path, Texture& outTexture);
+
+	/**
+	 * Same as read() for a file already in memory (the asset pack): the levels point in data, nothing is copied.
+	 */
+	bool parse(const unsigned char* data, std::size_t size, Texture& outTexture, const std::string& name);
+	bool write(const std::string& path, const Texture& texture);
+}
+
+#endif
@@ -102,14 +102,14 @@ void CubeMesh::faceAt(const glm::vec3& position, glm::vec3& outCenter, glm::vec3
 void CubeMesh::bindAndDraw() const
 {
 	const GLsizei sizeOfIndices = static_cast<long>(sizeof(GLfloat) * m_indices.size());
-	glBindVertexArray(m_VAOs[VAO_Cube]);
+	bindVertexArray(m_VAOs[VAO_Cube]);
 	glDrawElements(GL_TRIANGLES, sizeOfIndices, GL_UNSIGNED_INT, nullptr);
 }
 
 void CubeMesh::bindAndDrawConstant() const
 {
 	const GLsizei sizeOfIndices = static_cast<long>(sizeof(GLfloat) * m_indices.size());
-	glBindVertexArray(m_VAOs[VAO_CubeConstant]);
+	bindVertexArray(m_VAOs[VAO_CubeConstant]);
 	glDrawElements(GL_TRIANGLES, sizeOfIndices, GL_UNSIGNED_INT, nullptr);
 }
 
@@ -24,16 +24,21 @@ public:
 	void initAttributes(const std::shared_ptr<const Material>& material) const override;
 	void initConstantAttributes(const std::shared_ptr<const Material>& constantMaterial) const override;
 
-	const std::vector<GLfloat>& vertices() override { return m_vertices; }
-	const std::vector<GLfloat>& normals() override { return m_normals; }
-	const std::vector<GLfloat>& tangents() override { return m_tangents; }
-	const std::vector<GLfloat>& uvs() override { return m_uvs; }
-	const std::vector<GLuint>& indices() override { return m_indices; }
+	const std::vector<GLfloat>& vertices() const override { return m_vertices; }
+	const std::vector<GLfloat>& normals() const override { return m_normals; }
+	const std::vector<GLfloat>& tangents() const override { return m_tangents; }
+	const std::vector<GLfloat>& uvs() const override { return m_uvs; }
+	const std::vector<GLuint>& indices() const override { return m_indices; }
 
 	void faceAt(const glm::vec3& position, glm::vec3& outCenter, glm::vec3& outNormal) const override;
 
 	void bindAndDraw() const override;
 	void bindAndDrawConstant() const override;
+	GLuint vertexArray(bool constant, std::size_t /*level*/) const override { return m_VAOs[constant ? VAO_CubeConstant : VAO_Cube]; }
+
+	float boundsRadius() const override { return 0.8660254f; }
+	glm::vec3 boundsExtents() const override { return glm::vec3(0.5f); }
+	bool fillsBounds() const override { return true; }
 
 private:
 	void initVertices();
@@ -0,0 +1,231 @@
+/**
+ * @file DepthPrepass.cpp
+ *
+ * @brief Optional depth-only pass before the scene, so the shading pass only shades the visible fragments.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include "DepthPrepass.h"
+
+#include <glm/vec4.hpp>
+
+#include <algorithm>
+
+#include "ConstantMaterial.h"
+#include "MeshRenderer.h"
+#include "RenderQueue.h"
+#include "SceneObject.h"
+#include "StaticBatching.h"
+
+namespace
+{
+	// A choice has to be faster by this fraction to replace the other one
+	constexpr double SWITCH_MARGIN = 0.05;
+
+	// Weight of a new measure in the averages
+	constexpr double AVERAGE_WEIGHT = 0.2;
+
+	// Added by every fragment in the overdraw view: dark red for one, white from eight
+	const glm::vec4 OVERDRAW_COLOR(0.125f, 0.0625f, 0.03125f, 1.0f);
+
+	void addToAverage(double& average, double value)
+	{
+		average = average < 0.0 ? value : average + (value - average) * AVERAGE_WEIGHT;
+	}
+
+	bool resultAvailable(GLuint query)
+	{
+		GLint available = GL_FALSE;
+		glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		return available == GL_TRUE;
+	}
+}
+
+DepthPrepass::Settings& DepthPrepass::settings()
+{
+	static Settings settings;
+	return settings;
+}
+
+DepthPrepass::Statistics& DepthPrepass::statistics()
+{
+	static Statistics statistics;
+	return statistics;
+}
+
+void DepthPrepass::begin(const Camera& camera, RenderQueue& renderQueue, SceneObject& sceneRoot, StaticBatcher& staticBatcher, const ConstantMaterial& depthMaterial)
+{
+	readResults();
+	++m_frame;
+
+	const bool prepass = usePrepass();
+	statistics().active = prepass;
+
+	// Skipped when the GPU is so far behind that the query of this slot is still in use
+	TimeQuery& timeQuery = m_timeQueries[m_frame % QUERY_FRAMES];
+	m_timing = !timeQuery.pending;
+	if (m_timing)
+	{
+		if (timeQuery.query == 0)
+			glGenQueries(1, &timeQuery.query);
+		timeQuery.prepass = prepass;
+		timeQuery.pending = true;
+		glBeginQuery(GL_TIME_ELAPSED, timeQuery.query);
+	}
+
+	if (!prepass)
+		return;
+
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	depthMaterial.bind();
+	drawDepth(camera, renderQueue, sceneRoot, staticBatcher, depthMaterial);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+	// Only the nearest fragment of each pixel is shaded, the depth is already there
+	glDepthFunc(GL_EQUAL);
+	glDepthMask(GL_FALSE);
+}
+
+void DepthPrepass::end()
+{
+	if (m_timing)
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		m_timing = false;
+	}
+
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
+}
+
+void DepthPrepass::renderOverdraw(const Camera& camera, RenderQueue& renderQueue, SceneObject& sceneRoot, StaticBatcher& staticBatcher, const ConstantMaterial& depthMaterial)
+{
+	GLfloat clearColor[4];
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+
+	OverdrawQueries& queries = m_overdrawQueries[m_frame % QUERY_FRAMES];
+	const bool measuring = !queries.pending;
+	if (measuring && queries.shaded == 0)
+	{
+		glGenQueries(1, &queries.shaded);
+		glGenQueries(1, &queries.covered);
+	}
+
+	// The fragments passing the depth test in the order of the queue, as the shading pass sees them without the pre-pass
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+	depthMaterial.bind();
+	depthMaterial.setColor(OVERDRAW_COLOR);
+	if (measuring)
+		glBeginQuery(GL_SAMPLES_PASSED, queries.shaded);
+	drawDepth(camera, renderQueue, sceneRoot, staticBatcher, depthMaterial);
+	if (measuring)
+		glEndQuery(GL_SAMPLES_PASSED);
+	glDisable(GL_BLEND);
+
+	// Then the pixels left, as it sees them with it
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthFunc(GL_EQUAL);
+	glDepthMask(GL_FALSE);
+	if (measuring)
+		glBeginQuery(GL_SAMPLES_PASSED, queries.covered);
+	drawDepth(camera, renderQueue, sceneRoot, staticBatcher, depthMaterial);
+	if (measuring)
+		glEndQuery(GL_SAMPLES_PASSED);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
+
+	if (measuring)
+		queries.pending = true;
+}
+
+void DepthPrepass::clear()
+{
+	for (auto& timeQuery : m_timeQueries)
+	{
+		if (timeQuery.query != 0)
+			glDeleteQueries(1, &timeQuery.query);
+		timeQuery = TimeQuery();
+	}
+	for (auto& queries : m_overdrawQueries)
+	{
+		if (queries.shaded != 0)
+		{
+			glDeleteQueries(1, &queries.shaded);
+			glDeleteQueries(1, &queries.covered);
+		}
+		queries = OverdrawQueries();
+	}
+	m_timing = false;
+}
+
+bool DepthPrepass::usePrepass() const
+{
+	const auto& prepassSettings = settings();
+	if (prepassSettings.mode != Mode::Automatic)
+	{
+		return prepassSettings.mode == Mode::Always;
+	}
+
+	// The other choice is tried for a few frames now and then, the view may have changed which one is faster
+	const std::size_t interval = static_cast<std::size_t>(std::max(prepassSettings.trialInterval, 2 * TRIAL_FRAMES));
+	const bool trying = m_frame % interval < TRIAL_FRAMES;
+	return trying != m_automaticChoice;
+}
+
+void DepthPrepass::readResults()
+{
+	for (auto& timeQuery : m_timeQueries)
+	{
+		if (!timeQuery.pending || !resultAvailable(timeQuery.query))
+			continue;
+
+		GLuint64 nanoseconds = 0;
+		glGetQueryObjectui64v(timeQuery.query, GL_QUERY_RESULT, &nanoseconds);
+		timeQuery.pending = false;
+		addToAverage(timeQuery.prepass ? m_withPrepassMs : m_withoutPrepassMs, static_cast<double>(nanoseconds) * 1e-6);
+	}
+
+	if (m_withPrepassMs >= 0.0 && m_withoutPrepassMs >= 0.0)
+	{
+		if (!m_automaticChoice && m_withPrepassMs < m_withoutPrepassMs * (1.0 - SWITCH_MARGIN))
+			m_automaticChoice = true;
+		else if (m_automaticChoice && m_withoutPrepassMs < m_withPrepassMs * (1.0 - SWITCH_MARGIN))
+			m_automaticChoice = false;
+	}
+
+	auto& prepassStatistics = statistics();
+	prepassStatistics.withPrepassMs = m_withPrepassMs;
+	prepassStatistics.withoutPrepassMs = m_withoutPrepassMs;
+
+	for (auto& queries : m_overdrawQueries)
+	{
+		if (!queries.pending || !resultAvailable(queries.covered))
+			continue;
+
+		GLuint64 shaded = 0;
+		GLuint64 covered = 0;
+		glGetQueryObjectui64v(queries.shaded, GL_QUERY_RESULT, &shaded);
+		glGetQueryObjectui64v(queries.covered, GL_QUERY_RESULT, &covered);
+		queries.pending = false;
+
+		prepassStatistics.shadedFragments = static_cast<std::size_t>(shaded);
+		prepassStatistics.coveredPixels = static_cast<std::size_t>(covered);
+		prepassStatistics.overdraw = covered > 0 ? static_cast<float>(shaded) / static_cast<float>(covered) : 0.0f;
+	}
+}
+
+void DepthPrepass::drawDepth(const Camera& camera, RenderQueue& renderQueue, SceneObject& sceneRoot, StaticBatcher& staticBatcher, const ConstantMaterial& depthMaterial)
+{
+	MeshRenderer::renderPass(MeshRenderer::RenderPass::DepthOnly);
+	renderQueue.render(camera, sceneRoot);
+	staticBatcher.renderDepth(camera, depthMaterial);
+	MeshRenderer::renderPass(MeshRenderer::RenderPass::Shading);
+}
@@ -0,0 +1,115 @@
+#pragma once
+#ifndef DEPTHPREPASS_H
+#define DEPTHPREPASS_H
+
+/**
+ * @file DepthPrepass.h
+ *
+ * @brief Optional depth-only pass before the scene, so the shading pass only shades the visible fragments.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+class Camera;
+class ConstantMaterial;
+class RenderQueue;
+class SceneObject;
+class StaticBatcher;
+
+/**
+ * The scene is first drawn with the position-only constant VAOs and no color writes, then shaded with GL_EQUAL
+ * and no depth writes. It costs a second traversal and a second set of draws, which only pays off when hidden
+ * fragments are expensive: the automatic mode measures the GPU time of the scene with and without it and keeps
+ * the fastest, trying the other choice again now and then.
+ */
+class DepthPrepass
+{
+public:
+	enum class Mode
+	{
+		Automatic,
+		Always,
+		Never
+	};
+
+	struct Settings
+	{
+		Mode mode = Mode::Automatic;
+		int trialInterval = 300;    // Frames between two trials of the other choice, in automatic mode
+		bool showOverdraw = false;  // Replace the image by the number of fragments shaded per pixel without the pre-pass
+	};
+
+	struct Statistics
+	{
+		bool active = false;               // Pre-pass drawn this frame
+		double withPrepassMs = -1.0;       // GPU time of the scene, averaged over the frames of each choice
+		double withoutPrepassMs = -1.0;
+		std::size_t shadedFragments = 0;   // Of the overdraw view
+		std::size_t coveredPixels = 0;
+		float overdraw = 0.0f;
+	};
+
+	static Settings& settings();
+	static Statistics& statistics();
+
+	/**
+	 * Before the scene graph: draw its depth if the pre-pass is used this frame and set the depth test of the shading pass.
+	 */
+	void begin(const Camera& camera, RenderQueue& renderQueue, SceneObject& sceneRoot, StaticBatcher& staticBatcher, const ConstantMaterial& depthMaterial);
+
+	/**
+	 * After the scene graph and the batches: back to the usual depth test.
+	 */
+	void end();
+
+	/**
+	 * Debug view, after the scene: every fragment that would be shaded without the pre-pass adds to the color of its pixel.
+	 */
+	void renderOverdraw(const Camera& camera, RenderQueue& renderQueue, SceneObject& sceneRoot, StaticBatcher& staticBatcher, const ConstantMaterial& depthMaterial);
+
+	/**
+	 * Delete the queries, while the context is still alive.
+	 */
+	void clear();
+
+private:
+	// Results are read a few frames later, once the GPU is done with them, so the queries never stall
+	static constexpr int QUERY_FRAMES = 4;
+	static constexpr int TRIAL_FRAMES = 8;
+
+	struct TimeQuery
+	{
+		GLuint query = 0;
+		bool prepass = false;
+		bool pending = false;
+	};
+
+	struct OverdrawQueries
+	{
+		GLuint shaded = 0;
+		GLuint covered = 0;
+		bool pending = false;
+	};
+
+	bool usePrepass() const;
+	void readResults();
+	void drawDepth(const Camera& camera, RenderQueue& renderQueue, SceneObject& sceneRoot, StaticBatcher& staticBatcher, const ConstantMaterial& depthMaterial);
+
+private:
+	TimeQuery m_timeQueries[QUERY_FRAMES];
+	OverdrawQueries m_overdrawQueries[QUERY_FRAMES];
+	std::size_t m_frame = 0;
+	bool m_timing = false;
+
+	bool m_automaticChoice = false;
+	double m_withPrepassMs = -1.0;
+	double m_withoutPrepassMs = -1.0;
+};
+
+#endif
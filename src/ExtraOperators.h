@@ -15,24 +15,21 @@
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/gtx/euler_angles.hpp>
 
-bool operator==(const glm::vec3& a, const glm::vec3& b)
+inline bool operator==(const glm::vec3& a, const glm::vec3& b)
 {
 	const double epsilon = 0.0000001;
 
 	return glm::abs(a[0] - b[0]) < epsilon &&
-		glm::abs(a[1] - b[0]) < epsilon &&
+		glm::abs(a[1] - b[1]) < epsilon &&
 		glm::abs(a[2] - b[2]) < epsilon;
 }
 
-bool operator!=(const glm::vec3& a, const glm::vec3& b)
+inline bool operator!=(const glm::vec3& a, const glm::vec3& b)
 {
-	const double epsilon = 0.0000001;
-	return !(glm::abs(a[0] - b[0]) < epsilon) ||
-		!(glm::abs(a[1] - b[0]) < epsilon) ||
-		!(glm::abs(a[2] - b[2]) < epsilon);
+	return !(a == b);
 }
 
-glm::vec3 operator+(const glm::vec3 v, const double a)
+inline glm::vec3 operator+(const glm::vec3 v, const double a)
 {
 	glm::vec3 sum(v);
 	sum[0] += a;
@@ -42,7 +39,7 @@ glm::vec3 operator+(const glm::vec3 v, const double a)
 	return sum;
 }
 
-glm::vec3 operator-(const glm::vec3 v, const double a)
+inline glm::vec3 operator-(const glm::vec3 v, const double a)
 {
 	glm::vec3 subst(v);
 	subst[0] -= a;
@@ -52,7 +49,7 @@ glm::vec3 operator-(const glm::vec3 v, const double a)
 	return subst;
 }
 
-glm::vec3 operator*(const glm::vec3 v, const double a)
+inline glm::vec3 operator*(const glm::vec3 v, const double a)
 {
 	glm::vec3 product(v);
 
@@ -63,7 +60,7 @@ glm::vec3 operator*(const glm::vec3 v, const double a)
 	return product;
 }
 
-glm::vec3 operator/(const glm::vec3 v, const double a)
+inline glm::vec3 operator/(const glm::vec3 v, const double a)
 {
 	glm::vec3 division(v);
 
@@ -0,0 +1,803 @@
+/**
+ * @file GLTFLoader.cpp
+ *
+ * @brief Reads binary glTF 2.0 files (.glb) and describes their buffers as they will be uploaded to OpenGL.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include "GLTFLoader.h"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/gtx/matrix_decompose.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <utility>
+
+namespace
+{
+	constexpr uint32_t GLB_MAGIC = 0x46546C67;       // "glTF"
+	constexpr uint32_t GLB_VERSION = 2;
+	constexpr uint32_t CHUNK_JSON = 0x4E4F534A;      // "JSON"
+	constexpr uint32_t CHUNK_BIN = 0x004E4942;       // "BIN\0"
+
+	constexpr uint32_t MODE_TRIANGLES = 4;
+
+	// glTF component types, same values as the GL enums
+	constexpr uint32_t TYPE_BYTE = 5120;
+	constexpr uint32_t TYPE_UNSIGNED_BYTE = 5121;
+	constexpr uint32_t TYPE_SHORT = 5122;
+	constexpr uint32_t TYPE_UNSIGNED_SHORT = 5123;
+	constexpr uint32_t TYPE_UNSIGNED_INT = 5125;
+	constexpr uint32_t TYPE_FLOAT = 5126;
+
+	// Just enough JSON for the glTF header: the whole document is small next to the binary chunk
+	struct JsonValue
+	{
+		enum class Type { Null, Bool, Number, String, Array, Object };
+
+		Type type = Type::Null;
+		bool boolean = false;
+		double number = 0.0;
+		std::string string;
+		std::vector<JsonValue> array;
+		std::vector<std::pair<std::string, JsonValue>> object;
+
+		const JsonValue& operator[](const std::string& key) const
+		{
+			static const JsonValue null;
+			if (type == Type::Object)
+			{
+				for (const auto& member : object)
+				{
+					if (member.first == key)
+						return member.second;
+				}
+			}
+			return null;
+		}
+
+		const JsonValue& operator[](std::size_t index) const
+		{
+			static const JsonValue null;
+			return type == Type::Array && index < array.size() ? array[index] : null;
+		}
+
+		inline bool isNull() const { return type == Type::Null; }
+		inline std::size_t size() const { return type == Type::Array ? array.size() : 0; }
+		inline double numberOr(double defaultValue) const { return type == Type::Number ? number : defaultValue; }
+		// Clamped first: converting a double out of the range of int is undefined, and the file is not trusted
+		inline int intOr(int defaultValue) const
+		{
+			if (type != Type::Number || std::isnan(number))
+				return defaultValue;
+			return static_cast<int>(std::clamp(number, static_cast<double>(std::numeric_limits<int>::min()), static_cast<double>(std::numeric_limits<int>::max())));
+		}
+		inline bool boolOr(bool defaultValue) const { return type == Type::Bool ? boolean : defaultValue; }
+		inline const std::string& stringOr(const std::string& defaultValue) const { return type == Type::String ? string : defaultValue; }
+	};
+
+	class JsonParser
+	{
+	public:
+		JsonParser(const char* begin, const char* end) : m_it(begin), m_end(end) {}
+
+		bool parse(JsonValue& outValue)
+		{
+			if (!parseValue(outValue, 0))
+				return false;
+
+			skipSpaces();
+			return m_it == m_end;
+		}
+
+	private:
+		static constexpr int MAX_DEPTH = 64;
+
+		void skipSpaces()
+		{
+			while (m_it != m_end && (*m_it == ' ' || *m_it == '\t' || *m_it == '\n' || *m_it == '\r'))
+				++m_it;
+		}
+
+		bool consume(const char* word)
+		{
+			const std::size_t length = std::strlen(word);
+			if (static_cast<std::size_t>(m_end - m_it) < length || std::memcmp(m_it, word, length) != 0)
+				return false;
+
+			m_it += length;
+			return true;
+		}
+
+		bool parseValue(JsonValue& outValue, int depth)
+		{
+			skipSpaces();
+			if (m_it == m_end || depth > MAX_DEPTH)
+				return false;
+
+			switch (*m_it)
+			{
+			case '{':
+				return parseObject(outValue, depth);
+			case '[':
+				return parseArray(outValue, depth);
+			case '"':
+				outValue.type = JsonValue::Type::String;
+				return parseString(outValue.string);
+			case 't':
+				outValue.type = JsonValue::Type::Bool;
+				outValue.boolean = true;
+				return consume("true");
+			case 'f':
+				outValue.type = JsonValue::Type::Bool;
+				outValue.boolean = false;
+				return consume("false");
+			case 'n':
+				outValue.type = JsonValue::Type::Null;
+				return consume("null");
+			default:
+				outValue.type = JsonValue::Type::Number;
+				return parseNumber(outValue.number);
+			}
+		}
+
+		bool parseObject(JsonValue& outValue, int depth)
+		{
+			outValue.type = JsonValue::Type::Object;
+			++m_it;
+			skipSpaces();
+			if (m_it != m_end && *m_it == '}')
+			{
+				++m_it;
+				return true;
+			}
+
+			while (true)
+			{
+				skipSpaces();
+				std::pair<std::string, JsonValue> member;
+				if (m_it == m_end || *m_it != '"' || !parseString(member.first))
+					return false;
+
+				skipSpaces();
+				if (m_it == m_end || *m_it != ':')
+					return false;
+				++m_it;
+
+				if (!parseValue(member.second, depth + 1))
+					return false;
+				outValue.object.push_back(std::move(member));
+
+				skipSpaces();
+				if (m_it == m_end)
+					return false;
+				if (*m_it == '}')
+				{
+					++m_it;
+					return true;
+				}
+				if (*m_it != ',')
+					return false;
+				++m_it;
+			}
+		}
+
+		bool parseArray(JsonValue& outValue, int depth)
+		{
+			outValue.type = JsonValue::Type::Array;
+			++m_it;
+			skipSpaces();
+			if (m_it != m_end && *m_it == ']')
+			{
+				++m_it;
+				return true;
+			}
+
+			while (true)
+			{
+				outValue.array.emplace_back();
+				if (!parseValue(outValue.array.back(), depth + 1))
+					return false;
+
+				skipSpaces();
+				if (m_it == m_end)
+					return false;
+				if (*m_it == ']')
+				{
+					++m_it;
+					return true;
+				}
+				if (*m_it != ',')
+					return false;
+				++m_it;
+			}
+		}
+
+		bool parseNumber(double& outNumber)
+		{
+			// from_chars does not take the leading + that JSON forbids anyway
+			const auto result = std::from_chars(m_it, m_end, outNumber);
+			if (result.ec != std::errc() || result.ptr == m_it)
+				return false;
+
+			m_it = result.ptr;
+			return true;
+		}
+
+		bool parseHex(uint32_t& outValue)
+		{
+			if (m_end - m_it < 4)
+				return false;
+
+			const auto result = std::from_chars(m_it, m_it + 4, outValue, 16);
+			if (result.ptr != m_it + 4)
+				return false;
+
+			m_it += 4;
+			return true;
+		}
+
+		static void appendUtf8(uint32_t codePoint, std::string& outString)
+		{
+			if (codePoint < 0x80)
+			{
+				outString += static_cast<char>(codePoint);
+			}
+			else if (codePoint < 0x800)
+			{
+				outString += static_cast<char>(0xC0 | (codePoint >> 6));
+				outString += static_cast<char>(0x80 | (codePoint & 0x3F));
+			}
+			else if (codePoint < 0x10000)
+			{
+				outString += static_cast<char>(0xE0 | (codePoint >> 12));
+				outString += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+				outString += static_cast<char>(0x80 | (codePoint & 0x3F));
+			}
+			else
+			{
+				outString += static_cast<char>(0xF0 | (codePoint >> 18));
+				outString += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+				outString += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+				outString += static_cast<char>(0x80 | (codePoint & 0x3F));
+			}
+		}
+
+		bool parseString(std::string& outString)
+		{
+			++m_it;
+			while (m_it != m_end && *m_it != '"')
+			{
+				if (*m_it != '\\')
+				{
+					outString += *m_it++;
+					continue;
+				}
+
+				if (++m_it == m_end)
+					return false;
+
+				const char escaped = *m_it++;
+				switch (escaped)
+				{
+				case '"': outString += '"'; break;
+				case '\\': outString += '\\'; break;
+				case '/': outString += '/'; break;
+				case 'b': outString += '\b'; break;
+				case 'f': outString += '\f'; break;
+				case 'n': outString += '\n'; break;
+				case 'r': outString += '\r'; break;
+				case 't': outString += '\t'; break;
+				case 'u':
+				{
+					uint32_t codePoint;
+					if (!parseHex(codePoint))
+						return false;
+
+					// Characters out of the basic plane are written as a surrogate pair
+					uint32_t lowSurrogate;
+					if (codePoint >= 0xD800 && codePoint < 0xDC00 && consume("\\u") && parseHex(lowSurrogate))
+					{
+						codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (lowSurrogate - 0xDC00);
+					}
+					appendUtf8(codePoint, outString);
+					break;
+				}
+				default:
+					return false;
+				}
+			}
+
+			if (m_it == m_end)
+				return false;
+
+			++m_it;
+			return true;
+		}
+
+	private:
+		const char* m_it;
+		const char* m_end;
+	};
+
+	uint32_t componentSize(uint32_t componentType)
+	{
+		switch (componentType)
+		{
+		case TYPE_BYTE:
+		case TYPE_UNSIGNED_BYTE:
+			return 1;
+		case TYPE_SHORT:
+		case TYPE_UNSIGNED_SHORT:
+			return 2;
+		case TYPE_UNSIGNED_INT:
+		case TYPE_FLOAT:
+			return 4;
+		default:
+			return 0;
+		}
+	}
+
+	uint32_t componentCount(const std::string& type)
+	{
+		if (type == "SCALAR")
+			return 1;
+		if (type == "VEC2")
+			return 2;
+		if (type == "VEC3")
+			return 3;
+		if (type == "VEC4")
+			return 4;
+		return 0;
+	}
+
+	// An accessor checked against the binary chunk
+	struct Accessor
+	{
+		GLTFLoader::Attribute attribute;
+		std::size_t count = 0;
+		const JsonValue* json = nullptr;
+	};
+
+	bool resolveAccessor(const JsonValue& document, int index, std::size_t binarySize, Accessor& outAccessor)
+	{
+		const JsonValue& accessor = document["accessors"][static_cast<std::size_t>(std::max(index, 0))];
+		if (index < 0 || accessor.isNull())
+		{
+			std::cout << "Error: glTF accessor " << index << " does not exist" << std::endl;
+			return false;
+		}
+		if (!accessor["sparse"].isNull() || accessor["bufferView"].isNull())
+		{
+			std::cout << "Error: glTF accessor " << index << " is sparse or has no buffer view, which is not supported" << std::endl;
+			return false;
+		}
+
+		const JsonValue& bufferView = document["bufferViews"][static_cast<std::size_t>(std::max(accessor["bufferView"].intOr(-1), 0))];
+		const int bufferIndex = bufferView["buffer"].intOr(-1);
+		if (bufferView.isNull() || bufferIndex != 0 || !document["buffers"][0]["uri"].isNull())
+		{
+			std::cout << "Error: glTF accessor " << index << " is not in the binary chunk, only self-contained .glb files are supported" << std::endl;
+			return false;
+		}
+
+		GLTFLoader::Attribute& attribute = outAccessor.attribute;
+		attribute.componentType = static_cast<uint32_t>(accessor["componentType"].intOr(0));
+		attribute.componentCount = componentCount(accessor["type"].stringOr(""));
+		attribute.normalized = accessor["normalized"].boolOr(false);
+		outAccessor.count = static_cast<std::size_t>(std::max(accessor["count"].numberOr(0.0), 0.0));
+		outAccessor.json = &accessor;
+
+		const uint32_t elementSize = componentSize(attribute.componentType) * attribute.componentCount;
+		const double viewOffset = bufferView["byteOffset"].numberOr(0.0);
+		const double viewLength = bufferView["byteLength"].numberOr(0.0);
+		const double accessorOffset = accessor["byteOffset"].numberOr(0.0);
+		const uint32_t stride = static_cast<uint32_t>(bufferView["byteStride"].intOr(0));
+		attribute.stride = stride > 0 ? stride : elementSize;
+		attribute.offset = static_cast<std::size_t>(viewOffset + accessorOffset);
+
+		const double lastByte = viewOffset + accessorOffset + (outAccessor.count > 0 ? static_cast<double>(outAccessor.count - 1) * attribute.stride + elementSize : 0.0);
+		if (elementSize == 0 || viewOffset < 0.0 || accessorOffset < 0.0 || viewOffset + viewLength > static_cast<double>(binarySize)
+			|| lastByte > viewOffset + viewLength)
+		{
+			std::cout << "Error: glTF accessor " << index << " does not fit in its buffer view" << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	bool readVec3(const JsonValue& value, glm::vec3& outVector)
+	{
+		if (value.size() != 3)
+			return false;
+
+		for (int i = 0; i < 3; ++i)
+			outVector[i] = static_cast<float>(value[i].numberOr(0.0));
+		return true;
+	}
+
+	template <class T>
+	std::size_t maxIndex(const unsigned char* data, std::size_t count)
+	{
+		T maximum = 0;
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			T value;
+			std::memcpy(&value, data + i * sizeof(T), sizeof(T));
+			maximum = std::max(maximum, value);
+		}
+		return maximum;
+	}
+
+	template <class T>
+	void computeNormals(const unsigned char* positions, uint32_t stride, const unsigned char* indices, std::size_t indexCount, std::size_t vertexCount, float* outNormals)
+	{
+		auto position = [&](std::size_t vertex)
+		{
+			glm::vec3 value;
+			std::memcpy(&value[0], positions + vertex * stride, sizeof(glm::vec3));
+			return value;
+		};
+
+		// Smooth normals weighted by the area of the triangles, the file asked for flat ones but they need unshared vertices
+		std::fill(outNormals, outNormals + 3 * vertexCount, 0.0f);
+		for (std::size_t i = 0; i + 2 < indexCount; i += 3)
+		{
+			T corners[3];
+			std::memcpy(corners, indices + i * sizeof(T), sizeof(corners));
+			const glm::vec3 faceNormal = glm::cross(position(corners[1]) - position(corners[0]), position(corners[2]) - position(corners[0]));
+			for (const T corner : corners)
+			{
+				for (int axis = 0; axis < 3; ++axis)
+					outNormals[3 * corner + axis] += faceNormal[axis];
+			}
+		}
+
+		for (std::size_t vertex = 0; vertex < vertexCount; ++vertex)
+		{
+			float* normal = outNormals + 3 * vertex;
+			const glm::vec3 unitNormal = glm::normalize(glm::vec3(normal[0], normal[1], normal[2]) + glm::vec3(0.0f, 0.0f, 1e-20f));
+			std::copy(&unitNormal[0], &unitNormal[0] + 3, normal);
+		}
+	}
+
+	bool loadPrimitive(const JsonValue& document, const JsonValue& primitiveJson, const unsigned char* binary, std::size_t binarySize, GLTFLoader::Primitive& outPrimitive)
+	{
+		if (static_cast<uint32_t>(primitiveJson["mode"].intOr(MODE_TRIANGLES)) != MODE_TRIANGLES)
+		{
+			std::cout << "Warning: glTF primitive skipped, only triangle lists are supported" << std::endl;
+			return false;
+		}
+
+		const JsonValue& attributes = primitiveJson["attributes"];
+		Accessor position;
+		if (!resolveAccessor(document, attributes["POSITION"].intOr(-1), binarySize, position))
+			return false;
+		if (position.attribute.componentCount != 3 || position.count == 0)
+		{
+			std::cout << "Error: glTF positions must have three components" << std::endl;
+			return false;
+		}
+		outPrimitive.position = position.attribute;
+		outPrimitive.vertexCount = position.count;
+
+		// The optional attributes are dropped when they do not cover every vertex
+		Accessor normal;
+		if (!attributes["NORMAL"].isNull() && resolveAccessor(document, attributes["NORMAL"].intOr(-1), binarySize, normal)
+			&& normal.attribute.componentCount == 3 && normal.count >= position.count)
+		{
+			outPrimitive.normal = normal.attribute;
+		}
+		Accessor uv;
+		if (!attributes["TEXCOORD_0"].isNull() && resolveAccessor(document, attributes["TEXCOORD_0"].intOr(-1), binarySize, uv)
+			&& uv.attribute.componentCount == 2 && uv.count >= position.count)
+		{
+			outPrimitive.uv = uv.attribute;
+		}
+
+		const JsonValue& materialIndex = primitiveJson["material"];
+		outPrimitive.material = materialIndex.intOr(-1) < static_cast<int>(document["materials"].size()) ? materialIndex.intOr(-1) : -1;
+
+		// Bounds are mandatory for the positions, only computed for files that skip them anyway
+		if (!readVec3((*position.json)["min"], outPrimitive.boundsMin) || !readVec3((*position.json)["max"], outPrimitive.boundsMax))
+		{
+			outPrimitive.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+			outPrimitive.boundsMax = glm::vec3(std::numeric_limits<float>::lowest());
+			if (position.attribute.componentType == TYPE_FLOAT)
+			{
+				for (std::size_t i = 0; i < position.count; ++i)
+				{
+					glm::vec3 value;
+					std::memcpy(&value[0], binary + position.attribute.offset + i * position.attribute.stride, sizeof(glm::vec3));
+					outPrimitive.boundsMin = glm::min(outPrimitive.boundsMin, value);
+					outPrimitive.boundsMax = glm::max(outPrimitive.boundsMax, value);
+				}
+			}
+		}
+
+		const unsigned char* indices = nullptr;
+		if (!primitiveJson["indices"].isNull())
+		{
+			Accessor indexAccessor;
+			if (!resolveAccessor(document, primitiveJson["indices"].intOr(-1), binarySize, indexAccessor))
+				return false;
+
+			const GLTFLoader::Attribute& indexAttribute = indexAccessor.attribute;
+			const uint32_t indexSize = componentSize(indexAttribute.componentType);
+			if (indexAttribute.componentCount != 1 || indexAttribute.stride != indexSize
+				|| (indexAttribute.componentType != TYPE_UNSIGNED_BYTE && indexAttribute.componentType != TYPE_UNSIGNED_SHORT && indexAttribute.componentType != TYPE_UNSIGNED_INT))
+			{
+				std::cout << "Error: glTF indices must be packed unsigned integers" << std::endl;
+				return false;
+			}
+
+			outPrimitive.indexType = indexAttribute.componentType;
+			outPrimitive.indexOffset = indexAttribute.offset;
+			outPrimitive.indexCount = indexAccessor.count / 3 * 3;
+			indices = binary + indexAttribute.offset;
+
+			// Nothing else reads the indices on the CPU, but an index past the vertices would read outside the buffers on the GPU
+			std::size_t largestIndex = 0;
+			if (indexAttribute.componentType == TYPE_UNSIGNED_BYTE)
+				largestIndex = maxIndex<uint8_t>(indices, outPrimitive.indexCount);
+			else if (indexAttribute.componentType == TYPE_UNSIGNED_SHORT)
+				largestIndex = maxIndex<uint16_t>(indices, outPrimitive.indexCount);
+			else
+				largestIndex = maxIndex<uint32_t>(indices, outPrimitive.indexCount);
+
+			if (outPrimitive.indexCount > 0 && largestIndex >= outPrimitive.vertexCount)
+			{
+				std::cout << "Error: glTF primitive has an index past its " << outPrimitive.vertexCount << " vertices" << std::endl;
+				return false;
+			}
+		}
+
+		// What the file leaves out goes to extraData: indices of a non-indexed primitive, then normals
+		std::size_t extraSize = 0;
+		const bool generateIndices = indices == nullptr;
+		const bool generateNormals = !outPrimitive.normal.present() && position.attribute.componentType == TYPE_FLOAT;
+		if (generateIndices)
+			extraSize += sizeof(uint32_t) * (outPrimitive.vertexCount / 3 * 3);
+		if (generateNormals)
+			extraSize += sizeof(float) * 3 * outPrimitive.vertexCount;
+		outPrimitive.extraData.resize(extraSize);
+
+		if (generateIndices)
+		{
+			outPrimitive.indexType = TYPE_UNSIGNED_INT;
+			outPrimitive.indexOffset = 0;
+			outPrimitive.indexCount = outPrimitive.vertexCount / 3 * 3;
+			outPrimitive.indicesInExtraData = true;
+
+			for (uint32_t i = 0; i < outPrimitive.indexCount; ++i)
+				std::memcpy(outPrimitive.extraData.data() + i * sizeof(uint32_t), &i, sizeof(uint32_t));
+			indices = outPrimitive.extraData.data();
+		}
+
+		if (generateNormals)
+		{
+			const std::size_t normalsOffset = generateIndices ? sizeof(uint32_t) * outPrimitive.indexCount : 0;
+			std::vector<float> normals(3 * outPrimitive.vertexCount);
+			const unsigned char* positions = binary + position.attribute.offset;
+			if (outPrimitive.indexType == TYPE_UNSIGNED_BYTE)
+				computeNormals<uint8_t>(positions, position.attribute.stride, indices, outPrimitive.indexCount, outPrimitive.vertexCount, normals.data());
+			else if (outPrimitive.indexType == TYPE_UNSIGNED_SHORT)
+				computeNormals<uint16_t>(positions, position.attribute.stride, indices, outPrimitive.indexCount, outPrimitive.vertexCount, normals.data());
+			else
+				computeNormals<uint32_t>(positions, position.attribute.stride, indices, outPrimitive.indexCount, outPrimitive.vertexCount, normals.data());
+			std::memcpy(outPrimitive.extraData.data() + normalsOffset, normals.data(), sizeof(float) * normals.size());
+
+			outPrimitive.normal.offset = normalsOffset;
+			outPrimitive.normal.stride = 3 * sizeof(float);
+			outPrimitive.normal.componentType = TYPE_FLOAT;
+			outPrimitive.normal.componentCount = 3;
+			outPrimitive.normal.inExtraData = true;
+		}
+
+		return outPrimitive.indexCount > 0;
+	}
+
+	void loadNode(const JsonValue& nodeJson, int meshCount, int nodeCount, GLTFLoader::Node& outNode)
+	{
+		outNode.name = nodeJson["name"].stringOr("");
+
+		const int mesh = nodeJson["mesh"].intOr(-1);
+		outNode.mesh = mesh < meshCount ? mesh : -1;
+
+		const JsonValue& children = nodeJson["children"];
+		for (std::size_t i = 0; i < children.size(); ++i)
+		{
+			const int child = children[i].intOr(-1);
+			if (child >= 0 && child < nodeCount)
+				outNode.children.push_back(child);
+		}
+
+		const JsonValue& matrix = nodeJson["matrix"];
+		if (matrix.size() == 16)
+		{
+			// Column major, like glm
+			glm::mat4 transform;
+			for (int i = 0; i < 16; ++i)
+				transform[i / 4][i % 4] = static_cast<float>(matrix[i].numberOr(0.0));
+
+			glm::vec3 skew;
+			glm::vec4 perspective;
+			glm::decompose(transform, outNode.scale, outNode.rotation, outNode.translation, skew, perspective);
+			return;
+		}
+
+		readVec3(nodeJson["translation"], outNode.translation);
+		readVec3(nodeJson["scale"], outNode.scale);
+
+		// glTF writes x, y, z, w
+		const JsonValue& rotation = nodeJson["rotation"];
+		if (rotation.size() == 4)
+		{
+			outNode.rotation = glm::quat(static_cast<float>(rotation[3].numberOr(1.0)), static_cast<float>(rotation[0].numberOr(0.0)),
+				static_cast<float>(rotation[1].numberOr(0.0)), static_cast<float>(rotation[2].numberOr(0.0)));
+		}
+	}
+}
+
+namespace GLTFLoader
+{
+	void Loader::unload()
+	{
+		m_isLoaded = false;
+		m_meshes.clear();
+		m_materials.clear();
+		m_nodes.clear();
+		m_rootNodes.clear();
+		m_binary = AssetPack::Span();
+		m_file.close();
+	}
+
+	bool Loader::loadFile(const std::string& filename)
+	{
+		unload();
+
+		const auto startTime = std::chrono::steady_clock::now();
+
+		AssetPack::Span span;
+		if (!AssetPack::findMounted(filename, span))
+		{
+			if (!m_file.open(filename, true))
+			{
+				std::cout << "Error: Failed to open file " << filename << " for reading!" << std::endl;
+				return false;
+			}
+			span = { m_file.data(), m_file.size() };
+		}
+
+		// 12 bytes header, then chunks of 8 bytes header and 4 bytes aligned data: JSON first, then BIN
+		uint32_t header[3] = {};
+		uint32_t jsonChunk[2] = {};
+		if (span.size < sizeof(header) + sizeof(jsonChunk))
+		{
+			std::cout << "Error: " << filename << " is not a binary glTF file" << std::endl;
+			unload();
+			return false;
+		}
+		std::memcpy(header, span.data, sizeof(header));
+		std::memcpy(jsonChunk, span.data + sizeof(header), sizeof(jsonChunk));
+
+		const std::size_t jsonOffset = sizeof(header) + sizeof(jsonChunk);
+		if (header[0] != GLB_MAGIC || header[1] != GLB_VERSION || header[2] > span.size || jsonChunk[1] != CHUNK_JSON
+			|| jsonChunk[0] > header[2] - jsonOffset)
+		{
+			std::cout << "Error: " << filename << " is not a binary glTF 2.0 file" << std::endl;
+			unload();
+			return false;
+		}
+
+		const std::size_t binaryChunkOffset = jsonOffset + jsonChunk[0];
+		uint32_t binaryChunk[2] = {};
+		if (binaryChunkOffset + sizeof(binaryChunk) <= header[2])
+		{
+			std::memcpy(binaryChunk, span.data + binaryChunkOffset, sizeof(binaryChunk));
+			if (binaryChunk[1] == CHUNK_BIN && binaryChunk[0] <= header[2] - binaryChunkOffset - sizeof(binaryChunk))
+			{
+				m_binary = { span.data + binaryChunkOffset + sizeof(binaryChunk), binaryChunk[0] };
+			}
+		}
+
+		JsonValue document;
+		JsonParser parser(span.data + jsonOffset, span.data + jsonOffset + jsonChunk[0]);
+		if (!parser.parse(document) || document.type != JsonValue::Type::Object)
+		{
+			// The chunk may be padded with spaces, never with anything else
+			std::cout << "Error: Invalid JSON chunk in " << filename << std::endl;
+			unload();
+			return false;
+		}
+
+		const JsonValue& materials = document["materials"];
+		m_materials.resize(materials.size());
+		for (std::size_t i = 0; i < materials.size(); ++i)
+		{
+			Material& material = m_materials[i];
+			material.name = materials[i]["name"].stringOr("");
+
+			const JsonValue& pbr = materials[i]["pbrMetallicRoughness"];
+			for (std::size_t c = 0; c < 4 && pbr["baseColorFactor"].size() == 4; ++c)
+				material.baseColor[c] = static_cast<float>(pbr["baseColorFactor"][c].numberOr(1.0));
+			material.metallic = static_cast<float>(pbr["metallicFactor"].numberOr(1.0));
+			material.roughness = static_cast<float>(pbr["roughnessFactor"].numberOr(1.0));
+			for (std::size_t c = 0; c < 3 && materials[i]["emissiveFactor"].size() == 3; ++c)
+				material.emissive[c] = static_cast<float>(materials[i]["emissiveFactor"][c].numberOr(0.0));
+			material.doubleSided = materials[i]["doubleSided"].boolOr(false);
+		}
+
+		const unsigned char* binary = binaryData();
+		std::size_t triangleCount = 0;
+		const JsonValue& meshes = document["meshes"];
+		m_meshes.resize(meshes.size());
+		for (std::size_t i = 0; i < meshes.size(); ++i)
+		{
+			Mesh& mesh = m_meshes[i];
+			mesh.name = meshes[i]["name"].stringOr("");
+
+			const JsonValue& primitives = meshes[i]["primitives"];
+			for (std::size_t p = 0; p < primitives.size(); ++p)
+			{
+				Primitive primitive;
+				if (loadPrimitive(document, primitives[p], binary, binarySize(), primitive))
+				{
+					triangleCount += primitive.indexCount / 3;
+					mesh.primitives.push_back(std::move(primitive));
+				}
+			}
+		}
+
+		const JsonValue& nodes = document["nodes"];
+		m_nodes.resize(nodes.size());
+		for (std::size_t i = 0; i < nodes.size(); ++i)
+		{
+			loadNode(nodes[i], static_cast<int>(m_meshes.size()), static_cast<int>(m_nodes.size()), m_nodes[i]);
+		}
+
+		// Roots of the default scene, or every node nobody has as a child when there is no scene
+		const JsonValue& scene = document["scenes"][static_cast<std::size_t>(std::max(document["scene"].intOr(0), 0))];
+		if (!scene.isNull())
+		{
+			for (std::size_t i = 0; i < scene["nodes"].size(); ++i)
+			{
+				const int node = scene["nodes"][i].intOr(-1);
+				if (node >= 0 && node < static_cast<int>(m_nodes.size()))
+					m_rootNodes.push_back(node);
+			}
+		}
+		else
+		{
+			std::vector<bool> isChild(m_nodes.size(), false);
+			for (const auto& node : m_nodes)
+			{
+				for (const int child : node.children)
+					isChild[child] = true;
+			}
+			for (std::size_t i = 0; i < m_nodes.size(); ++i)
+			{
+				if (!isChild[i])
+					m_rootNodes.push_back(static_cast<int>(i));
+			}
+		}
+
+		const auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+		std::cout << "Parsed " << filename << ": " << triangleCount << " triangles, " << m_nodes.size() << " nodes in " << elapsed << " ms" << std::endl;
+
+		m_isLoaded = true;
+		return true;
+	}
+}
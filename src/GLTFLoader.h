@@ -0,0 +1,123 @@
+#pragma once
+#ifndef GLTFLOADER_H
+#define GLTFLOADER_H
+
+/**
+ * @file GLTFLoader.h
+ *
+ * @brief Reads binary glTF 2.0 files (.glb) and describes their buffers as they will be uploaded to OpenGL.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include <glm/vec3.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "AssetPack.h"
+#include "MappedFile.h"
+
+namespace GLTFLoader
+{
+	// Where an attribute of a primitive is, inside the binary chunk (or inside extraData)
+	struct Attribute
+	{
+		std::size_t offset = 0;       // In bytes
+		uint32_t stride = 0;          // In bytes, from one vertex to the next
+		uint32_t componentType = 0;   // Same values as the GL enums (GL_FLOAT, GL_UNSIGNED_SHORT...), 0 when missing
+		uint32_t componentCount = 0;
+		bool normalized = false;
+		bool inExtraData = false;
+
+		inline bool present() const { return componentType != 0; }
+	};
+
+	struct Primitive
+	{
+		Attribute position;
+		Attribute normal;
+		Attribute uv;
+		std::size_t vertexCount = 0;
+
+		std::size_t indexOffset = 0;
+		uint32_t indexType = 0;       // GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+		std::size_t indexCount = 0;
+		bool indicesInExtraData = false;
+
+		int material = -1;
+		glm::vec3 boundsMin = glm::vec3(0.0f);
+		glm::vec3 boundsMax = glm::vec3(0.0f);
+
+		// Only what the file does not provide: generated indices, computed normals
+		std::vector<unsigned char> extraData;
+	};
+
+	struct Mesh
+	{
+		std::string name;
+		std::vector<Primitive> primitives;
+	};
+
+	// Factors of the metallic-roughness model, the textures are not read
+	struct Material
+	{
+		std::string name;
+		float baseColor[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		float metallic = 1.0f;
+		float roughness = 1.0f;
+		float emissive[3] = { 0.0f, 0.0f, 0.0f };
+		bool doubleSided = false;     // Otherwise the faces seen from the back are culled
+	};
+
+	struct Node
+	{
+		std::string name;
+		int mesh = -1;
+		std::vector<int> children;
+
+		glm::vec3 translation = glm::vec3(0.0f);
+		glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+		glm::vec3 scale = glm::vec3(1.0f);
+	};
+
+	// Class responsible for loading a .glb file. The binary chunk is used in place and stays mapped while loaded.
+	class Loader
+	{
+	public:
+		Loader() = default;
+		Loader(const Loader&) = delete;
+		Loader& operator=(const Loader&) = delete;
+
+		bool loadFile(const std::string& filename);
+		bool isLoaded() const { return m_isLoaded; }
+		void unload();
+
+		// Uploaded as is, every attribute and index offset of the primitives is relative to it
+		const unsigned char* binaryData() const { return reinterpret_cast<const unsigned char*>(m_binary.data); }
+		std::size_t binarySize() const { return m_binary.size; }
+
+		const std::vector<Mesh>& getMeshes() const { return m_meshes; }
+		const std::vector<Material>& getMaterials() const { return m_materials; }
+		const std::vector<Node>& getNodes() const { return m_nodes; }
+		const std::vector<int>& getRootNodes() const { return m_rootNodes; }
+
+	private:
+		MappedFile m_file;
+		AssetPack::Span m_binary;
+
+		std::vector<Mesh> m_meshes;
+		std::vector<Material> m_materials;
+		std::vector<Node> m_nodes;
+		std::vector<int> m_rootNodes;
+
+		bool m_isLoaded = false;
+	};
+}
+
+#endif // GLTFLOADER_H
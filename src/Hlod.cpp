@@ -0,0 +1,686 @@
+/**
+ * @file Hlod.cpp
+ *
+ * @brief Hierarchical levels of detail: merged proxies drawn in place of large static subtrees.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include "Hlod.h"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+#include "Camera.h"
+#include "ConstantMaterial.h"
+#include "MeshCache.h"
+#include "MeshRenderer.h"
+#include "ObjectMesh.h"
+#include "SceneObject.h"
+#include "TextureMaterial.h"
+#include "ThreadPool.h"
+
+namespace
+{
+	// Texels repeated around each cell of the atlas, so the filtering and the first mipmaps do not mix the cells
+	constexpr int ATLAS_GUTTER = 2;
+
+	// The scene version changes with every camera move: the subtrees are searched at most this often
+	constexpr double SCAN_INTERVAL = 0.5;
+
+	// A proxy inside another one only pays off when it is much smaller
+	constexpr std::size_t NESTED_PROXY_RATIO = 4;
+
+	// A quad (two coplanar triangles sharing an edge) or a lone triangle, to find the faces hidden between two meshes
+	struct Face
+	{
+		std::array<glm::ivec3, 4> points;
+		int pointCount = 0;
+		glm::vec3 normal = glm::vec3(0.0f);
+		uint32_t firstTriangle = 0;
+		uint32_t triangleCount = 0;
+	};
+
+	bool pointLess(const glm::ivec3& a, const glm::ivec3& b)
+	{
+		if (a.x != b.x)
+			return a.x < b.x;
+		if (a.y != b.y)
+			return a.y < b.y;
+		return a.z < b.z;
+	}
+
+	bool faceLess(const Face& a, const Face& b)
+	{
+		if (a.pointCount != b.pointCount)
+			return a.pointCount < b.pointCount;
+		return std::lexicographical_compare(a.points.begin(), a.points.begin() + a.pointCount, b.points.begin(), b.points.begin() + b.pointCount, pointLess);
+	}
+
+	bool sameFace(const Face& a, const Face& b)
+	{
+		return a.pointCount == b.pointCount && std::equal(a.points.begin(), a.points.begin() + a.pointCount, b.points.begin());
+	}
+
+	bool isMergeable(const MeshRenderer& renderer)
+	{
+		const auto& mesh = renderer.mesh();
+		const std::size_t vertexCount = mesh->vertices().size() / 3;
+		return vertexCount > 0 && !mesh->indices().empty()
+			&& mesh->normals().size() == 3 * vertexCount && mesh->uvs().size() == 2 * vertexCount;
+	}
+}
+
+HlodProxy::Settings& HlodProxy::settings()
+{
+	static Settings settings;
+	return settings;
+}
+
+HlodProxy::Statistics& HlodProxy::statistics()
+{
+	static Statistics statistics;
+	return statistics;
+}
+
+HlodProxy::HlodProxy(SceneObject& root)
+	: m_root(root)
+{
+	m_root.hlodProxy(this);
+}
+
+HlodProxy::~HlodProxy()
+{
+	if (m_root.hlodProxy() == this)
+	{
+		m_root.hlodProxy(nullptr);
+	}
+	release();
+}
+
+bool HlodProxy::render(const Camera& camera, const glm::mat4& modelMatrix)
+{
+	if (!drawn(camera, modelMatrix))
+	{
+		return false;
+	}
+
+	m_renderer->render(camera, modelMatrix);
+
+	if (MeshRenderer::renderPass() == MeshRenderer::RenderPass::Shading)
+	{
+		statistics().proxiesDrawn += 1;
+		statistics().renderersReplaced += m_rendererCount;
+	}
+	return true;
+}
+
+bool HlodProxy::drawn(const Camera& camera, const glm::mat4& modelMatrix) const
+{
+	const auto& proxySettings = settings();
+	if (!proxySettings.enabled || m_renderer == nullptr || m_containsSelection || m_builtVersion != m_root.version())
+	{
+		return false;
+	}
+
+	const float pixelsPerUnit = MeshRenderer::projectedPixelsPerUnit(camera, modelMatrix, m_boundsCenter, m_boundsRadius);
+	return m_texelError * pixelsPerUnit <= proxySettings.pixelError;
+}
+
+void HlodProxy::release()
+{
+	if (m_mesh != nullptr)
+	{
+		m_mesh->release();
+		m_mesh.reset();
+	}
+	m_renderer.reset();
+	if (m_atlas != 0)
+	{
+		glDeleteTextures(1, &m_atlas);
+		m_atlas = 0;
+	}
+}
+
+void HlodSystem::init(const std::shared_ptr<const TextureMaterial>& textureMaterial, const std::shared_ptr<const ConstantMaterial>& constantMaterial)
+{
+	m_textureMaterial = textureMaterial;
+	m_constantMaterial = constantMaterial;
+}
+
+void HlodSystem::update(SceneObject& sceneRoot, const SceneObject* selectedObject, double time)
+{
+	std::vector<BuildResult> results;
+	{
+		std::lock_guard<std::mutex> lock(m_pending->mutex);
+		results.swap(m_pending->results);
+	}
+	for (auto& result : results)
+	{
+		--m_buildsInProgress;
+		install(result);
+	}
+
+	const auto& settings = HlodProxy::settings();
+	if (settings.atlasCellSize != m_texturePixelsSize)
+	{
+		m_texturePixels.clear();
+		m_texturePixelsSize = settings.atlasCellSize;
+	}
+
+	if (!settings.enabled)
+	{
+		return;
+	}
+
+	if (sceneRoot.version() != m_scannedVersion && time - m_scanTime >= SCAN_INTERVAL)
+	{
+		scan(sceneRoot);
+		m_scannedVersion = sceneRoot.version();
+		m_scanTime = time;
+	}
+
+	for (auto& [root, proxy] : m_proxies)
+	{
+		// The selection is drawn by the renderer of the selected object
+		proxy->m_containsSelection = false;
+		for (const SceneObject* object = selectedObject != nullptr ? selectedObject->parent() : nullptr; object != nullptr; object = object->parent())
+		{
+			if (object == root)
+			{
+				proxy->m_containsSelection = true;
+				break;
+			}
+		}
+
+		const uint64_t version = root->version();
+		if (version != proxy->m_seenVersion)
+		{
+			proxy->m_seenVersion = version;
+			proxy->m_changeTime = time;
+		}
+		else if (version != proxy->m_builtVersion && !proxy->m_building && time - proxy->m_changeTime >= settings.staticDelay)
+		{
+			startBuild(*proxy);
+		}
+	}
+}
+
+void HlodSystem::clear()
+{
+	m_proxies.clear();
+	m_texturePixels.clear();
+	m_scannedVersion = ~uint64_t(0);
+	++m_version;
+}
+
+void HlodSystem::scan(SceneObject& sceneRoot)
+{
+	struct SubtreeInfo
+	{
+		std::size_t rendererCount = 0;
+		bool mergeable = true;
+	};
+	std::unordered_map<const SceneObject*, SubtreeInfo> infos;
+
+	// Renderers below each object (not counting the object itself, it draws itself whatever its proxy does)
+	auto count = [&](const SceneObject& object, auto& countRef) -> SubtreeInfo
+	{
+		SubtreeInfo info;
+		for (const auto* child : object.children())
+		{
+			const SubtreeInfo childInfo = countRef(*child, countRef);
+			info.rendererCount += childInfo.rendererCount;
+			info.mergeable = info.mergeable && childInfo.mergeable;
+			if (const auto* renderer = dynamic_cast<const MeshRenderer*>(child))
+			{
+				info.rendererCount += 1;
+				info.mergeable = info.mergeable && isMergeable(*renderer);
+			}
+		}
+		infos[&object] = info;
+		return info;
+	};
+	count(sceneRoot, count);
+
+	const std::size_t minRenderers = static_cast<std::size_t>(std::max(HlodProxy::settings().minRenderers, 1));
+	std::map<SceneObject*, std::size_t> wanted;
+	auto select = [&](SceneObject& object, std::size_t ancestorCount, auto& selectRef) -> void
+	{
+		const SubtreeInfo& info = infos[&object];
+		if (&object != &sceneRoot && info.mergeable && info.rendererCount >= minRenderers
+			&& (ancestorCount == 0 || info.rendererCount * NESTED_PROXY_RATIO <= ancestorCount))
+		{
+			wanted[&object] = info.rendererCount;
+			ancestorCount = info.rendererCount;
+		}
+		for (auto* child : object.children())
+			selectRef(*child, ancestorCount, selectRef);
+	};
+	select(sceneRoot, 0, select);
+
+	for (auto it = m_proxies.begin(); it != m_proxies.end(); )
+	{
+		if (wanted.count(it->first) == 0)
+		{
+			it = m_proxies.erase(it);
+			++m_version;
+		}
+		else
+			++it;
+	}
+	for (const auto& [object, rendererCount] : wanted)
+	{
+		if (m_proxies.count(object) == 0)
+		{
+			m_proxies[object] = std::make_unique<HlodProxy>(*object);
+			++m_version;
+		}
+	}
+}
+
+void HlodSystem::startBuild(HlodProxy& proxy)
+{
+	const auto& settings = HlodProxy::settings();
+	auto input = std::make_shared<BuildInput>();
+	input->root = &proxy.root();
+	input->version = proxy.root().version();
+	input->cellSize = std::max(settings.atlasCellSize, 4 * ATLAS_GUTTER);
+	const int cellContent = input->cellSize - 2 * ATLAS_GUTTER;
+
+	// The model matrices are the ones of the last frame: the subtree has been drawn without the proxy since it changed
+	const glm::mat4 toRoot = glm::inverse(proxy.root().modelMatrix());
+	std::map<std::pair<GLuint, uint32_t>, uint32_t> cellOf;
+	std::size_t rendererCount = 0;
+	auto gather = [&](const SceneObject& object, auto& gatherRef) -> void
+	{
+		for (const auto* child : object.children())
+		{
+			gatherRef(*child, gatherRef);
+
+			const auto* renderer = dynamic_cast<const MeshRenderer*>(child);
+			if (renderer == nullptr || !isMergeable(*renderer))
+				continue;
+
+			Leaf leaf;
+			leaf.mesh = renderer->mesh();
+			leaf.transform = toRoot * renderer->modelMatrix();
+			if (std::abs(glm::determinant(glm::mat3(leaf.transform))) < 1e-12f)
+				continue;  // Scaled down to nothing, like an object being deleted
+
+			// One cell per texture and diffuse color, the color is baked in the texels
+			const glm::vec3 diffuse = glm::clamp(glm::vec3(renderer->diffuseColor()), glm::vec3(0.0f), glm::vec3(1.0f));
+			const glm::uvec3 quantized = glm::uvec3(diffuse * 255.0f + 0.5f);
+			const auto key = std::make_pair(static_cast<GLuint>(renderer->textureIndex()), quantized.r << 16 | quantized.g << 8 | quantized.b);
+			const auto cell = cellOf.find(key);
+			if (cell != cellOf.end())
+			{
+				leaf.cell = cell->second;
+			}
+			else
+			{
+				leaf.cell = static_cast<uint32_t>(input->cells.size());
+				cellOf[key] = leaf.cell;
+				input->cells.push_back({ readTexture(key.first, cellContent), diffuse });
+			}
+			input->leaves.push_back(std::move(leaf));
+
+			input->ambiantColor += renderer->ambiantColor();
+			input->specularColor += renderer->specularColor();
+			input->specularTerm += renderer->specularTerm();
+			++rendererCount;
+		}
+	};
+	gather(proxy.root(), gather);
+
+	if (rendererCount > 0)
+	{
+		input->ambiantColor /= static_cast<float>(rendererCount);
+		input->specularColor /= static_cast<float>(rendererCount);
+		input->specularTerm /= static_cast<float>(rendererCount);
+	}
+
+	proxy.m_building = true;
+	++m_buildsInProgress;
+	ThreadPool::instance().enqueue([input, rendererCount, pending = m_pending]()
+	{
+		BuildResult result;
+		result.rendererCount = rendererCount;
+		build(*input, result);
+
+		std::lock_guard<std::mutex> lock(pending->mutex);
+		pending->results.push_back(std::move(result));
+	});
+}
+
+void HlodSystem::install(BuildResult& result)
+{
+	// Gone from the scene while it was built
+	const auto it = m_proxies.find(result.root);
+	if (it == m_proxies.end())
+		return;
+
+	HlodProxy& proxy = *it->second;
+	proxy.m_building = false;
+	if (result.version != proxy.root().version())
+		return;  // Edited in the meantime, built again once it stays still
+
+	proxy.release();
+	proxy.m_builtVersion = result.version;
+	++m_version;
+	if (result.indices.empty())
+		return;
+
+	glGenTextures(1, &proxy.m_atlas);
+	glBindTexture(GL_TEXTURE_2D, proxy.m_atlas);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, result.atlasWidth, result.atlasHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, result.atlas.data());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	MeshCache::MeshView meshView;
+	meshView.vertexData = result.vertexData.data();
+	meshView.vertexDataSize = result.vertexData.size() * sizeof(float);
+	meshView.vertexCount = result.vertexCount;
+	meshView.indices = result.indices.data();
+	meshView.indexCount = result.indices.size();
+	meshView.lodIndices = result.lods.indices.data();
+	meshView.lodIndexCount = result.lods.indices.size();
+	meshView.lods = result.lods.levels;
+	meshView.meshlets = result.meshlets.data();
+	meshView.meshletCount = result.meshlets.size();
+	meshView.boundsMin = result.boundsMin;
+	meshView.boundsMax = result.boundsMax;
+
+	proxy.m_mesh = std::make_shared<ObjectMesh>();
+	proxy.m_mesh->init(meshView);
+	proxy.m_mesh->initAttributes(m_textureMaterial);
+	proxy.m_mesh->initConstantAttributes(m_constantMaterial);
+
+	// Outside of the scene graph: only drawn by the proxy, never picked
+	proxy.m_renderer = std::make_unique<MeshRenderer>(proxy.m_mesh, m_textureMaterial, m_constantMaterial);
+	proxy.m_renderer->setName(proxy.root().getName() + " (proxy)");
+	proxy.m_renderer->mobility(MeshRenderer::Mobility::Movable);
+	proxy.m_renderer->textureIndex(proxy.m_atlas);
+	proxy.m_renderer->normalsTextureIndex(0);
+	MaterialRecord record;
+	record.ambiantColor = result.ambiantColor;
+	record.diffuseColor = glm::vec4(1.0f);
+	record.specularColor = result.specularColor;
+	record.parameters.x = result.specularTerm;
+	proxy.m_renderer->appearance(record);
+
+	proxy.m_rendererCount = result.rendererCount;
+	proxy.m_texelError = result.texelError;
+	proxy.m_boundsCenter = 0.5f * (result.boundsMin + result.boundsMax);
+	proxy.m_boundsRadius = 0.5f * glm::length(result.boundsMax - result.boundsMin);
+}
+
+std::shared_ptr<const std::vector<unsigned char>> HlodSystem::readTexture(GLuint texture, int size)
+{
+	const auto cached = m_texturePixels.find(texture);
+	if (cached != m_texturePixels.end())
+		return cached->second;
+
+	auto pixels = std::make_shared<std::vector<unsigned char>>(static_cast<std::size_t>(size) * size * 4, 255);
+	if (texture != 0)
+	{
+		// The smallest mipmap still larger than the cell, read back uncompressed
+		glBindTexture(GL_TEXTURE_2D, texture);
+		GLint level = 0;
+		GLint width = 0;
+		GLint height = 0;
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+		for (;;)
+		{
+			GLint nextWidth = 0;
+			GLint nextHeight = 0;
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, level + 1, GL_TEXTURE_WIDTH, &nextWidth);
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, level + 1, GL_TEXTURE_HEIGHT, &nextHeight);
+			if (nextWidth < size || nextHeight < size)
+				break;
+			++level;
+			width = nextWidth;
+			height = nextHeight;
+		}
+
+		if (width > 0 && height > 0)
+		{
+			std::vector<unsigned char> image(static_cast<std::size_t>(width) * height * 4);
+			glPixelStorei(GL_PACK_ALIGNMENT, 1);
+			glGetTexImage(GL_TEXTURE_2D, level, GL_RGBA, GL_UNSIGNED_BYTE, image.data());
+			glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+			// Average of the texels under each texel of the cell
+			for (int y = 0; y < size; ++y)
+			{
+				const int y0 = y * height / size;
+				const int y1 = std::max((y + 1) * height / size, y0 + 1);
+				for (int x = 0; x < size; ++x)
+				{
+					const int x0 = x * width / size;
+					const int x1 = std::max((x + 1) * width / size, x0 + 1);
+					unsigned int sum[4] = {};
+					for (int sy = y0; sy < y1; ++sy)
+					{
+						for (int sx = x0; sx < x1; ++sx)
+						{
+							for (int c = 0; c < 4; ++c)
+								sum[c] += image[(static_cast<std::size_t>(sy) * width + sx) * 4 + c];
+						}
+					}
+					const unsigned int area = static_cast<unsigned int>((y1 - y0) * (x1 - x0));
+					for (int c = 0; c < 4; ++c)
+						(*pixels)[(static_cast<std::size_t>(y) * size + x) * 4 + c] = static_cast<unsigned char>(sum[c] / area);
+				}
+			}
+		}
+	}
+
+	m_texturePixels[texture] = pixels;
+	return pixels;
+}
+
+void HlodSystem::build(const BuildInput& input, BuildResult& result)
+{
+	result.root = input.root;
+	result.version = input.version;
+	result.ambiantColor = input.ambiantColor;
+	result.specularColor = input.specularColor;
+	result.specularTerm = input.specularTerm;
+
+	const int cellContent = input.cellSize - 2 * ATLAS_GUTTER;
+	const int columns = std::max(static_cast<int>(std::ceil(std::sqrt(static_cast<double>(input.cells.size())))), 1);
+	const int rows = std::max((static_cast<int>(input.cells.size()) + columns - 1) / columns, 1);
+
+	// Atlas: the cells in a grid, each one tinted by its diffuse color and surrounded by copies of its edges
+	result.atlasWidth = columns * input.cellSize;
+	result.atlasHeight = rows * input.cellSize;
+	result.atlas.assign(static_cast<std::size_t>(result.atlasWidth) * result.atlasHeight * 4, 255);
+	for (std::size_t c = 0; c < input.cells.size(); ++c)
+	{
+		const auto& cell = input.cells[c];
+		const int originX = static_cast<int>(c % columns) * input.cellSize;
+		const int originY = static_cast<int>(c / columns) * input.cellSize;
+		for (int y = 0; y < input.cellSize; ++y)
+		{
+			const int sourceY = std::clamp(y - ATLAS_GUTTER, 0, cellContent - 1);
+			for (int x = 0; x < input.cellSize; ++x)
+			{
+				const int sourceX = std::clamp(x - ATLAS_GUTTER, 0, cellContent - 1);
+				const unsigned char* source = cell.pixels->data() + (static_cast<std::size_t>(sourceY) * cellContent + sourceX) * 4;
+				unsigned char* target = result.atlas.data() + (static_cast<std::size_t>(originY + y) * result.atlasWidth + originX + x) * 4;
+				for (int k = 0; k < 3; ++k)
+					target[k] = static_cast<unsigned char>(source[k] * cell.tint[k] + 0.5f);
+				target[3] = source[3];
+			}
+		}
+	}
+
+	// Every leaf in the space of the root, the uvs moved into the cell of the leaf
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> uvs;
+	std::vector<uint32_t> indices;
+	glm::vec3 boundsMin(std::numeric_limits<float>::max());
+	glm::vec3 boundsMax(std::numeric_limits<float>::lowest());
+	for (const auto& leaf : input.leaves)
+	{
+		const auto& leafPositions = leaf.mesh->vertices();
+		const auto& leafNormals = leaf.mesh->normals();
+		const auto& leafUVs = leaf.mesh->uvs();
+		const auto& leafIndices = leaf.mesh->indices();
+		const std::size_t vertexCount = leafPositions.size() / 3;
+		const auto firstVertex = static_cast<uint32_t>(positions.size());
+
+		const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(leaf.transform)));
+		const glm::vec2 cellOrigin(static_cast<float>((leaf.cell % columns) * input.cellSize + ATLAS_GUTTER), static_cast<float>((leaf.cell / columns) * input.cellSize + ATLAS_GUTTER));
+		const glm::vec2 atlasSize(static_cast<float>(result.atlasWidth), static_cast<float>(result.atlasHeight));
+
+		glm::vec3 leafMin(std::numeric_limits<float>::max());
+		glm::vec3 leafMax(std::numeric_limits<float>::lowest());
+		for (std::size_t v = 0; v < vertexCount; ++v)
+		{
+			const glm::vec3 position = glm::vec3(leaf.transform * glm::vec4(leafPositions[3 * v], leafPositions[3 * v + 1], leafPositions[3 * v + 2], 1.0f));
+			const glm::vec3 normal = normalMatrix * glm::vec3(leafNormals[3 * v], leafNormals[3 * v + 1], leafNormals[3 * v + 2]);
+			const glm::vec2 uv = glm::clamp(glm::vec2(leafUVs[2 * v], leafUVs[2 * v + 1]), glm::vec2(0.0f), glm::vec2(1.0f));
+			positions.push_back(position);
+			normals.push_back(glm::length(normal) > 0.0f ? glm::normalize(normal) : normal);
+			uvs.push_back((cellOrigin + uv * static_cast<float>(cellContent)) / atlasSize);
+			leafMin = glm::min(leafMin, position);
+			leafMax = glm::max(leafMax, position);
+		}
+		for (const GLuint index : leafIndices)
+		{
+			if (index < vertexCount)
+				indices.push_back(firstVertex + index);
+		}
+		indices.resize(indices.size() / 3 * 3);
+
+		// A texel of the cell covers at most the size of the leaf divided by the texels of the cell
+		if (vertexCount > 0)
+		{
+			result.texelError = std::max(result.texelError, glm::length(leafMax - leafMin) / static_cast<float>(cellContent));
+			boundsMin = glm::min(boundsMin, leafMin);
+			boundsMax = glm::max(boundsMax, leafMax);
+		}
+	}
+	if (positions.empty())
+		return;
+	result.boundsMin = boundsMin;
+	result.boundsMax = boundsMax;
+
+	// Faces against each other with opposite normals (two cubes side by side) can never be seen
+	const float quantum = std::max(glm::length(boundsMax - boundsMin), 1.0f) * 1e-5f;
+	auto quantize = [&](uint32_t vertex) { return glm::ivec3(glm::round(positions[vertex] / quantum)); };
+	// From the normals of the vertices: the winding of the meshes is not consistent, faces are never culled
+	auto triangleNormal = [&](uint32_t triangle)
+	{
+		const glm::vec3 normal = normals[indices[3 * triangle]] + normals[indices[3 * triangle + 1]] + normals[indices[3 * triangle + 2]];
+		return glm::length(normal) > 0.0f ? glm::normalize(normal) : normal;
+	};
+
+	std::vector<Face> faces;
+	const auto triangleCount = static_cast<uint32_t>(indices.size() / 3);
+	for (uint32_t t = 0; t < triangleCount; )
+	{
+		Face face;
+		face.firstTriangle = t;
+		face.normal = triangleNormal(t);
+		for (int k = 0; k < 3; ++k)
+			face.points[k] = quantize(indices[3 * t + k]);
+		face.pointCount = 3;
+		face.triangleCount = 1;
+
+		// The next triangle completes a quad when it shares an edge and the plane
+		if (t + 1 < triangleCount && glm::dot(triangleNormal(t + 1), face.normal) > 0.999f)
+		{
+			std::array<glm::ivec3, 3> next;
+			int shared = 0;
+			int extra = -1;
+			for (int k = 0; k < 3; ++k)
+			{
+				next[k] = quantize(indices[3 * (t + 1) + k]);
+				if (std::find(face.points.begin(), face.points.begin() + 3, next[k]) != face.points.begin() + 3)
+					++shared;
+				else
+					extra = k;
+			}
+			if (shared == 2 && extra >= 0)
+			{
+				face.points[3] = next[extra];
+				face.pointCount = 4;
+				face.triangleCount = 2;
+			}
+		}
+
+		std::sort(face.points.begin(), face.points.begin() + face.pointCount, pointLess);
+		t += face.triangleCount;
+		faces.push_back(face);
+	}
+	std::sort(faces.begin(), faces.end(), faceLess);
+
+	std::vector<char> hidden(triangleCount, 0);
+	for (std::size_t i = 0; i < faces.size(); )
+	{
+		std::size_t end = i + 1;
+		while (end < faces.size() && sameFace(faces[i], faces[end]))
+			++end;
+		if (end - i == 2 && glm::dot(faces[i].normal, faces[i + 1].normal) < -0.999f)
+		{
+			for (const Face* face : { &faces[i], &faces[i + 1] })
+				std::fill(hidden.begin() + face->firstTriangle, hidden.begin() + face->firstTriangle + face->triangleCount, 1);
+		}
+		i = end;
+	}
+
+	result.indices.reserve(indices.size());
+	for (uint32_t t = 0; t < triangleCount; ++t)
+	{
+		if (!hidden[t])
+			result.indices.insert(result.indices.end(), indices.begin() + 3 * t, indices.begin() + 3 * t + 3);
+	}
+	if (result.indices.empty())
+		return;
+
+	// Laid out like the mesh cache: positions, then uvs, then normals
+	result.vertexCount = positions.size();
+	result.vertexData.resize(result.vertexCount * 8);
+	float* outPositions = result.vertexData.data();
+	float* outUVs = outPositions + 3 * result.vertexCount;
+	float* outNormals = outPositions + 5 * result.vertexCount;
+	for (std::size_t v = 0; v < result.vertexCount; ++v)
+	{
+		std::copy(&positions[v][0], &positions[v][0] + 3, outPositions + 3 * v);
+		std::copy(&uvs[v][0], &uvs[v][0] + 2, outUVs + 2 * v);
+		std::copy(&normals[v][0], &normals[v][0] + 3, outNormals + 3 * v);
+	}
+
+	MeshSimplifier::VertexInput vertexInput;
+	vertexInput.positions = { reinterpret_cast<const unsigned char*>(outPositions), sizeof(float) * 3, sizeof(float) * 3 };
+	vertexInput.attributes[0] = { reinterpret_cast<const unsigned char*>(outNormals), sizeof(float) * 3, sizeof(float) * 3 };
+	vertexInput.attributes[1] = { reinterpret_cast<const unsigned char*>(outUVs), sizeof(float) * 2, sizeof(float) * 2 };
+	vertexInput.vertexCount = result.vertexCount;
+	result.lods = MeshSimplifier::buildLodChain(vertexInput, result.indices.data(), result.indices.size());
+
+	auto meshletSet = Meshlets::build(vertexInput.positions, vertexInput.vertexCount, result.indices.data(), result.indices.size());
+	if (!meshletSet.meshlets.empty())
+	{
+		result.indices.swap(meshletSet.indices);
+		result.meshlets = std::move(meshletSet.meshlets);
+	}
+}
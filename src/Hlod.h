@@ -0,0 +1,214 @@
+#pragma once
+#ifndef HLOD_H
+#define HLOD_H
+
+/**
+ * @file Hlod.h
+ *
+ * @brief Hierarchical levels of detail: merged proxies drawn in place of large static subtrees.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include <glad/glad.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Meshlets.h"
+#include "MeshSimplifier.h"
+
+class Camera;
+class ConstantMaterial;
+class Mesh;
+class MeshRenderer;
+class ObjectMesh;
+class SceneObject;
+class TextureMaterial;
+
+/**
+ * The meshes under a scene object merged in one mesh, in the space of that object, with an atlas of their textures.
+ * Drawn in place of the children while the subtree has not changed since the proxy was built and
+ * the texels of the atlas are smaller than the allowed error on the screen.
+ */
+class HlodProxy
+{
+public:
+	struct Settings
+	{
+		bool enabled = true;
+		float pixelError = 2.0f;      // Largest size of a texel of the atlas on the screen, in pixels
+		float staticDelay = 1.0f;     // Seconds without a change before a subtree is baked
+		int minRenderers = 8;         // Smaller subtrees are drawn as they are
+		int atlasCellSize = 64;       // Texels per side for each texture of the subtree, gutters included
+	};
+
+	// Reset by the window every frame
+	struct Statistics
+	{
+		std::size_t proxiesDrawn = 0;
+		std::size_t renderersReplaced = 0;
+	};
+
+	static Settings& settings();
+	static Statistics& statistics();
+
+	explicit HlodProxy(SceneObject& root);
+	~HlodProxy();
+	HlodProxy(const HlodProxy&) = delete;
+	HlodProxy& operator=(const HlodProxy&) = delete;
+
+	/**
+	 * Called by the root instead of rendering its children. False when the children have to be drawn.
+	 */
+	bool render(const Camera& camera, const glm::mat4& modelMatrix);
+
+	/**
+	 * Whether render() would draw the proxy, without drawing it.
+	 */
+	bool drawn(const Camera& camera, const glm::mat4& modelMatrix) const;
+
+	inline SceneObject& root() const { return m_root; }
+	inline bool isReady() const { return m_renderer != nullptr; }
+	inline std::size_t rendererCount() const { return m_rendererCount; }
+
+private:
+	friend class HlodSystem;
+
+	void release();
+
+private:
+	SceneObject& m_root;
+
+	std::shared_ptr<ObjectMesh> m_mesh;
+	std::unique_ptr<MeshRenderer> m_renderer;
+	GLuint m_atlas = 0;
+	std::size_t m_rendererCount = 0;
+	float m_texelError = 0.0f;
+	glm::vec3 m_boundsCenter = glm::vec3(0.0f);
+	float m_boundsRadius = 0.0f;
+
+	uint64_t m_builtVersion = ~uint64_t(0);   // Version of the subtree the proxy shows
+	uint64_t m_seenVersion = 0;      // Last version seen, the subtree is static when it stays the same
+	double m_changeTime = 0.0;
+	bool m_building = false;
+	bool m_containsSelection = false;
+};
+
+/**
+ * Finds the subtrees worth a proxy and keeps their proxies up to date. The baking runs on the thread pool,
+ * only the reading of the textures and the uploads are done on the GL thread.
+ */
+class HlodSystem
+{
+public:
+	void init(const std::shared_ptr<const TextureMaterial>& textureMaterial, const std::shared_ptr<const ConstantMaterial>& constantMaterial);
+
+	/**
+	 * Once per frame, before the scene is rendered.
+	 */
+	void update(SceneObject& sceneRoot, const SceneObject* selectedObject, double time);
+
+	/**
+	 * Delete the proxies while the context and the scene objects are still alive. Builds still running are dropped.
+	 */
+	void clear();
+
+	inline std::size_t proxyCount() const { return m_proxies.size(); }
+	inline std::size_t buildsInProgress() const { return m_buildsInProgress; }
+
+	// Changes whenever a proxy is added, removed or built (see RenderBundle)
+	inline uint64_t version() const { return m_version; }
+
+private:
+	struct Leaf
+	{
+		std::shared_ptr<const Mesh> mesh;       // Read on the thread pool, the geometry in memory never changes after init
+		glm::mat4 transform = glm::mat4(1.0f);   // From the leaf to the root of the proxy
+		uint32_t cell = 0;
+	};
+
+	struct Cell
+	{
+		std::shared_ptr<const std::vector<unsigned char>> pixels;   // RGBA, the inside of the cell (without gutters)
+		glm::vec3 tint = glm::vec3(1.0f);
+	};
+
+	struct BuildInput
+	{
+		SceneObject* root = nullptr;
+		uint64_t version = 0;
+		std::vector<Leaf> leaves;
+		std::vector<Cell> cells;
+		int cellSize = 0;
+
+		// Averages of the renderers, the diffuse colors are baked in the atlas
+		glm::vec4 ambiantColor = glm::vec4(0.0f);
+		glm::vec4 specularColor = glm::vec4(0.0f);
+		float specularTerm = 0.0f;
+	};
+
+	struct BuildResult
+	{
+		SceneObject* root = nullptr;
+		uint64_t version = 0;
+		std::size_t rendererCount = 0;
+
+		std::vector<float> vertexData;   // Laid out like a mesh of the cache
+		std::vector<uint32_t> indices;
+		std::size_t vertexCount = 0;
+		MeshSimplifier::LodChain lods;
+		std::vector<Meshlets::Meshlet> meshlets;
+		glm::vec3 boundsMin = glm::vec3(0.0f);
+		glm::vec3 boundsMax = glm::vec3(0.0f);
+		float texelError = 0.0f;
+
+		std::vector<unsigned char> atlas;
+		int atlasWidth = 0;
+		int atlasHeight = 0;
+
+		glm::vec4 ambiantColor = glm::vec4(0.0f);
+		glm::vec4 specularColor = glm::vec4(0.0f);
+		float specularTerm = 0.0f;
+	};
+
+	struct PendingResults
+	{
+		std::mutex mutex;
+		std::vector<BuildResult> results;
+	};
+
+	void scan(SceneObject& sceneRoot);
+	void startBuild(HlodProxy& proxy);
+	void install(BuildResult& result);
+	std::shared_ptr<const std::vector<unsigned char>> readTexture(GLuint texture, int size);
+
+	static void build(const BuildInput& input, BuildResult& result);
+
+private:
+	std::shared_ptr<const TextureMaterial> m_textureMaterial;
+	std::shared_ptr<const ConstantMaterial> m_constantMaterial;
+
+	std::map<SceneObject*, std::unique_ptr<HlodProxy>> m_proxies;
+	std::shared_ptr<PendingResults> m_pending = std::make_shared<PendingResults>();
+	std::size_t m_buildsInProgress = 0;
+	uint64_t m_version = 0;
+
+	uint64_t m_scannedVersion = ~uint64_t(0);
+	double m_scanTime = -1.0;
+
+	// The textures only change on a reload, they are read back once per cell size
+	std::map<GLuint, std::shared_ptr<const std::vector<unsigned char>>> m_texturePixels;
+	int m_texturePixelsSize = 0;
+};
+
+#endif
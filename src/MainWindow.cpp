@@ -17,18 +17,30 @@
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
 
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
 #include <iostream>
+#include <map>
+#include <random>
 #include <thread>
 
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/euler_angles.hpp>
+#include <glm/gtc/constants.hpp>
 
+#include "AssetPack.h"
+#include "GLTFLoader.h"
+#include "MeshCache.h"
 #include "TextureMaterial.h"
 #include "SkyboxMaterial.h"
 #include "ConstantMaterial.h"
 #include "CubeMesh.h"
 #include "ObjectMesh.h"
 #include "MeshRenderer.h"
+#include "TextureLoader.h"
+#include "ThreadPool.h"
 
 inline uint32_t getIntFromRGBA(const glm::uvec4& rgba)
 {
@@ -61,14 +73,20 @@ MainWindow::~MainWindow()
 	{
 		delete sceneObject;
 	}
-
-	m_screwdriverLoader.unload();
 }
 
 int MainWindow::initialisation()
 {
+	const auto startTime = std::chrono::steady_clock::now();
 	const char* glslVersion = "#version 430 core";
 
+	// Mapped first so the OS reads it ahead while the window and the context are created
+	const std::string assetPackPath = ASSET_PACK_PATH;
+	if (!AssetPack::mount(assetPackPath))
+	{
+		std::cout << "No asset pack at " << assetPackPath << ", reading the loose files" << std::endl;
+	}
+
 	glfwInit();
 
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
@@ -96,6 +114,8 @@ int MainWindow::initialisation()
 		return 2;
 	}
 
+	ShaderProgram::enableParallelCompile();
+
 	ImGui::CreateContext();
 	ImGuiIO& io = ImGui::GetIO(); (void)io;
 	io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;
@@ -105,15 +125,19 @@ int MainWindow::initialisation()
 	ImGui_ImplGlfw_InitForOpenGL(m_window, true);
 	ImGui_ImplOpenGL3_Init(glslVersion);
 
-	if (!loadObjectTextures())
-	{
-		return 4;
-	}
+	// The images are decoded on the thread pool while the shaders compile, then uploaded as they arrive
+	TextureLoader textureLoader;
+	queueObjectTextures(textureLoader);
 
-	const auto glError = initializeGL();
+	const auto glError = initializeGL(textureLoader);
 	if (glError != 0)
 		return glError;
 
+	if (!textureLoader.uploadAll())
+	{
+		return 4;
+	}
+
 	if (!loadScrewdriver())
 	{
 		return 4;
@@ -122,6 +146,13 @@ int MainWindow::initialisation()
 	initializeSelectionPreviewObject();
 	initializeSceneGraph();
 
+	m_shaderReloader.init(m_window);
+	m_shaderReloader.addMaterial(m_skyDomeMaterial);
+	m_shaderReloader.addMaterial(m_textureMaterial);
+	m_shaderReloader.addMaterial(m_constantMaterial);
+
+	const std::chrono::duration<double, std::milli> startupDuration = std::chrono::steady_clock::now() - startTime;
+	std::cout << "Startup took " << startupDuration.count() << " ms" << std::endl;
 
 	return 0;
 }
@@ -148,25 +179,35 @@ void MainWindow::initializeCallback()
 
 }
 
-int MainWindow::initializeGL()
+int MainWindow::initializeGL(TextureLoader& textureLoader)
 {
     m_skyDomeMaterial = std::make_shared<SkyboxMaterial>();
+    m_skyDomeMaterial->queueTextures(textureLoader);
+	m_textureMaterial = std::make_shared<TextureMaterial>();
+	m_constantMaterial = std::make_shared<ConstantMaterial>();
+
+	// Issue every compilation before waiting on any of them so the driver can build them in parallel
+	m_skyDomeMaterial->compile();
+	m_textureMaterial->compile();
+	m_constantMaterial->compile();
+
     if (!m_skyDomeMaterial->init()){
         return 3;
     }
 
-	m_textureMaterial = std::make_shared<TextureMaterial>();
 	if (!m_textureMaterial->init())
 	{
 		return 3;
 	}
 
-	m_constantMaterial = std::make_shared<ConstantMaterial>();
 	if (!m_constantMaterial->init())
 	{
 		return 3;
 	}
 
+	m_hlodSystem.init(m_textureMaterial, m_constantMaterial);
+	m_objectData.init();
+
 	m_cubeMesh = std::make_shared<CubeMesh>();
 	m_cubeMesh->init();
 	m_cubeMesh->initAttributes(m_textureMaterial);
@@ -207,6 +248,7 @@ void MainWindow::initializeSceneGraph()
 
 			auto* newRenderer = createNewMeshRenderer(m_environmentSceneObject);
 			newRenderer->transform().translation(glm::vec3(posX + evenHorizontalAlign, 0, posZ + evenVerticalAlign));
+			newRenderer->mobility(MeshRenderer::Mobility::Static);
 		}
 	}
 }
@@ -217,108 +259,278 @@ void MainWindow::initializeSelectionPreviewObject()
 	selectionObject->selectedColor(glm::vec4(0.0f, 1.0f, 0.0f, 1.0f));
 	selectionObject->canBePicked(false);
 	selectionObject->select();
+	selectionObject->mobility(MeshRenderer::Mobility::Movable);
 
 	m_selectionPreviewObject = selectionObject;
 }
 
-bool MainWindow::loadObjectTextures()
+void MainWindow::queueObjectTextures(TextureLoader& textureLoader)
 {
 	const std::string assetsDir = ASSETS_DIR;
 	for (auto i = 0; i < NUMBER_OF_OBJECT_TEXTURES; ++i)
 	{
-		std::string imagePath = assetsDir + OBJECT_TEXTURE_PATH[i];
-		if (!loadTexture(imagePath, m_objectTextureIDs[i], GL_CLAMP_TO_BORDER, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR))
-		{
-			std::cerr << "Unable to load texture: " << imagePath << std::endl;
-			return false;
-		}
-		else
-		{
-			std::cout << "Load texture " << OBJECT_TEXTURE_NAME[i] << " -- OpenGL ID: " << m_objectTextureIDs[i] << "\n";
-		}
+		textureLoader.add(assetsDir + OBJECT_TEXTURE_PATH[i], m_objectTextureIDs[i], GL_CLAMP_TO_BORDER, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
+		std::cout << "Load texture " << OBJECT_TEXTURE_NAME[i] << " -- OpenGL ID: " << m_objectTextureIDs[i] << "\n";
 
-		std::string normalsImagePath = assetsDir + OBJECT_TEXTURE_NORMALS_PATH[i];
-		if (!loadTexture(normalsImagePath, m_objectNormalsTextureIDs[i], GL_CLAMP_TO_BORDER, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR))
-		{
-			std::cerr << "Unable to load texture: " << normalsImagePath << std::endl;
-			return false;
-		}
-		else
-		{
-			std::cout << "Load normals texture " << OBJECT_TEXTURE_NAME[i] << " -- OpenGL ID: " << m_objectNormalsTextureIDs[i] << "\n";
-		}
+		textureLoader.add(assetsDir + OBJECT_TEXTURE_NORMALS_PATH[i], m_objectNormalsTextureIDs[i], GL_CLAMP_TO_BORDER, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
+		std::cout << "Load normals texture " << OBJECT_TEXTURE_NAME[i] << " -- OpenGL ID: " << m_objectNormalsTextureIDs[i] << "\n";
 	}
-
-	return true;
 }
 
-bool MainWindow::loadTexture(const std::string& path, unsigned int& textureID, GLint uvMode, GLint minMode, GLint magMode)
+bool MainWindow::loadScrewdriver()
 {
-	glGenTextures(1, &textureID);
+	const std::string assetsDir = ASSETS_DIR;
+	const std::string modelPath = assetsDir + "tournevis.obj";
 
-	// Ask the library to flip the image horizontally
-	// This is necessary as TexImage2D assume "The first element corresponds to the lower left corner of the texture image"
-	// whereas stb_image load the image such "the first pixel pointed to is top-left-most in the image"
-	stbi_set_flip_vertically_on_load(true);
+	// Only mapped while the buffers are created, the data then lives on the GPU
+	MeshCache::Cache screwdriverCache;
+	if (!screwdriverCache.load(modelPath))
+	{
+		std::cout << "Failed to load screwdriver file " << modelPath << std::endl;
+		return false;
+	}
 
-	int width, height, nrComponents;
-	unsigned char* data = stbi_load(path.c_str(), &width, &height, &nrComponents, STBI_rgb_alpha);
-	if (data)
+	const auto currentTextureIndex = m_currentObjectTextureIndex;
+	m_currentObjectTextureIndex = NUMBER_OF_OBJECT_TEXTURES - 1; // No material
+
+	for (const auto& mesh : screwdriverCache.meshes())
 	{
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-		if (minMode == GL_LINEAR_MIPMAP_LINEAR) {
-			glGenerateMipmap(GL_TEXTURE_2D);
-		}
+		auto objectMesh = std::make_shared<ObjectMesh>();
+		objectMesh->init(mesh);
+		objectMesh->initAttributes(m_textureMaterial);
+		objectMesh->initConstantAttributes(m_constantMaterial);
+
+		const auto meshRenderer = createNewMeshRenderer(m_screwDriverSceneObject, objectMesh, m_textureMaterial);
+		meshRenderer->setName(mesh.name);
+		meshRenderer->canBePicked(false);
+		meshRenderer->setColors(screwdriverCache.materials()[mesh.materialID]);
+	}
+
+	m_currentObjectTextureIndex = currentTextureIndex;
 
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, uvMode);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, uvMode);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minMode);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magMode);
+	return true;
+}
 
-		stbi_image_free(data);
+void MainWindow::startImport()
+{
+	m_importer.cancel();
 
-		std::cout << "Texture loaded at path: " << path << std::endl;
+	const std::string path = m_importPath;
+	if (std::filesystem::path(path).extension() == ".glb")
+	{
+		if (!loadGltf(path))
+			std::cout << "Failed to import " << path << std::endl;
+		return;
 	}
-	else
+
+	if (!m_importer.start(path, static_cast<std::size_t>(std::max(m_importBudgetMB, 0)) << 20))
 	{
-		std::cout << "Texture failed to load at path: " << path << std::endl;
-		stbi_image_free(data);
+		std::cout << "Failed to start the import of " << path << std::endl;
+		return;
+	}
+
+	auto* importSceneObject = new SceneObject(m_root);
+	importSceneObject->setName(AssetPack::assetName(path));
+	importSceneObject->canBePicked(false);
+	m_heapSceneObjects.push_back(importSceneObject);
+	m_importSceneObject = importSceneObject;
+}
+
+bool MainWindow::loadGltf(const std::string& path)
+{
+	// Mapped until the binary chunk is uploaded and the levels of detail are built
+	const auto loaderPointer = std::make_shared<GLTFLoader::Loader>();
+	if (!loaderPointer->loadFile(path))
 		return false;
+	const auto& loader = *loaderPointer;
+
+	const auto startTime = glfwGetTime();
+
+	// The whole binary chunk goes to one buffer, every primitive reads its accessors from there and owns a share of it
+	const auto binaryBuffer = ObjectMesh::uploadSharedBuffer(loader.binaryData(), loader.binarySize());
+
+	// The primitives of a mesh are shared by all the nodes using it
+	std::vector<std::vector<std::shared_ptr<ObjectMesh>>> meshes(loader.getMeshes().size());
+	for (std::size_t i = 0; i < meshes.size(); ++i)
+	{
+		for (const auto& primitive : loader.getMeshes()[i].primitives)
+		{
+			auto objectMesh = std::make_shared<ObjectMesh>();
+			objectMesh->init(primitive, binaryBuffer);
+			objectMesh->singleSided(primitive.material < 0 || !loader.getMaterials()[primitive.material].doubleSided);
+			objectMesh->initAttributes(m_textureMaterial);
+			objectMesh->initConstantAttributes(m_constantMaterial);
+			meshes[i].push_back(objectMesh);
+		}
 	}
 
+	auto* importSceneObject = new SceneObject(m_root);
+	importSceneObject->setName(AssetPack::assetName(path));
+	m_heapSceneObjects.push_back(importSceneObject);
+
+	const auto currentTextureIndex = m_currentObjectTextureIndex;
+	m_currentObjectTextureIndex = NUMBER_OF_OBJECT_TEXTURES - 1; // No material
+
+	const GLTFLoader::Material defaultMaterial;
+	const auto& nodes = loader.getNodes();
+	std::vector<bool> visited(nodes.size(), false);
+	auto addNode = [&](int nodeIndex, SceneObject& parent, auto& addNodeRef) -> void
+	{
+		// A node can only have one parent, the ones reached again are skipped
+		if (visited[nodeIndex])
+			return;
+		visited[nodeIndex] = true;
+
+		const auto& node = nodes[nodeIndex];
+		auto* sceneObject = new SceneObject(parent);
+		m_heapSceneObjects.push_back(sceneObject);
+		sceneObject->setName(node.name.empty() ? "Node " + std::to_string(nodeIndex) : node.name);
+		sceneObject->transform().translation(node.translation);
+		sceneObject->transform().orientation(node.rotation);
+		sceneObject->transform().scale(node.scale);
+		sceneObject->dirtyGlobal();
+
+		if (node.mesh >= 0)
+		{
+			const auto& mesh = loader.getMeshes()[node.mesh];
+			for (std::size_t i = 0; i < mesh.primitives.size(); ++i)
+			{
+				const int materialIndex = mesh.primitives[i].material;
+				const auto meshRenderer = createNewMeshRenderer(*sceneObject, meshes[node.mesh][i], m_textureMaterial);
+				meshRenderer->setName(mesh.name.empty() ? sceneObject->getName() : mesh.name);
+				meshRenderer->setColors(materialIndex >= 0 ? loader.getMaterials()[materialIndex] : defaultMaterial);
+			}
+		}
+
+		for (const int child : node.children)
+			addNodeRef(child, *sceneObject, addNodeRef);
+	};
+	for (const int rootNode : loader.getRootNodes())
+		addNode(rootNode, *importSceneObject, addNode);
+
+	m_currentObjectTextureIndex = currentTextureIndex;
+
+	// Simplifying takes much longer than uploading, the scene is shown at full detail and unculled until the results arrive
+	queueGltfMeshData(loaderPointer, meshes);
+
+	std::cout << "Uploaded " << path << " in " << (glfwGetTime() - startTime) * 1000.0 << " ms" << std::endl;
 	return true;
 }
 
-bool MainWindow::loadScrewdriver()
+void MainWindow::queueGltfMeshData(const std::shared_ptr<const GLTFLoader::Loader>& loader, const std::vector<std::vector<std::shared_ptr<ObjectMesh>>>& meshes)
 {
-	const std::string assetsDir = ASSETS_DIR;
-	const std::string modelPath = assetsDir + "tournevis.obj";
-	if (!m_screwdriverLoader.loadFile(modelPath))
+	// Reordering indices shared by several primitives would break the meshlets of the others
+	std::map<std::size_t, int> indexUsers;
+	for (const auto& mesh : loader->getMeshes())
 	{
-		std::cout << "Failed to load screwdriver file " << modelPath << std::endl;
-		return false;
+		for (const auto& primitive : mesh.primitives)
+		{
+			if (!primitive.indicesInExtraData)
+				indexUsers[primitive.indexOffset] += 1;
+		}
 	}
 
+	for (std::size_t meshIndex = 0; meshIndex < meshes.size(); ++meshIndex)
+	{
+		const auto& primitives = loader->getMeshes()[meshIndex].primitives;
+		for (std::size_t i = 0; i < primitives.size(); ++i)
+		{
+			const auto& primitive = primitives[i];
+			if (primitive.position.componentType != GL_FLOAT || primitive.indexCount / 3 < MeshSimplifier::MIN_LOD_TRIANGLES)
+				continue;
+
+			const bool sharedIndices = !primitive.indicesInExtraData && indexUsers[primitive.indexOffset] > 1;
+			std::weak_ptr<ObjectMesh> objectMesh = meshes[meshIndex][i];
+			ThreadPool::instance().enqueue([loader, &primitive, objectMesh, sharedIndices, pendingMeshData = m_pendingMeshData]()
+			{
+				auto source = [&](const GLTFLoader::Attribute& attribute)
+				{
+					MeshSimplifier::AttributeStream stream;
+					if (!attribute.present())
+						return stream;
+					stream.data = (attribute.inExtraData ? primitive.extraData.data() : loader->binaryData()) + attribute.offset;
+					stream.stride = attribute.stride;
+					const std::size_t componentSize = attribute.componentType == GL_FLOAT ? 4 : (attribute.componentType == GL_UNSIGNED_SHORT || attribute.componentType == GL_SHORT ? 2 : 1);
+					stream.size = attribute.componentCount * componentSize;
+					return stream;
+				};
+
+				MeshSimplifier::VertexInput input;
+				input.positions = source(primitive.position);
+				input.attributes[0] = source(primitive.normal);
+				input.attributes[1] = source(primitive.uv);
+				input.vertexCount = primitive.vertexCount;
+
+				// The simplifier works on 32-bit indices whatever the file uses
+				const unsigned char* indexData = (primitive.indicesInExtraData ? primitive.extraData.data() : loader->binaryData()) + primitive.indexOffset;
+				std::vector<uint32_t> indices(primitive.indexCount);
+				for (std::size_t j = 0; j < indices.size(); ++j)
+				{
+					switch (primitive.indexType)
+					{
+					case GL_UNSIGNED_BYTE: indices[j] = indexData[j]; break;
+					case GL_UNSIGNED_SHORT: indices[j] = reinterpret_cast<const uint16_t*>(indexData)[j]; break;
+					default: indices[j] = reinterpret_cast<const uint32_t*>(indexData)[j]; break;
+					}
+				}
+
+				PendingMeshData data;
+				data.mesh = objectMesh;
+				data.lods = MeshSimplifier::buildLodChain(input, indices.data(), indices.size());
+				if (!sharedIndices)
+					data.meshlets = Meshlets::build(input.positions, input.vertexCount, indices.data(), indices.size());
+				if (data.lods.levels.size() <= 1 && data.meshlets.meshlets.empty())
+					return;
+
+				std::lock_guard<std::mutex> lock(pendingMeshData->mutex);
+				pendingMeshData->meshes.push_back(std::move(data));
+			});
+		}
+	}
+}
+
+void MainWindow::updateImport()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_pendingMeshData->mutex);
+		for (const auto& data : m_pendingMeshData->meshes)
+		{
+			// Skipped when the mesh was deleted in the meantime
+			const auto objectMesh = data.mesh.lock();
+			if (!objectMesh)
+				continue;
+
+			if (data.lods.levels.size() > 1)
+				objectMesh->setLods(data.lods.indices.data(), data.lods.indices.size(), data.lods.levels);
+			if (!data.meshlets.meshlets.empty())
+				objectMesh->setMeshlets(data.meshlets.indices.data(), data.meshlets.indices.size(), data.meshlets.meshlets.data(), data.meshlets.meshlets.size());
+		}
+		m_pendingMeshData->meshes.clear();
+	}
+
+	if (m_importSceneObject == nullptr)
+		return;
+
 	const auto currentTextureIndex = m_currentObjectTextureIndex;
 	m_currentObjectTextureIndex = NUMBER_OF_OBJECT_TEXTURES - 1; // No material
 
-	for (const auto& mesh : m_screwdriverLoader.getMeshes())
+	// The uploads are spread over the frames so a large import never stalls the window
+	const double startTime = glfwGetTime();
+	StreamingObjImporter::MeshPart part;
+	while (glfwGetTime() - startTime < m_importUploadTimePerFrame && m_importer.popPart(part))
 	{
 		auto objectMesh = std::make_shared<ObjectMesh>();
-		objectMesh->init(mesh);
+		objectMesh->init(part.view());
 		objectMesh->initAttributes(m_textureMaterial);
 		objectMesh->initConstantAttributes(m_constantMaterial);
 
-		const auto meshRenderer = createNewMeshRenderer(m_screwDriverSceneObject, objectMesh, m_textureMaterial);
-		meshRenderer->setName(mesh.name);
+		const auto meshRenderer = createNewMeshRenderer(*m_importSceneObject, objectMesh, m_textureMaterial);
+		meshRenderer->setName(part.name);
 		meshRenderer->canBePicked(false);
-		meshRenderer->setColorsFromObjectLoader(m_screwdriverLoader, mesh.materialID);
+		meshRenderer->setColors(part.material);
 	}
 
 	m_currentObjectTextureIndex = currentTextureIndex;
-
-	return true;
 }
 
 void MainWindow::renderImGui()
@@ -375,7 +587,12 @@ void MainWindow::renderImGui()
 				//Update Local Transform
 				ImGui::Text("Local Transform: ");
 				isGlobalDirty = ImGui::InputFloat3("Translate object", &objectToTransform->translation()[0], "%.2f", ImGuiInputTextFlags_EnterReturnsTrue);
-				isGlobalDirty = isGlobalDirty || ImGui::InputFloat3("Rotate object", &objectToTransform->rotation()[0], "%.2f", ImGuiInputTextFlags_EnterReturnsTrue);
+				glm::vec3 rotation = objectToTransform->rotation();
+				if (ImGui::InputFloat3("Rotate object", &rotation[0], "%.2f", ImGuiInputTextFlags_EnterReturnsTrue))
+				{
+					objectToTransform->rotation(rotation);
+					isGlobalDirty = true;
+				}
 				isGlobalDirty = isGlobalDirty || ImGui::InputFloat3("Scale object", &objectToTransform->scale()[0], "%.2f", ImGuiInputTextFlags_EnterReturnsTrue);
 
 				if (isGlobalDirty)
@@ -383,18 +600,23 @@ void MainWindow::renderImGui()
 					objectToTransform->dirtyGlobal();
 				}
 
-				//Signal if there's a change to the global transform update the local transform.
+				//Update Global Transform, decomposed for the selected object only. A change gives the local transform back.
+				Transform globalTransform = objectToTransform->globalTransform();
+				glm::vec3 globalRotation = globalTransform.rotation();
 				bool isLocalDirty = false;
 
-				//Update Global Transform.
 				ImGui::Text("Global Transform: ");
-				isLocalDirty = ImGui::InputFloat3("Translate object ##Global", &objectToTransform->translationGlobal()[0], "%.2f", ImGuiInputTextFlags_EnterReturnsTrue);
-				isLocalDirty = isLocalDirty || ImGui::InputFloat3("Rotate object ##Global", &objectToTransform->rotationGlobal()[0], "%.2f", ImGuiInputTextFlags_EnterReturnsTrue);
-				isLocalDirty = isLocalDirty || ImGui::InputFloat3("Scale object ##Global", &objectToTransform->scaleGlobal()[0], "%.2f", ImGuiInputTextFlags_EnterReturnsTrue);
+				isLocalDirty = ImGui::InputFloat3("Translate object ##Global", &globalTransform.translation()[0], "%.2f", ImGuiInputTextFlags_EnterReturnsTrue);
+				if (ImGui::InputFloat3("Rotate object ##Global", &globalRotation[0], "%.2f", ImGuiInputTextFlags_EnterReturnsTrue))
+				{
+					globalTransform.rotation(globalRotation);
+					isLocalDirty = true;
+				}
+				isLocalDirty = ImGui::InputFloat3("Scale object ##Global", &globalTransform.scale()[0], "%.2f", ImGuiInputTextFlags_EnterReturnsTrue) || isLocalDirty;
 
 				if (isLocalDirty)
 				{
-					objectToTransform->dirtyLocal();
+					objectToTransform->globalTransform(globalTransform);
 				}
 
 
@@ -413,29 +635,30 @@ void MainWindow::renderImGui()
 				const bool rotationZP = ImGui::Button("Z+");
 
 
+				// Clicked again before the end, the turns add up
 				if (rotationXN)
 				{
-					objectToTransform->addRotationAnimation(glm::vec3(-90.0f, 0.0f, 0.0f), animDuration);
+					m_animationSystem.rotate(*objectToTransform, glm::vec3(1.0f, 0.0f, 0.0f), -90.0f, animDuration);
 				}
 				if (rotationYN)
 				{
-					objectToTransform->addRotationAnimation(glm::vec3(0.0f, -90.0f, 0.0f), animDuration);
+					m_animationSystem.rotate(*objectToTransform, glm::vec3(0.0f, 1.0f, 0.0f), -90.0f, animDuration);
 				}
 				if (rotationZN)
 				{
-					objectToTransform->addRotationAnimation(glm::vec3(0.0f, 0.0f, -90.0f), animDuration);
+					m_animationSystem.rotate(*objectToTransform, glm::vec3(0.0f, 0.0f, 1.0f), -90.0f, animDuration);
 				}
 				if (rotationXP)
 				{
-					objectToTransform->addRotationAnimation(glm::vec3(90.0f, 0.0f, 0.0f), animDuration);
+					m_animationSystem.rotate(*objectToTransform, glm::vec3(1.0f, 0.0f, 0.0f), 90.0f, animDuration);
 				}
 				if (rotationYP)
 				{
-					objectToTransform->addRotationAnimation(glm::vec3(0.0f, 90.0f, 0.0f), animDuration);
+					m_animationSystem.rotate(*objectToTransform, glm::vec3(0.0f, 1.0f, 0.0f), 90.0f, animDuration);
 				}
 				if (rotationZP)
 				{
-					objectToTransform->addRotationAnimation(glm::vec3(0.0f, 0.0f, 90.0f), animDuration);
+					m_animationSystem.rotate(*objectToTransform, glm::vec3(0.0f, 0.0f, 1.0f), 90.0f, animDuration);
 				}
 
 				if (objectToTransform != &m_root)
@@ -444,10 +667,9 @@ void MainWindow::renderImGui()
 
 					if (ImGui::Button("Delete"))
 					{
-						objectToTransform->addRotationAnimation(glm::vec3(0.0f, 360.0f, 0.0f), 0.5f, [objectToTransform]()
-							{
-								objectToTransform->removeParent();
-							}, -objectToTransform->scale());
+						m_animationSystem.stop(*objectToTransform);
+						m_deletionTracks.push_back(m_animationSystem.rotate(*objectToTransform, glm::vec3(0.0f, 1.0f, 0.0f), 360.0f, 0.5f));
+						m_animationSystem.scale(*objectToTransform, -objectToTransform->scale(), 0.5f);
 
 						objectToTransform->canBePicked(false);
 						m_selectedObject = nullptr;
@@ -463,11 +685,20 @@ void MainWindow::renderImGui()
 
 				if (auto* meshRenderer = dynamic_cast<MeshRenderer*>(objectToTransform))
 				{
-					ImGui::Text("Color:");
-					ImGui::ColorEdit3("Ambiant color", &meshRenderer->ambiantColor()[0]);
-					ImGui::ColorEdit3("Diffuse color", &meshRenderer->diffuseColor()[0]);
-					ImGui::ColorEdit3("Specular color", &meshRenderer->specularColor()[0]);
-					ImGui::InputFloat("Specular term", &meshRenderer->specularTerm());
+					// Edits a copy: the record is shared with the renderers of the same colors
+					MaterialRecord record = meshRenderer->appearance();
+					ImGui::Text("Color (material %u, %zu users):", meshRenderer->materialIndex(), MaterialRegistry::instance().userCount(meshRenderer->materialIndex()));
+					bool colorChanged = ImGui::ColorEdit3("Ambiant color", &record.ambiantColor[0]);
+					colorChanged |= ImGui::ColorEdit3("Diffuse color", &record.diffuseColor[0]);
+					colorChanged |= ImGui::ColorEdit3("Specular color", &record.specularColor[0]);
+					colorChanged |= ImGui::InputFloat("Specular term", &record.parameters.x);
+					if (colorChanged)
+						meshRenderer->appearance(record);
+
+					const char* mobilityNames[] = { "Automatic", "Static", "Movable" };
+					int mobility = static_cast<int>(meshRenderer->mobility());
+					if (ImGui::Combo("Mobility", &mobility, mobilityNames, IM_ARRAYSIZE(mobilityNames)))
+						meshRenderer->mobility(static_cast<MeshRenderer::Mobility>(mobility));
 				}
 
 			}
@@ -631,10 +862,431 @@ void MainWindow::renderImGui()
 		ImGui::End();
 	}
 
+	renderImportWindow();
+	renderLodWindow();
+	renderCullingWindow();
+	renderHlodWindow();
+	renderStaticBatchingWindow();
+	renderOcclusionWindow();
+	renderPointLightsWindow();
+	renderDepthPrepassWindow();
+	renderRenderQueueWindow();
+	renderRenderBundlesWindow();
+	renderObjectDataWindow();
+	renderTransformHierarchyWindow();
+	renderAnimationWindow();
+
 	ImGui::Render();
 	ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
 
+void MainWindow::renderImportWindow()
+{
+	ImGui::SetNextWindowSize(ImVec2(300, 170), ImGuiCond_Once);
+	ImGui::SetNextWindowPos(ImVec2(20, 520), ImGuiCond_Once);
+	ImGui::Begin("Import");
+
+	const auto progress = m_importer.progress();
+
+	ImGui::InputText("OBJ file", m_importPath, IM_ARRAYSIZE(m_importPath));
+	ImGui::InputInt("Memory (MB)", &m_importBudgetMB, 64, 256);
+	m_importBudgetMB = std::max(m_importBudgetMB, static_cast<int>(StreamingObjImporter::MIN_MEMORY_BUDGET >> 20));
+
+	if (progress.running)
+	{
+		if (ImGui::Button("Cancel"))
+			m_importer.cancel();
+	}
+	else if (ImGui::Button("Import"))
+	{
+		startImport();
+	}
+
+	const float fraction = progress.totalBytes > 0 ? static_cast<float>(progress.bytesRead) / static_cast<float>(progress.totalBytes) : 0.0f;
+	ImGui::ProgressBar(progress.failed ? 0.0f : fraction);
+	ImGui::Text("%zu triangles in %zu parts", progress.triangleCount, progress.partCount);
+	ImGui::Text("Memory in use: %.1f MB", static_cast<double>(progress.memoryInUse) / (1 << 20));
+	if (progress.failed)
+		ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "Import failed");
+
+	ImGui::End();
+}
+
+void MainWindow::renderLodWindow()
+{
+	ImGui::SetNextWindowSize(ImVec2(300, 200), ImGuiCond_Once);
+	ImGui::SetNextWindowPos(ImVec2(20, 700), ImGuiCond_Once);
+	ImGui::Begin("Levels of detail");
+
+	auto& settings = MeshRenderer::lodSettings();
+	ImGui::Checkbox("Enabled", &settings.enabled);
+	ImGui::SliderFloat("Pixel error", &settings.pixelError, 0.1f, 16.0f, "%.1f");
+	ImGui::SliderFloat("Hysteresis", &settings.hysteresis, 0.0f, 0.9f);
+	ImGui::SliderInt("Forced level", &settings.forcedLevel, -1, static_cast<int>(MeshSimplifier::MAX_LOD_LEVELS));
+
+	// Counted during the last renderScene
+	const auto& statistics = MeshRenderer::lodStatistics();
+	const std::size_t fullTriangles = statistics.drawnTriangles + statistics.savedTriangles;
+	ImGui::Text("Triangles drawn: %zu", statistics.drawnTriangles);
+	ImGui::Text("Triangles saved: %zu (%.1f%%)", statistics.savedTriangles,
+		fullTriangles > 0 ? 100.0 * static_cast<double>(statistics.savedTriangles) / static_cast<double>(fullTriangles) : 0.0);
+	for (std::size_t level = 0; level <= MeshSimplifier::MAX_LOD_LEVELS; ++level)
+		ImGui::Text("Level %zu: %zu meshes", level, statistics.renderersPerLevel[level]);
+
+	ImGui::End();
+}
+
+void MainWindow::renderCullingWindow()
+{
+	ImGui::SetNextWindowSize(ImVec2(300, 190), ImGuiCond_Once);
+	ImGui::SetNextWindowPos(ImVec2(340, 700), ImGuiCond_Once);
+	ImGui::Begin("Meshlet culling");
+
+	auto& settings = MeshRenderer::cullingSettings();
+	ImGui::Checkbox("Enabled", &settings.enabled);
+	ImGui::Checkbox("Frustum", &settings.frustumCulling);
+	ImGui::SameLine();
+	ImGui::Checkbox("Back faces of every mesh (cone)", &settings.coneCulling);
+
+	const auto& statistics = MeshRenderer::cullingStatistics();
+	ImGui::Text("Triangles culled: %zu / %zu (%.1f%%)", statistics.culledTriangles, statistics.testedTriangles,
+		statistics.testedTriangles > 0 ? 100.0 * static_cast<double>(statistics.culledTriangles) / static_cast<double>(statistics.testedTriangles) : 0.0);
+
+	ImGui::InputInt("Views", &m_cullingBenchmarkViews);
+	m_cullingBenchmarkViews = std::clamp(m_cullingBenchmarkViews, 1, 360);
+	if (ImGui::Button("Orbit benchmark"))
+		m_cullingBenchmarkResult = benchmarkCulling(m_cullingBenchmarkViews);
+	if (m_cullingBenchmarkResult >= 0.0f)
+		ImGui::Text("Culled on average: %.1f%%", 100.0f * m_cullingBenchmarkResult);
+
+	ImGui::End();
+}
+
+void MainWindow::renderHlodWindow()
+{
+	ImGui::SetNextWindowSize(ImVec2(300, 210), ImGuiCond_Once);
+	ImGui::SetNextWindowPos(ImVec2(660, 700), ImGuiCond_Once);
+	ImGui::Begin("Hierarchical LOD");
+
+	auto& settings = HlodProxy::settings();
+	ImGui::Checkbox("Enabled", &settings.enabled);
+	ImGui::SliderFloat("Pixel error", &settings.pixelError, 0.1f, 16.0f, "%.1f");
+	ImGui::SliderFloat("Static delay (s)", &settings.staticDelay, 0.0f, 10.0f, "%.1f");
+	ImGui::SliderInt("Min. renderers", &settings.minRenderers, 2, 256);
+	ImGui::SliderInt("Atlas cell size", &settings.atlasCellSize, 16, 256);
+
+	const auto& statistics = HlodProxy::statistics();
+	ImGui::Text("Proxies: %zu (%zu building)", m_hlodSystem.proxyCount(), m_hlodSystem.buildsInProgress());
+	ImGui::Text("Drawn: %zu, replacing %zu renderers", statistics.proxiesDrawn, statistics.renderersReplaced);
+
+	ImGui::End();
+}
+
+void MainWindow::renderStaticBatchingWindow()
+{
+	ImGui::SetNextWindowSize(ImVec2(300, 170), ImGuiCond_Once);
+	ImGui::SetNextWindowPos(ImVec2(980, 700), ImGuiCond_Once);
+	ImGui::Begin("Static batching");
+
+	auto& settings = StaticBatcher::settings();
+	ImGui::Checkbox("Enabled", &settings.enabled);
+	ImGui::SliderInt("Idle frames", &settings.idleFrames, 1, 600);
+	ImGui::SliderInt("Renderers per batch", &settings.maxRenderers, 16, 8192);
+
+	const auto& statistics = StaticBatcher::statistics();
+	ImGui::Text("Batches: %zu (%zu building)", m_staticBatcher.batchCount(), m_staticBatcher.buildsInProgress());
+	ImGui::Text("Drawn: %zu draws for %zu renderers", statistics.batchDraws, statistics.batchedRenderers);
+
+	ImGui::End();
+}
+
+void MainWindow::renderOcclusionWindow()
+{
+	ImGui::SetNextWindowSize(ImVec2(300, 170), ImGuiCond_Once);
+	ImGui::SetNextWindowPos(ImVec2(1300, 700), ImGuiCond_Once);
+	ImGui::Begin("Occlusion culling");
+
+	auto& settings = OcclusionCuller::settings();
+	ImGui::Checkbox("Enabled", &settings.enabled);
+	ImGui::SliderInt("Occluders", &settings.maxOccluders, 0, 1024);
+	ImGui::SliderFloat("Min. occluder size", &settings.minOccluderSize, 0.0f, 1.0f, "%.3f");
+
+	const auto& statistics = OcclusionCuller::statistics();
+	ImGui::Text("Culled: %zu / %zu (%.1f%%)", statistics.culledRenderers, statistics.testedRenderers,
+		statistics.testedRenderers > 0 ? 100.0 * static_cast<double>(statistics.culledRenderers) / static_cast<double>(statistics.testedRenderers) : 0.0);
+	ImGui::Text("Occluders rasterized: %zu", statistics.occluders);
+	ImGui::Text("CPU time: %.3f ms", statistics.milliseconds);
+
+	ImGui::End();
+}
+
+void MainWindow::renderPointLightsWindow()
+{
+	ImGui::SetNextWindowSize(ImVec2(300, 250), ImGuiCond_Once);
+	ImGui::SetNextWindowPos(ImVec2(340, 520), ImGuiCond_Once);
+	ImGui::Begin("Point lights");
+
+	auto& settings = LightClusters::settings();
+	ImGui::Checkbox("Enabled", &settings.enabled);
+	ImGui::Checkbox("Show lights per cell", &settings.showLightCount);
+
+	ImGui::SliderInt("Count", &m_scatteredLightCount, 1, 4096);
+	ImGui::SliderFloat("Radius", &m_scatteredLightRadius, 0.5f, 20.0f, "%.1f");
+	ImGui::SliderFloat("Intensity", &m_scatteredLightIntensity, 0.1f, 10.0f, "%.1f");
+	if (ImGui::Button("Scatter"))
+		scatterPointLights(m_scatteredLightCount);
+	ImGui::SameLine();
+	if (ImGui::Button("Remove all"))
+		m_lightClusters.lights().clear();
+	ImGui::Checkbox("Animate", &m_animatePointLights);
+
+	const auto& statistics = LightClusters::statistics();
+	ImGui::Text("Visible: %zu / %zu", statistics.visibleLights, statistics.lights);
+	ImGui::Text("Per cell: %zu at most, %.1f on average", statistics.maxLightsPerCluster,
+		statistics.occupiedClusters > 0 ? static_cast<double>(statistics.lightIndices) / static_cast<double>(statistics.occupiedClusters) : 0.0);
+	ImGui::Text("Cells with lights: %zu / %d", statistics.occupiedClusters, LightClusters::CLUSTER_COUNT);
+	ImGui::Text("CPU time: %.3f ms", statistics.milliseconds);
+
+	ImGui::End();
+}
+
+void MainWindow::renderDepthPrepassWindow()
+{
+	ImGui::SetNextWindowSize(ImVec2(300, 190), ImGuiCond_Once);
+	ImGui::SetNextWindowPos(ImVec2(660, 520), ImGuiCond_Once);
+	ImGui::Begin("Depth pre-pass");
+
+	auto& settings = DepthPrepass::settings();
+	const char* modeNames[] = { "Automatic", "Always", "Never" };
+	int mode = static_cast<int>(settings.mode);
+	if (ImGui::Combo("Mode", &mode, modeNames, IM_ARRAYSIZE(modeNames)))
+		settings.mode = static_cast<DepthPrepass::Mode>(mode);
+	ImGui::SliderInt("Trial interval", &settings.trialInterval, 16, 3000);
+	ImGui::Checkbox("Show overdraw", &settings.showOverdraw);
+
+	const auto& statistics = DepthPrepass::statistics();
+	ImGui::Text("Pre-pass: %s", statistics.active ? "on" : "off");
+	ImGui::Text("GPU time with: %.3f ms", statistics.withPrepassMs);
+	ImGui::Text("GPU time without: %.3f ms", statistics.withoutPrepassMs);
+	if (settings.showOverdraw)
+		ImGui::Text("Overdraw: %.2f (%zu fragments, %zu pixels)", statistics.overdraw, statistics.shadedFragments, statistics.coveredPixels);
+
+	ImGui::End();
+}
+
+void MainWindow::renderRenderQueueWindow()
+{
+	ImGui::SetNextWindowSize(ImVec2(300, 330), ImGuiCond_Once);
+	ImGui::SetNextWindowPos(ImVec2(980, 520), ImGuiCond_Once);
+	ImGui::Begin("Render queue");
+
+	auto& settings = RenderQueue::settings();
+	ImGui::Checkbox("Sort draws", &settings.enabled);
+	ImGui::Checkbox("Record on all cores", &settings.parallelRecording);
+	ImGui::SliderInt("Draws per buffer", &settings.packetsPerBuffer, 64, 8192);
+
+	// Counted during the last renderScene, with the depth pre-pass when it was drawn
+	const auto& statistics = RenderQueue::statistics();
+	ImGui::Text("Draws: %zu, sorted in %.3f ms", statistics.packets, statistics.sortMilliseconds);
+	ImGui::Text("Switches   traversal  sorted");
+	ImGui::Text("Programs   %9zu  %6zu", statistics.traversalProgramSwitches, statistics.programSwitches);
+	ImGui::Text("VAOs       %9zu  %6zu", statistics.traversalVertexArraySwitches, statistics.vertexArraySwitches);
+	ImGui::Text("Textures   %9zu  %6zu", statistics.traversalTextureSwitches, statistics.textureSwitches);
+	ImGui::Text("Commands: %zu in %zu buffers", statistics.commands, statistics.commandBuffers);
+	ImGui::Text("Recorded in %.3f ms, replayed in %.3f ms", statistics.recordMilliseconds, statistics.replayMilliseconds);
+
+	ImGui::InputInt("Draws", &m_recordingBenchmarkPackets, 10000);
+	m_recordingBenchmarkPackets = std::clamp(m_recordingBenchmarkPackets, 1, 1000000);
+	if (ImGui::Button("Benchmark the recording"))
+		m_recordingBenchmarkResult = RenderQueue::benchmarkRecording(m_camera, m_root, static_cast<std::size_t>(m_recordingBenchmarkPackets), 5);
+	if (m_recordingBenchmarkResult.packets > 0)
+	{
+		const auto& result = m_recordingBenchmarkResult;
+		ImGui::Text("%zu draws of %zu renderers, %zu buffers", result.packets, result.renderers, result.buffers);
+		ImGui::Text("Serial: %.2f ms, parallel: %.2f ms on %zu threads", result.serialMilliseconds, result.parallelMilliseconds, result.threads);
+		ImGui::Text("Speedup: %.2fx", result.parallelMilliseconds > 0.0 ? result.serialMilliseconds / result.parallelMilliseconds : 0.0);
+	}
+
+	ImGui::End();
+}
+
+void MainWindow::renderRenderBundlesWindow()
+{
+	ImGui::SetNextWindowSize(ImVec2(300, 190), ImGuiCond_Once);
+	ImGui::SetNextWindowPos(ImVec2(1300, 520), ImGuiCond_Once);
+	ImGui::Begin("Render bundles");
+
+	auto& settings = RenderBundle::settings();
+	ImGui::Checkbox("Replay unchanged subtrees", &settings.enabled);
+	ImGui::SliderInt("Min renderers", &settings.minRenderers, 1, 1024);
+	ImGui::SliderInt("Max renderers", &settings.maxRenderers, 16, 16384);
+
+	const auto& statistics = RenderQueue::statistics();
+	ImGui::Text("Bundles: %zu", m_renderBundles.bundleCount());
+	ImGui::Text("Replayed: %zu, recorded: %zu", statistics.bundlesReplayed, statistics.bundlesRecorded);
+	ImGui::Text("Outdated by the camera: %zu", statistics.bundlesOutdated);
+	ImGui::Text("Draws replayed: %zu", statistics.bundledDraws);
+
+	// On the CPU, of all the passes: what the bundles save, compared with the checkbox off
+	const double submissionMilliseconds = statistics.traversalMilliseconds + statistics.recordMilliseconds + statistics.replayMilliseconds;
+	ImGui::Text("Submission: %.3f ms", submissionMilliseconds);
+	ImGui::Text("Traversal %.3f, record %.3f, replay %.3f", statistics.traversalMilliseconds, statistics.recordMilliseconds, statistics.replayMilliseconds);
+
+	ImGui::End();
+}
+
+void MainWindow::renderObjectDataWindow()
+{
+	ImGui::SetNextWindowSize(ImVec2(300, 170), ImGuiCond_Once);
+	ImGui::SetNextWindowPos(ImVec2(20, 920), ImGuiCond_Once);
+	ImGui::Begin("Object data");
+
+	if (ObjectDataBuffer::instance() == nullptr)
+	{
+		ImGui::Text("Needs OpenGL 4.4, set as uniforms");
+		ImGui::End();
+		return;
+	}
+
+	auto& settings = ObjectDataBuffer::settings();
+	ImGui::Checkbox("Read from the buffer", &settings.enabled);
+
+	const auto& statistics = ObjectDataBuffer::statistics();
+	ImGui::Text("Objects: %zu of %zu slots", m_objectData.objectCount(), m_objectData.capacity());
+	ImGui::Text("Changed: %zu, caught up: %zu in %zu ranges", statistics.updatedObjects, statistics.rewrittenObjects, statistics.dirtyRanges);
+	ImGui::Text("Uploaded: %.1f KB", static_cast<double>(statistics.uploadedBytes) / 1024.0);
+	ImGui::Text("Fence waits: %.3f ms", statistics.fenceWaitMilliseconds);
+	ImGui::Text("Materials: %zu, %zu uploaded", MaterialRegistry::instance().recordCount(), MaterialRegistry::statistics().uploadedRecords);
+
+	ImGui::End();
+}
+
+void MainWindow::renderTransformHierarchyWindow()
+{
+	ImGui::SetNextWindowSize(ImVec2(300, 440), ImGuiCond_Once);
+	ImGui::SetNextWindowPos(ImVec2(340, 920), ImGuiCond_Once);
+	ImGui::Begin("Transform hierarchy");
+
+	auto& settings = TransformHierarchy::settings();
+	ImGui::Checkbox("Update in one pass", &settings.enabled);
+	ImGui::SameLine();
+	ImGui::Checkbox("Parallel", &settings.parallel);
+	ImGui::SliderInt("Nodes per job", &settings.nodesPerJob, 256, 65536);
+
+	const auto& statistics = TransformHierarchy::statistics();
+	ImGui::Text("Nodes: %zu, moved: %zu, reordered: %zu", statistics.nodes, statistics.movedNodes, statistics.rebuilds);
+	ImGui::Text("Top nodes: %zu, jobs: %zu", statistics.topNodes, statistics.jobs);
+	ImGui::Text("Serial %.3f ms, parallel %.3f ms", statistics.serialMilliseconds, statistics.parallelMilliseconds);
+
+	ImGui::InputInt("Nodes", &m_hierarchyBenchmarkNodes, 100000);
+	m_hierarchyBenchmarkNodes = std::clamp(m_hierarchyBenchmarkNodes, 1, 4000000);
+	const char* shapeNames[] = { "Random", "Wide", "Deep" };
+	ImGui::Combo("Shape", &m_hierarchyBenchmarkShape, shapeNames, IM_ARRAYSIZE(shapeNames));
+	if (ImGui::Button("Benchmark against the recursion"))
+		m_hierarchyBenchmarkResult = TransformHierarchy::benchmark(static_cast<std::size_t>(m_hierarchyBenchmarkNodes), static_cast<TransformHierarchy::BenchmarkShape>(m_hierarchyBenchmarkShape), 5);
+	if (m_hierarchyBenchmarkResult.nodeCount > 0)
+	{
+		const auto& result = m_hierarchyBenchmarkResult;
+		ImGui::Text("%zu nodes, %zu levels, %zu jobs", result.nodeCount, result.maxDepth + 1, result.jobs);
+		ImGui::Text("Recursive: %.2f ms, linear: %.2f ms", result.recursiveMilliseconds, result.linearMilliseconds);
+		ImGui::Text("Parallel: %.2f ms on %zu threads", result.parallelMilliseconds, result.threads);
+		ImGui::Text("Through the objects: %.2f ms, parallel %.2f ms", result.updateMilliseconds, result.parallelUpdateMilliseconds);
+		for (const auto& timing : result.workerSweep)
+			ImGui::Text("  %2u workers: %.2f ms, %.2fx", timing.workers, timing.milliseconds, timing.milliseconds > 0.0 ? result.updateMilliseconds / timing.milliseconds : 0.0);
+		ImGui::Text("Speedup: %.2fx, max difference: %g", result.parallelMilliseconds > 0.0 ? result.recursiveMilliseconds / result.parallelMilliseconds : 0.0, result.maxDifference);
+	}
+
+	const std::string checkLabel = std::string("Check the ") + TransformKernels::instructionSet() + " kernels";
+	if (ImGui::Button(checkLabel.c_str()))
+	{
+		m_kernelCheckResult = TransformKernels::check(4099);
+		m_kernelsChecked = true;
+	}
+	if (m_kernelsChecked)
+		ImGui::Text("Against glm: %g, %g, worlds %g, normals %g", m_kernelCheckResult.composeError, m_kernelCheckResult.multiplyError, m_kernelCheckResult.worldError, m_kernelCheckResult.normalError);
+
+	ImGui::End();
+}
+
+void MainWindow::renderAnimationWindow()
+{
+	ImGui::SetNextWindowSize(ImVec2(300, 170), ImGuiCond_Once);
+	ImGui::SetNextWindowPos(ImVec2(660, 920), ImGuiCond_Once);
+	ImGui::Begin("Animations");
+
+	auto& settings = AnimationSystem::settings();
+	ImGui::Checkbox("Paused", &settings.paused);
+	ImGui::SliderFloat("Time scale", &settings.timeScale, 0.1f, 4.0f);
+
+	const auto& statistics = AnimationSystem::statistics();
+	ImGui::Text("Running tracks: %zu", statistics.activeTracks);
+	ImGui::Text("Started: %zu, finished: %zu", statistics.startedTracks, statistics.finishedTracks);
+	ImGui::Text("Update: %.3f ms", statistics.updateMilliseconds);
+
+	ImGui::End();
+}
+
+void MainWindow::scatterPointLights(int count)
+{
+	// Always the same lights for a given count, to compare the timings
+	std::mt19937 generator(1234u);
+	std::uniform_real_distribution<float> horizontal(-20.0f, 20.0f);
+	std::uniform_real_distribution<float> height(0.25f, 3.0f);
+	std::uniform_real_distribution<float> channel(0.0f, 1.0f);
+
+	auto& lights = m_lightClusters.lights();
+	lights.clear();
+	for (int i = 0; i < count; ++i)
+	{
+		PointLight light;
+		light.position = glm::vec3(horizontal(generator), height(generator), horizontal(generator));
+		light.radius = m_scatteredLightRadius;
+		light.color = glm::normalize(glm::vec3(channel(generator), channel(generator), channel(generator)) + glm::vec3(0.05f)) * 1.5f;
+		light.intensity = m_scatteredLightIntensity;
+		lights.push_back(light);
+	}
+}
+
+float MainWindow::benchmarkCulling(int viewCount)
+{
+	std::vector<const MeshRenderer*> renderers;
+	auto collect = [&](const SceneObject& sceneObject, auto& collectRef) -> void
+	{
+		if (const auto* renderer = dynamic_cast<const MeshRenderer*>(&sceneObject))
+			renderers.push_back(renderer);
+		for (const auto* child : sceneObject.children())
+			collectRef(*child, collectRef);
+	};
+	collect(m_root, collect);
+
+	// Same distance and height as the camera, around the vertical axis of the scene
+	const glm::vec3 cameraPosition = m_camera.position();
+	const float radius = glm::length(glm::vec2(cameraPosition.x, cameraPosition.z));
+	const float startAngle = std::atan2(cameraPosition.z, cameraPosition.x);
+	const glm::mat4 projection = m_camera.projectionMatrix();
+
+	const auto startTime = glfwGetTime();
+	MeshRenderer::CullingStatistics total;
+	for (int i = 0; i < viewCount; ++i)
+	{
+		const float angle = startAngle + glm::two_pi<float>() * static_cast<float>(i) / static_cast<float>(viewCount);
+		const glm::vec3 position(radius * std::cos(angle), cameraPosition.y, radius * std::sin(angle));
+		const glm::mat4 view = glm::lookAt(position, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+		MeshRenderer::CullingStatistics statistics;
+		for (const auto* renderer : renderers)
+			renderer->measureCulling(projection * view, position, statistics);
+		total.testedTriangles += statistics.testedTriangles;
+		total.culledTriangles += statistics.culledTriangles;
+	}
+
+	const float culledFraction = total.testedTriangles > 0 ? static_cast<float>(total.culledTriangles) / static_cast<float>(total.testedTriangles) : 0.0f;
+	std::cout << "Meshlet culling over " << viewCount << " orbiting views: " << 100.0f * culledFraction << "% of "
+		<< total.testedTriangles / viewCount << " triangles culled per view, "
+		<< (glfwGetTime() - startTime) * 1000.0 / viewCount << " ms per view" << std::endl;
+	return culledFraction;
+}
+
 void MainWindow::updateLightParameters(float deltaTime)
 {
 	if (m_lightAnimateVertical)
@@ -646,6 +1298,18 @@ void MainWindow::updateLightParameters(float deltaTime)
 	{
 		m_directionalLight.horizontalAngle() += 0.5f * deltaTime;
 	}
+
+	if (m_animatePointLights)
+	{
+		// Around the vertical axis, the farthest ones slower
+		for (auto& light : m_lightClusters.lights())
+		{
+			const float angle = deltaTime * 2.0f / std::max(glm::length(glm::vec2(light.position.x, light.position.z)), 1.0f);
+			const float cosine = std::cos(angle);
+			const float sine = std::sin(angle);
+			light.position = glm::vec3(cosine * light.position.x - sine * light.position.z, light.position.y, sine * light.position.x + cosine * light.position.z);
+		}
+	}
 }
 
 void MainWindow::updateHoveringFace()
@@ -733,13 +1397,11 @@ void MainWindow::performAddCube()
 
 void MainWindow::animateTool()
 {
-	m_screwDriverSceneObject.stopAnimation();
-	m_screwDriverSceneObject.rotation() = glm::vec3(0.0f);
+	// Restarts from the top, the track of the previous cube finishes without going back up
+	m_animationSystem.stop(m_screwDriverSceneObject);
+	m_screwDriverSceneObject.rotation(glm::vec3(0.0f));
 
-	m_screwDriverSceneObject.addRotationAnimation(glm::vec3(0.0f, 0.0f, -90.0f), 0.1f, [this]()
-		{
-			m_screwDriverSceneObject.addRotationAnimation(glm::vec3(0.0f, 0.0f, 90.0f), 0.2f);
-		});
+	m_toolTrack = m_animationSystem.rotate(m_screwDriverSceneObject, glm::vec3(0.0f, 0.0f, 1.0f), -90.0f, 0.1f);
 }
 
 void MainWindow::clearColorForPicking()
@@ -799,9 +1461,34 @@ void MainWindow::renderScene()
 {
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+	MeshRenderer::lodSettings().viewportHeight = static_cast<float>(m_windowHeight);
+	MeshRenderer::lodStatistics() = MeshRenderer::LodStatistics();
+	MeshRenderer::cullingStatistics() = MeshRenderer::CullingStatistics();
+	HlodProxy::statistics() = HlodProxy::Statistics();
+	StaticBatcher::statistics() = StaticBatcher::Statistics();
+	RenderQueue::statistics() = RenderQueue::Statistics();
+	ObjectDataBuffer::statistics() = ObjectDataBuffer::Statistics();
+	MaterialRegistry::statistics() = MaterialRegistry::Statistics();
+	TransformHierarchy::statistics() = TransformHierarchy::Statistics();
+
+	// Every model matrix of the frame, the traversals below only draw
+	m_transformHierarchy.update(m_root);
+
+	m_objectData.beginFrame();
+	MaterialRegistry::instance().upload();
+
+	// After the settings of the frame, the viewport height included
+	m_renderBundles.update(m_root, m_staticBatcher.version() + m_hlodSystem.version(), m_occlusionCuller.resultVersion(), glfwGetTime());
+
     renderSkybox();
 
-	m_root.render(m_camera);
+	m_textureMaterial->bind();
+	m_textureMaterial->setLightClusters(m_lightClusters);
+
+	m_depthPrepass.begin(m_camera, m_renderQueue, m_root, m_staticBatcher, *m_constantMaterial);
+	m_renderQueue.render(m_camera, m_root);
+	m_staticBatcher.render(m_camera);
+	m_depthPrepass.end();
 
 	if (m_isHoveringFace && !glfwGetKey(m_window, GLFW_KEY_LEFT_CONTROL))
 	{
@@ -810,6 +1497,11 @@ void MainWindow::renderScene()
 		m_selectionPreviewObject->transform().translation() = newCubeTranslation;
 		m_selectionPreviewObject->render(m_camera, m_hoveringObject->modelMatrix());
 	}
+
+	if (DepthPrepass::settings().showOverdraw)
+		m_depthPrepass.renderOverdraw(m_camera, m_renderQueue, m_root, m_staticBatcher, *m_constantMaterial);
+
+	m_objectData.endFrame();
 }
 
 void MainWindow::renderSkybox()
@@ -820,14 +1512,35 @@ void MainWindow::renderSkybox()
     m_skyDomeMaterial->setViewRotMatrix(glm::mat3(m_camera.viewMatrix()));
     m_skyDomeMaterial->setSunPos(m_directionalLight.position());
     m_skyDomeMaterial->setSunRot(glm::vec2(m_directionalLight.horizontalAngle(),m_directionalLight.verticalAngle()));
-    m_skyDomeMaterial->setViewDir(m_camera.rotation());
+    m_skyDomeMaterial->setViewDir(m_camera.viewAngles());
     m_skyDomeMaterial->bindTextureAndDraw();
     glEnable(GL_DEPTH_TEST);
 }
 
 void MainWindow::animate(float deltaTime)
 {
-	m_root.animate(deltaTime);
+	m_animationSystem.update(deltaTime);
+	handleAnimationEvents();
+}
+
+void MainWindow::handleAnimationEvents()
+{
+	for (const auto& event : m_animationSystem.takeEvents())
+	{
+		if (event.track == m_toolTrack)
+		{
+			m_toolTrack = AnimationSystem::NO_TRACK;
+			m_animationSystem.rotate(m_screwDriverSceneObject, glm::vec3(0.0f, 0.0f, 1.0f), 90.0f, 0.2f);
+		}
+
+		const auto deletion = std::find(m_deletionTracks.begin(), m_deletionTracks.end(), event.track);
+		if (deletion != m_deletionTracks.end())
+		{
+			m_deletionTracks.erase(deletion);
+			m_animationSystem.stop(*event.object);
+			event.object->removeParent();
+		}
+	}
 }
 
 int MainWindow::renderLoop()
@@ -848,9 +1561,15 @@ int MainWindow::renderLoop()
 			m_camera.keybordEvents(m_window, deltaTime);
 		}
 
+		m_shaderReloader.update();
+		updateImport();
 		updateLightParameters(deltaTime);
 		updateHoveringFace();
 		animate(deltaTime);
+		m_hlodSystem.update(m_root, m_selectedObject, glfwGetTime());
+		m_staticBatcher.update();
+		m_occlusionCuller.cull(m_camera, m_root);
+		m_lightClusters.update(m_camera, static_cast<int>(m_windowWidth), static_cast<int>(m_windowHeight));
 		renderScene();
 		renderImGui();
 
@@ -861,6 +1580,16 @@ int MainWindow::renderLoop()
 	}
 
 	// Cleanup
+	m_importer.cancel();
+	m_shaderReloader.shutdown();
+	m_hlodSystem.clear();
+	m_staticBatcher.clear();
+	m_occlusionCuller.clear();
+	m_renderBundles.clear();
+	m_objectData.clear();
+	MaterialRegistry::instance().clear();
+	m_lightClusters.clear();
+	m_depthPrepass.clear();
 	glfwDestroyWindow(m_window);
 	glfwTerminate();
 
@@ -14,10 +14,26 @@
 #include <GLFW/glfw3.h>
 
 #include <memory>
+#include <mutex>
+#include <vector>
 
+#include "AnimationSystem.h"
 #include "Camera.h"
+#include "ClusteredLighting.h"
+#include "DepthPrepass.h"
+#include "Hlod.h"
+#include "Meshlets.h"
+#include "MeshSimplifier.h"
+#include "ObjectData.h"
+#include "OcclusionCulling.h"
+#include "RenderBundle.h"
+#include "RenderQueue.h"
 #include "SceneObject.h"
-#include "OBJLoader.h"
+#include "ShaderReloader.h"
+#include "StaticBatching.h"
+#include "StreamingObjImporter.h"
+#include "TransformHierarchy.h"
+#include "ObjectTextures.h"
 
 class Mesh;
 class Material;
@@ -25,42 +41,17 @@ class ConstantMaterial;
 class SkyboxMaterial;
 class TextureMaterial;
 class MeshRenderer;
+class ObjectMesh;
+class TextureLoader;
+
+namespace GLTFLoader
+{
+	class Loader;
+}
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow* window);
 
-constexpr int NUMBER_OF_OBJECT_TEXTURES = 7;
-inline const char* OBJECT_TEXTURE_NAME[NUMBER_OF_OBJECT_TEXTURES] =
-{
-	"Grass",
-	"Dry Ground",
-	"Granite Floor",
-	"Limestone Wall",
-	"Pierre Boucharde",
-	"Wood Floor",
-	"No Material"
-};
-const std::string OBJECT_TEXTURE_PATH[NUMBER_OF_OBJECT_TEXTURES] =
-{
-	"grass2.jpg",
-	"dry_ground.jpg",
-	"granite_floor.jpg",
-	"limestone_wall.jpg",
-	"pierre_bouchardee.jpg",
-	"wood_floor.jpg",
-	"no_material.png"
-};
-const std::string OBJECT_TEXTURE_NORMALS_PATH[NUMBER_OF_OBJECT_TEXTURES] =
-{
-	"grass_normals.jpg",
-	"dry_ground_normals.jpg",
-	"granite_floor_normals.jpg",
-	"limestone_wall_normals.jpg",
-	"pierre_bouchardee_normals.jpg",
-	"wood_floor_normals.jpg",
-	"no_material_normals.png"
-};
-
 struct DirectionalLight
 {
 private:
@@ -146,19 +137,38 @@ public:
 
 private:
 	void initializeCallback();
-	int initializeGL();
+	int initializeGL(TextureLoader& textureLoader);
 	void initializeSceneGraph();
 	void initializeSelectionPreviewObject();
-	bool loadObjectTextures();
-	bool loadTexture(const std::string& path, unsigned int& textureID, GLint uvMode, GLint minMode, GLint magMode);
+	void queueObjectTextures(TextureLoader& textureLoader);
 	bool loadScrewdriver();
+	void startImport();
+	bool loadGltf(const std::string& path);
+	void updateImport();
+	void queueGltfMeshData(const std::shared_ptr<const GLTFLoader::Loader>& loader, const std::vector<std::vector<std::shared_ptr<ObjectMesh>>>& meshes);
 
     void renderScene();
 	void renderSkybox();
 	void animate(float deltaTime);
+	void handleAnimationEvents();
 	void renderImGui();
+	void renderImportWindow();
+	void renderLodWindow();
+	void renderCullingWindow();
+	void renderHlodWindow();
+	void renderStaticBatchingWindow();
+	void renderOcclusionWindow();
+	void renderPointLightsWindow();
+	void renderDepthPrepassWindow();
+	void renderRenderQueueWindow();
+	void renderRenderBundlesWindow();
+	void renderObjectDataWindow();
+	void renderTransformHierarchyWindow();
+	void renderAnimationWindow();
+	float benchmarkCulling(int viewCount);
 
 	void updateLightParameters(float deltaTime);
+	void scatterPointLights(int count);
 	void updateHoveringFace();
 
 	SceneObject* pickedObjectAt(int x, int y);
@@ -192,14 +202,83 @@ private:
 
 	int m_currentObjectTextureIndex = 0;
 
-	OBJLoader::Loader m_screwdriverLoader;
-
     std::shared_ptr<Mesh> m_cubeMesh;
 	std::vector<std::shared_ptr<Mesh>> m_screwdriverMeshes;
     std::shared_ptr<SkyboxMaterial> m_skyDomeMaterial;
     std::shared_ptr<ConstantMaterial> m_constantMaterial;
 	std::shared_ptr<TextureMaterial> m_textureMaterial;
 
+	ShaderReloader m_shaderReloader;
+
+	// Import window: .glb files are loaded at once, OBJ files are streamed and their parts added
+	// under m_importSceneObject as they arrive
+	StreamingObjImporter m_importer;
+	SceneObject* m_importSceneObject = nullptr;
+	char m_importPath[512] = "";
+	int m_importBudgetMB = 256;
+	const double m_importUploadTimePerFrame = 0.004;
+
+	// Levels of detail and meshlets of the .glb primitives, built on the thread pool and uploaded by updateImport
+	struct PendingMeshData
+	{
+		std::weak_ptr<ObjectMesh> mesh;
+		MeshSimplifier::LodChain lods;
+		Meshlets::MeshletSet meshlets;
+	};
+	struct PendingMeshQueue
+	{
+		std::mutex mutex;
+		std::vector<PendingMeshData> meshes;
+	};
+	std::shared_ptr<PendingMeshQueue> m_pendingMeshData = std::make_shared<PendingMeshQueue>();
+
+	// Orbit around the scene, measuring the meshlet culling of each view
+	int m_cullingBenchmarkViews = 36;
+	float m_cullingBenchmarkResult = -1.0f;
+
+	// Merged proxies of the large subtrees that stay still
+	HlodSystem m_hlodSystem;
+
+	// Renderers that stopped changing, drawn a few batches at a time
+	StaticBatcher m_staticBatcher;
+
+	// Renderers hidden behind the nearest solid meshes, skipped for the frame
+	OcclusionCuller m_occlusionCuller;
+
+	// Depth of the scene drawn first when the shading of hidden fragments costs more than a second pass
+	DepthPrepass m_depthPrepass;
+
+	// World matrices of the scene graph, computed in one pass before the draws
+	TransformHierarchy m_transformHierarchy;
+	int m_hierarchyBenchmarkNodes = 1000000;
+	int m_hierarchyBenchmarkShape = 0;
+	TransformHierarchy::BenchmarkResult m_hierarchyBenchmarkResult;
+	TransformKernels::CheckResult m_kernelCheckResult;
+	bool m_kernelsChecked = false;
+
+	// Running translations, rotations and scales of the scene objects
+	AnimationSystem m_animationSystem;
+	AnimationSystem::TrackId m_toolTrack = AnimationSystem::NO_TRACK;     // Screwdriver going down, then back up when it finishes
+	std::vector<AnimationSystem::TrackId> m_deletionTracks;               // The object leaves the scene when its spin finishes
+
+	// Draws of the scene graph, sorted to change the state as little as possible
+	RenderQueue m_renderQueue;
+	int m_recordingBenchmarkPackets = 100000;
+	RenderQueue::BenchmarkResult m_recordingBenchmarkResult;
+
+	// Command buffers of the unchanged subtrees, replayed instead of traversing them
+	RenderBundleCache m_renderBundles;
+
+	// Matrices and colors of the renderers, read by the shaders instead of uniforms set at every draw
+	ObjectDataBuffer m_objectData;
+
+	// Point lights placed in the scene, binned every frame for the texture material
+	LightClusters m_lightClusters;
+	int m_scatteredLightCount = 1024;
+	float m_scatteredLightRadius = 3.0f;
+	float m_scatteredLightIntensity = 2.0f;
+	bool m_animatePointLights = false;
+
 	std::vector<const SceneObject*> m_heapSceneObjects;
 
 	bool m_isHoveringFace = false;
@@ -0,0 +1,154 @@
+/**
+ * @file MappedFile.cpp
+ *
+ * @brief Read-only memory mapping of a whole file.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include "MappedFile.h"
+
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+	if (this != &other)
+	{
+		close();
+		std::swap(m_data, other.m_data);
+		std::swap(m_size, other.m_size);
+		std::swap(m_isOpen, other.m_isOpen);
+#ifdef _WIN32
+		std::swap(m_file, other.m_file);
+		std::swap(m_mapping, other.m_mapping);
+#endif
+	}
+	return *this;
+}
+
+bool MappedFile::open(const std::string& path, bool sequential)
+{
+	close();
+
+#ifdef _WIN32
+	const HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize))
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	m_file = file;
+	m_size = static_cast<std::size_t>(fileSize.QuadPart);
+	m_isOpen = true;
+	if (m_size == 0)
+	{
+		return true;
+	}
+
+	m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_mapping != nullptr)
+	{
+		m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	}
+#else
+	const int file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (file < 0)
+	{
+		return false;
+	}
+
+	struct stat fileStatus;
+	if (fstat(file, &fileStatus) != 0)
+	{
+		::close(file);
+		return false;
+	}
+
+	m_size = static_cast<std::size_t>(fileStatus.st_size);
+	m_isOpen = true;
+	if (m_size > 0)
+	{
+		void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, file, 0);
+		if (data != MAP_FAILED)
+		{
+			m_data = static_cast<const char*>(data);
+			if (sequential)
+			{
+				madvise(data, m_size, MADV_SEQUENTIAL);
+				madvise(data, m_size, MADV_WILLNEED);
+			}
+		}
+	}
+
+	// The mapping keeps its own reference to the file
+	::close(file);
+#endif
+
+	if (m_size > 0 && m_data == nullptr)
+	{
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (m_data != nullptr)
+	{
+		UnmapViewOfFile(m_data);
+	}
+	if (m_mapping != nullptr)
+	{
+		CloseHandle(m_mapping);
+	}
+	if (m_file != nullptr)
+	{
+		CloseHandle(m_file);
+	}
+	m_mapping = nullptr;
+	m_file = nullptr;
+#else
+	if (m_data != nullptr)
+	{
+		munmap(const_cast<char*>(m_data), m_size);
+	}
+#endif
+
+	m_data = nullptr;
+	m_size = 0;
+	m_isOpen = false;
+}
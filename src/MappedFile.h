@@ -0,0 +1,50 @@
+#pragma once
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+/**
+ * @file MappedFile.h
+ *
+ * @brief Read-only memory mapping of a whole file.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include <cstddef>
+#include <string>
+
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+
+	/**
+	 * Map the file. With sequential set, the OS is asked to read the whole file ahead in one pass.
+	 */
+	bool open(const std::string& path, bool sequential = false);
+	void close();
+
+	inline bool isOpen() const { return m_data != nullptr || (m_isOpen && m_size == 0); }
+	inline const char* data() const { return m_data; }
+	inline std::size_t size() const { return m_size; }
+
+private:
+	const char* m_data = nullptr;
+	std::size_t m_size = 0;
+	bool m_isOpen = false;
+
+#ifdef _WIN32
+	void* m_file = nullptr;
+	void* m_mapping = nullptr;
+#endif
+};
+
+#endif
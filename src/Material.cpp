@@ -10,16 +10,29 @@
 
 #include "Material.h"
 
+#include "AssetPack.h"
+
 Material::Material()
 {
 	m_shaderProgram = std::make_unique<ShaderProgram>();
 }
 
+void Material::compile()
+{
+	m_compileSuccess = initShaders(*m_shaderProgram, true);
+	m_shaderProgram->requestLink();
+	m_compiled = true;
+}
+
 bool Material::init()
 {
-	bool shaderSuccess = true;
-	shaderSuccess &= initShaders();
-	shaderSuccess &= m_shaderProgram->link();
+	if (!m_compiled)
+	{
+		compile();
+	}
+
+	bool shaderSuccess = m_compileSuccess;
+	shaderSuccess &= m_shaderProgram->finishLink();
 	if (!shaderSuccess) {
 		std::cerr << "Error when loading main shader" << std::endl;
 		return false;
@@ -35,19 +48,81 @@ void Material::bind() const
 	m_shaderProgram->bind();
 }
 
-bool Material::initShaders()
+bool Material::usesShaderFile(const std::string& fileName) const
+{
+	return !fileName.empty() && (fileName == vertexShader()
+		|| fileName == fragmentShader()
+		|| fileName == tessControlShader()
+		|| fileName == tessEvaluationShader()
+		|| fileName == geometryShader()
+		|| fileName == computeShader());
+}
+
+std::unique_ptr<ShaderProgram> Material::createShaderProgram(const std::map<std::string, GLint>& attributeLocations) const
+{
+	auto shaderProgram = std::make_unique<ShaderProgram>();
+	if (!initShaders(*shaderProgram, false))
+	{
+		return nullptr;
+	}
+
+	shaderProgram->bindAttributeLocations(attributeLocations);
+	shaderProgram->requestLink();
+	return shaderProgram;
+}
+
+std::map<std::string, GLint> Material::attributeLocations() const
+{
+	return m_shaderProgram->activeAttributeLocations();
+}
+
+void Material::beginReload(std::unique_ptr<ShaderProgram> pendingShaderProgram)
+{
+	m_pendingShaderProgram = std::move(pendingShaderProgram);
+}
+
+bool Material::updateReload()
+{
+	if (m_pendingShaderProgram == nullptr || !m_pendingShaderProgram->isLinkComplete())
+	{
+		return false;
+	}
+
+	auto pendingShaderProgram = std::move(m_pendingShaderProgram);
+	if (!pendingShaderProgram->finishLink())
+	{
+		std::cerr << "Shader reload of " << vertexShader() << " / " << fragmentShader() << " failed, keeping the previous program" << std::endl;
+		return false;
+	}
+
+	m_shaderProgram = std::move(pendingShaderProgram);
+	std::cout << "Shader reloaded: " << vertexShader() << " / " << fragmentShader() << std::endl;
+	return true;
+}
+
+bool Material::initShaders(ShaderProgram& shaderProgram, bool usePack) const
 {
 	bool shaderSuccess = true;
-	shaderSuccess &= m_shaderProgram->addShaderFromSource(GL_VERTEX_SHADER, directory + vertexShader());
-	shaderSuccess &= m_shaderProgram->addShaderFromSource(GL_FRAGMENT_SHADER, directory + fragmentShader());
-	if (!tessControlShader().empty()) shaderSuccess &= m_shaderProgram->addShaderFromSource(GL_TESS_CONTROL_SHADER, directory + tessControlShader());
-	if (!tessEvaluationShader().empty()) shaderSuccess &= m_shaderProgram->addShaderFromSource(GL_TESS_EVALUATION_SHADER, directory + tessEvaluationShader());
-	if (!geometryShader().empty()) shaderSuccess &= m_shaderProgram->addShaderFromSource(GL_GEOMETRY_SHADER, directory + geometryShader());
-	if (!computeShader().empty()) shaderSuccess &= m_shaderProgram->addShaderFromSource(GL_COMPUTE_SHADER, directory + computeShader());
+	shaderSuccess &= addShader(shaderProgram, GL_VERTEX_SHADER, vertexShader(), usePack);
+	shaderSuccess &= addShader(shaderProgram, GL_FRAGMENT_SHADER, fragmentShader(), usePack);
+	if (!tessControlShader().empty()) shaderSuccess &= addShader(shaderProgram, GL_TESS_CONTROL_SHADER, tessControlShader(), usePack);
+	if (!tessEvaluationShader().empty()) shaderSuccess &= addShader(shaderProgram, GL_TESS_EVALUATION_SHADER, tessEvaluationShader(), usePack);
+	if (!geometryShader().empty()) shaderSuccess &= addShader(shaderProgram, GL_GEOMETRY_SHADER, geometryShader(), usePack);
+	if (!computeShader().empty()) shaderSuccess &= addShader(shaderProgram, GL_COMPUTE_SHADER, computeShader(), usePack);
 
 	return shaderSuccess;
 }
 
+bool Material::addShader(ShaderProgram& shaderProgram, GLenum type, const std::string& fileName, bool usePack) const
+{
+	AssetPack::Span span;
+	if (usePack && AssetPack::findMounted(fileName, span))
+	{
+		return shaderProgram.addShaderFromCode(type, span.data, span.size);
+	}
+	return shaderProgram.addShaderFromSource(type, directory + fileName);
+}
+
 void Material::setProjectionMatrix(const glm::mat4& projection) const
 {
 	m_shaderProgram->setMat4(projectionAttributeName, projection);
@@ -56,6 +131,7 @@ void Material::setProjectionMatrix(const glm::mat4& projection) const
 void Material::setModelViewMatrix(const glm::mat4& modelView) const
 {
 	m_shaderProgram->setMat4(modelViewAttributeName, modelView);
+	m_shaderProgram->setInt(objectIndexAttributeName, -1);
 }
 
 void Material::setNormalMatrix(const glm::mat3& normalMatrix) const
@@ -67,3 +143,8 @@ void Material::setViewMatrix(const glm::mat4& viewMatrix) const
 {
 	m_shaderProgram->setMat4(viewMatrixAttributeName, viewMatrix);
 }
+
+void Material::setObjectIndex(int objectIndex) const
+{
+	m_shaderProgram->setInt(objectIndexAttributeName, objectIndex);
+}
@@ -22,9 +22,35 @@ public:
 	virtual ~Material() = default;
 	Material();
 
+	/**
+	 * Issue the compilation and link of the shaders without waiting for the result.
+	 * Called on every material before init() so the driver can build them in parallel.
+	 */
+	void compile();
 	bool init();
 	virtual void bind() const;
 
+	/**
+	 * Whether one of the shader stages of this material is read from the given file name.
+	 */
+	bool usesShaderFile(const std::string& fileName) const;
+
+	/**
+	 * Create a new program from the shader files, with the same attribute locations as the
+	 * current one. Can be called from a thread that has a context shared with the main one.
+	 * Always reads the loose files in SHADERS_DIR, even when an asset pack is mounted.
+	 */
+	std::unique_ptr<ShaderProgram> createShaderProgram(const std::map<std::string, GLint>& attributeLocations) const;
+	std::map<std::string, GLint> attributeLocations() const;
+
+	/**
+	 * Hot reload: the current program keeps being used until the pending one is linked.
+	 * updateReload() swaps them once the link succeeded and returns true when it did.
+	 */
+	void beginReload(std::unique_ptr<ShaderProgram> pendingShaderProgram);
+	bool updateReload();
+	bool isReloading() const { return m_pendingShaderProgram != nullptr; }
+
 	virtual GLint positionAttribLocation() const = 0;
 	virtual GLint normalAttribLocation() const = 0;
 	virtual GLint tangentAttribLocation() const = 0;
@@ -35,6 +61,12 @@ public:
 	void setNormalMatrix(const glm::mat3& normalMatrix) const;
 	void setViewMatrix(const glm::mat4& viewMatrix) const;
 
+	/**
+	 * Read the model matrix and the appearance from the slot of ObjectDataBuffer instead of the uniforms.
+	 * Setting the model-view matrix goes back to the uniforms.
+	 */
+	void setObjectIndex(int objectIndex) const;
+
 	virtual void setAppearance(const glm::vec4& ambiantColor, const glm::vec4& diffuseColor, const glm::vec4& specularColor, float specularTerm) const {}
 	virtual void setTexture(unsigned int textureId) const {}
 	virtual void setNormalsTexture(unsigned int textureId) const {}
@@ -50,18 +82,24 @@ protected:
 	virtual inline std::string computeShader() const { return ""; }
 
 private:
-	bool initShaders();
+	bool initShaders(ShaderProgram& shaderProgram, bool usePack) const;
+	bool addShader(ShaderProgram& shaderProgram, GLenum type, const std::string& fileName, bool usePack) const;
 
 protected:
 	std::unique_ptr<ShaderProgram> m_shaderProgram = nullptr;
+	std::unique_ptr<ShaderProgram> m_pendingShaderProgram = nullptr;
 
 private:
 	const std::string directory = SHADERS_DIR;
 
+	bool m_compiled = false;
+	bool m_compileSuccess = false;
+
 	const std::string projectionAttributeName = "projMatrix";
 	const std::string modelViewAttributeName = "mvMatrix";
 	const std::string normalMatrixAttributeName = "normalMatrix";
 	const std::string viewMatrixAttributeName = "viewMatrix";
+	const std::string objectIndexAttributeName = "uObject";
 
 };
 #endif
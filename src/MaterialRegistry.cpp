@@ -0,0 +1,175 @@
+/**
+ * @file MaterialRegistry.cpp
+ *
+ * @brief Colors of the renderers, stored once per distinct material and read by the shaders from a storage buffer.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include "MaterialRegistry.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+bool MaterialRecord::operator==(const MaterialRecord& other) const
+{
+	return ambiantColor == other.ambiantColor && diffuseColor == other.diffuseColor
+		&& specularColor == other.specularColor && parameters == other.parameters;
+}
+
+bool MaterialRegistry::RecordLess::operator()(const MaterialRecord& left, const MaterialRecord& right) const
+{
+	// Any strict order does, the records are only looked up by their exact colors
+	return std::memcmp(&left, &right, sizeof(MaterialRecord)) < 0;
+}
+
+MaterialRegistry& MaterialRegistry::instance()
+{
+	static MaterialRegistry registry;
+	return registry;
+}
+
+MaterialRegistry::Statistics& MaterialRegistry::statistics()
+{
+	static Statistics statistics;
+	return statistics;
+}
+
+uint32_t MaterialRegistry::acquire(const MaterialRecord& record)
+{
+	const auto it = m_indices.find(record);
+	if (it != m_indices.end())
+	{
+		++m_userCounts[it->second];
+		return it->second;
+	}
+
+	uint32_t index;
+	if (!m_freeIndices.empty())
+	{
+		index = m_freeIndices.back();
+		m_freeIndices.pop_back();
+		m_records[index] = record;
+	}
+	else
+	{
+		index = static_cast<uint32_t>(m_records.size());
+		m_records.push_back(record);
+		m_userCounts.push_back(0);
+	}
+
+	m_userCounts[index] = 1;
+	m_indices.emplace(record, index);
+	markDirty(index);
+	return index;
+}
+
+void MaterialRegistry::release(uint32_t index)
+{
+	assert(m_userCounts[index] > 0 && "Released more than acquired");
+	if (--m_userCounts[index] > 0)
+	{
+		return;
+	}
+
+	const auto it = m_indices.find(m_records[index]);
+	if (it != m_indices.end() && it->second == index)
+	{
+		m_indices.erase(it);
+	}
+	m_freeIndices.push_back(index);
+}
+
+uint32_t MaterialRegistry::replace(uint32_t index, const MaterialRecord& record)
+{
+	if (m_records[index] == record)
+	{
+		return index;
+	}
+
+	// Another record already has the colors: share it
+	const auto it = m_indices.find(record);
+	if (it != m_indices.end())
+	{
+		++m_userCounts[it->second];
+		release(index);
+		return it->second;
+	}
+
+	// Nobody else uses the record: edited in place
+	if (m_userCounts[index] == 1)
+	{
+		const auto previous = m_indices.find(m_records[index]);
+		if (previous != m_indices.end() && previous->second == index)
+			m_indices.erase(previous);
+		m_records[index] = record;
+		m_indices.emplace(record, index);
+		markDirty(index);
+		return index;
+	}
+
+	release(index);
+	return acquire(record);
+}
+
+void MaterialRegistry::upload()
+{
+	if (m_records.empty())
+	{
+		return;
+	}
+
+	if (m_buffer == 0)
+	{
+		glGenBuffers(1, &m_buffer);
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffer);
+	auto& registryStatistics = statistics();
+	if (m_bufferCapacity < m_records.size())
+	{
+		// Grown by half at a time, everything is uploaded again
+		m_bufferCapacity = std::max(m_records.size(), m_bufferCapacity + m_bufferCapacity / 2);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(m_bufferCapacity * sizeof(MaterialRecord)), nullptr, GL_DYNAMIC_DRAW);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, static_cast<GLsizeiptr>(m_records.size() * sizeof(MaterialRecord)), m_records.data());
+		registryStatistics.uploadedRecords += m_records.size();
+	}
+	else
+	{
+		std::sort(m_dirtyIndices.begin(), m_dirtyIndices.end());
+		m_dirtyIndices.erase(std::unique(m_dirtyIndices.begin(), m_dirtyIndices.end()), m_dirtyIndices.end());
+		for (std::size_t i = 0; i < m_dirtyIndices.size(); )
+		{
+			std::size_t end = i + 1;
+			while (end < m_dirtyIndices.size() && m_dirtyIndices[end] == m_dirtyIndices[end - 1] + 1)
+				++end;
+
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, static_cast<GLintptr>(m_dirtyIndices[i] * sizeof(MaterialRecord)),
+				static_cast<GLsizeiptr>((end - i) * sizeof(MaterialRecord)), m_records.data() + m_dirtyIndices[i]);
+			i = end;
+		}
+		registryStatistics.uploadedRecords += m_dirtyIndices.size();
+	}
+	m_dirtyIndices.clear();
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIALS_BINDING, m_buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void MaterialRegistry::clear()
+{
+	if (m_buffer != 0)
+	{
+		glDeleteBuffers(1, &m_buffer);
+		m_buffer = 0;
+	}
+	m_bufferCapacity = 0;
+}
+
+void MaterialRegistry::markDirty(uint32_t index)
+{
+	m_dirtyIndices.push_back(index);
+}
@@ -0,0 +1,109 @@
+#pragma once
+#ifndef MATERIALREGISTRY_H
+#define MATERIALREGISTRY_H
+
+/**
+ * @file MaterialRegistry.h
+ *
+ * @brief Colors of the renderers, stored once per distinct material and read by the shaders from a storage buffer.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include <glad/glad.h>
+#include <glm/vec4.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+// Laid out as the std430 MaterialRecord struct of textureShader.frag
+struct MaterialRecord
+{
+	glm::vec4 ambiantColor = glm::vec4(0.05f);
+	glm::vec4 diffuseColor = glm::vec4(1.0f);
+	glm::vec4 specularColor = glm::vec4(1.0f);
+	glm::vec4 parameters = glm::vec4(128.0f, 0.0f, 0.0f, 0.0f);   // x: specular term
+
+	inline float specularTerm() const { return parameters.x; }
+
+	bool operator==(const MaterialRecord& other) const;
+};
+
+static_assert(sizeof(MaterialRecord) == 64, "MaterialRecord has to match its std430 layout");
+
+/**
+ * The renderers reference a record by index, counted. Renderers with the same colors share their record: a
+ * whole imported model usually needs a handful of them. Changing the colors of a renderer moves it to the record
+ * with the new colors, rewriting its own in place when nobody else uses it, so an edit uploads at most one record.
+ *
+ * The records live on the main thread: they are only written between the frames, and read while recording.
+ */
+class MaterialRegistry
+{
+public:
+	// Binding point of the storage buffer, fixed in textureShader.frag
+	static constexpr GLuint MATERIALS_BINDING = 4;
+
+	// Reset by the window every frame
+	struct Statistics
+	{
+		std::size_t uploadedRecords = 0;
+	};
+
+	static MaterialRegistry& instance();
+	static Statistics& statistics();
+
+	MaterialRegistry(const MaterialRegistry&) = delete;
+	MaterialRegistry& operator=(const MaterialRegistry&) = delete;
+
+	/**
+	 * Index of a record with these colors, added when there is none.
+	 */
+	uint32_t acquire(const MaterialRecord& record);
+	void release(uint32_t index);
+
+	/**
+	 * The index now holding the colors of a user of the given record.
+	 */
+	uint32_t replace(uint32_t index, const MaterialRecord& record);
+
+	inline const MaterialRecord& record(uint32_t index) const { return m_records[index]; }
+	inline std::size_t userCount(uint32_t index) const { return m_userCounts[index]; }
+	inline std::size_t recordCount() const { return m_indices.size(); }
+
+	/**
+	 * Once per frame, before the scene is drawn: upload the changed records and bind the buffer.
+	 */
+	void upload();
+
+	/**
+	 * Delete the buffer while the context is still alive, the records stay.
+	 */
+	void clear();
+
+private:
+	MaterialRegistry() = default;
+
+	struct RecordLess
+	{
+		bool operator()(const MaterialRecord& left, const MaterialRecord& right) const;
+	};
+
+	void markDirty(uint32_t index);
+
+private:
+	std::vector<MaterialRecord> m_records;
+	std::vector<std::size_t> m_userCounts;
+	std::map<MaterialRecord, uint32_t, RecordLess> m_indices;   // Of the records in use
+	std::vector<uint32_t> m_freeIndices;
+	std::vector<uint32_t> m_dirtyIndices;
+
+	GLuint m_buffer = 0;
+	std::size_t m_bufferCapacity = 0;   // Records
+};
+
+#endif
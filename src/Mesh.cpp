@@ -7,3 +7,23 @@
  * Billy-Joe Lacasse
  * William Lebel
  */
+
+#include "Mesh.h"
+
+void Mesh::bindVertexArray(GLuint vertexArray)
+{
+	if (s_trackVertexArray && vertexArray == s_boundVertexArray)
+	{
+		return;
+	}
+
+	glBindVertexArray(vertexArray);
+	s_boundVertexArray = vertexArray;
+}
+
+void Mesh::trackVertexArray(bool track)
+{
+	// The bindings made in between are not known, the first one is never skipped
+	s_trackVertexArray = track;
+	s_boundVertexArray = 0;
+}
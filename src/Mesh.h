@@ -12,14 +12,23 @@
  * William Lebel
  */
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <glad/glad.h>
+#include <glm/vec3.hpp>
 #include <vector>
 
 #define BUFFER_OFFSET(i) ((char *)NULL + (i))
 
 class Material;
 
+namespace Meshlets
+{
+	struct CullingView;
+	struct Meshlet;
+}
+
 class Mesh
 {
 public:
@@ -31,14 +40,58 @@ public:
 
 	virtual void faceAt(const glm::vec3& position, glm::vec3& outCenter, glm::vec3& outNormal) const = 0;
 
-	virtual const std::vector<GLfloat>& vertices() = 0;
-	virtual const std::vector<GLfloat>& normals() = 0;
-	virtual const std::vector<GLfloat>& tangents() = 0;
-	virtual const std::vector<GLfloat>& uvs() = 0;
-	virtual const std::vector<GLuint>& indices() = 0;
+	virtual const std::vector<GLfloat>& vertices() const = 0;
+	virtual const std::vector<GLfloat>& normals() const = 0;
+	virtual const std::vector<GLfloat>& tangents() const = 0;
+	virtual const std::vector<GLfloat>& uvs() const = 0;
+	virtual const std::vector<GLuint>& indices() const = 0;
 
 	virtual void bindAndDraw() const = 0;
 	virtual void bindAndDrawConstant() const = 0;
+
+	// Vertex array drawing a level, with all the attributes or only the positions for the constant material
+	virtual GLuint vertexArray(bool constant, std::size_t level) const = 0;
+
+	// Levels of detail, level 0 is the full mesh. The error of a level is its largest distance to the full mesh.
+	virtual std::size_t lodCount() const { return 1; }
+	virtual float lodError(std::size_t /*level*/) const { return 0.0f; }
+	virtual std::size_t triangleCount(std::size_t /*level*/) const { return 0; }
+	virtual void bindAndDrawLod(std::size_t /*level*/) const { bindAndDraw(); }
+	virtual void bindAndDrawConstantLod(std::size_t /*level*/) const { bindAndDrawConstant(); }
+
+	// Full mesh drawn in meshlets, only the visible ones. Return the number of triangles drawn.
+	virtual std::size_t meshletCount() const { return 0; }
+	virtual const Meshlets::Meshlet* meshlets() const { return nullptr; }
+	virtual std::size_t bindAndDrawMeshlets(const Meshlets::CullingView& /*view*/) const { bindAndDraw(); return triangleCount(0); }
+	virtual std::size_t bindAndDrawConstantMeshlets(const Meshlets::CullingView& /*view*/) const { bindAndDrawConstant(); return triangleCount(0); }
+
+	// Full mesh drawn in the ranges of indices culled beforehand by Meshlets::cull, offset and count pairs
+	virtual void bindAndDrawRanges(bool constant, const uint32_t* /*ranges*/, std::size_t /*rangeValueCount*/) const { constant ? bindAndDrawConstant() : bindAndDraw(); }
+
+	// Sphere around the mesh, in model space, to measure its distance to the camera
+	virtual glm::vec3 boundsCenter() const { return glm::vec3(0.0f); }
+	virtual float boundsRadius() const { return 0.0f; }
+
+	// Half size of the box around the mesh, centered on boundsCenter, for the occlusion culling
+	virtual glm::vec3 boundsExtents() const { return glm::vec3(0.0f); }
+
+	// True when the mesh fills its box, so the box can hide what is behind it
+	virtual bool fillsBounds() const { return false; }
+
+	// True when the faces seen from the back are not drawn by the source (a glTF material without doubleSided),
+	// so the normal cones of the meshlets can cull them. The winding of the other meshes is not consistent.
+	virtual bool singleSided() const { return false; }
+
+	/**
+	 * Bind one of the vertex arrays of a mesh to draw it. While a RenderQueue submits its draws nothing else binds
+	 * a vertex array, so the binding is skipped when the same one is already bound.
+	 */
+	static void bindVertexArray(GLuint vertexArray);
+	static void trackVertexArray(bool track);
+
+protected:
+	inline static bool s_trackVertexArray = false;
+	inline static GLuint s_boundVertexArray = 0;
 };
 
 #endif
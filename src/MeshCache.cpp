@@ -0,0 +1,460 @@
+/**
+ * @file MeshCache.cpp
+ *
+ * @brief Binary cache of an imported OBJ file, laid out as the buffers uploaded to OpenGL.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include "MeshCache.h"
+
+#include <glm/common.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <numeric>
+
+#include "AssetPack.h"
+#include "ThreadPool.h"
+
+namespace MeshCache
+{
+	namespace
+	{
+		constexpr std::size_t ALIGNMENT = 16;
+		constexpr std::size_t FLOATS_PER_VERTEX = 3 + 2 + 3;
+
+		uint64_t align(uint64_t offset)
+		{
+			return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+		}
+
+		bool isInside(uint64_t offset, uint64_t size, std::size_t fileSize)
+		{
+			return offset <= fileSize && size <= fileSize - offset;
+		}
+	}
+
+	std::string cachePath(const std::string& sourcePath)
+	{
+		const auto extension = sourcePath.find_last_of('.');
+		const auto directory = sourcePath.find_last_of("/\\");
+		if (extension == std::string::npos || (directory != std::string::npos && extension < directory))
+		{
+			return sourcePath + EXTENSION;
+		}
+		return sourcePath.substr(0, extension) + EXTENSION;
+	}
+
+	bool Cache::load(const std::string& sourcePath)
+	{
+		const std::string path = cachePath(sourcePath);
+		const SourceStamp stamp = stampSource(sourcePath);
+
+		AssetPack::Span span;
+		if (AssetPack::findMounted(path, span) && parse(span.data, span.size, sourcePath, stamp))
+		{
+			std::cout << "Mesh cache loaded from the asset pack: " << AssetPack::assetName(path) << std::endl;
+			return true;
+		}
+
+		bool stampOutdated = false;
+		if (m_file.open(path, true) && parse(m_file.data(), m_file.size(), sourcePath, stamp, &stampOutdated))
+		{
+			if (!stampOutdated)
+			{
+				std::cout << "Mesh cache loaded: " << path << std::endl;
+				return true;
+			}
+
+			// The mapping keeps the file from being written on Windows. The content was checked, it is not hashed again.
+			m_file.close();
+			if (restamp(path, stamp))
+			{
+				std::cout << "Mesh cache stamped with the new write time of " << sourcePath << std::endl;
+			}
+			if (m_file.open(path, true) && parse(m_file.data(), m_file.size(), sourcePath, SourceStamp()))
+			{
+				std::cout << "Mesh cache loaded: " << path << std::endl;
+				return true;
+			}
+		}
+		m_file.close();
+
+		return build(sourcePath, stamp);
+	}
+
+	Cache::SourceStamp Cache::stampSource(const std::string& sourcePath)
+	{
+		SourceStamp stamp;
+		std::error_code error;
+		stamp.size = std::filesystem::file_size(sourcePath, error);
+		if (error)
+		{
+			return stamp;
+		}
+
+		const auto writeTime = std::filesystem::last_write_time(sourcePath, error);
+		if (error)
+		{
+			return stamp;
+		}
+
+		stamp.writeTime = static_cast<int64_t>(writeTime.time_since_epoch().count());
+		stamp.exists = true;
+		return stamp;
+	}
+
+	bool Cache::hashSource(const std::string& sourcePath, uint64_t& outHash)
+	{
+		MappedFile source;
+		if (source.open(sourcePath, true))
+		{
+			outHash = AssetPack::hash(source.data(), source.size());
+			return true;
+		}
+
+		AssetPack::Span span;
+		if (AssetPack::findMounted(sourcePath, span))
+		{
+			outHash = AssetPack::hash(span.data, span.size);
+			return true;
+		}
+		return false;
+	}
+
+	bool Cache::restamp(const std::string& path, const SourceStamp& stamp)
+	{
+		std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+		file.seekp(static_cast<std::streamoff>(offsetof(Header, sourceWriteTime)));
+		file.write(reinterpret_cast<const char*>(&stamp.writeTime), sizeof(stamp.writeTime));
+		if (!file)
+		{
+			std::cerr << "Unable to update the mesh cache " << path << ", the source will be hashed again next time" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	bool Cache::parse(const char* data, std::size_t size, const std::string& sourcePath, const SourceStamp& stamp, bool* outStampOutdated)
+	{
+		m_meshes.clear();
+		m_materials.clear();
+
+		Header header;
+		const Header expected;
+		if (size < sizeof(Header))
+		{
+			return false;
+		}
+		std::memcpy(&header, data, sizeof(Header));
+		if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 || header.version != expected.version || header.fileSize != size)
+		{
+			std::cout << "Mesh cache for " << sourcePath << " has an old format, rebuilding it" << std::endl;
+			return false;
+		}
+
+		// Without the source (shipped in the pack alone), the cache is all there is
+		if (stamp.exists)
+		{
+			bool upToDate = header.sourceSize == stamp.size;
+			if (upToDate && header.sourceWriteTime != stamp.writeTime)
+			{
+				// Touched but maybe not modified (a checkout, a copy): only the content decides
+				uint64_t sourceHash = 0;
+				upToDate = hashSource(sourcePath, sourceHash) && sourceHash == header.sourceHash;
+				if (upToDate && outStampOutdated != nullptr)
+				{
+					*outStampOutdated = true;
+				}
+			}
+			if (!upToDate)
+			{
+				std::cout << "Mesh cache for " << sourcePath << " is out of date, rebuilding it" << std::endl;
+				return false;
+			}
+		}
+
+		if (!isInside(header.meshesOffset, uint64_t(header.meshCount) * sizeof(MeshRecord), size)
+			|| !isInside(header.materialsOffset, uint64_t(header.materialCount) * sizeof(MaterialRecord), size)
+			|| header.meshesOffset % alignof(MeshRecord) != 0 || header.materialsOffset % alignof(MaterialRecord) != 0
+			|| header.namesOffset > size)
+		{
+			std::cerr << "Corrupted mesh cache for " << sourcePath << std::endl;
+			return false;
+		}
+
+		const auto* meshRecords = reinterpret_cast<const MeshRecord*>(data + header.meshesOffset);
+		const auto* materialRecords = reinterpret_cast<const MaterialRecord*>(data + header.materialsOffset);
+		const char* names = data + header.namesOffset;
+		const std::size_t namesSize = size - header.namesOffset;
+
+		m_meshes.reserve(header.meshCount);
+		for (uint32_t i = 0; i < header.meshCount; ++i)
+		{
+			const MeshRecord& record = meshRecords[i];
+			const uint64_t vertexDataSize = uint64_t(record.vertexCount) * FLOATS_PER_VERTEX * sizeof(float);
+			if (!isInside(record.vertexDataOffset, vertexDataSize, size)
+				|| !isInside(record.indexDataOffset, uint64_t(record.indexCount) * sizeof(uint32_t), size)
+				|| record.vertexDataOffset % alignof(float) != 0 || record.indexDataOffset % alignof(uint32_t) != 0
+				|| !isInside(record.nameOffset, record.nameLength, namesSize)
+				|| record.materialID >= header.materialCount
+				|| record.lodCount > MeshSimplifier::MAX_LOD_LEVELS
+				|| !isInside(record.lodIndexDataOffset, uint64_t(record.lodIndexCount) * sizeof(uint32_t), size)
+				|| record.lodIndexDataOffset % alignof(uint32_t) != 0
+				|| std::any_of(record.lods, record.lods + record.lodCount, [&](const MeshSimplifier::LodLevel& level)
+					{ return !isInside(level.indexOffset, level.indexCount, record.lodIndexCount); })
+				|| !isInside(record.meshletDataOffset, uint64_t(record.meshletCount) * sizeof(Meshlets::Meshlet), size)
+				|| record.meshletDataOffset % alignof(Meshlets::Meshlet) != 0)
+			{
+				std::cerr << "Corrupted mesh cache for " << sourcePath << std::endl;
+				m_meshes.clear();
+				return false;
+			}
+
+			MeshView mesh;
+			mesh.name.assign(names + record.nameOffset, record.nameLength);
+			mesh.materialID = record.materialID;
+			mesh.vertexData = reinterpret_cast<const float*>(data + record.vertexDataOffset);
+			mesh.vertexDataSize = static_cast<std::size_t>(vertexDataSize);
+			mesh.vertexCount = record.vertexCount;
+			mesh.indices = reinterpret_cast<const uint32_t*>(data + record.indexDataOffset);
+			mesh.indexCount = record.indexCount;
+			mesh.lodIndices = reinterpret_cast<const uint32_t*>(data + record.lodIndexDataOffset);
+			mesh.lodIndexCount = record.lodIndexCount;
+			mesh.lods.assign(record.lods, record.lods + record.lodCount);
+			mesh.meshlets = reinterpret_cast<const Meshlets::Meshlet*>(data + record.meshletDataOffset);
+			mesh.meshletCount = record.meshletCount;
+			if (std::any_of(mesh.meshlets, mesh.meshlets + mesh.meshletCount, [&](const Meshlets::Meshlet& meshlet)
+				{ return !isInside(meshlet.indexOffset, meshlet.indexCount, record.indexCount); }))
+			{
+				std::cerr << "Corrupted mesh cache for " << sourcePath << std::endl;
+				m_meshes.clear();
+				return false;
+			}
+			mesh.boundsMin = glm::vec3(record.boundsMin[0], record.boundsMin[1], record.boundsMin[2]);
+			mesh.boundsMax = glm::vec3(record.boundsMax[0], record.boundsMax[1], record.boundsMax[2]);
+			m_meshes.push_back(std::move(mesh));
+		}
+
+		m_materials.reserve(header.materialCount);
+		for (uint32_t i = 0; i < header.materialCount; ++i)
+		{
+			const MaterialRecord& record = materialRecords[i];
+			if (!isInside(record.nameOffset, record.nameLength, namesSize))
+			{
+				std::cerr << "Corrupted mesh cache for " << sourcePath << std::endl;
+				m_meshes.clear();
+				m_materials.clear();
+				return false;
+			}
+
+			OBJLoader::Material material;
+			std::copy(record.Ka, record.Ka + 4, material.Ka);
+			std::copy(record.Ke, record.Ke + 4, material.Ke);
+			std::copy(record.Kd, record.Kd + 4, material.Kd);
+			std::copy(record.Ks, record.Ks + 4, material.Ks);
+			material.Kn = record.Kn;
+			material.name.assign(names + record.nameOffset, record.nameLength);
+			m_materials.push_back(std::move(material));
+		}
+
+		m_boundsMin = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+		m_boundsMax = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+		return true;
+	}
+
+	bool Cache::build(const std::string& sourcePath, const SourceStamp& stamp)
+	{
+		OBJLoader::Loader loader;
+		if (!loader.loadFile(sourcePath))
+		{
+			return false;
+		}
+
+		uint64_t sourceHash = 0;
+		hashSource(sourcePath, sourceHash);
+		m_built = serialize(loader, stamp, sourceHash);
+
+		const std::string path = cachePath(sourcePath);
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file.write(m_built.data(), static_cast<std::streamsize>(m_built.size()));
+		if (file)
+		{
+			std::cout << "Mesh cache written: " << path << std::endl;
+		}
+		else
+		{
+			std::cerr << "Unable to write the mesh cache " << path << ", the OBJ will be parsed again next time" << std::endl;
+		}
+
+		// Same views as a cache read from the disk, over the buffer just built
+		return parse(m_built.data(), m_built.size(), sourcePath, SourceStamp());
+	}
+
+	std::vector<char> Cache::serialize(const OBJLoader::Loader& loader, const SourceStamp& stamp, uint64_t sourceHash)
+	{
+		const auto& meshes = loader.getMeshes();
+		const auto& materials = loader.getMaterials();
+
+		Header header;
+		header.meshCount = static_cast<uint32_t>(meshes.size());
+		header.materialCount = static_cast<uint32_t>(materials.size());
+		header.sourceSize = stamp.size;
+		header.sourceWriteTime = stamp.writeTime;
+		header.sourceHash = sourceHash;
+
+		std::string names;
+		std::vector<MeshRecord> meshRecords(meshes.size());
+		std::vector<MaterialRecord> materialRecords(materials.size());
+
+		for (std::size_t i = 0; i < materials.size(); ++i)
+		{
+			const auto& material = materials[i];
+			auto& record = materialRecords[i];
+			std::copy(material.Ka, material.Ka + 4, record.Ka);
+			std::copy(material.Ke, material.Ke + 4, record.Ke);
+			std::copy(material.Kd, material.Kd + 4, record.Kd);
+			std::copy(material.Ks, material.Ks + 4, record.Ks);
+			record.Kn = material.Kn;
+			record.nameOffset = static_cast<uint32_t>(names.size());
+			record.nameLength = static_cast<uint32_t>(material.name.size());
+			names += material.name;
+		}
+
+		header.meshesOffset = align(sizeof(Header));
+		header.materialsOffset = align(header.meshesOffset + meshRecords.size() * sizeof(MeshRecord));
+		header.namesOffset = align(header.materialsOffset + materialRecords.size() * sizeof(MaterialRecord));
+
+		for (std::size_t i = 0; i < meshes.size(); ++i)
+		{
+			meshRecords[i].nameOffset = static_cast<uint32_t>(names.size());
+			meshRecords[i].nameLength = static_cast<uint32_t>(meshes[i].name.size());
+			names += meshes[i].name;
+		}
+
+		// The simplification and the meshlets are the expensive part of the import, the meshes are independent
+		std::vector<MeshSimplifier::LodChain> lodChains(meshes.size());
+		std::vector<Meshlets::MeshletSet> meshletSets(meshes.size());
+		ThreadPool::instance().parallelFor(meshes.size(), 1, [&](std::size_t begin, std::size_t end)
+		{
+			for (std::size_t i = begin; i < end; ++i)
+			{
+				const auto& vertices = meshes[i].vertices;
+				const auto* vertexData = reinterpret_cast<const unsigned char*>(vertices.data());
+
+				MeshSimplifier::VertexInput input;
+				input.positions = { vertexData + offsetof(OBJLoader::Vertex, position), sizeof(OBJLoader::Vertex), sizeof(float) * 3 };
+				input.attributes[0] = { vertexData + offsetof(OBJLoader::Vertex, normal), sizeof(OBJLoader::Vertex), sizeof(float) * 3 };
+				input.attributes[1] = { vertexData + offsetof(OBJLoader::Vertex, uv), sizeof(OBJLoader::Vertex), sizeof(float) * 2 };
+				input.vertexCount = vertices.size();
+
+				// The OBJ meshes are triangle soups, the simplifier welds them by itself
+				std::vector<uint32_t> indices(vertices.size());
+				std::iota(indices.begin(), indices.end(), 0u);
+				lodChains[i] = MeshSimplifier::buildLodChain(input, indices.data(), indices.size());
+				meshletSets[i] = Meshlets::build(input.positions, input.vertexCount, indices.data(), indices.size());
+			}
+		});
+
+		uint64_t offset = align(header.namesOffset + names.size());
+		for (std::size_t i = 0; i < meshes.size(); ++i)
+		{
+			auto& record = meshRecords[i];
+			record.vertexCount = static_cast<uint32_t>(meshes[i].vertices.size());
+			record.indexCount = record.vertexCount;
+			record.materialID = meshes[i].materialID;
+			record.vertexDataOffset = offset;
+			offset = align(offset + uint64_t(record.vertexCount) * FLOATS_PER_VERTEX * sizeof(float));
+		}
+		for (auto& record : meshRecords)
+		{
+			record.indexDataOffset = offset;
+			offset = align(offset + uint64_t(record.indexCount) * sizeof(uint32_t));
+		}
+		for (std::size_t i = 0; i < meshes.size(); ++i)
+		{
+			auto& record = meshRecords[i];
+			const auto& chain = lodChains[i];
+			record.lodCount = static_cast<uint32_t>(chain.levels.size());
+			std::copy(chain.levels.begin(), chain.levels.end(), record.lods);
+			record.lodIndexCount = static_cast<uint32_t>(chain.indices.size());
+			record.lodIndexDataOffset = offset;
+			offset = align(offset + uint64_t(record.lodIndexCount) * sizeof(uint32_t));
+		}
+		for (std::size_t i = 0; i < meshes.size(); ++i)
+		{
+			auto& record = meshRecords[i];
+			record.meshletCount = static_cast<uint32_t>(meshletSets[i].meshlets.size());
+			record.meshletDataOffset = offset;
+			offset = align(offset + uint64_t(record.meshletCount) * sizeof(Meshlets::Meshlet));
+		}
+		header.fileSize = offset;
+
+		std::vector<char> data(static_cast<std::size_t>(header.fileSize), 0);
+
+		glm::vec3 boundsMin(std::numeric_limits<float>::max());
+		glm::vec3 boundsMax(std::numeric_limits<float>::lowest());
+		for (std::size_t i = 0; i < meshes.size(); ++i)
+		{
+			const auto& vertices = meshes[i].vertices;
+			auto& record = meshRecords[i];
+
+			auto* positions = reinterpret_cast<float*>(data.data() + record.vertexDataOffset);
+			float* uvs = positions + 3 * vertices.size();
+			float* normals = positions + 5 * vertices.size();
+			auto* indices = reinterpret_cast<uint32_t*>(data.data() + record.indexDataOffset);
+
+			glm::vec3 meshMin(std::numeric_limits<float>::max());
+			glm::vec3 meshMax(std::numeric_limits<float>::lowest());
+			for (std::size_t v = 0; v < vertices.size(); ++v)
+			{
+				std::copy(vertices[v].position, vertices[v].position + 3, positions + 3 * v);
+				std::copy(vertices[v].uv, vertices[v].uv + 2, uvs + 2 * v);
+				std::copy(vertices[v].normal, vertices[v].normal + 3, normals + 3 * v);
+				indices[v] = static_cast<uint32_t>(v);
+
+				const glm::vec3 position(vertices[v].position[0], vertices[v].position[1], vertices[v].position[2]);
+				meshMin = glm::min(meshMin, position);
+				meshMax = glm::max(meshMax, position);
+			}
+
+			std::copy(lodChains[i].indices.begin(), lodChains[i].indices.end(), reinterpret_cast<uint32_t*>(data.data() + record.lodIndexDataOffset));
+
+			// Same triangles, in the order of the meshlets
+			const auto& meshletSet = meshletSets[i];
+			if (!meshletSet.meshlets.empty())
+			{
+				std::copy(meshletSet.indices.begin(), meshletSet.indices.end(), indices);
+				std::memcpy(data.data() + record.meshletDataOffset, meshletSet.meshlets.data(), meshletSet.meshlets.size() * sizeof(Meshlets::Meshlet));
+			}
+
+			if (!vertices.empty())
+			{
+				std::copy(&meshMin[0], &meshMin[0] + 3, record.boundsMin);
+				std::copy(&meshMax[0], &meshMax[0] + 3, record.boundsMax);
+				boundsMin = glm::min(boundsMin, meshMin);
+				boundsMax = glm::max(boundsMax, meshMax);
+			}
+		}
+
+		if (boundsMin.x <= boundsMax.x)
+		{
+			std::copy(&boundsMin[0], &boundsMin[0] + 3, header.boundsMin);
+			std::copy(&boundsMax[0], &boundsMax[0] + 3, header.boundsMax);
+		}
+
+		std::memcpy(data.data(), &header, sizeof(Header));
+		std::memcpy(data.data() + header.meshesOffset, meshRecords.data(), meshRecords.size() * sizeof(MeshRecord));
+		std::memcpy(data.data() + header.materialsOffset, materialRecords.data(), materialRecords.size() * sizeof(MaterialRecord));
+		std::memcpy(data.data() + header.namesOffset, names.data(), names.size());
+		return data;
+	}
+}
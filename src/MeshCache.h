@@ -0,0 +1,178 @@
+#pragma once
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+/**
+ * @file MeshCache.h
+ *
+ * @brief Binary cache of an imported OBJ file, laid out as the buffers uploaded to OpenGL.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include <glm/vec3.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "Meshlets.h"
+#include "MeshSimplifier.h"
+#include "OBJLoader.h"
+
+// File layout (little endian), sections aligned on 16 bytes:
+//   Header
+//   meshCount x MeshRecord
+//   materialCount x MaterialRecord
+//   names, referenced by nameOffset/nameLength
+//   vertex data: one block per mesh, positions (3 floats) then uvs (2 floats) then normals (3 floats) for all of its vertices
+//   index data: one range of uint32 per mesh, relative to the first vertex of the mesh, grouped by meshlet
+//   level of detail index data: one range of uint32 per mesh, the levels one after the other
+//   meshlets: one array of Meshlets::Meshlet per mesh, ranges of its index data
+// The cache stays valid as long as the source has the same size and either the same write time or the same content hash.
+namespace MeshCache
+{
+	constexpr const char* EXTENSION = ".meshcache";
+
+	struct Header
+	{
+		char magic[4] = { 'O', 'G', 'M', 'C' };
+		uint32_t version = 3;
+		uint32_t meshCount = 0;
+		uint32_t materialCount = 0;
+		uint64_t sourceSize = 0;
+		int64_t sourceWriteTime = 0;
+		uint64_t sourceHash = 0;
+		uint64_t meshesOffset = 0;
+		uint64_t materialsOffset = 0;
+		uint64_t namesOffset = 0;
+		uint64_t fileSize = 0;
+		float boundsMin[3] = {};
+		float boundsMax[3] = {};
+	};
+
+	struct MeshRecord
+	{
+		uint64_t vertexDataOffset = 0;
+		uint64_t indexDataOffset = 0;
+		uint32_t vertexCount = 0;
+		uint32_t indexCount = 0;
+		uint32_t materialID = 0;
+		uint32_t nameOffset = 0;
+		uint32_t nameLength = 0;
+		float boundsMin[3] = {};
+		float boundsMax[3] = {};
+		uint32_t lodCount = 0;
+		uint64_t lodIndexDataOffset = 0;
+		uint32_t lodIndexCount = 0;
+		MeshSimplifier::LodLevel lods[MeshSimplifier::MAX_LOD_LEVELS] = {};
+		uint64_t meshletDataOffset = 0;
+		uint32_t meshletCount = 0;
+		uint32_t reserved = 0;
+	};
+
+	struct MaterialRecord
+	{
+		float Ka[4] = {};
+		float Ke[4] = {};
+		float Kd[4] = {};
+		float Ks[4] = {};
+		float Kn = 0.0f;
+		uint32_t nameOffset = 0;
+		uint32_t nameLength = 0;
+		uint32_t reserved = 0;
+	};
+
+	/**
+	 * One mesh of the cache. The pointers are in the cache and stay valid as long as it is loaded.
+	 */
+	struct MeshView
+	{
+		std::string name;
+		unsigned int materialID = 0;
+
+		// positions, uvs and normals one after the other, ready for a single glBufferData
+		const float* vertexData = nullptr;
+		std::size_t vertexDataSize = 0;
+		std::size_t vertexCount = 0;
+
+		const uint32_t* indices = nullptr;
+		std::size_t indexCount = 0;
+
+		// Simplified versions, their indices use the same vertices
+		const uint32_t* lodIndices = nullptr;
+		std::size_t lodIndexCount = 0;
+		std::vector<MeshSimplifier::LodLevel> lods;
+
+		// Ranges of indices, empty for the small meshes
+		const Meshlets::Meshlet* meshlets = nullptr;
+		std::size_t meshletCount = 0;
+
+		glm::vec3 boundsMin = glm::vec3(0.0f);
+		glm::vec3 boundsMax = glm::vec3(0.0f);
+
+		inline const float* positions() const { return vertexData; }
+		inline const float* uvs() const { return vertexData + 3 * vertexCount; }
+		inline const float* normals() const { return vertexData + 5 * vertexCount; }
+	};
+
+	/**
+	 * "C:/.../tournevis.obj" gives "C:/.../tournevis.meshcache".
+	 */
+	std::string cachePath(const std::string& sourcePath);
+
+	class Cache
+	{
+	public:
+		/**
+		 * Map the cache of the OBJ file at sourcePath (from the asset pack or next to the source).
+		 * When it is missing or out of date, the OBJ is parsed, the levels of detail and the meshlets
+		 * are generated and the cache is written for the next run.
+		 */
+		bool load(const std::string& sourcePath);
+
+		inline const std::vector<MeshView>& meshes() const { return m_meshes; }
+		inline const std::vector<OBJLoader::Material>& materials() const { return m_materials; }
+		inline const glm::vec3& boundsMin() const { return m_boundsMin; }
+		inline const glm::vec3& boundsMax() const { return m_boundsMax; }
+
+	private:
+		struct SourceStamp
+		{
+			bool exists = false;
+			uint64_t size = 0;
+			int64_t writeTime = 0;
+		};
+
+		static SourceStamp stampSource(const std::string& sourcePath);
+		static bool hashSource(const std::string& sourcePath, uint64_t& outHash);
+
+		/**
+		 * outStampOutdated is set when the source was only touched: same content under a new write time.
+		 */
+		bool parse(const char* data, std::size_t size, const std::string& sourcePath, const SourceStamp& stamp, bool* outStampOutdated = nullptr);
+
+		/**
+		 * Write the new write time of the source in the header of the cache file, not to hash it at every launch.
+		 */
+		static bool restamp(const std::string& path, const SourceStamp& stamp);
+		bool build(const std::string& sourcePath, const SourceStamp& stamp);
+
+		static std::vector<char> serialize(const OBJLoader::Loader& loader, const SourceStamp& stamp, uint64_t sourceHash);
+
+	private:
+		MappedFile m_file;
+		std::vector<char> m_built;
+
+		std::vector<MeshView> m_meshes;
+		std::vector<OBJLoader::Material> m_materials;
+		glm::vec3 m_boundsMin = glm::vec3(0.0f);
+		glm::vec3 m_boundsMax = glm::vec3(0.0f);
+	};
+}
+
+#endif
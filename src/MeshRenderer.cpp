@@ -10,14 +10,33 @@
 
 #include "MeshRenderer.h"
 
+#include <algorithm>
 #include <cassert>
-#include <glm/gtc/matrix_inverse.hpp>
 
 #include "Material.h"
 #include "ConstantMaterial.h"
 #include "Camera.h"
+#include "CommandBuffer.h"
+#include "GLTFLoader.h"
 #include "Mesh.h"
 #include "OBJLoader.h"
+#include "ObjectData.h"
+#include "RenderBundle.h"
+#include "RenderQueue.h"
+#include "StaticBatching.h"
+#include "TransformKernels.h"
+
+namespace
+{
+	// FNV-1a 64 bits, over the values instead of the bytes
+	constexpr uint64_t HASH_OFFSET = 14695981039346656037ull;
+	constexpr uint64_t HASH_PRIME = 1099511628211ull;
+
+	// Outcomes of viewOutcome() without a draw, the levels start after them
+	constexpr uint64_t OCCLUDED_OUTCOME = 0;
+	constexpr uint64_t BATCHED_OUTCOME = 1;
+	constexpr uint64_t FIRST_LEVEL_OUTCOME = 2;
+}
 
 inline glm::uvec4 getRGBA(uint32_t packedUint) {
 	const unsigned int blue = packedUint & 255;
@@ -29,7 +48,7 @@ inline glm::uvec4 getRGBA(uint32_t packedUint) {
 }
 
 MeshRenderer::MeshRenderer(const std::shared_ptr<const Mesh>& mesh, const std::shared_ptr<const Material>& material, const std::shared_ptr<const ConstantMaterial>& constantMaterial)
-	: SceneObject(), m_mesh(mesh), m_material(material), m_constantMaterial(constantMaterial)
+	: SceneObject(), m_mesh(mesh), m_material(material), m_constantMaterial(constantMaterial), m_materialIndex(MaterialRegistry::instance().acquire(MaterialRecord()))
 {
 	assert(mesh != nullptr);
 	assert(material != nullptr);
@@ -37,20 +56,60 @@ MeshRenderer::MeshRenderer(const std::shared_ptr<const Mesh>& mesh, const std::s
 }
 
 MeshRenderer::MeshRenderer(SceneObject& parent, const std::shared_ptr<const Mesh>& mesh, const std::shared_ptr<const Material>& material, const std::shared_ptr<const ConstantMaterial>& constantMaterial)
-	: SceneObject(parent), m_mesh(mesh), m_material(material), m_constantMaterial(constantMaterial)
+	: SceneObject(parent), m_mesh(mesh), m_material(material), m_constantMaterial(constantMaterial), m_materialIndex(MaterialRegistry::instance().acquire(MaterialRecord()))
 {
 	assert(mesh != nullptr);
 	assert(material != nullptr);
 	assert(constantMaterial != nullptr);
 }
 
+MeshRenderer::~MeshRenderer()
+{
+	ObjectDataBuffer* objectData = ObjectDataBuffer::instance();
+	if (objectData != nullptr && m_objectSlot != NO_OBJECT_SLOT)
+	{
+		objectData->release(m_objectSlot);
+	}
+	MaterialRegistry::instance().release(m_materialIndex);
+}
+
+MeshRenderer::LodSettings& MeshRenderer::lodSettings()
+{
+	static LodSettings settings;
+	return settings;
+}
+
+MeshRenderer::LodStatistics& MeshRenderer::lodStatistics()
+{
+	static LodStatistics statistics;
+	return statistics;
+}
+
+MeshRenderer::CullingSettings& MeshRenderer::cullingSettings()
+{
+	static CullingSettings settings;
+	return settings;
+}
+
+MeshRenderer::CullingStatistics& MeshRenderer::cullingStatistics()
+{
+	static CullingStatistics statistics;
+	return statistics;
+}
+
+std::vector<MeshRenderer*>& MeshRenderer::staticCandidates()
+{
+	static std::vector<MeshRenderer*> candidates;
+	return candidates;
+}
+
 void MeshRenderer::getFace(const glm::vec3& worldPosition, glm::vec3& outLocalCenter, glm::vec3& outLocalNormal) const
 {
 	const glm::vec3 localPosition = glm::inverse(modelMatrix())* glm::vec4(worldPosition, 1.0f);
 	m_mesh->faceAt(localPosition, outLocalCenter, outLocalNormal);
 }
 
-void MeshRenderer::setColorsFromObjectLoader(OBJLoader::Loader loader, unsigned materialId)
+void MeshRenderer::setColorsFromObjectLoader(const OBJLoader::Loader& loader, unsigned materialId)
 {
 	assert(("Loader must be loaded", loader.isLoaded()));
 	assert(("Invalid material Id", loader.getMaterials().size() > materialId));
@@ -58,31 +117,268 @@ void MeshRenderer::setColorsFromObjectLoader(OBJLoader::Loader loader, unsigned
 	setColors(loader.getMaterials()[materialId]);
 }
 
-void MeshRenderer::setColors(OBJLoader::Material materialData)
+void MeshRenderer::setColors(const OBJLoader::Material& materialData)
+{
+	MaterialRecord record;
+	record.ambiantColor = glm::vec4(materialData.Ka[0], materialData.Ka[1], materialData.Ka[2], materialData.Ka[3]);
+	record.diffuseColor = glm::vec4(materialData.Kd[0], materialData.Kd[1], materialData.Kd[2], materialData.Kd[3]);
+	record.specularColor = glm::vec4(materialData.Ks[0], materialData.Ks[1], materialData.Ks[2], materialData.Ks[3]);
+	record.parameters.x = materialData.Kn;
+	appearance(record);
+}
+
+void MeshRenderer::setColors(const GLTFLoader::Material& materialData)
 {
-	ambiantColor(glm::vec4(materialData.Ka[0], materialData.Ka[1], materialData.Ka[2], materialData.Ka[3]));
-	diffuseColor(glm::vec4(materialData.Kd[0], materialData.Kd[1], materialData.Kd[2], materialData.Kd[3]));
-	specularColor(glm::vec4(materialData.Ks[0], materialData.Ks[1], materialData.Ks[2], materialData.Ks[3]));
-	specularTerm(materialData.Kn);
+	// Approximation of the metallic-roughness model with the Phong parameters of the shaders
+	const glm::vec4 baseColor(materialData.baseColor[0], materialData.baseColor[1], materialData.baseColor[2], materialData.baseColor[3]);
+	const glm::vec4 emissive(materialData.emissive[0], materialData.emissive[1], materialData.emissive[2], 0.0f);
+	const float roughness = glm::clamp(materialData.roughness, 0.05f, 1.0f);
+	const glm::vec3 specular = glm::mix(glm::vec3(0.04f), glm::vec3(baseColor), materialData.metallic) * (1.0f - roughness);
+
+	MaterialRecord record;
+	record.ambiantColor = 0.2f * baseColor + emissive;
+	record.diffuseColor = baseColor * (1.0f - materialData.metallic);
+	record.specularColor = glm::vec4(specular, 1.0f);
+	record.parameters.x = glm::clamp(2.0f / (roughness * roughness * roughness * roughness) - 2.0f, 1.0f, 1000.0f);
+	appearance(record);
+}
+
+void MeshRenderer::appearance(const MaterialRecord& record)
+{
+	if (appearance() == record)
+	{
+		return;
+	}
+
+	m_materialIndex = MaterialRegistry::instance().replace(m_materialIndex, record);
+	appearanceChanged();
+}
+
+void MeshRenderer::ambiantColor(const glm::vec4& newAmbiantColor)
+{
+	MaterialRecord record = appearance();
+	record.ambiantColor = newAmbiantColor;
+	appearance(record);
+}
+
+void MeshRenderer::diffuseColor(const glm::vec4& newDiffuseColor)
+{
+	MaterialRecord record = appearance();
+	record.diffuseColor = newDiffuseColor;
+	appearance(record);
+}
+
+void MeshRenderer::specularColor(const glm::vec4& newSpecularColor)
+{
+	MaterialRecord record = appearance();
+	record.specularColor = newSpecularColor;
+	appearance(record);
+}
+
+void MeshRenderer::specularTerm(float newSpecularTerm)
+{
+	MaterialRecord record = appearance();
+	record.parameters.x = newSpecularTerm;
+	appearance(record);
 }
 
 void MeshRenderer::renderImplementation(const Camera& camera, const glm::mat4& modelMatrix)
 {
-	if (selected())
+	if (RenderBundle* bundle = RenderBundle::recording())
 	{
-		bindAndUpdateMaterialMatrices(*m_constantMaterial, camera, modelMatrix);
-		m_constantMaterial->setColor(m_selectedColor);
-		m_mesh->bindAndDrawConstant();
+		bundle->addRenderer(*this);
 	}
-	else
+
+	if (drawnByStaticBatch(modelMatrix) || m_occluded)
 	{
-		m_material->setAppearance(m_ambiantColor, m_diffuseColor, m_specularColor, m_specularTerm);
-		m_material->setTexture(m_textureIndex);
-		m_material->setNormalsTexture(m_normalsTextureIndex);
+		return;
+	}
 
-		bindAndUpdateMaterialMatrices(*m_material, camera, modelMatrix);
-		m_mesh->bindAndDraw();
+	selectLod(camera, modelMatrix);
+	updateObjectData(modelMatrix);
+
+	if (RenderQueue* renderQueue = RenderQueue::recording())
+	{
+		renderQueue->push(*this, camera);
+		return;
 	}
+
+	// Drawn right away, through a buffer reused by every renderer
+	static CommandBuffer commands;
+	commands.clear();
+	recordDraw(commands, RecordingView(camera), lodStatistics(), cullingStatistics());
+	commands.replay();
+}
+
+const Material& MeshRenderer::drawMaterial() const
+{
+	if (usesConstantMaterial())
+	{
+		return *m_constantMaterial;
+	}
+	return *m_material;
+}
+
+void MeshRenderer::recordDraw(CommandBuffer& commands, const RecordingView& view, LodStatistics& lodStatistics, CullingStatistics& cullingStatistics) const
+{
+	const glm::mat4& modelMatrix = this->modelMatrix();
+	const bool constant = usesConstantMaterial();
+
+	// Same level and meshlets in both passes, the depths have to match
+	const bool meshletCulling = m_lodLevel == 0 && m_mesh->meshletCount() > 0 && cullingSettings().enabled;
+	const std::size_t firstRangeValue = commands.ranges().size();
+	std::size_t drawnTriangles = m_mesh->triangleCount(m_lodLevel);
+	if (meshletCulling)
+	{
+		drawnTriangles = Meshlets::cull(m_mesh->meshlets(), m_mesh->meshletCount(), cullingView(view.viewProjection, view.cameraPosition, modelMatrix), commands.ranges());
+	}
+
+	const bool drawn = !meshletCulling || commands.ranges().size() > firstRangeValue;
+	if (drawn)
+	{
+		const Material& material = drawMaterial();
+		commands.bindProgram(material, view);
+		commands.bindVertexArray(m_mesh->vertexArray(constant, m_lodLevel));
+		if (!constant)
+		{
+			commands.bindTextures(material, m_textureIndex, m_normalsTextureIndex);
+		}
+
+		CommandBuffer::SetUniforms uniforms;
+		uniforms.material = &material;
+		if (m_objectSlot != NO_OBJECT_SLOT && ObjectDataBuffer::active())
+		{
+			uniforms.objectIndex = static_cast<int>(m_objectSlot);
+		}
+		else
+		{
+			uniforms.modelViewMatrix = view.viewMatrix * modelMatrix;
+			uniforms.normalMatrix = TransformKernels::normalMatrix(glm::mat3(uniforms.modelViewMatrix));
+		}
+
+		// The texture material reads its colors from the slot, the constant one only has a uniform color
+		if (s_renderPass == RenderPass::Shading && (uniforms.objectIndex < 0 || constant))
+		{
+			// The constant material takes the diffuse color as its color
+			uniforms.appearance = true;
+			const MaterialRecord& record = appearance();
+			uniforms.ambiantColor = record.ambiantColor;
+			uniforms.diffuseColor = selected() ? m_selectedColor : record.diffuseColor;
+			uniforms.specularColor = record.specularColor;
+			uniforms.specularTerm = record.specularTerm();
+		}
+		commands.setUniforms(uniforms);
+
+		if (meshletCulling)
+			commands.drawRanges(*m_mesh, constant, firstRangeValue);
+		else
+			commands.drawLod(*m_mesh, constant, m_lodLevel);
+	}
+
+	if (s_renderPass != RenderPass::Shading)
+	{
+		return;
+	}
+
+	lodStatistics.drawnTriangles += drawnTriangles;
+	lodStatistics.savedTriangles += m_mesh->triangleCount(0) - m_mesh->triangleCount(m_lodLevel);
+	lodStatistics.renderersPerLevel[std::min<std::size_t>(m_lodLevel, MeshSimplifier::MAX_LOD_LEVELS)] += 1;
+	if (meshletCulling)
+	{
+		cullingStatistics.testedTriangles += m_mesh->triangleCount(0);
+		cullingStatistics.culledTriangles += m_mesh->triangleCount(0) - drawnTriangles;
+	}
+}
+
+bool MeshRenderer::drawnByStaticBatch(const glm::mat4& modelMatrix)
+{
+	// Followed even when batching is disabled, so the batches are still right when it is enabled again
+	if (selected() || modelMatrix != m_staticModelMatrix || m_appearanceVersion != m_staticAppearanceVersion)
+	{
+		m_staticModelMatrix = modelMatrix;
+		m_staticAppearanceVersion = m_appearanceVersion;
+		++m_staticStamp;
+		m_idleFrames = 0;
+		if (m_staticBatch != nullptr)
+		{
+			m_staticBatch->evict(*this);
+		}
+		return false;
+	}
+
+	const auto& settings = StaticBatcher::settings();
+	if (!settings.enabled || m_mobility == Mobility::Movable)
+	{
+		return false;
+	}
+
+	if (m_staticBatch != nullptr)
+	{
+		if (m_staticSlot == NO_STATIC_SLOT)
+		{
+			return false;  // Its batch is not built yet
+		}
+		if (!m_occluded)
+		{
+			m_staticBatch->markVisible(m_staticSlot);
+			if (RenderBundle* bundle = RenderBundle::recording())
+				bundle->addStaticSlot(*m_staticBatch, m_staticSlot);
+		}
+		return true;
+	}
+
+	// Counted once per frame, whatever the number of passes
+	if (s_renderPass == RenderPass::Shading)
+	{
+		m_idleFrames = std::min(m_idleFrames + 1, settings.idleFrames);
+	}
+	if (!m_staticQueued && (m_mobility == Mobility::Static || m_idleFrames >= settings.idleFrames) && canBeBatched())
+	{
+		m_staticQueued = true;
+		staticCandidates().push_back(this);
+	}
+	return false;
+}
+
+void MeshRenderer::updateObjectData(const glm::mat4& modelMatrix)
+{
+	ObjectDataBuffer* objectData = ObjectDataBuffer::instance();
+	if (objectData == nullptr)
+	{
+		return;
+	}
+
+	if (m_objectSlot == NO_OBJECT_SLOT)
+	{
+		m_objectSlot = objectData->allocate();
+		if (m_objectSlot == NO_OBJECT_SLOT)
+		{
+			return;
+		}
+	}
+	else if (modelMatrix == m_objectModelMatrix && m_materialIndex == m_objectMaterialIndex)
+	{
+		return;
+	}
+
+	m_objectModelMatrix = modelMatrix;
+	m_objectMaterialIndex = m_materialIndex;
+
+	// The colors are in the record of the material, edited there
+	ObjectData data;
+	data.modelMatrix = modelMatrix;
+	data.materialIndex = m_materialIndex;
+	data.uniformScale = TransformKernels::uniformScale(glm::mat3(modelMatrix)) ? 1 : 0;
+	objectData->update(m_objectSlot, data);
+}
+
+bool MeshRenderer::canBeBatched() const
+{
+	// Only the meshes keeping their geometry in memory can be merged
+	const std::size_t vertexCount = m_mesh->vertices().size() / 3;
+	return vertexCount > 0 && !m_mesh->indices().empty()
+		&& m_mesh->normals().size() == 3 * vertexCount && m_mesh->uvs().size() == 2 * vertexCount
+		&& (m_mesh->tangents().empty() || m_mesh->tangents().size() == 3 * vertexCount);
 }
 
 void MeshRenderer::renderIdImplementation(const Camera& camera, const glm::mat4& modelMatrix)
@@ -93,7 +389,8 @@ void MeshRenderer::renderIdImplementation(const Camera& camera, const glm::mat4&
 	const auto colorFloat = glm::vec4(color.r / 255.0, color.g / 255.0, color.b / 255.0, color.a / 255.0);
 	m_constantMaterial->setColor(colorFloat);
 
-	m_mesh->bindAndDrawConstant();
+	// Same level as the last frame drawn, the picking pass does not move the camera
+	m_mesh->bindAndDrawConstantLod(m_lodLevel);
 }
 
 void MeshRenderer::bindAndUpdateMaterialMatrices(const Material& material, const Camera& camera, const glm::mat4& modelMatrix) const
@@ -102,10 +399,99 @@ void MeshRenderer::bindAndUpdateMaterialMatrices(const Material& material, const
 
 	const glm::mat4 viewMatrix = camera.viewMatrix();
 	const glm::mat4 modelViewMatrix = viewMatrix * modelMatrix;
-	const glm::mat3 normalMat = glm::inverseTranspose(glm::mat3(modelViewMatrix));
+	const glm::mat3 normalMat = TransformKernels::normalMatrix(glm::mat3(modelViewMatrix));
 
 	material.setModelViewMatrix(modelViewMatrix);
     material.setViewMatrix(viewMatrix);
 	material.setProjectionMatrix(camera.projectionMatrix());
 	material.setNormalMatrix(normalMat);
 }
+
+float MeshRenderer::projectedPixelsPerUnit(const Camera& camera, const glm::mat4& modelMatrix, const glm::vec3& boundsCenter, float boundsRadius)
+{
+	const glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(boundsCenter, 1.0f));
+	const float scale = std::max({ glm::length(glm::vec3(modelMatrix[0])), glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2])) });
+	const float distance = std::max(glm::length(center - camera.position()) - boundsRadius * scale, 0.001f);
+	return camera.projectionMatrix()[1][1] * 0.5f * lodSettings().viewportHeight * scale / distance;
+}
+
+void MeshRenderer::selectLod(const Camera& camera, const glm::mat4& modelMatrix)
+{
+	const auto& settings = lodSettings();
+	const std::size_t levelCount = m_mesh->lodCount();
+	if (!settings.enabled || levelCount <= 1)
+	{
+		m_lodLevel = 0;
+		return;
+	}
+	if (settings.forcedLevel >= 0)
+	{
+		m_lodLevel = std::min(static_cast<std::size_t>(settings.forcedLevel), levelCount - 1);
+		return;
+	}
+
+	const float pixelsPerUnit = projectedPixelsPerUnit(camera, modelMatrix, m_mesh->boundsCenter(), m_mesh->boundsRadius());
+
+	std::size_t level = std::min(m_lodLevel, levelCount - 1);
+	while (level > 0 && m_mesh->lodError(level) * pixelsPerUnit > settings.pixelError * (1.0f + settings.hysteresis))
+	{
+		--level;
+	}
+	while (level + 1 < levelCount && m_mesh->lodError(level + 1) * pixelsPerUnit < settings.pixelError * (1.0f - settings.hysteresis))
+	{
+		++level;
+	}
+	m_lodLevel = level;
+}
+
+Meshlets::CullingView MeshRenderer::cullingView(const glm::mat4& viewProjection, const glm::vec3& cameraPosition, const glm::mat4& modelMatrix) const
+{
+	auto view = Meshlets::makeCullingView(viewProjection * modelMatrix, modelMatrix, cameraPosition);
+	view.frustumCulling = cullingSettings().frustumCulling;
+	view.coneCulling = cullingSettings().coneCulling || m_mesh->singleSided();
+	return view;
+}
+
+void MeshRenderer::measureCulling(const glm::mat4& viewProjection, const glm::vec3& cameraPosition, CullingStatistics& statistics) const
+{
+	if (m_mesh->meshletCount() == 0)
+	{
+		return;
+	}
+
+	std::vector<uint32_t> ranges;
+	const auto view = cullingView(viewProjection, cameraPosition, modelMatrix());
+	const std::size_t visibleTriangles = Meshlets::cull(m_mesh->meshlets(), m_mesh->meshletCount(), view, ranges);
+	statistics.testedTriangles += m_mesh->triangleCount(0);
+	statistics.culledTriangles += m_mesh->triangleCount(0) - visibleTriangles;
+}
+
+uint64_t MeshRenderer::viewOutcome(const Camera& camera, const RecordingView& view)
+{
+	// The decisions of renderImplementation, for a renderer whose matrix and appearance did not change
+	if (m_occluded)
+	{
+		return OCCLUDED_OUTCOME;
+	}
+	if (StaticBatcher::settings().enabled && m_mobility != Mobility::Movable && isStaticBatched())
+	{
+		return BATCHED_OUTCOME;
+	}
+
+	selectLod(camera, modelMatrix());
+	uint64_t outcome = FIRST_LEVEL_OUTCOME + m_lodLevel;
+	if (m_lodLevel == 0 && m_mesh->meshletCount() > 0 && cullingSettings().enabled)
+	{
+		// Only ever called on the GL thread, during the traversal
+		static std::vector<uint32_t> ranges;
+		ranges.clear();
+		Meshlets::cull(m_mesh->meshlets(), m_mesh->meshletCount(), cullingView(view.viewProjection, view.cameraPosition, modelMatrix()), ranges);
+
+		outcome ^= HASH_OFFSET;
+		for (const uint32_t value : ranges)
+		{
+			outcome = (outcome ^ value) * HASH_PRIME;
+		}
+	}
+	return outcome;
+}
@@ -12,13 +12,22 @@
  * William Lebel
  */
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <vector>
 
+#include "MaterialRegistry.h"
+#include "Meshlets.h"
+#include "MeshSimplifier.h"
 #include "SceneObject.h"
 
+class CommandBuffer;
 class Material;
 class ConstantMaterial;
 class Mesh;
+class StaticBatch;
+struct RecordingView;
 
 namespace OBJLoader
 {
@@ -26,43 +35,180 @@ namespace OBJLoader
 	class Loader;
 }
 
+namespace GLTFLoader
+{
+	struct Material;
+}
+
 class MeshRenderer : public SceneObject
 {
 public:
+	// Level of detail selection, shared by every renderer
+	struct LodSettings
+	{
+		bool enabled = true;
+		float pixelError = 1.0f;    // Largest error of a level on the screen, in pixels
+		float hysteresis = 0.25f;   // Fraction of pixelError to go past before changing level, so a mesh at the limit does not pop every frame
+		int forcedLevel = -1;
+		float viewportHeight = 800.0f;
+	};
+
+	// Reset by the window every frame
+	struct LodStatistics
+	{
+		std::size_t drawnTriangles = 0;
+		std::size_t savedTriangles = 0;
+		std::size_t renderersPerLevel[MeshSimplifier::MAX_LOD_LEVELS + 1] = {};
+	};
+
+	// Meshlet culling of the full meshes, the simplified levels are drawn whole
+	struct CullingSettings
+	{
+		bool enabled = true;
+		bool frustumCulling = true;
+		bool coneCulling = false;    // On every mesh, not only the single-sided ones: without GL_CULL_FACE, open meshes lose their back side
+	};
+
+	struct CullingStatistics
+	{
+		std::size_t testedTriangles = 0;
+		std::size_t culledTriangles = 0;
+	};
+
+	static LodSettings& lodSettings();
+	static LodStatistics& lodStatistics();
+	static CullingSettings& cullingSettings();
+	static CullingStatistics& cullingStatistics();
+
+	// Renderers that stop changing are drawn by a StaticBatch instead of on their own
+	enum class Mobility
+	{
+		Automatic,   // Batched after StaticBatcher::Settings::idleFrames frames without a change
+		Static,      // Batched as soon as it stops changing
+		Movable      // Always drawn on its own
+	};
+
+	// What a traversal of the scene draws, set by DepthPrepass around its own traversals
+	enum class RenderPass
+	{
+		Shading,     // The materials, with the statistics of the frame
+		DepthOnly    // The positions with the constant material, which the caller has bound and colored
+	};
+
+	static inline RenderPass renderPass() { return s_renderPass; }
+	static inline void renderPass(RenderPass pass) { s_renderPass = pass; }
+
+	/**
+	 * Renderers ready to be batched, added during the traversal and taken by StaticBatcher::update.
+	 */
+	static std::vector<MeshRenderer*>& staticCandidates();
+
+	/**
+	 * Pixels covered by one unit of model space at the nearest point of a bounding sphere, to turn an error into pixels.
+	 */
+	static float projectedPixelsPerUnit(const Camera& camera, const glm::mat4& modelMatrix, const glm::vec3& boundsCenter, float boundsRadius);
+
 	MeshRenderer(const std::shared_ptr<const Mesh>& mesh, const std::shared_ptr<const Material>& material, const std::shared_ptr<const ConstantMaterial>& constantMaterial);
 	MeshRenderer(SceneObject& parent, const std::shared_ptr<const Mesh>& mesh, const std::shared_ptr<const Material>& material, const std::shared_ptr<const ConstantMaterial>& constantMaterial);
+	~MeshRenderer() override;
 
 	void getFace(const glm::vec3& worldPosition, glm::vec3& outLocalCenter, glm::vec3& outLocalNormal) const;
 
-	inline void selectedColor(const glm::vec4& newSelectedColor) { m_selectedColor = newSelectedColor; }
-	inline void textureIndex(unsigned int newTextureIndex) { m_textureIndex = newTextureIndex; }
-	inline void normalsTextureIndex(unsigned int newNormalsTextureIndex) { m_normalsTextureIndex = newNormalsTextureIndex; }
-
-	inline glm::vec4& ambiantColor() { return m_ambiantColor; }
-	inline glm::vec4& diffuseColor() { return m_diffuseColor; }
-	inline glm::vec4& specularColor() { return m_specularColor; }
-	inline float& specularTerm() { return m_specularTerm; }
-
-	inline const glm::vec4& ambiantColor() const { return m_ambiantColor; }
-	inline const glm::vec4& diffuseColor() const { return m_diffuseColor; }
-	inline const glm::vec4& specularColor() const { return m_specularColor; }
-	inline const float& specularTerm() const { return m_specularTerm; }
-
-	inline void ambiantColor(const glm::vec4& newAmbiantColor) { m_ambiantColor = newAmbiantColor; }
-	inline void diffuseColor(const glm::vec4& newDiffuseColor) { m_diffuseColor = newDiffuseColor; }
-	inline void specularColor(const glm::vec4& newSpecularColor) { m_specularColor = newSpecularColor; }
-	inline void specularTerm(float newSpecularTerm) { m_specularTerm = newSpecularTerm; }
-
-	void setColorsFromObjectLoader(OBJLoader::Loader loader, unsigned int materialId);
+	inline void selectedColor(const glm::vec4& newSelectedColor) { m_selectedColor = newSelectedColor; appearanceChanged(); }
+	inline void textureIndex(unsigned int newTextureIndex) { m_textureIndex = newTextureIndex; appearanceChanged(); }
+	inline void normalsTextureIndex(unsigned int newNormalsTextureIndex) { m_normalsTextureIndex = newNormalsTextureIndex; appearanceChanged(); }
+	inline unsigned int textureIndex() const { return m_textureIndex; }
+	inline unsigned int normalsTextureIndex() const { return m_normalsTextureIndex; }
+
+	inline const std::shared_ptr<const Mesh>& mesh() const { return m_mesh; }
+	inline const std::shared_ptr<const Material>& material() const { return m_material; }
+
+	/**
+	 * The colors, in a record of the MaterialRegistry shared with the renderers having the same.
+	 */
+	inline const MaterialRecord& appearance() const { return MaterialRegistry::instance().record(m_materialIndex); }
+	void appearance(const MaterialRecord& record);
+	inline uint32_t materialIndex() const { return m_materialIndex; }
+
+	inline const glm::vec4& ambiantColor() const { return appearance().ambiantColor; }
+	inline const glm::vec4& diffuseColor() const { return appearance().diffuseColor; }
+	inline const glm::vec4& specularColor() const { return appearance().specularColor; }
+	inline float specularTerm() const { return appearance().specularTerm(); }
+
+	void ambiantColor(const glm::vec4& newAmbiantColor);
+	void diffuseColor(const glm::vec4& newDiffuseColor);
+	void specularColor(const glm::vec4& newSpecularColor);
+	void specularTerm(float newSpecularTerm);
+
+	/**
+	 * Called when something the batches, proxies and bundles draw from changed, besides the transform.
+	 */
+	inline void appearanceChanged() { ++m_appearanceVersion; markChanged(); }
+
+	inline void mobility(Mobility newMobility) { m_mobility = newMobility; }
+	inline Mobility mobility() const { return m_mobility; }
+	inline bool isStaticBatched() const { return m_staticBatch != nullptr && m_staticSlot != NO_STATIC_SLOT; }
+
+	// Set by the OcclusionCuller for the current frame
+	inline void occluded(bool isOccluded) { m_occluded = isOccluded; }
+	inline bool occluded() const { return m_occluded; }
+
+	void setColorsFromObjectLoader(const OBJLoader::Loader& loader, unsigned int materialId);
+	void setColors(const OBJLoader::Material& materialData);
+	void setColors(const GLTFLoader::Material& materialData);
+
+	inline std::size_t lodLevel() const { return m_lodLevel; }
+
+	/**
+	 * Material of the next draw: the constant one when selected or in the depth-only pass.
+	 */
+	inline bool usesConstantMaterial() const { return selected() || s_renderPass == RenderPass::DepthOnly; }
+	const Material& drawMaterial() const;
+
+	/**
+	 * Add the draw of the last selected level to a command buffer, without any GL call: the RenderQueue records
+	 * its draws on several threads. The statistics are those of the buffer, merged once it is recorded.
+	 */
+	void recordDraw(CommandBuffer& commands, const RecordingView& view, LodStatistics& lodStatistics, CullingStatistics& cullingStatistics) const;
+
+	/**
+	 * Cull the meshlets for another camera without drawing, with the model matrix of the last frame.
+	 */
+	void measureCulling(const glm::mat4& viewProjection, const glm::vec3& cameraPosition, CullingStatistics& statistics) const;
+
+	/**
+	 * What the camera decides for the renderer, besides the order of its draw: hidden, drawn by its static batch,
+	 * or its level of detail and, at the full level, its visible meshlets. The level is selected like in a
+	 * traversal, with the model matrix of the last frame. Compared by RenderBundle to replay for another camera.
+	 */
+	uint64_t viewOutcome(const Camera& camera, const RecordingView& view);
 
 protected:
 	virtual void renderImplementation(const Camera& camera, const glm::mat4& modelMatrix) override;
 	virtual void renderIdImplementation(const Camera& camera, const glm::mat4& modelMatrix) override;
 
 	void bindAndUpdateMaterialMatrices(const Material& material, const Camera& camera, const glm::mat4& modelMatrix) const;
+	void selectLod(const Camera& camera, const glm::mat4& modelMatrix);
+	Meshlets::CullingView cullingView(const glm::mat4& viewProjection, const glm::vec3& cameraPosition, const glm::mat4& modelMatrix) const;
+
+	/**
+	 * Follow the changes of the renderer, evicting it from its batch or offering it to one.
+	 * True when its batch draws it this frame.
+	 */
+	bool drawnByStaticBatch(const glm::mat4& modelMatrix);
+	bool canBeBatched() const;
+
+	/**
+	 * Write the slot of the renderer in ObjectDataBuffer when its matrix or material changed since.
+	 */
+	void updateObjectData(const glm::mat4& modelMatrix);
 
 private:
-	void setColors(OBJLoader::Material materialData);
+	friend class StaticBatch;
+	friend class StaticBatcher;
+
+	static constexpr uint32_t NO_STATIC_SLOT = ~uint32_t(0);
+	static constexpr uint32_t NO_OBJECT_SLOT = ~uint32_t(0);   // Same as ObjectDataBuffer::NO_SLOT
 
 	std::shared_ptr<const Mesh> m_mesh;
 	std::shared_ptr<const Material> m_material;
@@ -73,10 +219,26 @@ private:
 	int m_textureIndex = 1;
 	int m_normalsTextureIndex = 2;
 
-	glm::vec4 m_ambiantColor = glm::vec4(0.05f);
-	glm::vec4 m_diffuseColor = glm::vec4(1.0f);
-	glm::vec4 m_specularColor = glm::vec4(1.0f);
-	float m_specularTerm = 128.0f;
+	uint32_t m_materialIndex = 0;   // Counted in the MaterialRegistry
+
+	std::size_t m_lodLevel = 0;
+	bool m_occluded = false;
+
+	Mobility m_mobility = Mobility::Automatic;
+	uint64_t m_appearanceVersion = 0;
+	glm::mat4 m_staticModelMatrix = glm::mat4(0.0f);     // As last seen, with the appearance version below
+	uint64_t m_staticAppearanceVersion = 0;
+	uint64_t m_staticStamp = 0;                          // Changes seen, a batch built before the last one does not draw the renderer
+	int m_idleFrames = 0;
+	bool m_staticQueued = false;
+	StaticBatch* m_staticBatch = nullptr;                // The batch of the renderer, or the one it waits for
+	uint32_t m_staticSlot = NO_STATIC_SLOT;
+
+	uint32_t m_objectSlot = NO_OBJECT_SLOT;              // In ObjectDataBuffer, taken when first drawn
+	glm::mat4 m_objectModelMatrix = glm::mat4(0.0f);     // As last written in the slot, with the material below
+	uint32_t m_objectMaterialIndex = 0;
+
+	inline static RenderPass s_renderPass = RenderPass::Shading;
 };
 
 #endif
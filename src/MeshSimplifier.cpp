@@ -0,0 +1,415 @@
+/**
+ * @file MeshSimplifier.cpp
+ *
+ * @brief Quadric error metric simplification, used to build the levels of detail of the imported meshes.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include "MeshSimplifier.h"
+
+#include <glm/geometric.hpp>
+#include <glm/vec3.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+
+namespace
+{
+	constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+	// Sum of the squared distances to the planes of the triangles around a vertex, weighted by their area
+	struct Quadric
+	{
+		double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+		double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+		double c = 0.0;
+		double weight = 0.0;
+
+		void addPlane(const glm::dvec3& normal, double distance, double planeWeight)
+		{
+			a00 += planeWeight * normal.x * normal.x;
+			a01 += planeWeight * normal.x * normal.y;
+			a02 += planeWeight * normal.x * normal.z;
+			a11 += planeWeight * normal.y * normal.y;
+			a12 += planeWeight * normal.y * normal.z;
+			a22 += planeWeight * normal.z * normal.z;
+			b0 += planeWeight * normal.x * distance;
+			b1 += planeWeight * normal.y * distance;
+			b2 += planeWeight * normal.z * distance;
+			c += planeWeight * distance * distance;
+			weight += planeWeight;
+		}
+
+		void add(const Quadric& other)
+		{
+			a00 += other.a00; a01 += other.a01; a02 += other.a02;
+			a11 += other.a11; a12 += other.a12; a22 += other.a22;
+			b0 += other.b0; b1 += other.b1; b2 += other.b2;
+			c += other.c;
+			weight += other.weight;
+		}
+
+		double evaluate(const glm::dvec3& p) const
+		{
+			return a00 * p.x * p.x + 2.0 * a01 * p.x * p.y + 2.0 * a02 * p.x * p.z
+				+ a11 * p.y * p.y + 2.0 * a12 * p.y * p.z + a22 * p.z * p.z
+				+ 2.0 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+		}
+	};
+
+	// Squared distance, per unit of area, of moving both vertices of the edge to position
+	double collapseCost(const Quadric& from, const Quadric& to, const glm::dvec3& position)
+	{
+		const double weight = from.weight + to.weight;
+		return weight > 0.0 ? std::max(from.evaluate(position) + to.evaluate(position), 0.0) / weight : 0.0;
+	}
+
+	glm::vec3 readPosition(const MeshSimplifier::AttributeStream& positions, std::size_t vertex)
+	{
+		glm::vec3 position;
+		std::memcpy(&position[0], positions.data + vertex * positions.stride, sizeof(glm::vec3));
+		return position;
+	}
+
+	bool positionLess(const glm::vec3& a, const glm::vec3& b)
+	{
+		if (a.x != b.x)
+			return a.x < b.x;
+		if (a.y != b.y)
+			return a.y < b.y;
+		return a.z < b.z;
+	}
+
+	int compareAttributes(const MeshSimplifier::VertexInput& vertices, uint32_t a, uint32_t b)
+	{
+		for (const auto& attribute : vertices.attributes)
+		{
+			if (attribute.data == nullptr)
+				continue;
+
+			const int result = std::memcmp(attribute.data + a * attribute.stride, attribute.data + b * attribute.stride, attribute.size);
+			if (result != 0)
+				return result;
+		}
+		return 0;
+	}
+}
+
+namespace MeshSimplifier
+{
+	std::vector<uint32_t> simplify(const VertexInput& vertices, const uint32_t* indices, std::size_t indexCount, std::size_t targetIndexCount, float& outError)
+	{
+		outError = 0.0f;
+		const std::size_t vertexCount = vertices.vertexCount;
+
+		// Vertices at the same position form a group, the collapses move groups
+		std::vector<glm::vec3> positions(vertexCount);
+		for (std::size_t v = 0; v < vertexCount; ++v)
+			positions[v] = readPosition(vertices.positions, v);
+
+		std::vector<uint32_t> order(vertexCount);
+		std::iota(order.begin(), order.end(), 0u);
+		std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return positionLess(positions[a], positions[b]); });
+
+		std::vector<uint32_t> groupOf(vertexCount);
+		std::vector<glm::dvec3> groupPositions;
+		for (std::size_t i = 0; i < vertexCount; ++i)
+		{
+			if (i == 0 || positions[order[i]] != positions[order[i - 1]])
+				groupPositions.emplace_back(positions[order[i]]);
+			groupOf[order[i]] = static_cast<uint32_t>(groupPositions.size() - 1);
+		}
+		const std::size_t groupCount = groupPositions.size();
+
+		// Vertices of a group with the same attributes are interchangeable: a wedge, named by its first vertex
+		std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+		{
+			if (groupOf[a] != groupOf[b])
+				return groupOf[a] < groupOf[b];
+			const int attributes = compareAttributes(vertices, a, b);
+			return attributes != 0 ? attributes < 0 : a < b;
+		});
+
+		std::vector<uint32_t> wedgeOf(vertexCount);
+		for (std::size_t i = 0; i < vertexCount; ++i)
+		{
+			const bool sameWedge = i > 0 && groupOf[order[i]] == groupOf[order[i - 1]] && compareAttributes(vertices, order[i], order[i - 1]) == 0;
+			wedgeOf[order[i]] = sameWedge ? wedgeOf[order[i - 1]] : order[i];
+		}
+		std::vector<uint32_t>().swap(order);
+		std::vector<glm::vec3>().swap(positions);
+
+		// Triangles as wedges, the degenerate ones are dropped right away
+		std::vector<uint32_t> triangles;
+		triangles.reserve(indexCount / 3 * 3);
+		for (std::size_t i = 0; i + 2 < indexCount; i += 3)
+		{
+			const uint32_t a = wedgeOf[indices[i]], b = wedgeOf[indices[i + 1]], c = wedgeOf[indices[i + 2]];
+			if (groupOf[a] != groupOf[b] && groupOf[b] != groupOf[c] && groupOf[a] != groupOf[c])
+			{
+				triangles.push_back(a);
+				triangles.push_back(b);
+				triangles.push_back(c);
+			}
+		}
+
+		// Locked: more than one wedge (UV seam, normal crease), or an edge without exactly two triangles (border, non-manifold)
+		std::vector<uint32_t> groupWedge(groupCount, NONE);
+		std::vector<char> locked(groupCount, 0);
+		for (const uint32_t wedge : triangles)
+		{
+			uint32_t& firstWedge = groupWedge[groupOf[wedge]];
+			if (firstWedge == NONE)
+				firstWedge = wedge;
+			else if (firstWedge != wedge)
+				locked[groupOf[wedge]] = 1;
+		}
+
+		std::vector<uint64_t> edges;
+		edges.reserve(triangles.size());
+		for (std::size_t t = 0; t < triangles.size(); t += 3)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				const uint64_t a = groupOf[triangles[t + k]];
+				const uint64_t b = groupOf[triangles[t + (k + 1) % 3]];
+				edges.push_back(std::min(a, b) << 32 | std::max(a, b));
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		for (std::size_t i = 0; i < edges.size(); )
+		{
+			std::size_t end = i + 1;
+			while (end < edges.size() && edges[end] == edges[i])
+				++end;
+			if (end - i != 2)
+			{
+				locked[edges[i] >> 32] = 1;
+				locked[edges[i] & 0xFFFFFFFFu] = 1;
+			}
+			i = end;
+		}
+		std::vector<uint64_t>().swap(edges);
+
+		std::vector<Quadric> quadrics(groupCount);
+		for (std::size_t t = 0; t < triangles.size(); t += 3)
+		{
+			const glm::dvec3& p0 = groupPositions[groupOf[triangles[t]]];
+			const glm::dvec3& p1 = groupPositions[groupOf[triangles[t + 1]]];
+			const glm::dvec3& p2 = groupPositions[groupOf[triangles[t + 2]]];
+			const glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+			const double length = glm::length(normal);
+			if (length <= 0.0)
+				continue;
+
+			const glm::dvec3 unitNormal = normal / length;
+			for (int k = 0; k < 3; ++k)
+				quadrics[groupOf[triangles[t + k]]].addPlane(unitNormal, -glm::dot(unitNormal, p0), 0.5 * length);
+		}
+
+		struct Collapse
+		{
+			uint32_t from;
+			uint32_t to;
+			double cost;
+		};
+
+		const std::size_t targetTriangles = targetIndexCount / 3;
+		std::vector<uint32_t> adjacencyOffsets(groupCount + 1);
+		std::vector<uint32_t> adjacency;
+		std::vector<double> bestCost(groupCount);
+		std::vector<uint32_t> bestTarget(groupCount);
+		std::vector<char> touched(groupCount);
+		std::vector<uint32_t> wedgeRemap(vertexCount);
+		std::vector<uint32_t> fromNeighbors;
+		std::vector<uint32_t> toNeighbors;
+		double maxCost = 0.0;
+
+		// Each pass collapses the cheapest edges that do not touch each other, then the triangles are rebuilt
+		while (triangles.size() / 3 > targetTriangles)
+		{
+			std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0u);
+			for (const uint32_t wedge : triangles)
+				++adjacencyOffsets[groupOf[wedge] + 1];
+			std::partial_sum(adjacencyOffsets.begin(), adjacencyOffsets.end(), adjacencyOffsets.begin());
+			adjacency.resize(triangles.size());
+			{
+				std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+				for (std::size_t i = 0; i < triangles.size(); ++i)
+					adjacency[fill[groupOf[triangles[i]]]++] = static_cast<uint32_t>(i / 3);
+			}
+
+			std::fill(bestCost.begin(), bestCost.end(), std::numeric_limits<double>::max());
+			std::fill(bestTarget.begin(), bestTarget.end(), NONE);
+			for (std::size_t t = 0; t < triangles.size(); t += 3)
+			{
+				for (int k = 0; k < 3; ++k)
+				{
+					const uint32_t a = groupOf[triangles[t + k]];
+					const uint32_t b = groupOf[triangles[t + (k + 1) % 3]];
+					for (const auto& [from, to] : { std::make_pair(a, b), std::make_pair(b, a) })
+					{
+						if (locked[from])
+							continue;
+
+						const double cost = collapseCost(quadrics[from], quadrics[to], groupPositions[to]);
+						if (cost < bestCost[from])
+						{
+							bestCost[from] = cost;
+							bestTarget[from] = to;
+						}
+					}
+				}
+			}
+
+			std::vector<Collapse> collapses;
+			for (uint32_t group = 0; group < groupCount; ++group)
+			{
+				if (bestTarget[group] != NONE)
+					collapses.push_back({ group, bestTarget[group], bestCost[group] });
+			}
+			std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+			auto neighbors = [&](uint32_t group, std::vector<uint32_t>& outNeighbors)
+			{
+				outNeighbors.clear();
+				for (uint32_t i = adjacencyOffsets[group]; i < adjacencyOffsets[group + 1]; ++i)
+				{
+					for (int k = 0; k < 3; ++k)
+					{
+						const uint32_t other = groupOf[triangles[3 * adjacency[i] + k]];
+						if (other != group)
+							outNeighbors.push_back(other);
+					}
+				}
+				std::sort(outNeighbors.begin(), outNeighbors.end());
+				outNeighbors.erase(std::unique(outNeighbors.begin(), outNeighbors.end()), outNeighbors.end());
+			};
+
+			std::fill(touched.begin(), touched.end(), 0);
+			std::iota(wedgeRemap.begin(), wedgeRemap.end(), 0u);
+			const std::size_t neededTriangles = triangles.size() / 3 - targetTriangles;
+			std::size_t removedTriangles = 0;
+			for (const auto& collapse : collapses)
+			{
+				const uint32_t from = collapse.from;
+				const uint32_t to = collapse.to;
+				if (touched[from] || touched[to])
+					continue;
+
+				// The triangles that stay must not flip, and the edge must be the only link between the two groups
+				bool valid = true;
+				uint32_t toWedge = NONE;
+				std::size_t edgeTriangles = 0;
+				for (uint32_t i = adjacencyOffsets[from]; i < adjacencyOffsets[from + 1] && valid; ++i)
+				{
+					const uint32_t* corners = &triangles[3 * adjacency[i]];
+					int toCorner = -1;
+					for (int k = 0; k < 3; ++k)
+					{
+						if (groupOf[corners[k]] == to)
+							toCorner = k;
+					}
+					if (toCorner >= 0)
+					{
+						toWedge = corners[toCorner];
+						++edgeTriangles;
+						continue;
+					}
+
+					glm::dvec3 before[3];
+					glm::dvec3 after[3];
+					for (int k = 0; k < 3; ++k)
+					{
+						before[k] = groupPositions[groupOf[corners[k]]];
+						after[k] = groupOf[corners[k]] == from ? groupPositions[to] : before[k];
+					}
+					const glm::dvec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+					const glm::dvec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+					valid = glm::dot(normalBefore, normalAfter) > 0.0;
+				}
+				if (!valid || toWedge == NONE)
+					continue;
+
+				neighbors(from, fromNeighbors);
+				neighbors(to, toNeighbors);
+				std::size_t sharedNeighbors = 0;
+				for (const uint32_t neighbor : fromNeighbors)
+					sharedNeighbors += std::binary_search(toNeighbors.begin(), toNeighbors.end(), neighbor) ? 1 : 0;
+				if (sharedNeighbors != edgeTriangles)
+					continue;
+
+				// The group is not locked, so it has a single wedge: it becomes the wedge of the other end of the edge
+				wedgeRemap[groupWedge[from]] = toWedge;
+				groupWedge[from] = NONE;
+				quadrics[to].add(quadrics[from]);
+				maxCost = std::max(maxCost, collapse.cost);
+
+				touched[from] = 1;
+				touched[to] = 1;
+				for (const uint32_t neighbor : fromNeighbors)
+					touched[neighbor] = 1;
+
+				removedTriangles += edgeTriangles;
+				if (removedTriangles >= neededTriangles)
+					break;
+			}
+
+			if (removedTriangles == 0)
+				break;
+
+			std::size_t kept = 0;
+			for (std::size_t t = 0; t < triangles.size(); t += 3)
+			{
+				const uint32_t a = wedgeRemap[triangles[t]], b = wedgeRemap[triangles[t + 1]], c = wedgeRemap[triangles[t + 2]];
+				if (groupOf[a] != groupOf[b] && groupOf[b] != groupOf[c] && groupOf[a] != groupOf[c])
+				{
+					triangles[kept++] = a;
+					triangles[kept++] = b;
+					triangles[kept++] = c;
+				}
+			}
+			triangles.resize(kept);
+		}
+
+		outError = static_cast<float>(std::sqrt(maxCost));
+		return triangles;
+	}
+
+	LodChain buildLodChain(const VertexInput& vertices, const uint32_t* indices, std::size_t indexCount)
+	{
+		LodChain chain;
+		if (indexCount / 3 < MIN_LOD_TRIANGLES)
+			return chain;
+
+		std::vector<uint32_t> previous;
+		const uint32_t* source = indices;
+		std::size_t sourceCount = indexCount;
+		float error = 0.0f;
+
+		// Each level starts from the previous one, the errors add up
+		for (std::size_t level = 0; level < MAX_LOD_LEVELS; ++level)
+		{
+			float levelError;
+			std::vector<uint32_t> lod = simplify(vertices, source, sourceCount, sourceCount / 6 * 3, levelError);
+			if (lod.empty() || lod.size() > sourceCount / 4 * 3)
+				break;
+
+			error += levelError;
+			chain.levels.push_back({ static_cast<uint32_t>(chain.indices.size()), static_cast<uint32_t>(lod.size()), error });
+			chain.indices.insert(chain.indices.end(), lod.begin(), lod.end());
+
+			previous = std::move(lod);
+			source = previous.data();
+			sourceCount = previous.size();
+		}
+
+		return chain;
+	}
+}
@@ -0,0 +1,73 @@
+#pragma once
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+/**
+ * @file MeshSimplifier.h
+ *
+ * @brief Quadric error metric simplification, used to build the levels of detail of the imported meshes.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The levels only have indices: they reuse the vertices of the full mesh, so the vertex buffers are shared.
+// A vertex on a UV seam, a normal crease or an open border (the edge of a material, every part has a single one)
+// never moves, the simplified levels keep the same borders as the full mesh.
+namespace MeshSimplifier
+{
+	// Levels built on top of the full mesh, each one has about half the triangles of the previous one
+	constexpr std::size_t MAX_LOD_LEVELS = 3;
+
+	// Meshes smaller than this are cheap enough as they are
+	constexpr std::size_t MIN_LOD_TRIANGLES = 256;
+
+	// Working memory of the simplification, to account for it in a memory budget
+	constexpr std::size_t SCRATCH_BYTES_PER_VERTEX = 192;
+
+	// Values of one vertex attribute, read with a stride in bytes
+	struct AttributeStream
+	{
+		const unsigned char* data = nullptr;
+		std::size_t stride = 0;
+		std::size_t size = 0;
+	};
+
+	struct VertexInput
+	{
+		AttributeStream positions;     // 3 floats
+		AttributeStream attributes[2]; // Anything else, only compared: two vertices at the same position but with other values make a seam
+		std::size_t vertexCount = 0;
+	};
+
+	struct LodLevel
+	{
+		uint32_t indexOffset = 0;  // In the indices of the chain
+		uint32_t indexCount = 0;
+		float error = 0.0f;        // Largest distance to the full mesh, in model units
+	};
+
+	struct LodChain
+	{
+		std::vector<uint32_t> indices;
+		std::vector<LodLevel> levels;
+	};
+
+	/**
+	 * Collapse edges until at most targetIndexCount indices are left, or nothing can be collapsed anymore.
+	 * outError receives the largest error of the collapses, in model units.
+	 */
+	std::vector<uint32_t> simplify(const VertexInput& vertices, const uint32_t* indices, std::size_t indexCount, std::size_t targetIndexCount, float& outError);
+
+	/**
+	 * Up to MAX_LOD_LEVELS levels, stops early once a level would not remove enough triangles to be worth it.
+	 */
+	LodChain buildLodChain(const VertexInput& vertices, const uint32_t* indices, std::size_t indexCount);
+}
+
+#endif
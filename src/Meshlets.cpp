@@ -0,0 +1,327 @@
+/**
+ * @file Meshlets.cpp
+ *
+ * @brief Small clusters of neighbouring triangles, culled on their own against the view frustum and by their normals.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include "Meshlets.h"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+
+namespace
+{
+	constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+	// Below this, the normals of the cluster spread too much for the cone to ever cull it
+	constexpr float MIN_CONE_DOT = 0.1f;
+
+	glm::vec3 readPosition(const MeshSimplifier::AttributeStream& positions, std::size_t vertex)
+	{
+		glm::vec3 position;
+		std::memcpy(&position[0], positions.data + vertex * positions.stride, sizeof(glm::vec3));
+		return position;
+	}
+
+	uint32_t spreadBits(uint32_t value)
+	{
+		value &= 0x3FF;
+		value = (value | (value << 16)) & 0x030000FF;
+		value = (value | (value << 8)) & 0x0300F00F;
+		value = (value | (value << 4)) & 0x030C30C3;
+		value = (value | (value << 2)) & 0x09249249;
+		return value;
+	}
+
+	void finishMeshlet(Meshlets::Meshlet& meshlet, const uint32_t* indices, const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals)
+	{
+		const uint32_t* begin = indices + meshlet.indexOffset;
+		const uint32_t* end = begin + meshlet.indexCount;
+
+		glm::vec3 boundsMin(std::numeric_limits<float>::max());
+		glm::vec3 boundsMax(std::numeric_limits<float>::lowest());
+		for (const uint32_t* it = begin; it != end; ++it)
+		{
+			boundsMin = glm::min(boundsMin, positions[*it]);
+			boundsMax = glm::max(boundsMax, positions[*it]);
+		}
+		const glm::vec3 center = 0.5f * (boundsMin + boundsMax);
+		float radius = 0.0f;
+		for (const uint32_t* it = begin; it != end; ++it)
+			radius = std::max(radius, glm::length(positions[*it] - center));
+
+		glm::vec3 axis(0.0f);
+		for (uint32_t t = meshlet.indexOffset / 3; t < (meshlet.indexOffset + meshlet.indexCount) / 3; ++t)
+			axis += normals[t];
+		const float axisLength = glm::length(axis);
+		axis = axisLength > 0.0f ? axis / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+
+		// Degenerate triangles have no normal and cannot be seen anyway
+		float minDot = 1.0f;
+		for (uint32_t t = meshlet.indexOffset / 3; t < (meshlet.indexOffset + meshlet.indexCount) / 3; ++t)
+		{
+			if (normals[t] != glm::vec3(0.0f))
+				minDot = std::min(minDot, glm::dot(normals[t], axis));
+		}
+
+		std::copy(&center[0], &center[0] + 3, meshlet.center);
+		meshlet.radius = radius;
+		std::copy(&axis[0], &axis[0] + 3, meshlet.coneAxis);
+		meshlet.coneCutoff = minDot < MIN_CONE_DOT ? 1.0f : std::sqrt(1.0f - minDot * minDot);
+	}
+}
+
+namespace Meshlets
+{
+	MeshletSet build(const MeshSimplifier::AttributeStream& positionStream, std::size_t vertexCount, const uint32_t* indices, std::size_t indexCount)
+	{
+		MeshletSet result;
+		const std::size_t triangleCount = indexCount / 3;
+		if (triangleCount < MIN_MESH_TRIANGLES)
+			return result;
+
+		std::vector<glm::vec3> positions(vertexCount);
+		for (std::size_t v = 0; v < vertexCount; ++v)
+			positions[v] = readPosition(positionStream, v);
+
+		// Vertices at the same position are welded, the OBJ parts are triangle soups
+		std::vector<uint32_t> order(vertexCount);
+		std::iota(order.begin(), order.end(), 0u);
+		std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+		{
+			const glm::vec3& pa = positions[a];
+			const glm::vec3& pb = positions[b];
+			return pa.x != pb.x ? pa.x < pb.x : (pa.y != pb.y ? pa.y < pb.y : pa.z < pb.z);
+		});
+		std::vector<uint32_t> groupOf(vertexCount);
+		uint32_t groupCount = 0;
+		for (std::size_t i = 0; i < vertexCount; ++i)
+		{
+			if (i == 0 || positions[order[i]] != positions[order[i - 1]])
+				++groupCount;
+			groupOf[order[i]] = groupCount - 1;
+		}
+		std::vector<uint32_t>().swap(order);
+
+		// Triangles around each group, as offsets in a single array
+		std::vector<uint32_t> groupTriangleOffsets(groupCount + 1, 0);
+		for (std::size_t i = 0; i < triangleCount * 3; ++i)
+			++groupTriangleOffsets[groupOf[indices[i]] + 1];
+		std::partial_sum(groupTriangleOffsets.begin(), groupTriangleOffsets.end(), groupTriangleOffsets.begin());
+		std::vector<uint32_t> groupTriangles(triangleCount * 3);
+		{
+			std::vector<uint32_t> fill(groupTriangleOffsets.begin(), groupTriangleOffsets.end() - 1);
+			for (std::size_t i = 0; i < triangleCount * 3; ++i)
+				groupTriangles[fill[groupOf[indices[i]]]++] = static_cast<uint32_t>(i / 3);
+		}
+
+		std::vector<glm::vec3> normals(triangleCount);
+		std::vector<glm::vec3> centroids(triangleCount);
+		double totalArea = 0.0;
+		glm::vec3 boundsMin(std::numeric_limits<float>::max());
+		glm::vec3 boundsMax(std::numeric_limits<float>::lowest());
+		for (std::size_t t = 0; t < triangleCount; ++t)
+		{
+			const glm::vec3& a = positions[indices[3 * t]];
+			const glm::vec3& b = positions[indices[3 * t + 1]];
+			const glm::vec3& c = positions[indices[3 * t + 2]];
+			const glm::vec3 normal = glm::cross(b - a, c - a);
+			const float doubleArea = glm::length(normal);
+			normals[t] = doubleArea > 0.0f ? normal / doubleArea : glm::vec3(0.0f);
+			centroids[t] = (a + b + c) / 3.0f;
+			totalArea += 0.5 * doubleArea;
+			boundsMin = glm::min(boundsMin, centroids[t]);
+			boundsMax = glm::max(boundsMax, centroids[t]);
+		}
+
+		// Radius of a full meshlet on an even mesh, the distance to the cluster is measured against it
+		const float expectedRadius = std::max(static_cast<float>(std::sqrt(totalArea / triangleCount * MAX_TRIANGLES / 3.14159)), 1e-6f);
+
+		// New meshlets start from the first free triangle along a Morton curve, so they stay next to the previous one
+		const glm::vec3 extent = glm::max(boundsMax - boundsMin, glm::vec3(1e-20f));
+		std::vector<uint32_t> seeds(triangleCount);
+		std::vector<uint32_t> codes(triangleCount);
+		for (std::size_t t = 0; t < triangleCount; ++t)
+		{
+			const glm::vec3 cell = (centroids[t] - boundsMin) / extent * 1023.0f;
+			codes[t] = spreadBits(static_cast<uint32_t>(cell.x)) | spreadBits(static_cast<uint32_t>(cell.y)) << 1 | spreadBits(static_cast<uint32_t>(cell.z)) << 2;
+		}
+		std::iota(seeds.begin(), seeds.end(), 0u);
+		std::sort(seeds.begin(), seeds.end(), [&](uint32_t a, uint32_t b) { return codes[a] < codes[b]; });
+		std::vector<uint32_t>().swap(codes);
+
+		std::vector<char> used(triangleCount, 0);
+		std::vector<uint32_t> candidateOf(triangleCount, NONE);  // Meshlet that has the triangle in its candidates
+		std::vector<uint32_t> candidates;
+
+		result.indices.reserve(triangleCount * 3);
+		std::size_t nextSeed = 0;
+		while (result.indices.size() < triangleCount * 3)
+		{
+			while (used[seeds[nextSeed]])
+				++nextSeed;
+
+			Meshlet meshlet;
+			meshlet.indexOffset = static_cast<uint32_t>(result.indices.size());
+			const uint32_t meshletIndex = static_cast<uint32_t>(result.meshlets.size());
+			glm::vec3 normalSum(0.0f);
+			glm::vec3 centroidSum(0.0f);
+			std::size_t meshletTriangles = 0;
+			candidates.clear();
+
+			uint32_t triangle = seeds[nextSeed];
+			while (triangle != NONE)
+			{
+				used[triangle] = 1;
+				result.indices.insert(result.indices.end(), indices + 3 * triangle, indices + 3 * triangle + 3);
+				normalSum += normals[triangle];
+				centroidSum += centroids[triangle];
+				++meshletTriangles;
+				if (meshletTriangles == MAX_TRIANGLES)
+					break;
+
+				for (int k = 0; k < 3; ++k)
+				{
+					const uint32_t group = groupOf[indices[3 * triangle + k]];
+					for (uint32_t i = groupTriangleOffsets[group]; i < groupTriangleOffsets[group + 1]; ++i)
+					{
+						const uint32_t neighbour = groupTriangles[i];
+						if (!used[neighbour] && candidateOf[neighbour] != meshletIndex)
+						{
+							candidateOf[neighbour] = meshletIndex;
+							candidates.push_back(neighbour);
+						}
+					}
+				}
+
+				// Best candidate: facing like the meshlet so far, and close to its middle
+				const float normalLength = glm::length(normalSum);
+				const glm::vec3 axis = normalLength > 0.0f ? normalSum / normalLength : glm::vec3(0.0f);
+				const glm::vec3 middle = centroidSum / static_cast<float>(meshletTriangles);
+				triangle = NONE;
+				float bestScore = std::numeric_limits<float>::lowest();
+				std::size_t bestCandidate = 0;
+				for (std::size_t i = 0; i < candidates.size(); )
+				{
+					if (used[candidates[i]])
+					{
+						candidates[i] = candidates.back();
+						candidates.pop_back();
+						continue;
+					}
+					const float score = glm::dot(normals[candidates[i]], axis) - glm::length(centroids[candidates[i]] - middle) / expectedRadius;
+					if (score > bestScore)
+					{
+						bestScore = score;
+						bestCandidate = i;
+					}
+					++i;
+				}
+				if (!candidates.empty())
+				{
+					triangle = candidates[bestCandidate];
+					candidates[bestCandidate] = candidates.back();
+					candidates.pop_back();
+				}
+			}
+
+			meshlet.indexCount = static_cast<uint32_t>(result.indices.size()) - meshlet.indexOffset;
+			result.meshlets.push_back(meshlet);
+		}
+
+		// Cones and spheres once the triangles are final
+		std::vector<glm::vec3> meshletNormals(triangleCount);
+		for (std::size_t t = 0; t < triangleCount; ++t)
+		{
+			const glm::vec3& a = positions[result.indices[3 * t]];
+			const glm::vec3 normal = glm::cross(positions[result.indices[3 * t + 1]] - a, positions[result.indices[3 * t + 2]] - a);
+			const float length = glm::length(normal);
+			meshletNormals[t] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+		}
+		for (auto& meshlet : result.meshlets)
+			finishMeshlet(meshlet, result.indices.data(), positions, meshletNormals);
+
+		return result;
+	}
+
+	CullingView makeCullingView(const glm::mat4& modelViewProjection, const glm::mat4& modelMatrix, const glm::vec3& cameraPosition)
+	{
+		CullingView view;
+
+		// Rows of the matrix: left, right, bottom, top, near, far
+		const glm::mat4 rows = glm::transpose(modelViewProjection);
+		for (int i = 0; i < 3; ++i)
+		{
+			view.planes[2 * i] = rows[3] + rows[i];
+			view.planes[2 * i + 1] = rows[3] - rows[i];
+		}
+		for (auto& plane : view.planes)
+		{
+			const float length = glm::length(glm::vec3(plane));
+			if (length > 0.0f)
+				plane /= length;
+		}
+
+		view.cameraPosition = glm::vec3(glm::inverse(modelMatrix) * glm::vec4(cameraPosition, 1.0f));
+		return view;
+	}
+
+	std::size_t cull(const Meshlet* meshlets, std::size_t meshletCount, const CullingView& view, std::vector<uint32_t>& outRanges)
+	{
+		std::size_t visibleTriangles = 0;
+		uint32_t rangeEnd = NONE;
+		for (std::size_t i = 0; i < meshletCount; ++i)
+		{
+			const Meshlet& meshlet = meshlets[i];
+			const glm::vec3 center(meshlet.center[0], meshlet.center[1], meshlet.center[2]);
+
+			bool visible = true;
+			if (view.frustumCulling)
+			{
+				for (const auto& plane : view.planes)
+				{
+					if (glm::dot(glm::vec3(plane), center) + plane.w < -meshlet.radius)
+					{
+						visible = false;
+						break;
+					}
+				}
+			}
+
+			// Every triangle faces away when the whole sphere is inside the back of the cone
+			if (visible && view.coneCulling && meshlet.coneCutoff < 1.0f)
+			{
+				const glm::vec3 toCenter = center - view.cameraPosition;
+				const glm::vec3 axis(meshlet.coneAxis[0], meshlet.coneAxis[1], meshlet.coneAxis[2]);
+				visible = glm::dot(toCenter, axis) < meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+			}
+
+			if (!visible)
+				continue;
+
+			visibleTriangles += meshlet.indexCount / 3;
+			if (rangeEnd == meshlet.indexOffset)
+			{
+				outRanges.back() += meshlet.indexCount;
+			}
+			else
+			{
+				outRanges.push_back(meshlet.indexOffset);
+				outRanges.push_back(meshlet.indexCount);
+			}
+			rangeEnd = meshlet.indexOffset + meshlet.indexCount;
+		}
+		return visibleTriangles;
+	}
+}
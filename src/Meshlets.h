@@ -0,0 +1,78 @@
+#pragma once
+#ifndef MESHLETS_H
+#define MESHLETS_H
+
+/**
+ * @file Meshlets.h
+ *
+ * @brief Small clusters of neighbouring triangles, culled on their own against the view frustum and by their normals.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "MeshSimplifier.h"
+
+// The meshlets of a mesh are ranges of its index buffer: building them only reorders the triangles,
+// and the visible meshlets that follow each other are drawn as one range.
+namespace Meshlets
+{
+	constexpr std::size_t MAX_TRIANGLES = 64;
+
+	// Under this, culling costs more than drawing everything
+	constexpr std::size_t MIN_MESH_TRIANGLES = 4 * MAX_TRIANGLES;
+
+	// Plain floats, stored as is in the mesh cache
+	struct Meshlet
+	{
+		uint32_t indexOffset = 0;
+		uint32_t indexCount = 0;
+		float center[3] = {};        // Bounding sphere
+		float radius = 0.0f;
+		float coneAxis[3] = {};      // Average direction of the normals
+		float coneCutoff = 1.0f;     // Sine of the angle left for the normals around the axis, 1 when the cluster can always be seen
+	};
+
+	struct MeshletSet
+	{
+		std::vector<uint32_t> indices;   // Same triangles as the source, grouped by meshlet
+		std::vector<Meshlet> meshlets;
+	};
+
+	/**
+	 * Group the triangles in meshlets of at most MAX_TRIANGLES, growing each one over the triangles
+	 * sharing a position with it and facing the same way. Empty when the mesh is too small.
+	 */
+	MeshletSet build(const MeshSimplifier::AttributeStream& positions, std::size_t vertexCount, const uint32_t* indices, std::size_t indexCount);
+
+	// What the meshlets are tested against, in the space of the mesh
+	struct CullingView
+	{
+		glm::vec4 planes[6];
+		glm::vec3 cameraPosition = glm::vec3(0.0f);
+		bool frustumCulling = true;
+		bool coneCulling = false;    // Only right for meshes whose back faces are never seen, see Mesh::singleSided
+	};
+
+	/**
+	 * Planes taken from the model-view-projection matrix, so they are already in model space.
+	 */
+	CullingView makeCullingView(const glm::mat4& modelViewProjection, const glm::mat4& modelMatrix, const glm::vec3& cameraPosition);
+
+	/**
+	 * Append the index ranges to draw, as (first index, index count), visible neighbours merged in one range.
+	 * Returns the number of visible triangles.
+	 */
+	std::size_t cull(const Meshlet* meshlets, std::size_t meshletCount, const CullingView& view, std::vector<uint32_t>& outRanges);
+}
+
+#endif
@@ -1,37 +1,259 @@
 #include "OBJLoader.h"
 
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <chrono>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <sstream>
 
+#include "AssetPack.h"
+#include "MappedFile.h"
+#include "ObjParsing.h"
+#include "ThreadPool.h"
+
 using namespace OBJLoader;
+using namespace OBJLoader::Parsing;
 
 namespace
 {
-	// 2D/3D point data structures
-	struct Point3D
+	// Extract path from a string
+	std::string extractPath(const std::string& filepathname)
 	{
-		Point3D() : x(0), y(0), z(0) {}
+		std::size_t pos = filepathname.find_last_of("/\\");
 
-		float x, y, z;
+		if (pos == std::string::npos)
+			return std::string(".");
+
+		return filepathname.substr(0, pos);
+	}
+
+	// Read-only stream buffer over bytes that stay in place (an entry of the asset pack)
+	class MemoryBuffer : public std::streambuf
+	{
+	public:
+		MemoryBuffer(const char* data, std::size_t size)
+		{
+			char* begin = const_cast<char*>(data);
+			setg(begin, begin, begin + size);
+		}
 	};
 
-	struct Point2D
+	// Reads the file from the mounted asset pack when it is there, from the disk otherwise
+	class AssetInput
 	{
-		Point2D() : x(0), y(0) {}
+	public:
+		explicit AssetInput(const std::string& filename)
+			: m_stream(nullptr)
+		{
+			AssetPack::Span span;
+			if (AssetPack::findMounted(filename, span))
+			{
+				m_memory = std::make_unique<MemoryBuffer>(span.data, span.size);
+				m_stream.rdbuf(m_memory.get());
+				return;
+			}
 
-		float x, y;
+			m_file.open(filename.c_str(), std::ifstream::in);
+			if (m_file.is_open())
+			{
+				m_stream.rdbuf(m_file.rdbuf());
+			}
+		}
+
+		bool is_open() const { return m_stream.rdbuf() != nullptr; }
+		std::istream& stream() { return m_stream; }
+
+		void close()
+		{
+			m_stream.rdbuf(nullptr);
+			m_file.close();
+		}
+
+	private:
+		std::ifstream m_file;
+		std::unique_ptr<MemoryBuffer> m_memory;
+		std::istream m_stream;
 	};
 
-	// Extract path from a string
-	std::string extractPath(const std::string& filepathname)
+	// Statements that change the state of the parser, replayed in file order after the first pass
+	struct Statement
 	{
-		std::size_t pos = filepathname.find_last_of("/\\");
+		enum Type { UseMaterial, Group, MaterialLibrary };
 
-		if (pos == std::string::npos)
-			return std::string(".");
+		Type type;
+		std::string name;
+		std::size_t faceIndex; // number of faces of the chunk before this statement
+	};
 
-		return filepathname.substr(0, pos);
+	// Consecutive faces of a chunk that all go in the same mesh
+	struct FaceRun
+	{
+		std::size_t faceBegin;
+		std::size_t faceEnd;
+		std::size_t firstCorner;
+		unsigned int mesh;
+		std::size_t firstVertex; // in the vertices of the mesh
+	};
+
+	struct Chunk
+	{
+		const char* begin;
+		const char* end;
+
+		std::vector<Point3D> vertices;
+		std::vector<Point3D> normals;
+		std::vector<Point2D> uvs;
+		std::vector<FaceCorner> corners;
+		std::vector<unsigned int> faceSizes;
+		std::vector<Statement> statements;
+
+		// Filled once all the chunks are scanned
+		std::size_t firstVertex = 0;
+		std::size_t firstNormal = 0;
+		std::size_t firstUV = 0;
+		std::vector<FaceRun> runs;
+	};
+
+	// Chunks are large enough for the scan to dominate the bookkeeping
+	constexpr std::size_t MIN_CHUNK_SIZE = 1 << 20;
+
+	std::vector<Chunk> splitInChunks(const char* data, std::size_t size)
+	{
+		const std::size_t threadCount = ThreadPool::instance().threadCount() + 1;
+		const std::size_t chunkCount = std::max<std::size_t>(1, std::min((size + MIN_CHUNK_SIZE - 1) / MIN_CHUNK_SIZE, threadCount * 4));
+		const std::size_t chunkSize = size / chunkCount + 1;
+
+		std::vector<Chunk> chunks;
+		const char* end = data + size;
+		for (const char* begin = data; begin < end; )
+		{
+			const char* chunkEnd = begin + std::min(chunkSize, static_cast<std::size_t>(end - begin));
+			chunkEnd = std::find(chunkEnd, end, '\n');
+			if (chunkEnd != end)
+				++chunkEnd;
+
+			chunks.emplace_back();
+			chunks.back().begin = begin;
+			chunks.back().end = chunkEnd;
+			begin = chunkEnd;
+		}
+		return chunks;
+	}
+
+	void scanChunk(Chunk& chunk)
+	{
+		// Rough reservation from the size, assuming mostly vertex and face lines
+		const std::size_t estimatedLines = static_cast<std::size_t>(chunk.end - chunk.begin) / 32;
+		chunk.vertices.reserve(estimatedLines / 2);
+		chunk.corners.reserve(estimatedLines);
+		chunk.faceSizes.reserve(estimatedLines / 2);
+
+		for (const char* line = chunk.begin; line < chunk.end; )
+		{
+			const char* lineEnd = std::find(line, chunk.end, '\n');
+			const std::size_t length = static_cast<std::size_t>(lineEnd - line);
+			const char first = length > 0 ? line[0] : '\0';
+			const char second = length > 1 ? line[1] : '\0';
+
+			if (first == '#')
+			{
+				// Comments... just ignore the line
+			}
+			else if (first == 'v' && (second == ' ' || second == 'n' || second == 't'))
+			{
+				// Vertex, normal or tex coord! Add it to the list. A failed read leaves the next values to 0
+				const char* it = line + std::min<std::size_t>(length, second == ' ' ? 2 : 3);
+				if (second == 't')
+				{
+					Point2D uv;
+					parseFloat(it, lineEnd, uv.x) && parseFloat(it, lineEnd, uv.y);
+					chunk.uvs.push_back(uv);
+				}
+				else
+				{
+					Point3D v;
+					parseFloat(it, lineEnd, v.x) && parseFloat(it, lineEnd, v.y) && parseFloat(it, lineEnd, v.z);
+					(second == ' ' ? chunk.vertices : chunk.normals).push_back(v);
+				}
+			}
+			else if (first == 'u' || first == 'g' || first == 'm')
+			{
+				// usemtl, group or mtllib! Only remember it, it is applied once every chunk is scanned
+				const Statement::Type type = first == 'u' ? Statement::UseMaterial : first == 'g' ? Statement::Group : Statement::MaterialLibrary;
+				chunk.statements.push_back({ type, secondWord(line, lineEnd), chunk.faceSizes.size() });
+			}
+			else if (first == 'f' && length >= 2)
+			{
+				// Face! The vertices are separated by exactly one space, two spaces make an empty vertex
+				const std::size_t firstCorner = chunk.corners.size();
+				for (const char* it = line + 2; it < lineEnd; )
+				{
+					const char* cornerEnd = std::find(it, lineEnd, ' ');
+					chunk.corners.push_back(parseCorner(it, cornerEnd));
+					it = cornerEnd == lineEnd ? lineEnd : cornerEnd + 1;
+				}
+
+				const std::size_t cornerCount = chunk.corners.size() - firstCorner;
+				if (cornerCount < 3)
+					chunk.corners.resize(firstCorner);
+				else
+					chunk.faceSizes.push_back(static_cast<unsigned int>(cornerCount));
+			}
+
+			line = lineEnd == chunk.end ? lineEnd : lineEnd + 1;
+		}
+	}
+
+	inline Vertex makeVertex(const FaceCorner& corner, const std::vector<Point3D>& vertices, const std::vector<Point3D>& normals, const std::vector<Point2D>& uvs)
+	{
+		// Indices out of the lists (negative or forward references) use the default values
+		const Point3D& position = vertices[corner.vertex < vertices.size() ? corner.vertex : 0];
+		const Point3D& normal = normals[corner.normal < normals.size() ? corner.normal : 0];
+		const Point2D& uv = uvs[corner.uv < uvs.size() ? corner.uv : 0];
+
+		Vertex v;
+		v.position[0] = position.x;
+		v.position[1] = position.y;
+		v.position[2] = position.z;
+		v.normal[0] = normal.x;
+		v.normal[1] = normal.y;
+		v.normal[2] = normal.z;
+		v.uv[0] = uv.x;
+		v.uv[1] = uv.y;
+		return v;
+	}
+
+	void writeTriangles(const Chunk& chunk, const std::vector<Point3D>& vertices, const std::vector<Point3D>& normals, const std::vector<Point2D>& uvs, std::vector<Mesh>& meshes)
+	{
+		for (const auto& run : chunk.runs)
+		{
+			Vertex* output = meshes[run.mesh].vertices.data() + run.firstVertex;
+			const FaceCorner* corners = chunk.corners.data() + run.firstCorner;
+			for (std::size_t face = run.faceBegin; face < run.faceEnd; ++face)
+			{
+				const unsigned int cornerCount = chunk.faceSizes[face];
+
+				// Create first triangle
+				for (unsigned int i = 0; i < 3; ++i)
+				{
+					*output++ = makeVertex(corners[i], vertices, normals, uvs);
+				}
+
+				// Create subsequent triangles (1 per additional vertices)
+				// Note: These triangles are created using a triangle fan approach
+				for (unsigned int i = 3; i < cornerCount; ++i)
+				{
+					*output++ = makeVertex(corners[0], vertices, normals, uvs);
+					*output++ = makeVertex(corners[i - 1], vertices, normals, uvs);
+					*output++ = makeVertex(corners[i], vertices, normals, uvs);
+				}
+
+				corners += cornerCount;
+			}
+		}
 	}
 }
 
@@ -52,17 +274,31 @@ Loader::~Loader()
 
 //--------------------------------------------------------------------------------------------------
 // Load file
+//
+// The file is mapped and cut in chunks at line boundaries, parsed on the thread pool in three passes:
+//  1. every chunk is scanned on its own: vertex attributes, face corners and the group/material
+//     statements, in the order they appear
+//  2. the statements are replayed in file order to know which mesh every face goes in and where
+//  3. every chunk writes the triangles of its faces at their final place
+// Face indices are absolute in an OBJ file, so the chunks don't need each other during the first pass.
 bool Loader::loadFile(const std::string& filename)
 {
 	// Clear current data
 	unload();
 
-	// Open the input file
-	std::ifstream file(filename.c_str(), std::ifstream::in);
-	if (!file.is_open())
+	const auto startTime = std::chrono::steady_clock::now();
+
+	// Map the input file
+	MappedFile mappedFile;
+	AssetPack::Span span;
+	if (!AssetPack::findMounted(filename, span))
 	{
-		std::cout << "Error: Failed to open file " << filename << " for reading!" << std::endl;
-		return false;
+		if (!mappedFile.open(filename, true))
+		{
+			std::cout << "Error: Failed to open file " << filename << " for reading!" << std::endl;
+			return false;
+		}
+		span = { mappedFile.data(), mappedFile.size() };
 	}
 
 	// Extract path. It will be useful later when loading the mtl file
@@ -87,185 +323,121 @@ bool Loader::loadFile(const std::string& filename)
 
 	unsigned int currentMesh = 0;
 
-	// Create vertices' position, normal, and uv lists with default values
-	std::vector<Point3D> vertices(1);
-	std::vector<Point3D> normals(1);
-	std::vector<Point2D> uvs(1);
-
-	// Read file
-	std::string line;
-	while (std::getline(file, line))
-	{
-		if (line[0] == '#')
-		{
-			// Comments... just ignore the line
-			continue;
-		}
-		else if (line[0] == 'v' && line[1] == ' ')
+	// First pass: scan the chunks in parallel
+	std::vector<Chunk> chunks = splitInChunks(span.data, span.size);
+	ThreadPool::instance().parallelFor(chunks.size(), 1, [&chunks](std::size_t begin, std::size_t end)
 		{
-			// Vertex! Add it to the list.
-			Point3D v;
-			std::stringstream ss(line.substr(2));
-			ss >> v.x >> v.y >> v.z;
-			vertices.push_back(v);
+			for (std::size_t i = begin; i < end; ++i)
+			{
+				scanChunk(chunks[i]);
+			}
+		});
 
-		}
-		else if (line[0] == 'v' && line[1] == 'n')
-		{
-			// Normal! Add it to the list.
-			Point3D n;
-			std::stringstream ss(line.substr(3));
-			ss >> n.x >> n.y >> n.z;
-			normals.push_back(n);
-		}
-		else if (line[0] == 'v' && line[1] == 't')
-		{
-			// Tex coord! Add it to the list
-			Point2D uv;
-			std::stringstream ss(line.substr(3));
-			ss >> uv.x >> uv.y;
-			uvs.push_back(uv);
-		}
-		else if (line[0] == 'u')
-		{
-			// usemtl! First, get the material's name
-			std::string name;
-			std::string dummy;
-			std::stringstream ss(line);
-			ss >> dummy >> name;
+	// Create vertices' position, normal, and uv lists with default values,
+	// then gather the ones of every chunk after them
+	std::size_t vertexCount = 1, normalCount = 1, uvCount = 1;
+	for (auto& chunk : chunks)
+	{
+		chunk.firstVertex = vertexCount;
+		chunk.firstNormal = normalCount;
+		chunk.firstUV = uvCount;
+		vertexCount += chunk.vertices.size();
+		normalCount += chunk.normals.size();
+		uvCount += chunk.uvs.size();
+	}
 
-			// Find it, and attach it to the current mesh
-			currentMaterial = findMaterial(name);
-			_meshes[currentMesh].materialID = currentMaterial;
-		}
-		else if (line[0] == 'g')
+	std::vector<Point3D> vertices(vertexCount);
+	std::vector<Point3D> normals(normalCount);
+	std::vector<Point2D> uvs(uvCount);
+	ThreadPool::instance().parallelFor(chunks.size(), 1, [&](std::size_t begin, std::size_t end)
 		{
-			// Group! Set it as the current mesh
-			std::string dummy;
-			std::string name;
-			std::stringstream ss(line);
-			ss >> dummy >> name;
+			for (std::size_t i = begin; i < end; ++i)
+			{
+				Chunk& chunk = chunks[i];
+				std::copy(chunk.vertices.begin(), chunk.vertices.end(), vertices.begin() + chunk.firstVertex);
+				std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + chunk.firstNormal);
+				std::copy(chunk.uvs.begin(), chunk.uvs.end(), uvs.begin() + chunk.firstUV);
+				chunk.vertices = std::vector<Point3D>();
+				chunk.normals = std::vector<Point3D>();
+				chunk.uvs = std::vector<Point2D>();
+			}
+		});
 
-			currentMesh = getMesh(name);
-			_meshes[currentMesh].materialID = currentMaterial;
-		}
-		else if (line[0] == 'f')
+	// Second pass: replay the statements in file order, the faces between two of them form a run
+	std::vector<std::size_t> meshVertexCounts(1, 0);
+	for (auto& chunk : chunks)
+	{
+		std::size_t face = 0;
+		std::size_t corner = 0;
+		auto addRun = [&](std::size_t faceEnd)
 		{
-			// Face! First, get its vertices data
-			std::string vertexData;
-			std::string dummy;
-			std::stringstream ssLine(line.substr(2));
-			std::vector<unsigned int> vertexIDs;
-			std::vector<unsigned int> uvIDs;
-			std::vector<unsigned int> normalIDs;
-			while (std::getline(ssLine, vertexData, ' '))
+			if (faceEnd == face)
+				return;
+
+			FaceRun run;
+			run.faceBegin = face;
+			run.faceEnd = faceEnd;
+			run.firstCorner = corner;
+			run.mesh = currentMesh;
+			run.firstVertex = meshVertexCounts[currentMesh];
+			for (; face < faceEnd; ++face)
 			{
-				unsigned int index = vertexIDs.size();
-				vertexIDs.push_back(0);
-				uvIDs.push_back(0);
-				normalIDs.push_back(0);
-
-				std::stringstream ss(vertexData);
-				std::string stringVal;
-				std::getline(ss, stringVal, '/');
-				std::stringstream ss2(stringVal);
-				ss2 >> vertexIDs[index];
-
-				std::getline(ss, stringVal, '/');
-				std::stringstream ss3(stringVal);
-				ss3 >> uvIDs[index];
-
-				std::getline(ss, stringVal, '/');
-				std::stringstream ss4(stringVal);
-				ss4 >> normalIDs[index];
+				const unsigned int cornerCount = chunk.faceSizes[face];
+				meshVertexCounts[currentMesh] += 3 * (cornerCount - 2);
+				corner += cornerCount;
 			}
+			chunk.runs.push_back(run);
+		};
 
-			// Create first triangle
-			if (vertexIDs.size() < 3)
-				continue;
+		for (const auto& statement : chunk.statements)
+		{
+			addRun(statement.faceIndex);
 
-			for (unsigned int i = 0; i < 3; ++i)
+			if (statement.type == Statement::UseMaterial)
 			{
-				Vertex v;
-				v.position[0] = vertices[vertexIDs[i]].x;
-				v.position[1] = vertices[vertexIDs[i]].y;
-				v.position[2] = vertices[vertexIDs[i]].z;
-
-				v.normal[0] = normals[normalIDs[i]].x;
-				v.normal[1] = normals[normalIDs[i]].y;
-				v.normal[2] = normals[normalIDs[i]].z;
-
-				v.uv[0] = uvs[uvIDs[i]].x;
-				v.uv[1] = uvs[uvIDs[i]].y;
-
-				_meshes[currentMesh].vertices.push_back(v);
+				// Find it, and attach it to the current mesh
+				currentMaterial = findMaterial(statement.name);
+				_meshes[currentMesh].materialID = currentMaterial;
 			}
-
-			// Create subsequent triangles (1 per additional vertices)
-			// Note: These triangles are created using a triangle fan approach
-			for (unsigned int i = 3; i < vertexIDs.size(); ++i)
+			else if (statement.type == Statement::Group)
 			{
-				// First vertex of triangle is always the first vertex that has been specified
-				Vertex v1;
-				v1.position[0] = vertices[vertexIDs[0]].x;
-				v1.position[1] = vertices[vertexIDs[0]].y;
-				v1.position[2] = vertices[vertexIDs[0]].z;
-				v1.normal[0] = normals[normalIDs[0]].x;
-				v1.normal[1] = normals[normalIDs[0]].y;
-				v1.normal[2] = normals[normalIDs[0]].z;
-				v1.uv[0] = uvs[uvIDs[0]].x;
-				v1.uv[1] = uvs[uvIDs[0]].y;
-
-				// Second vertex is the previous vertex
-				Vertex v2;
-				v2.position[0] = vertices[vertexIDs[i - 1]].x;
-				v2.position[1] = vertices[vertexIDs[i - 1]].y;
-				v2.position[2] = vertices[vertexIDs[i - 1]].z;
-				v2.normal[0] = normals[normalIDs[i - 1]].x;
-				v2.normal[1] = normals[normalIDs[i - 1]].y;
-				v2.normal[2] = normals[normalIDs[i - 1]].z;
-				v2.uv[0] = uvs[uvIDs[i - 1]].x;
-				v2.uv[1] = uvs[uvIDs[i - 1]].y;
-
-				// Third vertex is the current vertex
-				Vertex v3;
-				v3.position[0] = vertices[vertexIDs[i]].x;
-				v3.position[1] = vertices[vertexIDs[i]].y;
-				v3.position[2] = vertices[vertexIDs[i]].z;
-				v3.normal[0] = normals[normalIDs[i]].x;
-				v3.normal[1] = normals[normalIDs[i]].y;
-				v3.normal[2] = normals[normalIDs[i]].z;
-				v3.uv[0] = uvs[uvIDs[i]].x;
-				v3.uv[1] = uvs[uvIDs[i]].y;
-
-				// Add the triangle
-				_meshes[currentMesh].vertices.push_back(v1);
-				_meshes[currentMesh].vertices.push_back(v2);
-				_meshes[currentMesh].vertices.push_back(v3);
+				// Group! Set it as the current mesh
+				currentMesh = getMesh(statement.name);
+				_meshes[currentMesh].materialID = currentMaterial;
+				meshVertexCounts.resize(_meshes.size(), 0);
 			}
-		}
-		else if (line[0] == 'm')
-		{
-			// Get file name
-			std::string filename;
-			std::string dummy;
-			std::stringstream ss(line);
-			ss >> dummy >> filename;
-
-			// Add path to filename
-			std::string pathname = path;
+			else
+			{
+				// Add path to filename
+				std::string pathname = path;
 #ifdef Q_OS_WIN32
-			pathname.append("\\");
+				pathname.append("\\");
 #else
-			pathname.append("/");
+				pathname.append("/");
 #endif
-			pathname.append(filename);
+				pathname.append(statement.name);
 
-			// Load file
-			loadMtlFile(pathname);
+				// Load file
+				loadMtlFile(pathname);
+			}
 		}
+		addRun(chunk.faceSizes.size());
 	}
 
+	for (std::size_t i = 0; i < _meshes.size(); ++i)
+	{
+		_meshes[i].vertices.resize(meshVertexCounts[i]);
+	}
+
+	// Third pass: every chunk writes its triangles in place
+	ThreadPool::instance().parallelFor(chunks.size(), 1, [&](std::size_t begin, std::size_t end)
+		{
+			for (std::size_t i = begin; i < end; ++i)
+			{
+				writeTriangles(chunks[i], vertices, normals, uvs, _meshes);
+			}
+		});
+
 	// Everything is loaded! Now remove empty meshes (this generally happens with the default group)
 	std::vector<Mesh>::iterator it = _meshes.begin();
 	while (it != _meshes.end())
@@ -280,21 +452,24 @@ bool Loader::loadFile(const std::string& filename)
 		}
 	}
 
-
-	// Close file
-	file.close();
 	_isLoaded = true;
 
+	const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - startTime;
+	const double megabytes = static_cast<double>(span.size) / (1024.0 * 1024.0);
+	std::cout << "Parsed " << filename << ": " << megabytes << " MB in " << duration.count() * 1000.0 << " ms ("
+		<< (duration.count() > 0.0 ? megabytes / duration.count() : 0.0) << " MB/s, " << chunks.size() << " chunks)" << std::endl;
+
 	return true;
 }
 
 //--------------------------------------------------------------------------------------------------
 // Load material file
-void Loader::loadMtlFile(const std::string& filename)
+void OBJLoader::loadMaterialFile(const std::string& filename, std::vector<Material>& materials)
 {
 	// Open the input file
-	std::ifstream file(filename.c_str(), std::ifstream::in);
-	if (!file.is_open())
+	AssetInput input(filename);
+	std::istream& file = input.stream();
+	if (!input.is_open())
 	{
 		std::cout << "Error: Failed to open material file " << filename << " for reading!" << std::endl;
 		return;
@@ -326,8 +501,8 @@ void Loader::loadMtlFile(const std::string& filename)
 			ss >> dummy >> newMtl.name;
 
 			// Add it to the list and set as current material
-			currentMaterial = _materials.size();
-			_materials.push_back(newMtl);
+			currentMaterial = materials.size();
+			materials.push_back(newMtl);
 		}
 		else if (line[0] == 'N')
 		{
@@ -341,11 +516,11 @@ void Loader::loadMtlFile(const std::string& filename)
 			shininess /= 1000.0;
 			shininess *= 128.0;
 
-			_materials[currentMaterial].Kn = shininess;
+			materials[currentMaterial].Kn = shininess;
 		}
 		else if (line[0] == 'K')
 		{
-			Material& mat = _materials[currentMaterial];
+			Material& mat = materials[currentMaterial];
 			std::string dummy;
 			std::stringstream ss(line);
 
@@ -379,6 +554,13 @@ void Loader::loadMtlFile(const std::string& filename)
 	// Close file
 }
 
+//--------------------------------------------------------------------------------------------------
+// Load material file in the materials of the loader
+void Loader::loadMtlFile(const std::string& filename)
+{
+	loadMaterialFile(filename, _materials);
+}
+
 //--------------------------------------------------------------------------------------------------
 // Find a material by its name
 unsigned int Loader::findMaterial(const std::string& name)
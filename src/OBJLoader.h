@@ -37,6 +37,10 @@ namespace OBJLoader
 		std::string   name;
 	};
 
+	// Read the materials of an MTL file and add them to materials.
+	// The statements before the first newmtl modify the first material of the list.
+	void loadMaterialFile(const std::string& filename, std::vector<Material>& materials);
+
 	// Class responsible for loading all the meshes included in an OBJ file
 	class Loader
 	{
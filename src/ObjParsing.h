@@ -0,0 +1,149 @@
+#pragma once
+#ifndef OBJPARSING_H
+#define OBJPARSING_H
+
+/**
+ * @file ObjParsing.h
+ *
+ * @brief Scanning of OBJ lines without streams, shared by the loader and the streaming importer.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <string>
+
+// Every function reproduces what the original stream based loader read from the same text
+namespace OBJLoader
+{
+namespace Parsing
+{
+	// 2D/3D point data structures
+	struct Point3D
+	{
+		Point3D() : x(0), y(0), z(0) {}
+
+		float x, y, z;
+	};
+
+	struct Point2D
+	{
+		Point2D() : x(0), y(0) {}
+
+		float x, y;
+	};
+
+	// One vertex of a face, as the three indices written in the file (0 when missing)
+	struct FaceCorner
+	{
+		unsigned int vertex;
+		unsigned int uv;
+		unsigned int normal;
+	};
+
+	// Same characters as std::isspace in the "C" locale, which the stream extraction skips
+	inline bool isSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+	}
+
+	inline const char* skipSpaces(const char* it, const char* end)
+	{
+		while (it != end && isSpace(*it))
+			++it;
+		return it;
+	}
+
+	// Equivalent of "stream >> value" on a float: false (and value set to 0) when nothing could be read
+	inline bool parseFloat(const char*& it, const char* end, float& value)
+	{
+		it = skipSpaces(it, end);
+		if (it != end && *it == '+')
+			++it;
+
+		// The stream extraction doesn't accept "inf" or "nan", from_chars does
+		const char* digits = (it != end && *it == '-') ? it + 1 : it;
+		if (digits == end || !(std::isdigit(static_cast<unsigned char>(*digits)) || *digits == '.'))
+		{
+			value = 0.0f;
+			return false;
+		}
+
+		const auto result = std::from_chars(it, end, value);
+		if (result.ec != std::errc())
+		{
+			value = 0.0f;
+			return false;
+		}
+		it = result.ptr;
+		return true;
+	}
+
+	// Equivalent of "stream >> value" on an unsigned int, 0 when nothing could be read
+	inline unsigned int parseIndex(const char* it, const char* end)
+	{
+		it = skipSpaces(it, end);
+		if (it != end && *it == '+')
+			++it;
+
+		unsigned int value = 0;
+		if (std::from_chars(it, end, value).ec != std::errc())
+			return 0;
+		return value;
+	}
+
+	// Second whitespace separated word of the line, like "stream >> dummy >> name"
+	inline std::string secondWord(const char* it, const char* end)
+	{
+		it = skipSpaces(it, end);
+		while (it != end && !isSpace(*it))
+			++it;
+		it = skipSpaces(it, end);
+
+		const char* wordEnd = it;
+		while (wordEnd != end && !isSpace(*wordEnd))
+			++wordEnd;
+		return std::string(it, wordEnd);
+	}
+
+	// Vertex of a face: "v", "v/vt", "v/vt/vn" or "v//vn"
+	inline FaceCorner parseCorner(const char* it, const char* end)
+	{
+		// Each part ends at the next '/'. When there is none, the missing parts repeat the
+		// last one read (std::getline leaves its string unchanged once the stream is exhausted)
+		const char* parts[4] = { it, end, end, end };
+		const char* partEnds[3] = { end, end, end };
+		int partCount = 1;
+		for (const char* c = it; partCount < 3; ++c)
+		{
+			if (c == end)
+			{
+				break;
+			}
+			if (*c == '/')
+			{
+				partEnds[partCount - 1] = c;
+				parts[partCount] = c + 1;
+				++partCount;
+			}
+		}
+		for (int i = partCount; i < 3; ++i)
+		{
+			parts[i] = parts[partCount - 1];
+			partEnds[i] = partEnds[partCount - 1];
+		}
+		if (partCount == 3)
+		{
+			partEnds[2] = std::find(parts[2], end, '/');
+		}
+
+		return { parseIndex(parts[0], partEnds[0]), parseIndex(parts[1], partEnds[1]), parseIndex(parts[2], partEnds[2]) };
+	}
+}
+}
+
+#endif
@@ -0,0 +1,253 @@
+/**
+ * @file ObjectData.cpp
+ *
+ * @brief Per-object model matrices and material indices in a persistently mapped storage buffer, rewritten only where they changed.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include "ObjectData.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+	constexpr GLbitfield MAPPING_FLAGS = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	constexpr GLuint64 FENCE_TIMEOUT = 1000000;   // Nanoseconds per wait, retried until the fence is signaled
+}
+
+ObjectDataBuffer::Settings& ObjectDataBuffer::settings()
+{
+	static Settings settings;
+	return settings;
+}
+
+ObjectDataBuffer::Statistics& ObjectDataBuffer::statistics()
+{
+	static Statistics statistics;
+	return statistics;
+}
+
+bool ObjectDataBuffer::init(std::size_t capacity)
+{
+	// Only loaded by glad for OpenGL 4.4 and later
+	if (glBufferStorage == nullptr)
+	{
+		std::cerr << "Persistent buffer mapping is not supported, the object data is set as uniforms" << std::endl;
+		return false;
+	}
+
+	if (!createBuffer(std::max(capacity, std::size_t(1))))
+	{
+		deleteBuffer();
+		return false;
+	}
+	s_instance = this;
+	return true;
+}
+
+void ObjectDataBuffer::beginFrame()
+{
+	if (m_buffer == 0)
+	{
+		return;
+	}
+
+	m_frame = (m_frame + 1) % FRAME_COUNT;
+	waitForFrame(m_frame);
+
+	// Catch up on the changes made while the GPU was reading this copy
+	auto& dirtySlots = m_dirtySlots[m_frame];
+	std::sort(dirtySlots.begin(), dirtySlots.end());
+	dirtySlots.erase(std::unique(dirtySlots.begin(), dirtySlots.end()), dirtySlots.end());
+
+	auto& bufferStatistics = statistics();
+	for (std::size_t i = 0; i < dirtySlots.size(); )
+	{
+		std::size_t end = i + 1;
+		while (end < dirtySlots.size() && dirtySlots[end] == dirtySlots[end - 1] + 1)
+			++end;
+
+		writeSlots(m_frame, dirtySlots[i], static_cast<uint32_t>(end - i));
+		++bufferStatistics.dirtyRanges;
+		i = end;
+	}
+	bufferStatistics.rewrittenObjects += dirtySlots.size();
+	dirtySlots.clear();
+
+	bindFrame();
+}
+
+void ObjectDataBuffer::endFrame()
+{
+	if (m_buffer == 0)
+	{
+		return;
+	}
+
+	if (m_fences[m_frame] != nullptr)
+	{
+		glDeleteSync(m_fences[m_frame]);
+	}
+	m_fences[m_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void ObjectDataBuffer::clear()
+{
+	deleteBuffer();
+	m_shadow.clear();
+	m_freeSlots.clear();
+	for (auto& dirtySlots : m_dirtySlots)
+	{
+		dirtySlots.clear();
+	}
+	if (s_instance == this)
+	{
+		s_instance = nullptr;
+	}
+}
+
+uint32_t ObjectDataBuffer::allocate()
+{
+	if (!m_freeSlots.empty())
+	{
+		const uint32_t slot = m_freeSlots.back();
+		m_freeSlots.pop_back();
+		return slot;
+	}
+
+	if (m_shadow.size() == m_capacity)
+	{
+		// The storage of a persistent buffer is immutable: a new one, the draws already issued keep the old one alive
+		const std::size_t capacity = m_capacity * 2;
+		deleteBuffer();
+		if (!createBuffer(capacity))
+		{
+			clear();   // The renderers go back to the uniforms
+			return NO_SLOT;
+		}
+		bindFrame();
+	}
+	m_shadow.emplace_back();
+	return static_cast<uint32_t>(m_shadow.size() - 1);
+}
+
+void ObjectDataBuffer::release(uint32_t slot)
+{
+	if (slot < m_shadow.size())
+	{
+		m_freeSlots.push_back(slot);
+	}
+}
+
+void ObjectDataBuffer::update(uint32_t slot, const ObjectData& data)
+{
+	m_shadow[slot] = data;
+	writeSlots(m_frame, slot, 1);
+	++statistics().updatedObjects;
+
+	for (std::size_t frame = 0; frame < FRAME_COUNT; ++frame)
+	{
+		if (frame != m_frame)
+			m_dirtySlots[frame].push_back(slot);
+	}
+}
+
+bool ObjectDataBuffer::createBuffer(std::size_t capacity)
+{
+	GLint alignment = 1;
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	const std::size_t align = static_cast<std::size_t>(std::max(alignment, 1));
+
+	m_capacity = capacity;
+	m_frameSize = (capacity * sizeof(ObjectData) + align - 1) / align * align;
+
+	glGenBuffers(1, &m_buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffer);
+	glBufferStorage(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(m_frameSize * FRAME_COUNT), nullptr, MAPPING_FLAGS);
+	m_mapping = static_cast<unsigned char*>(glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, static_cast<GLsizeiptr>(m_frameSize * FRAME_COUNT), MAPPING_FLAGS));
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	if (m_mapping == nullptr)
+	{
+		std::cerr << "Unable to map the object data buffer" << std::endl;
+		return false;
+	}
+
+	// Every copy starts from the latest data
+	for (std::size_t frame = 0; frame < FRAME_COUNT; ++frame)
+	{
+		writeSlots(frame, 0, static_cast<uint32_t>(m_shadow.size()));
+		m_dirtySlots[frame].clear();
+	}
+	return true;
+}
+
+void ObjectDataBuffer::deleteBuffer()
+{
+	for (auto& fence : m_fences)
+	{
+		if (fence != nullptr)
+		{
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+	}
+
+	if (m_buffer != 0)
+	{
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffer);
+		glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		glDeleteBuffers(1, &m_buffer);
+		m_buffer = 0;
+	}
+	m_mapping = nullptr;
+	m_capacity = 0;
+	m_frameSize = 0;
+}
+
+void ObjectDataBuffer::waitForFrame(std::size_t frame)
+{
+	GLsync& fence = m_fences[frame];
+	if (fence == nullptr)
+	{
+		return;
+	}
+
+	// Usually signaled long ago: the GPU is at most FRAME_COUNT - 1 frames behind
+	const auto startTime = std::chrono::steady_clock::now();
+	GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	while (result == GL_TIMEOUT_EXPIRED)
+	{
+		result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT);
+	}
+	if (result == GL_WAIT_FAILED)
+	{
+		std::cerr << "Waiting for the object data of a previous frame failed" << std::endl;
+	}
+	statistics().fenceWaitMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+	glDeleteSync(fence);
+	fence = nullptr;
+}
+
+void ObjectDataBuffer::bindFrame() const
+{
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, OBJECTS_BINDING, m_buffer, static_cast<GLintptr>(m_frame * m_frameSize), static_cast<GLsizeiptr>(m_frameSize));
+}
+
+void ObjectDataBuffer::writeSlots(std::size_t frame, uint32_t firstSlot, uint32_t slotCount)
+{
+	if (slotCount == 0)
+	{
+		return;
+	}
+
+	std::memcpy(frameData(frame) + firstSlot, m_shadow.data() + firstSlot, slotCount * sizeof(ObjectData));
+	statistics().uploadedBytes += slotCount * sizeof(ObjectData);
+}
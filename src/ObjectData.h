@@ -0,0 +1,139 @@
+#pragma once
+#ifndef OBJECTDATA_H
+#define OBJECTDATA_H
+
+/**
+ * @file ObjectData.h
+ *
+ * @brief Per-object model matrices and material indices in a persistently mapped storage buffer, rewritten only where they changed.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include <glad/glad.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Laid out as the std430 ObjectData struct of textureShader.vert and constantShader.vert
+struct ObjectData
+{
+	glm::mat4 modelMatrix = glm::mat4(1.0f);
+	uint32_t materialIndex = 0;     // In the MaterialRegistry
+	uint32_t uniformScale = 0;      // The normals go through the model matrix itself, see TransformKernels::uniformScale
+	uint32_t padding[2] = {};
+};
+
+static_assert(sizeof(ObjectData) == 80, "ObjectData has to match its std430 layout");
+
+/**
+ * One slot per renderer, in FRAME_COUNT copies of the array: the CPU writes the copy of its frame while the GPU
+ * still reads the previous ones, and a fence per copy tells when it can be written again. The mapping is
+ * persistent and coherent, so nothing goes through the driver once the buffer exists.
+ *
+ * A change is written right away in the copy of the frame, and remembered as a dirty slot of the other copies:
+ * each of them rewrites it when its turn comes, coalesced in ranges. What goes over the bus follows what changed,
+ * at most FRAME_COUNT times the size of the changed slots.
+ *
+ * The matrices are in world space, the shaders apply the view matrix: the slots of still objects stay valid when
+ * the camera moves.
+ */
+class ObjectDataBuffer
+{
+public:
+	static constexpr std::size_t FRAME_COUNT = 3;
+	static constexpr uint32_t NO_SLOT = ~uint32_t(0);
+
+	// Binding point of the storage buffer, fixed in the shaders
+	static constexpr GLuint OBJECTS_BINDING = 3;
+
+	struct Settings
+	{
+		bool enabled = true;    // Otherwise the renderers set their matrices and colors as uniforms
+	};
+
+	// Reset by the window every frame
+	struct Statistics
+	{
+		std::size_t updatedObjects = 0;
+		std::size_t rewrittenObjects = 0;    // Changes of the last frames caught up in this copy
+		std::size_t dirtyRanges = 0;
+		std::size_t uploadedBytes = 0;
+		double fenceWaitMilliseconds = 0.0;
+	};
+
+	static Settings& settings();
+	static Statistics& statistics();
+
+	/**
+	 * The buffer of the renderers, null before init() or when the context cannot map buffers persistently.
+	 */
+	static inline ObjectDataBuffer* instance() { return s_instance; }
+
+	/**
+	 * Whether the draws recorded now read their data from the buffer.
+	 */
+	static inline bool active() { return s_instance != nullptr && settings().enabled; }
+
+	ObjectDataBuffer() = default;
+	ObjectDataBuffer(const ObjectDataBuffer&) = delete;
+	ObjectDataBuffer& operator=(const ObjectDataBuffer&) = delete;
+
+	/**
+	 * Needs glBufferStorage, from OpenGL 4.4: false without it, the renderers keep using the uniforms.
+	 */
+	bool init(std::size_t capacity = 4096);
+
+	/**
+	 * Around the draws of a frame: wait for the copy of the frame and catch it up, then fence it.
+	 */
+	void beginFrame();
+	void endFrame();
+
+	/**
+	 * Delete the buffer while the context is still alive.
+	 */
+	void clear();
+
+	// NO_SLOT when the buffer could not grow, it is cleared and the renderers go back to the uniforms
+	uint32_t allocate();
+	void release(uint32_t slot);
+
+	/**
+	 * Write a slot, between beginFrame and endFrame and before the draws reading it this frame.
+	 */
+	void update(uint32_t slot, const ObjectData& data);
+
+	inline std::size_t objectCount() const { return m_shadow.size() - m_freeSlots.size(); }
+	inline std::size_t capacity() const { return m_capacity; }
+
+private:
+	bool createBuffer(std::size_t capacity);
+	void deleteBuffer();
+	void waitForFrame(std::size_t frame);
+	void bindFrame() const;
+	void writeSlots(std::size_t frame, uint32_t firstSlot, uint32_t slotCount);
+
+	inline ObjectData* frameData(std::size_t frame) const { return reinterpret_cast<ObjectData*>(m_mapping + frame * m_frameSize); }
+
+private:
+	GLuint m_buffer = 0;
+	unsigned char* m_mapping = nullptr;
+	std::size_t m_capacity = 0;     // Slots per copy
+	std::size_t m_frameSize = 0;    // Bytes per copy, aligned for glBindBufferRange
+	std::size_t m_frame = 0;        // Copy of the frame in progress
+	GLsync m_fences[FRAME_COUNT] = {};
+
+	std::vector<ObjectData> m_shadow;                  // Latest data of every slot
+	std::vector<uint32_t> m_dirtySlots[FRAME_COUNT];   // Changed since the copy was last written
+	std::vector<uint32_t> m_freeSlots;
+
+	inline static ObjectDataBuffer* s_instance = nullptr;
+};
+
+#endif
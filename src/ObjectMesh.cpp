@@ -10,55 +10,217 @@
 
 #include "ObjectMesh.h"
 
+#include <GLFW/glfw3.h>
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
 #include <glm/vec3.hpp>
 
+#include "GLTFLoader.h"
 #include "Material.h"
-#include "OBJLoader.h"
+#include "MeshCache.h"
+
+void ObjectMesh::init(const MeshCache::MeshView& meshView)
+{
+	m_vertexCount = static_cast<GLsizei>(meshView.vertexCount);
+	m_indexCount = static_cast<GLsizei>(meshView.indexCount);
+
+	// The cache already has the positions, uvs and normals one after the other
+	glGenBuffers(1, &m_buffers[VBO_Object]);
+	glGenBuffers(1, &m_buffers[EBO_Object]);
+
+	glBindBuffer(GL_ARRAY_BUFFER, m_buffers[VBO_Object]);
+	glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(meshView.vertexDataSize), meshView.vertexData, GL_STATIC_DRAW);
+
+	// Uploaded through GL_ARRAY_BUFFER: binding an element buffer now would change whichever VAO is bound
+	glBindBuffer(GL_ARRAY_BUFFER, m_buffers[EBO_Object]);
+	glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(sizeof(GLuint) * meshView.indexCount), meshView.indices, GL_STATIC_DRAW);
+
+	const GLintptr vertexCount = static_cast<GLintptr>(meshView.vertexCount);
+	m_position = { m_buffers[VBO_Object], 0, 0, 3 };
+	m_uv = { m_buffers[VBO_Object], static_cast<GLintptr>(sizeof(GLfloat) * 3) * vertexCount, 0, 2 };
+	m_normal = { m_buffers[VBO_Object], static_cast<GLintptr>(sizeof(GLfloat) * 5) * vertexCount, 0, 3 };
+
+	initVAOs(m_buffers[EBO_Object]);
+	setBounds(meshView.boundsMin, meshView.boundsMax);
+
+	if (!meshView.lods.empty())
+	{
+		setLods(meshView.lodIndices, meshView.lodIndexCount, meshView.lods);
+	}
+
+	// The indices of the view are already in the order of its meshlets
+	m_meshlets.assign(meshView.meshlets, meshView.meshlets + meshView.meshletCount);
+}
+
+std::shared_ptr<const GLuint> ObjectMesh::uploadSharedBuffer(const void* data, std::size_t size)
+{
+	GLuint buffer;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(size), data, GL_STATIC_DRAW);
+
+	return std::shared_ptr<const GLuint>(new GLuint(buffer), [](const GLuint* sharedBuffer)
+		{
+			// The meshes can outlive the window, there is nothing left to delete then
+			if (glfwGetCurrentContext() != nullptr)
+			{
+				glDeleteBuffers(1, sharedBuffer);
+			}
+			delete sharedBuffer;
+		});
+}
+
+void ObjectMesh::init(const GLTFLoader::Primitive& primitive, std::shared_ptr<const GLuint> sharedBuffer)
+{
+	m_sharedBuffer = std::move(sharedBuffer);
+	const GLuint binaryBuffer = m_sharedBuffer != nullptr ? *m_sharedBuffer : 0;
+	m_vertexCount = static_cast<GLsizei>(primitive.vertexCount);
+	m_indexCount = static_cast<GLsizei>(primitive.indexCount);
+	m_indexType = primitive.indexType;
+	m_indexOffset = static_cast<GLintptr>(primitive.indexOffset);
+
+	GLuint extraBuffer = 0;
+	if (!primitive.extraData.empty())
+	{
+		glGenBuffers(1, &m_buffers[VBO_Object]);
+		extraBuffer = m_buffers[VBO_Object];
+		glBindBuffer(GL_ARRAY_BUFFER, extraBuffer);
+		glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(primitive.extraData.size()), primitive.extraData.data(), GL_STATIC_DRAW);
+	}
+
+	auto toVertexAttribute = [&](const GLTFLoader::Attribute& attribute)
+	{
+		VertexAttribute vertexAttribute;
+		if (attribute.present())
+		{
+			vertexAttribute.buffer = attribute.inExtraData ? extraBuffer : binaryBuffer;
+			vertexAttribute.offset = static_cast<GLintptr>(attribute.offset);
+			vertexAttribute.stride = static_cast<GLsizei>(attribute.stride);
+			vertexAttribute.size = static_cast<GLint>(attribute.componentCount);
+			vertexAttribute.type = attribute.componentType;
+			vertexAttribute.normalized = attribute.normalized ? GL_TRUE : GL_FALSE;
+		}
+		return vertexAttribute;
+	};
+	m_position = toVertexAttribute(primitive.position);
+	m_uv = toVertexAttribute(primitive.uv);
+	m_normal = toVertexAttribute(primitive.normal);
+
+	initVAOs(primitive.indicesInExtraData ? extraBuffer : binaryBuffer);
+	setBounds(primitive.boundsMin, primitive.boundsMax);
+}
+
+void ObjectMesh::setLods(const uint32_t* indices, std::size_t indexCount, const std::vector<MeshSimplifier::LodLevel>& levels)
+{
+	if (m_buffers[EBO_Lod] == 0)
+	{
+		glGenBuffers(1, &m_buffers[EBO_Lod]);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, m_buffers[EBO_Lod]);
+	glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(sizeof(GLuint) * indexCount), indices, GL_STATIC_DRAW);
+
+	glBindVertexArray(m_VAOs[VAO_ObjectLod]);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_buffers[EBO_Lod]);
+	glBindVertexArray(m_VAOs[VAO_ObjectConstantLod]);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_buffers[EBO_Lod]);
+	glBindVertexArray(0);
+
+	m_lods = levels;
+}
+
+void ObjectMesh::setMeshlets(const uint32_t* indices, std::size_t indexCount, const Meshlets::Meshlet* meshlets, std::size_t meshletCount)
+{
+	if (indexCount != static_cast<std::size_t>(m_indexCount) || m_indexBuffer == 0)
+	{
+		return;
+	}
+
+	// A permutation of the triangles: every index still fits in the type of the buffer
+	std::vector<unsigned char> data;
+	const std::size_t indexSize = m_indexType == GL_UNSIGNED_BYTE ? 1 : (m_indexType == GL_UNSIGNED_SHORT ? 2 : 4);
+	data.resize(indexCount * indexSize);
+	for (std::size_t i = 0; i < indexCount; ++i)
+	{
+		const uint8_t index8 = static_cast<uint8_t>(indices[i]);
+		const uint16_t index16 = static_cast<uint16_t>(indices[i]);
+		switch (indexSize)
+		{
+		case 1: std::memcpy(&data[i], &index8, 1); break;
+		case 2: std::memcpy(&data[2 * i], &index16, 2); break;
+		default: std::memcpy(&data[4 * i], &indices[i], 4); break;
+		}
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, m_indexBuffer);
+	glBufferSubData(GL_ARRAY_BUFFER, m_indexOffset, static_cast<GLsizeiptr>(data.size()), data.data());
+
+	m_meshlets.assign(meshlets, meshlets + meshletCount);
+}
 
-void ObjectMesh::init(const OBJLoader::Mesh& objectMesh)
+void ObjectMesh::release()
 {
-	initVertices(objectMesh);
-	initNormals(objectMesh);
-	initIndices(objectMesh);
-	initUVs(objectMesh);
-	initBuffersAndVAOs();
+	glDeleteVertexArrays(NumVAOs, m_VAOs);
+	glDeleteBuffers(NumBuffers, m_buffers);
+	std::fill(std::begin(m_VAOs), std::end(m_VAOs), 0u);
+	std::fill(std::begin(m_buffers), std::end(m_buffers), 0u);
+	m_indexBuffer = 0;
+	m_sharedBuffer.reset();
+	m_indexCount = 0;
+	m_lods.clear();
+	m_meshlets.clear();
+}
+
+void ObjectMesh::setBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	m_boundsCenter = 0.5f * (boundsMin + boundsMax);
+	m_boundsRadius = 0.5f * glm::length(boundsMax - boundsMin);
+	m_boundsExtents = 0.5f * (boundsMax - boundsMin);
 }
 
 void ObjectMesh::init()
 {
-	assert(("You should call init(const OBJLoader::Mesh&) instead",false));
+	assert(("You should call init(const MeshCache::MeshView&) instead",false));
 }
 
-void ObjectMesh::initAttributes(const std::shared_ptr<const Material>& material) const
+void ObjectMesh::enableAttribute(int location, const VertexAttribute& attribute)
 {
-	glBindVertexArray(m_VAOs[VAO_Object]);
-	glBindBuffer(GL_ARRAY_BUFFER, m_buffers[VBO_Object]);
+	if (attribute.buffer == 0)
+	{
+		// Reads the current value of the attribute, (0, 0, 0, 1) unless someone sets it
+		glDisableVertexAttribArray(location);
+		return;
+	}
 
-	const int positionAttributeLocation = material->positionAttribLocation();
-	glVertexAttribPointer(positionAttributeLocation, 3, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0));
-	glEnableVertexAttribArray(positionAttributeLocation);
+	glBindBuffer(GL_ARRAY_BUFFER, attribute.buffer);
+	glVertexAttribPointer(location, attribute.size, attribute.type, attribute.normalized, attribute.stride, BUFFER_OFFSET(attribute.offset));
+	glEnableVertexAttribArray(location);
+}
 
-	const int uvAttributeLocation = material->uvAttribLocation();
-	glVertexAttribPointer(uvAttributeLocation, 2, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(static_cast<long>(sizeof(GLfloat) * m_vertices.size())));
-	glEnableVertexAttribArray(uvAttributeLocation);
+void ObjectMesh::initAttributes(const std::shared_ptr<const Material>& material) const
+{
+	for (const auto vao : { VAO_Object, VAO_ObjectLod })
+	{
+		glBindVertexArray(m_VAOs[vao]);
 
-	const int normalAttributeLocation = material->normalAttribLocation();
-	glVertexAttribPointer(normalAttributeLocation, 3, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(static_cast<long>(sizeof(GLfloat) * (m_vertices.size() + m_uvs.size()))));
-	glEnableVertexAttribArray(normalAttributeLocation);
+		enableAttribute(material->positionAttribLocation(), m_position);
+		enableAttribute(material->uvAttribLocation(), m_uv);
+		enableAttribute(material->normalAttribLocation(), m_normal);
 
-	const int tangentAttributeLocation = material->tangentAttribLocation();
-	glVertexAttribPointer(tangentAttributeLocation, 3, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(static_cast<long>(sizeof(GLfloat) * (m_vertices.size() + m_uvs.size() + m_normals.size()))));
-	glEnableVertexAttribArray(tangentAttributeLocation);
+		// No tangents: a null tangent tells the shader to ignore the normal map
+		enableAttribute(material->tangentAttribLocation(), VertexAttribute());
+	}
 }
 
 void ObjectMesh::initConstantAttributes(const std::shared_ptr<const Material>& constantMaterial) const
 {
-	glBindVertexArray(m_VAOs[VAO_ObjectConstant]);
-	glBindBuffer(GL_ARRAY_BUFFER, m_buffers[VBO_ObjectConstant]);
+	for (const auto vao : { VAO_ObjectConstant, VAO_ObjectConstantLod })
+	{
+		glBindVertexArray(m_VAOs[vao]);
 
-	const int positionLocation = constantMaterial->positionAttribLocation();
-	glVertexAttribPointer(positionLocation, 3, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0));
-	glEnableVertexAttribArray(positionLocation);
+		enableAttribute(constantMaterial->positionAttribLocation(), m_position);
+	}
 }
 
 void ObjectMesh::faceAt(const glm::vec3& position, glm::vec3& outCenter, glm::vec3& outNormal) const
@@ -106,116 +268,105 @@ void ObjectMesh::faceAt(const glm::vec3& position, glm::vec3& outCenter, glm::ve
 
 void ObjectMesh::bindAndDraw() const
 {
-	const GLsizei sizeOfIndices = static_cast<long>(sizeof(GLfloat) * m_indices.size());
-	glBindVertexArray(m_VAOs[VAO_Object]);
-	glDrawElements(GL_TRIANGLES, sizeOfIndices, GL_UNSIGNED_INT, nullptr);
+	bindVertexArray(m_VAOs[VAO_Object]);
+	glDrawElements(GL_TRIANGLES, m_indexCount, m_indexType, BUFFER_OFFSET(m_indexOffset));
 }
 
 void ObjectMesh::bindAndDrawConstant() const
 {
-	const GLsizei sizeOfIndices = static_cast<long>(sizeof(GLfloat) * m_indices.size());
-	glBindVertexArray(m_VAOs[VAO_ObjectConstant]);
-	glDrawElements(GL_TRIANGLES, sizeOfIndices, GL_UNSIGNED_INT, nullptr);
+	bindVertexArray(m_VAOs[VAO_ObjectConstant]);
+	glDrawElements(GL_TRIANGLES, m_indexCount, m_indexType, BUFFER_OFFSET(m_indexOffset));
 }
 
-void ObjectMesh::initVertices(const OBJLoader::Mesh& objectMesh)
+GLuint ObjectMesh::vertexArray(bool constant, std::size_t level) const
 {
-	for (auto objectVertex : objectMesh.vertices)
+	if (level == 0 || level > m_lods.size())
 	{
-		for (auto objectPosition : objectVertex.position)
-		{
-			m_vertices.push_back(objectPosition);
-		}
+		return m_VAOs[constant ? VAO_ObjectConstant : VAO_Object];
 	}
+	return m_VAOs[constant ? VAO_ObjectConstantLod : VAO_ObjectLod];
 }
 
-void ObjectMesh::initNormals(const OBJLoader::Mesh& objectMesh)
+void ObjectMesh::bindAndDrawLod(std::size_t level) const
 {
-	for (auto objectVertex : objectMesh.vertices)
+	if (level == 0 || level > m_lods.size())
 	{
-		for (auto objectNormal : objectVertex.normal)
-		{
-			m_normals.push_back(objectNormal);
-		}
+		bindAndDraw();
+		return;
 	}
-}
 
-void ObjectMesh::initTangents(const OBJLoader::Mesh& objectMesh)
-{
-	for (auto objectVertex : objectMesh.vertices)
-	{
-		for (auto objectNormal : objectVertex.normal)
-		{
-			m_tangents.push_back(0.0f);
-		}
-	}
+	const auto& lod = m_lods[level - 1];
+	bindVertexArray(m_VAOs[VAO_ObjectLod]);
+	glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(lod.indexCount), GL_UNSIGNED_INT, BUFFER_OFFSET(sizeof(GLuint) * lod.indexOffset));
 }
 
-void ObjectMesh::initIndices(const OBJLoader::Mesh& objectMesh)
+void ObjectMesh::bindAndDrawConstantLod(std::size_t level) const
 {
-	for (auto i = 0; i < static_cast<int>(objectMesh.vertices.size()); ++i)
+	if (level == 0 || level > m_lods.size())
 	{
-		m_indices.push_back(i);
+		bindAndDrawConstant();
+		return;
 	}
-}
 
-void ObjectMesh::initUVs(const OBJLoader::Mesh& objectMesh)
-{
-	for (auto objectVertex : objectMesh.vertices)
-	{
-		for (auto objectUV : objectVertex.uv)
-		{
-			m_uvs.push_back(objectUV);
-		}
-	}
+	const auto& lod = m_lods[level - 1];
+	bindVertexArray(m_VAOs[VAO_ObjectConstantLod]);
+	glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(lod.indexCount), GL_UNSIGNED_INT, BUFFER_OFFSET(sizeof(GLuint) * lod.indexOffset));
 }
 
-void ObjectMesh::initBuffersAndVAOs()
+void ObjectMesh::initVAOs(GLuint indexBuffer)
 {
 	glGenVertexArrays(NumVAOs, m_VAOs);
-	glGenBuffers(NumBuffers, m_buffers);
+	m_indexBuffer = indexBuffer;
 
-	initCubeBuffersAndVAOs();
-	initCubeConstantBuffersAndVAOs();
+	// The element buffer is part of the state of the VAO, the attributes are set by initAttributes
+	for (const auto vao : { VAO_Object, VAO_ObjectConstant })
+	{
+		glBindVertexArray(m_VAOs[vao]);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	}
 
 	glBindVertexArray(0);
 }
 
-void ObjectMesh::initCubeBuffersAndVAOs()
+std::size_t ObjectMesh::bindAndDrawMeshlets(const Meshlets::CullingView& view) const
 {
-	constexpr GLsizeiptr offsetVertices = 0;
-	const GLsizeiptr sizeOfVertices = static_cast<long>(sizeof(GLfloat) * m_vertices.size());
-	const GLsizeiptr sizeOfNormals = static_cast<long>(sizeof(GLfloat) * m_normals.size());
-	const GLsizeiptr sizeOfTangents = static_cast<long>(sizeof(GLfloat) * m_tangents.size());
-	const GLsizeiptr sizeOfUVs = static_cast<long>(sizeof(GLfloat) * m_uvs.size());
-	const GLsizeiptr sizeOfIndices = static_cast<long>(sizeof(GLfloat) * m_indices.size());
-	const GLsizeiptr dataSize = sizeOfVertices + sizeOfUVs + sizeOfNormals + sizeOfTangents;
-
-	glBindVertexArray(m_VAOs[VAO_Object]);
-
-	glBindBuffer(GL_ARRAY_BUFFER, m_buffers[VBO_Object]);
-	glBufferData(GL_ARRAY_BUFFER, dataSize, nullptr, GL_STATIC_DRAW);
+	return drawVisibleMeshlets(m_VAOs[VAO_Object], view);
+}
 
-	glBufferSubData(GL_ARRAY_BUFFER, offsetVertices, sizeOfVertices, m_vertices.data());
-	glBufferSubData(GL_ARRAY_BUFFER, sizeOfVertices, sizeOfUVs, m_uvs.data());
-	glBufferSubData(GL_ARRAY_BUFFER, sizeOfVertices + sizeOfUVs, sizeOfNormals, m_normals.data());
-	glBufferSubData(GL_ARRAY_BUFFER, sizeOfVertices + sizeOfUVs + sizeOfNormals, sizeOfTangents, m_tangents.data());
+std::size_t ObjectMesh::bindAndDrawConstantMeshlets(const Meshlets::CullingView& view) const
+{
+	return drawVisibleMeshlets(m_VAOs[VAO_ObjectConstant], view);
+}
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_buffers[EBO_Object]);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeOfIndices, m_indices.data(), GL_STATIC_DRAW);
+std::size_t ObjectMesh::drawVisibleMeshlets(GLuint vao, const Meshlets::CullingView& view) const
+{
+	m_meshletRanges.clear();
+	const std::size_t visibleTriangles = Meshlets::cull(m_meshlets.data(), m_meshlets.size(), view, m_meshletRanges);
+	drawRanges(vao, m_meshletRanges.data(), m_meshletRanges.size());
+	return visibleTriangles;
 }
 
-void ObjectMesh::initCubeConstantBuffersAndVAOs()
+void ObjectMesh::bindAndDrawRanges(bool constant, const uint32_t* ranges, std::size_t rangeValueCount) const
 {
-	const GLsizeiptr sizeOfVertices = static_cast<long>(sizeof(GLfloat) * m_vertices.size());
-	const GLsizeiptr sizeOfIndices = static_cast<long>(sizeof(GLfloat) * m_indices.size());
+	drawRanges(m_VAOs[constant ? VAO_ObjectConstant : VAO_Object], ranges, rangeValueCount);
+}
 
-	glBindVertexArray(m_VAOs[VAO_ObjectConstant]);
+void ObjectMesh::drawRanges(GLuint vao, const uint32_t* ranges, std::size_t rangeValueCount) const
+{
+	if (rangeValueCount == 0)
+	{
+		return;
+	}
 
-	glBindBuffer(GL_ARRAY_BUFFER, m_buffers[VBO_ObjectConstant]);
-	glBufferData(GL_ARRAY_BUFFER, sizeOfVertices, m_vertices.data(), GL_STATIC_DRAW);
+	const std::size_t indexSize = m_indexType == GL_UNSIGNED_BYTE ? 1 : (m_indexType == GL_UNSIGNED_SHORT ? 2 : 4);
+	m_drawCounts.clear();
+	m_drawOffsets.clear();
+	for (std::size_t i = 0; i + 1 < rangeValueCount; i += 2)
+	{
+		m_drawOffsets.push_back(BUFFER_OFFSET(m_indexOffset + ranges[i] * indexSize));
+		m_drawCounts.push_back(static_cast<GLsizei>(ranges[i + 1]));
+	}
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_buffers[EBO_ObjectConstant]);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeOfIndices, m_indices.data(), GL_STATIC_DRAW);
+	bindVertexArray(vao);
+	glMultiDrawElements(GL_TRIANGLES, m_drawCounts.data(), m_indexType, m_drawOffsets.data(), static_cast<GLsizei>(m_drawCounts.size()));
 }
-
@@ -16,55 +16,147 @@
 #include <glm/vec3.hpp>
 
 #include "Mesh.h"
+#include "Meshlets.h"
+#include "MeshSimplifier.h"
 
-namespace OBJLoader
+namespace MeshCache
 {
-	struct Mesh;
-	struct Vertex;
+	struct MeshView;
+}
+
+namespace GLTFLoader
+{
+	struct Primitive;
 }
 
 class ObjectMesh : public Mesh
 {
 public:
-	void init(const OBJLoader::Mesh& objectMesh);
+	/**
+	 * Upload the buffers straight from the cache, the view only has to stay valid during the call.
+	 */
+	void init(const MeshCache::MeshView& meshView);
+
+	/**
+	 * Upload the binary chunk of a file once for all its primitives. The buffer is deleted when the last mesh
+	 * using it is released or destroyed.
+	 */
+	static std::shared_ptr<const GLuint> uploadSharedBuffer(const void* data, std::size_t size);
+
+	/**
+	 * Use the attributes and indices where they are in binaryBuffer, the binary chunk of the file already uploaded.
+	 * Only the data computed by the loader (extraData) is uploaded by the mesh.
+	 */
+	void init(const GLTFLoader::Primitive& primitive, std::shared_ptr<const GLuint> binaryBuffer);
+
+	/**
+	 * Upload the indices of the simplified levels, they use the vertices of the full mesh.
+	 * Can be called after initAttributes, when the levels are generated in the background.
+	 */
+	void setLods(const uint32_t* indices, std::size_t indexCount, const std::vector<MeshSimplifier::LodLevel>& levels);
+
+	/**
+	 * Replace the indices of the full mesh by the same triangles in the order of the meshlets.
+	 * Can be called after initAttributes, like setLods.
+	 */
+	void setMeshlets(const uint32_t* indices, std::size_t indexCount, const Meshlets::Meshlet* meshlets, std::size_t meshletCount);
+	/**
+	 * Delete the buffers and vertex arrays created by the mesh, a shared buffer given to init once no mesh uses it.
+	 * The meshes are otherwise kept until the end of the program, with the GL context.
+	 */
+	void release();
+
 	void initAttributes(const std::shared_ptr<const Material>& material) const override;
 	void initConstantAttributes(const std::shared_ptr<const Material>& constantMaterial) const override;
 
-	const std::vector<GLfloat>& vertices() override { return m_vertices; }
-	const std::vector<GLfloat>& normals() override { return m_normals; }
-	const std::vector<GLfloat>& tangents() override { return m_tangents; }
-	const std::vector<GLfloat>& uvs() override { return m_uvs; }
-	const std::vector<GLuint>& indices() override { return m_indices; }
+	const std::vector<GLfloat>& vertices() const override { return m_vertices; }
+	const std::vector<GLfloat>& normals() const override { return m_normals; }
+	const std::vector<GLfloat>& tangents() const override { return m_tangents; }
+	const std::vector<GLfloat>& uvs() const override { return m_uvs; }
+	const std::vector<GLuint>& indices() const override { return m_indices; }
 
 	void faceAt(const glm::vec3& position, glm::vec3& outCenter, glm::vec3& outNormal) const override;
 
 	void bindAndDraw() const override;
 	void bindAndDrawConstant() const override;
+	GLuint vertexArray(bool constant, std::size_t level) const override;
+
+	std::size_t lodCount() const override { return m_lods.size() + 1; }
+	float lodError(std::size_t level) const override { return level == 0 ? 0.0f : m_lods[level - 1].error; }
+	std::size_t triangleCount(std::size_t level) const override { return (level == 0 ? m_indexCount : m_lods[level - 1].indexCount) / 3; }
+	void bindAndDrawLod(std::size_t level) const override;
+	void bindAndDrawConstantLod(std::size_t level) const override;
+
+	std::size_t meshletCount() const override { return m_meshlets.size(); }
+	const Meshlets::Meshlet* meshlets() const override { return m_meshlets.data(); }
+	std::size_t bindAndDrawMeshlets(const Meshlets::CullingView& view) const override;
+	std::size_t bindAndDrawConstantMeshlets(const Meshlets::CullingView& view) const override;
+	void bindAndDrawRanges(bool constant, const uint32_t* ranges, std::size_t rangeValueCount) const override;
+
+	glm::vec3 boundsCenter() const override { return m_boundsCenter; }
+	float boundsRadius() const override { return m_boundsRadius; }
+	glm::vec3 boundsExtents() const override { return m_boundsExtents; }
+
+	bool singleSided() const override { return m_singleSided; }
+	inline void singleSided(bool isSingleSided) { m_singleSided = isSingleSided; }
 
 private:
 	void init() override;
 
-	void initVertices(const OBJLoader::Mesh& objectMesh);
-	void initNormals(const OBJLoader::Mesh& objectMesh);
-	void initTangents(const OBJLoader::Mesh& objectMesh);
-	void initIndices(const OBJLoader::Mesh& objectMesh);
-	void initUVs(const OBJLoader::Mesh& objectMesh);
-	void initBuffersAndVAOs();
-	void initCubeBuffersAndVAOs();
-	void initCubeConstantBuffersAndVAOs();
+	// Where an attribute is read from, a buffer of 0 leaves the attribute disabled
+	struct VertexAttribute
+	{
+		GLuint buffer = 0;
+		GLintptr offset = 0;
+		GLsizei stride = 0;
+		GLint size = 0;
+		GLenum type = GL_FLOAT;
+		GLboolean normalized = GL_FALSE;
+	};
+
+	void initVAOs(GLuint indexBuffer);
+	void setBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+	static void enableAttribute(int location, const VertexAttribute& attribute);
+	std::size_t drawVisibleMeshlets(GLuint vao, const Meshlets::CullingView& view) const;
+	void drawRanges(GLuint vao, const uint32_t* ranges, std::size_t rangeValueCount) const;
 
 private:
+	GLsizei m_vertexCount = 0;
+	GLsizei m_indexCount = 0;
+	GLenum m_indexType = GL_UNSIGNED_INT;
+	GLintptr m_indexOffset = 0;
+	GLuint m_indexBuffer = 0;
+	std::shared_ptr<const GLuint> m_sharedBuffer;     // Binary chunk of a glTF file, shared by its primitives
+
+	VertexAttribute m_position;
+	VertexAttribute m_uv;
+	VertexAttribute m_normal;
+
+	std::vector<MeshSimplifier::LodLevel> m_lods;
+	std::vector<Meshlets::Meshlet> m_meshlets;
+
+	// Rebuilt every draw on the GL thread, kept to reuse their memory
+	mutable std::vector<uint32_t> m_meshletRanges;
+	mutable std::vector<GLsizei> m_drawCounts;
+	mutable std::vector<const void*> m_drawOffsets;
+	glm::vec3 m_boundsCenter = glm::vec3(0.0f);
+	float m_boundsRadius = 0.0f;
+	glm::vec3 m_boundsExtents = glm::vec3(0.0f);
+	bool m_singleSided = false;
+
+	// The data only lives in the buffers (uploaded from the mapped cache), these stay empty
 	std::vector<GLfloat> m_vertices;
 	std::vector<GLfloat> m_normals;
 	std::vector<GLfloat> m_tangents;
 	std::vector<GLuint> m_indices;
 	std::vector<GLfloat> m_uvs;
 
-	enum VAO_IDs { VAO_Object, VAO_ObjectConstant, NumVAOs };
-	enum Buffer_IDs { VBO_Object, EBO_Object, VBO_ObjectConstant, EBO_ObjectConstant, NumBuffers };
+	enum VAO_IDs { VAO_Object, VAO_ObjectConstant, VAO_ObjectLod, VAO_ObjectConstantLod, NumVAOs };
+	enum Buffer_IDs { VBO_Object, EBO_Object, EBO_Lod, NumBuffers };
 
-	GLuint m_VAOs[NumVAOs];
-	GLuint m_buffers[NumBuffers];
+	// All the VAOs read the same vertices, the constant ones only use the positions. The Lod ones draw from EBO_Lod.
+	GLuint m_VAOs[NumVAOs] = {};
+	GLuint m_buffers[NumBuffers] = {};
 };
 
 #endif
@@ -0,0 +1,49 @@
+#pragma once
+#ifndef OBJECTTEXTURES_H
+#define OBJECTTEXTURES_H
+
+/**
+ * @file ObjectTextures.h
+ *
+ * @brief Textures that can be assigned to the cubes, shared by the application and the texture cooker.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include <string>
+
+constexpr int NUMBER_OF_OBJECT_TEXTURES = 7;
+inline const char* OBJECT_TEXTURE_NAME[NUMBER_OF_OBJECT_TEXTURES] =
+{
+	"Grass",
+	"Dry Ground",
+	"Granite Floor",
+	"Limestone Wall",
+	"Pierre Boucharde",
+	"Wood Floor",
+	"No Material"
+};
+const std::string OBJECT_TEXTURE_PATH[NUMBER_OF_OBJECT_TEXTURES] =
+{
+	"grass2.jpg",
+	"dry_ground.jpg",
+	"granite_floor.jpg",
+	"limestone_wall.jpg",
+	"pierre_bouchardee.jpg",
+	"wood_floor.jpg",
+	"no_material.png"
+};
+const std::string OBJECT_TEXTURE_NORMALS_PATH[NUMBER_OF_OBJECT_TEXTURES] =
+{
+	"grass_normals.jpg",
+	"dry_ground_normals.jpg",
+	"granite_floor_normals.jpg",
+	"limestone_wall_normals.jpg",
+	"pierre_bouchardee_normals.jpg",
+	"wood_floor_normals.jpg",
+	"no_material_normals.png"
+};
+
+#endif
@@ -0,0 +1,410 @@
+/**
+ * @file OcclusionCulling.cpp
+ *
+ * @brief Software depth buffer of the largest occluders, to skip the renderers hidden behind them.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include "OcclusionCulling.h"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OCCLUSION_SSE2 1
+#endif
+
+#include "Mesh.h"
+#include "MeshRenderer.h"
+#include "Camera.h"
+#include "SceneObject.h"
+#include "ThreadPool.h"
+
+namespace
+{
+	static_assert(OcclusionCuller::WIDTH % 4 == 0, "The rows are rasterized four pixels at a time");
+	static_assert(OcclusionCuller::HEIGHT % OcclusionCuller::BAND_HEIGHT == 0, "The bands have to cover the rows");
+
+	// Corners of a box are numbered by their bits: x for 1, y for 2, z for 4
+	constexpr int BOX_TRIANGLES[12][3] = {
+		{ 0, 2, 6 }, { 0, 6, 4 },   // -x
+		{ 1, 5, 7 }, { 1, 7, 3 },   // +x
+		{ 0, 4, 5 }, { 0, 5, 1 },   // -y
+		{ 2, 3, 7 }, { 2, 7, 6 },   // +y
+		{ 0, 1, 3 }, { 0, 3, 2 },   // -z
+		{ 4, 6, 7 }, { 4, 7, 5 },   // +z
+	};
+
+	// A candidate is only hidden when the occluders are nearer by more than this fraction of its depth
+	constexpr float DEPTH_BIAS = 1e-4f;
+
+	glm::vec3 boxCorner(const glm::vec3& center, const glm::vec3& extents, int corner)
+	{
+		return center + glm::vec3(corner & 1 ? extents.x : -extents.x, corner & 2 ? extents.y : -extents.y, corner & 4 ? extents.z : -extents.z);
+	}
+
+	// Clip coordinates in front of the near plane
+	bool inFrontOfNearPlane(const glm::vec4& clip)
+	{
+		return clip.w > 0.0f && clip.z > -clip.w;
+	}
+
+	glm::vec3 toScreen(const glm::vec4& clip)
+	{
+		const float invW = 1.0f / clip.w;
+		return glm::vec3((clip.x * invW * 0.5f + 0.5f) * OcclusionCuller::WIDTH, (clip.y * invW * 0.5f + 0.5f) * OcclusionCuller::HEIGHT, invW);
+	}
+}
+
+OcclusionCuller::Settings& OcclusionCuller::settings()
+{
+	static Settings settings;
+	return settings;
+}
+
+OcclusionCuller::Statistics& OcclusionCuller::statistics()
+{
+	static Statistics statistics;
+	return statistics;
+}
+
+void OcclusionCuller::cull(const Camera& camera, SceneObject& sceneRoot)
+{
+	const auto startTime = std::chrono::steady_clock::now();
+	clear();
+
+	auto& cullerStatistics = statistics();
+	cullerStatistics = Statistics();
+
+	const auto& cullerSettings = settings();
+	if (!cullerSettings.enabled)
+	{
+		if (!m_previousCulled.empty())
+			++m_resultVersion;
+		return;
+	}
+
+	m_viewProjection = camera.projectionMatrix() * camera.viewMatrix();
+	m_cameraPosition = camera.position();
+
+	m_candidates.clear();
+	gather(sceneRoot, false);
+
+	// The meshes covering the most of the screen
+	std::vector<const Candidate*> occluders;
+	for (const auto& candidate : m_candidates)
+	{
+		if (candidate.occluderScore >= cullerSettings.minOccluderSize)
+			occluders.push_back(&candidate);
+	}
+	const std::size_t maxOccluders = static_cast<std::size_t>(std::max(cullerSettings.maxOccluders, 0));
+	if (occluders.size() > maxOccluders)
+	{
+		std::nth_element(occluders.begin(), occluders.begin() + maxOccluders, occluders.end(),
+			[](const Candidate* a, const Candidate* b) { return a->occluderScore > b->occluderScore; });
+		occluders.resize(maxOccluders);
+	}
+
+	m_triangles.clear();
+	for (const auto* occluder : occluders)
+	{
+		setupOccluder(*occluder);
+	}
+
+	m_depth.assign(static_cast<std::size_t>(WIDTH) * HEIGHT, 0.0f);
+	ThreadPool::instance().parallelFor(HEIGHT / BAND_HEIGHT, 1, [this](std::size_t begin, std::size_t end)
+	{
+		for (std::size_t band = begin; band < end; ++band)
+			rasterizeBand(static_cast<int>(band) * BAND_HEIGHT, static_cast<int>(band + 1) * BAND_HEIGHT);
+	});
+	buildHierarchy();
+
+	std::vector<char> occluded(m_candidates.size(), 0);
+	ThreadPool::instance().parallelFor(m_candidates.size(), 256, [&](std::size_t begin, std::size_t end)
+	{
+		for (std::size_t i = begin; i < end; ++i)
+			occluded[i] = isOccluded(m_candidates[i]);
+	});
+
+	for (std::size_t i = 0; i < m_candidates.size(); ++i)
+	{
+		if (occluded[i])
+		{
+			m_candidates[i].renderer->occluded(true);
+			m_culled.push_back(m_candidates[i].renderer);
+		}
+	}
+	if (m_culled != m_previousCulled)
+	{
+		++m_resultVersion;
+	}
+
+	cullerStatistics.testedRenderers = m_candidates.size();
+	cullerStatistics.culledRenderers = m_culled.size();
+	cullerStatistics.occluders = occluders.size();
+	cullerStatistics.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void OcclusionCuller::clear()
+{
+	for (auto* renderer : m_culled)
+	{
+		renderer->occluded(false);
+	}
+	m_previousCulled.swap(m_culled);
+	m_culled.clear();
+}
+
+void OcclusionCuller::gather(SceneObject& object, bool dirty)
+{
+	dirty = dirty || object.isDirty();
+
+	auto* renderer = dynamic_cast<MeshRenderer*>(&object);
+	if (renderer != nullptr && !dirty)
+	{
+		const Mesh& mesh = *renderer->mesh();
+		Candidate candidate;
+		candidate.renderer = renderer;
+		candidate.modelMatrix = renderer->modelMatrix();
+		candidate.center = mesh.boundsCenter();
+		candidate.extents = mesh.boundsExtents();
+		if (candidate.extents == glm::vec3(0.0f))
+			candidate.extents = glm::vec3(mesh.boundsRadius());
+
+		if (candidate.extents != glm::vec3(0.0f))
+		{
+			const glm::vec3 worldCenter = glm::vec3(candidate.modelMatrix * glm::vec4(candidate.center, 1.0f));
+			const glm::mat3 linear = glm::mat3(candidate.modelMatrix);
+			const glm::mat3 absolute(glm::abs(linear[0]), glm::abs(linear[1]), glm::abs(linear[2]));
+			const glm::vec3 worldExtents = absolute * candidate.extents;
+			candidate.worldMin = worldCenter - worldExtents;
+			candidate.worldMax = worldCenter + worldExtents;
+
+			// Only the ones in front of the camera can hide something
+			if (mesh.fillsBounds() && (m_viewProjection * glm::vec4(worldCenter, 1.0f)).w > 0.0f)
+			{
+				const float distance = std::max(glm::length(worldCenter - m_cameraPosition), 1e-3f);
+				candidate.occluderScore = glm::length(worldExtents) / distance;
+			}
+			m_candidates.push_back(candidate);
+		}
+	}
+
+	for (auto* child : object.children())
+	{
+		gather(*child, dirty);
+	}
+}
+
+void OcclusionCuller::setupOccluder(const Candidate& occluder)
+{
+	// An occluder cut by the near plane has a hole in it on the screen, it is left out
+	const glm::mat4 modelViewProjection = m_viewProjection * occluder.modelMatrix;
+	glm::vec3 corners[8];
+	for (int corner = 0; corner < 8; ++corner)
+	{
+		const glm::vec4 clip = modelViewProjection * glm::vec4(boxCorner(occluder.center, occluder.extents, corner), 1.0f);
+		if (!inFrontOfNearPlane(clip))
+			return;
+		corners[corner] = toScreen(clip);
+	}
+
+	for (const auto& indices : BOX_TRIANGLES)
+	{
+		glm::vec3 v0 = corners[indices[0]];
+		glm::vec3 v1 = corners[indices[1]];
+		glm::vec3 v2 = corners[indices[2]];
+
+		// Both sides are drawn: the nearest faces win anyway
+		float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+		if (std::abs(area) < 1e-6f)
+			continue;
+		if (area < 0.0f)
+		{
+			std::swap(v1, v2);
+			area = -area;
+		}
+
+		ScreenTriangle triangle;
+		triangle.minX = std::max(static_cast<int>(std::ceil(std::min({ v0.x, v1.x, v2.x }) - 0.5f)), 0);
+		triangle.maxX = std::min(static_cast<int>(std::floor(std::max({ v0.x, v1.x, v2.x }) - 0.5f)), WIDTH - 1);
+		triangle.minY = std::max(static_cast<int>(std::ceil(std::min({ v0.y, v1.y, v2.y }) - 0.5f)), 0);
+		triangle.maxY = std::min(static_cast<int>(std::floor(std::max({ v0.y, v1.y, v2.y }) - 0.5f)), HEIGHT - 1);
+		if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+			continue;
+
+		const glm::vec3* vertices[3] = { &v0, &v1, &v2 };
+		for (int edge = 0; edge < 3; ++edge)
+		{
+			const glm::vec3& a = *vertices[edge];
+			const glm::vec3& b = *vertices[(edge + 1) % 3];
+			triangle.edgeA[edge] = a.y - b.y;
+			triangle.edgeB[edge] = b.x - a.x;
+			triangle.edgeC[edge] = (b.y - a.y) * a.x - (b.x - a.x) * a.y;
+		}
+
+		triangle.depthA = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+		triangle.depthB = ((v1.x - v0.x) * (v2.z - v0.z) - (v2.x - v0.x) * (v1.z - v0.z)) / area;
+		triangle.depthC = v0.z - triangle.depthA * v0.x - triangle.depthB * v0.y;
+		m_triangles.push_back(triangle);
+	}
+}
+
+void OcclusionCuller::rasterizeBand(int firstRow, int endRow)
+{
+	for (const auto& triangle : m_triangles)
+	{
+		const int minY = std::max(triangle.minY, firstRow);
+		const int maxY = std::min(triangle.maxY, endRow - 1);
+		const int minX = triangle.minX & ~3;
+
+		for (int y = minY; y <= maxY; ++y)
+		{
+			const float pixelY = static_cast<float>(y) + 0.5f;
+			float* row = m_depth.data() + static_cast<std::size_t>(y) * WIDTH;
+
+#ifdef OCCLUSION_SSE2
+			// Four pixels at a time, the ones outside of the triangle keep their depth
+			const __m128 rowEdge0 = _mm_set1_ps(triangle.edgeB[0] * pixelY + triangle.edgeC[0]);
+			const __m128 rowEdge1 = _mm_set1_ps(triangle.edgeB[1] * pixelY + triangle.edgeC[1]);
+			const __m128 rowEdge2 = _mm_set1_ps(triangle.edgeB[2] * pixelY + triangle.edgeC[2]);
+			const __m128 rowDepth = _mm_set1_ps(triangle.depthB * pixelY + triangle.depthC);
+			const __m128 edgeA0 = _mm_set1_ps(triangle.edgeA[0]);
+			const __m128 edgeA1 = _mm_set1_ps(triangle.edgeA[1]);
+			const __m128 edgeA2 = _mm_set1_ps(triangle.edgeA[2]);
+			const __m128 depthA = _mm_set1_ps(triangle.depthA);
+			const __m128 zero = _mm_setzero_ps();
+
+			for (int x = minX; x <= triangle.maxX; x += 4)
+			{
+				const __m128 pixelX = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f));
+				const __m128 inside = _mm_and_ps(
+					_mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA0, pixelX), rowEdge0), zero), _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA1, pixelX), rowEdge1), zero)),
+					_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA2, pixelX), rowEdge2), zero));
+				if (_mm_movemask_ps(inside) == 0)
+					continue;
+
+				const __m128 depth = _mm_add_ps(_mm_mul_ps(depthA, pixelX), rowDepth);
+				const __m128 previous = _mm_loadu_ps(row + x);
+				const __m128 nearest = _mm_max_ps(previous, depth);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, previous)));
+			}
+#else
+			for (int x = triangle.minX; x <= triangle.maxX; ++x)
+			{
+				const float pixelX = static_cast<float>(x) + 0.5f;
+				bool inside = true;
+				for (int edge = 0; edge < 3; ++edge)
+					inside = inside && triangle.edgeA[edge] * pixelX + triangle.edgeB[edge] * pixelY + triangle.edgeC[edge] >= 0.0f;
+				if (inside)
+					row[x] = std::max(row[x], triangle.depthA * pixelX + triangle.depthB * pixelY + triangle.depthC);
+			}
+#endif
+		}
+	}
+}
+
+void OcclusionCuller::buildHierarchy()
+{
+	m_hierarchy.resize(1);
+	m_hierarchy[0] = m_depth;
+	for (int level = 1; (WIDTH >> level) > 0 && (HEIGHT >> level) > 0; ++level)
+	{
+		const int width = WIDTH >> level;
+		const int height = HEIGHT >> level;
+		const int previousWidth = WIDTH >> (level - 1);
+		const auto& previous = m_hierarchy[level - 1];
+
+		std::vector<float> current(static_cast<std::size_t>(width) * height);
+		for (int y = 0; y < height; ++y)
+		{
+			const float* row0 = previous.data() + static_cast<std::size_t>(2 * y) * previousWidth;
+			const float* row1 = row0 + previousWidth;
+			for (int x = 0; x < width; ++x)
+				current[static_cast<std::size_t>(y) * width + x] = std::min({ row0[2 * x], row0[2 * x + 1], row1[2 * x], row1[2 * x + 1] });
+		}
+		m_hierarchy.push_back(std::move(current));
+	}
+}
+
+bool OcclusionCuller::isOccluded(const Candidate& candidate) const
+{
+	glm::vec2 screenMin(std::numeric_limits<float>::max());
+	glm::vec2 screenMax(std::numeric_limits<float>::lowest());
+	float nearest = 0.0f;
+	for (int corner = 0; corner < 8; ++corner)
+	{
+		const glm::vec3 worldCorner(corner & 1 ? candidate.worldMax.x : candidate.worldMin.x, corner & 2 ? candidate.worldMax.y : candidate.worldMin.y, corner & 4 ? candidate.worldMax.z : candidate.worldMin.z);
+		const glm::vec4 clip = m_viewProjection * glm::vec4(worldCorner, 1.0f);
+		if (!inFrontOfNearPlane(clip))
+			return false;
+
+		const glm::vec3 screen = toScreen(clip);
+		screenMin = glm::min(screenMin, glm::vec2(screen));
+		screenMax = glm::max(screenMax, glm::vec2(screen));
+		nearest = std::max(nearest, screen.z);
+	}
+
+	// Out of the screen: left to the clipping
+	if (screenMax.x < 0.0f || screenMax.y < 0.0f || screenMin.x >= WIDTH || screenMin.y >= HEIGHT)
+		return false;
+
+	const int pixelRectangle[4] = {
+		std::max(static_cast<int>(std::floor(screenMin.x)), 0),
+		std::max(static_cast<int>(std::floor(screenMin.y)), 0),
+		std::min(static_cast<int>(std::floor(screenMax.x)), WIDTH - 1),
+		std::min(static_cast<int>(std::floor(screenMax.y)), HEIGHT - 1),
+	};
+
+	// Start from the level where the rectangle covers at most 4 by 4 texels
+	int level = 0;
+	while (level + 1 < static_cast<int>(m_hierarchy.size())
+		&& ((pixelRectangle[2] >> level) - (pixelRectangle[0] >> level) > 3 || (pixelRectangle[3] >> level) - (pixelRectangle[1] >> level) > 3))
+		++level;
+
+	const float threshold = nearest * (1.0f + DEPTH_BIAS);
+	for (int y = pixelRectangle[1] >> level; y <= pixelRectangle[3] >> level; ++y)
+	{
+		for (int x = pixelRectangle[0] >> level; x <= pixelRectangle[2] >> level; ++x)
+		{
+			if (!isTexelOccluded(level, x, y, pixelRectangle, threshold))
+				return false;
+		}
+	}
+	return true;
+}
+
+bool OcclusionCuller::isTexelOccluded(int level, int x, int y, const int pixelRectangle[4], float threshold) const
+{
+	if (m_hierarchy[level][static_cast<std::size_t>(y) * (WIDTH >> level) + x] > threshold)
+		return true;
+	if (level == 0)
+		return false;
+
+	// A texel partly covered: its children inside the rectangle may all be
+	const int childLevel = level - 1;
+	for (int childY = 2 * y; childY <= 2 * y + 1; ++childY)
+	{
+		if ((childY << childLevel) > pixelRectangle[3] || (((childY + 1) << childLevel) - 1) < pixelRectangle[1])
+			continue;
+		for (int childX = 2 * x; childX <= 2 * x + 1; ++childX)
+		{
+			if ((childX << childLevel) > pixelRectangle[2] || (((childX + 1) << childLevel) - 1) < pixelRectangle[0])
+				continue;
+			if (!isTexelOccluded(childLevel, childX, childY, pixelRectangle, threshold))
+				return false;
+		}
+	}
+	return true;
+}
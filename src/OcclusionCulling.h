@@ -0,0 +1,122 @@
+#pragma once
+#ifndef OCCLUSIONCULLING_H
+#define OCCLUSIONCULLING_H
+
+/**
+ * @file OcclusionCulling.h
+ *
+ * @brief Software depth buffer of the largest occluders, to skip the renderers hidden behind them.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+#include <cstddef>
+#include <vector>
+
+class Camera;
+class MeshRenderer;
+class SceneObject;
+
+/**
+ * Before the scene is drawn, the boxes of the nearest solid meshes are rasterized at a low resolution
+ * and every renderer's box is tested against the hierarchical depth built from them.
+ * The rasterization runs per band of rows and the tests per range of renderers on the thread pool,
+ * while the GPU is still busy with the previous frame.
+ */
+class OcclusionCuller
+{
+public:
+	static constexpr int WIDTH = 256;
+	static constexpr int HEIGHT = 128;
+	static constexpr int BAND_HEIGHT = 16;
+
+	struct Settings
+	{
+		bool enabled = true;
+		int maxOccluders = 128;
+		float minOccluderSize = 0.05f;   // Projected radius over the distance, smaller meshes do not hide much
+	};
+
+	// Of the last cull
+	struct Statistics
+	{
+		std::size_t testedRenderers = 0;
+		std::size_t culledRenderers = 0;
+		std::size_t occluders = 0;
+		double milliseconds = 0.0;
+	};
+
+	static Settings& settings();
+	static Statistics& statistics();
+
+	/**
+	 * Flag the renderers of the scene hidden from the camera. The renderers moved this frame are never
+	 * flagged nor used as occluders: their model matrix is only updated by the render.
+	 */
+	void cull(const Camera& camera, SceneObject& sceneRoot);
+
+	/**
+	 * Clear the flags of the last cull.
+	 */
+	void clear();
+
+	// Nearest occluder of each texel as 1/w, 0 where there is none
+	inline const std::vector<float>& depth() const { return m_depth; }
+
+	// Changes whenever a cull flags other renderers than the last one (see RenderBundle)
+	inline uint64_t resultVersion() const { return m_resultVersion; }
+
+private:
+	struct Candidate
+	{
+		MeshRenderer* renderer = nullptr;
+		glm::mat4 modelMatrix = glm::mat4(1.0f);
+		glm::vec3 center = glm::vec3(0.0f);    // Box of the mesh, in model space
+		glm::vec3 extents = glm::vec3(0.0f);
+		glm::vec3 worldMin = glm::vec3(0.0f);
+		glm::vec3 worldMax = glm::vec3(0.0f);
+		float occluderScore = 0.0f;   // 0 when it cannot hide anything
+	};
+
+	// Edge functions (a * x + b * y + c, positive inside) and depth plane in pixels. The depth is 1/w,
+	// which varies linearly across the screen.
+	struct ScreenTriangle
+	{
+		float edgeA[3];
+		float edgeB[3];
+		float edgeC[3];
+		float depthA = 0.0f;
+		float depthB = 0.0f;
+		float depthC = 0.0f;
+		int minX = 0;
+		int maxX = 0;
+		int minY = 0;
+		int maxY = 0;
+	};
+
+	void gather(SceneObject& object, bool dirty);
+	void setupOccluder(const Candidate& occluder);
+	void rasterizeBand(int firstRow, int endRow);
+	void buildHierarchy();
+	bool isOccluded(const Candidate& candidate) const;
+	bool isTexelOccluded(int level, int x, int y, const int pixelRectangle[4], float threshold) const;
+
+private:
+	glm::mat4 m_viewProjection = glm::mat4(1.0f);
+	glm::vec3 m_cameraPosition = glm::vec3(0.0f);
+
+	std::vector<Candidate> m_candidates;
+	std::vector<ScreenTriangle> m_triangles;
+	std::vector<float> m_depth;
+	std::vector<std::vector<float>> m_hierarchy;   // Level n: the farthest of 2^n by 2^n texels
+	std::vector<MeshRenderer*> m_culled;
+	std::vector<MeshRenderer*> m_previousCulled;   // In the order of the traversal, like m_culled
+	uint64_t m_resultVersion = 0;
+};
+
+#endif
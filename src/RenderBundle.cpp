@@ -0,0 +1,307 @@
+/**
+ * @file RenderBundle.cpp
+ *
+ * @brief Recorded draw commands of unchanged subtrees, replayed without traversing them.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include "RenderBundle.h"
+
+#include <algorithm>
+#include <set>
+#include <unordered_map>
+
+#include "Camera.h"
+#include "ObjectData.h"
+#include "SceneObject.h"
+#include "StaticBatching.h"
+
+namespace
+{
+	constexpr double SCAN_INTERVAL = 0.5;
+}
+
+RenderBundle::Settings& RenderBundle::settings()
+{
+	static Settings settings;
+	return settings;
+}
+
+RenderBundle::RenderBundle(SceneObject& root)
+	: m_root(root)
+{
+	m_root.renderBundle(this);
+}
+
+RenderBundle::~RenderBundle()
+{
+	if (m_root.renderBundle() == this)
+	{
+		m_root.renderBundle(nullptr);
+	}
+	if (s_recording == this)
+	{
+		s_recording = nullptr;
+	}
+}
+
+bool RenderBundle::replay(const Camera& camera, const glm::mat4& modelMatrix)
+{
+	RenderQueue* renderQueue = RenderQueue::recording();
+	if (renderQueue == nullptr || !settings().enabled || s_recording != nullptr)
+	{
+		return false;
+	}
+
+	Recording& recording = current();
+	if (!recording.valid || !sameKey(recording, modelMatrix))
+	{
+		return false;
+	}
+	if (!sameOutcomes(recording, camera, RecordingView(camera)))
+	{
+		recording.valid = false;
+		recording.outdated = true;
+		++RenderQueue::statistics().bundlesOutdated;
+		return false;
+	}
+
+	// What the traversal would have done besides pushing packets
+	for (const auto& staticSlot : recording.staticSlots)
+	{
+		staticSlot.batch->markVisible(staticSlot.slot);
+	}
+	auto& hlodStatistics = HlodProxy::statistics();
+	hlodStatistics.proxiesDrawn += recording.hlodStatistics.proxiesDrawn;
+	hlodStatistics.renderersReplaced += recording.hlodStatistics.renderersReplaced;
+
+	renderQueue->addBundle(*this, false);
+	return true;
+}
+
+void RenderBundle::beginRecording(const Camera& camera, const glm::mat4& modelMatrix)
+{
+	if (RenderQueue::recording() == nullptr || !settings().enabled || s_recording != nullptr)
+	{
+		return;
+	}
+
+	Recording& recording = current();
+	const RecordingView view(camera);
+	const bool stable = sameKey(recording, modelMatrix);
+	const bool cameraMoved = view.viewMatrix != recording.checkedViewMatrix || view.projectionMatrix != recording.checkedProjectionMatrix;
+	recording.version = m_root.version();
+	recording.generation = s_generation;
+	recording.modelMatrix = modelMatrix;
+	recording.checkedViewMatrix = view.viewMatrix;
+	recording.checkedProjectionMatrix = view.projectionMatrix;
+	recording.checkGeneration = s_checkGeneration;
+	recording.valid = false;
+	if (!stable || (recording.outdated && cameraMoved))
+	{
+		return;  // Changed since the last frame, drawn with the rest of the queue
+	}
+
+	recording.viewMatrix = view.viewMatrix;
+	recording.outdated = false;
+	recording.packets.clear();
+	recording.staticSlots.clear();
+	recording.renderers.clear();
+	recording.proxies.clear();
+	m_hlodStatisticsBefore = HlodProxy::statistics();
+	s_recording = this;
+}
+
+void RenderBundle::endRecording(const Camera& camera)
+{
+	if (s_recording != this)
+	{
+		return;
+	}
+	s_recording = nullptr;
+
+	// Once the levels are selected, the meshlets are culled again on their own
+	Recording& recording = current();
+	const RecordingView view(camera);
+	for (auto& renderer : recording.renderers)
+	{
+		renderer.outcome = renderer.renderer->viewOutcome(camera, view);
+	}
+
+	const auto& hlodStatistics = HlodProxy::statistics();
+	recording.hlodStatistics.proxiesDrawn = hlodStatistics.proxiesDrawn - m_hlodStatisticsBefore.proxiesDrawn;
+	recording.hlodStatistics.renderersReplaced = hlodStatistics.renderersReplaced - m_hlodStatisticsBefore.renderersReplaced;
+
+	RenderQueue::recording()->addBundle(*this, true);
+}
+
+void RenderBundle::addStaticSlot(StaticBatch& batch, uint32_t slot)
+{
+	current().staticSlots.push_back({ &batch, slot });
+}
+
+void RenderBundle::addRenderer(MeshRenderer& renderer)
+{
+	current().renderers.push_back({ &renderer, 0 });
+}
+
+void RenderBundle::addProxy(const HlodProxy& proxy, bool drawn)
+{
+	current().proxies.push_back({ &proxy, drawn });
+}
+
+RenderBundle::Recording& RenderBundle::current()
+{
+	return m_recordings[MeshRenderer::renderPass() == MeshRenderer::RenderPass::Shading ? 0 : 1];
+}
+
+bool RenderBundle::sameKey(const Recording& recording, const glm::mat4& modelMatrix) const
+{
+	return recording.version == m_root.version() && recording.generation == s_generation && recording.modelMatrix == modelMatrix;
+}
+
+bool RenderBundle::sameOutcomes(Recording& recording, const Camera& camera, const RecordingView& view) const
+{
+	if (view.viewMatrix == recording.checkedViewMatrix && view.projectionMatrix == recording.checkedProjectionMatrix
+		&& recording.checkGeneration == s_checkGeneration)
+	{
+		return true;
+	}
+
+	// Their model-view matrices are those of the recording
+	if (recording.buffer.commands.bakesView() && view.viewMatrix != recording.viewMatrix)
+	{
+		return false;
+	}
+
+	// The proxies first, the renderers below them were only visited when they were not drawn
+	for (const auto& proxy : recording.proxies)
+	{
+		if (proxy.proxy->drawn(camera, proxy.proxy->root().modelMatrix()) != proxy.drawn)
+		{
+			return false;
+		}
+	}
+	for (const auto& renderer : recording.renderers)
+	{
+		if (renderer.renderer->viewOutcome(camera, view) != renderer.outcome)
+		{
+			return false;
+		}
+	}
+
+	recording.checkedViewMatrix = view.viewMatrix;
+	recording.checkedProjectionMatrix = view.projectionMatrix;
+	recording.checkGeneration = s_checkGeneration;
+	return true;
+}
+
+bool RenderBundleCache::FrameKey::operator==(const FrameKey& other) const
+{
+	return selectionVersion == other.selectionVersion && stateVersion == other.stateVersion
+		&& lodSettings.enabled == other.lodSettings.enabled && lodSettings.pixelError == other.lodSettings.pixelError
+		&& lodSettings.hysteresis == other.lodSettings.hysteresis && lodSettings.forcedLevel == other.lodSettings.forcedLevel
+		&& lodSettings.viewportHeight == other.lodSettings.viewportHeight
+		&& cullingSettings.enabled == other.cullingSettings.enabled && cullingSettings.frustumCulling == other.cullingSettings.frustumCulling
+		&& cullingSettings.coneCulling == other.cullingSettings.coneCulling
+		&& hlodEnabled == other.hlodEnabled && hlodPixelError == other.hlodPixelError && staticBatching == other.staticBatching
+		&& objectData == other.objectData;
+}
+
+void RenderBundleCache::update(SceneObject& sceneRoot, uint64_t stateVersion, uint64_t occlusionVersion, double time)
+{
+	FrameKey frameKey;
+	frameKey.selectionVersion = SceneObject::selectionVersion();
+	frameKey.stateVersion = stateVersion;
+	frameKey.lodSettings = MeshRenderer::lodSettings();
+	frameKey.cullingSettings = MeshRenderer::cullingSettings();
+	frameKey.hlodEnabled = HlodProxy::settings().enabled;
+	frameKey.hlodPixelError = HlodProxy::settings().pixelError;
+	frameKey.staticBatching = StaticBatcher::settings().enabled;
+	frameKey.objectData = ObjectDataBuffer::active();
+	if (!(frameKey == m_frameKey))
+	{
+		m_frameKey = frameKey;
+		RenderBundle::invalidateAll();
+	}
+	if (occlusionVersion != m_occlusionVersion)
+	{
+		m_occlusionVersion = occlusionVersion;
+		RenderBundle::recheckAll();
+	}
+
+	const auto& bundleSettings = RenderBundle::settings();
+	if (!bundleSettings.enabled)
+	{
+		m_bundles.clear();
+		m_scannedVersion = ~uint64_t(0);
+		return;
+	}
+
+	const bool settingsChanged = bundleSettings.minRenderers != m_scannedMinRenderers || bundleSettings.maxRenderers != m_scannedMaxRenderers;
+	if (settingsChanged || (sceneRoot.version() != m_scannedVersion && time - m_scanTime >= SCAN_INTERVAL))
+	{
+		scan(sceneRoot);
+		m_scannedVersion = sceneRoot.version();
+		m_scanTime = time;
+		m_scannedMinRenderers = bundleSettings.minRenderers;
+		m_scannedMaxRenderers = bundleSettings.maxRenderers;
+	}
+}
+
+void RenderBundleCache::clear()
+{
+	m_bundles.clear();
+	m_scannedVersion = ~uint64_t(0);
+}
+
+void RenderBundleCache::scan(SceneObject& sceneRoot)
+{
+	// Renderers of each subtree, the object itself included: its bundle draws it as well
+	std::unordered_map<const SceneObject*, std::size_t> rendererCounts;
+	auto count = [&](const SceneObject& object, auto& countRef) -> std::size_t
+	{
+		std::size_t rendererCount = dynamic_cast<const MeshRenderer*>(&object) != nullptr ? 1 : 0;
+		for (const auto* child : object.children())
+			rendererCount += countRef(*child, countRef);
+		rendererCounts[&object] = rendererCount;
+		return rendererCount;
+	};
+	count(sceneRoot, count);
+
+	// The largest subtrees within the limits, the root changes too often to be one
+	const auto& bundleSettings = RenderBundle::settings();
+	const std::size_t minRenderers = static_cast<std::size_t>(std::max(bundleSettings.minRenderers, 1));
+	const std::size_t maxRenderers = std::max(static_cast<std::size_t>(std::max(bundleSettings.maxRenderers, 1)), minRenderers);
+	std::set<SceneObject*> wanted;
+	auto select = [&](SceneObject& object, auto& selectRef) -> void
+	{
+		for (auto* child : object.children())
+		{
+			const std::size_t rendererCount = rendererCounts[child];
+			if (rendererCount < minRenderers)
+				continue;
+			if (rendererCount <= maxRenderers)
+				wanted.insert(child);
+			else
+				selectRef(*child, selectRef);
+		}
+	};
+	select(sceneRoot, select);
+
+	for (auto it = m_bundles.begin(); it != m_bundles.end(); )
+	{
+		if (wanted.count(it->first) == 0)
+			it = m_bundles.erase(it);
+		else
+			++it;
+	}
+	for (auto* object : wanted)
+	{
+		if (m_bundles.count(object) == 0)
+			m_bundles[object] = std::make_unique<RenderBundle>(*object);
+	}
+}
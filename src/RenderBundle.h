@@ -0,0 +1,205 @@
+#pragma once
+#ifndef RENDERBUNDLE_H
+#define RENDERBUNDLE_H
+
+/**
+ * @file RenderBundle.h
+ *
+ * @brief Recorded draw commands of unchanged subtrees, replayed without traversing them.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include <glm/mat4x4.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "Hlod.h"
+#include "MeshRenderer.h"
+#include "RenderQueue.h"
+
+class Camera;
+class SceneObject;
+class StaticBatch;
+
+/**
+ * The command buffer of a subtree, one per render pass. It is valid while the subtree keeps the version and the
+ * model matrix it was recorded with and nothing outside of it changed what it draws: the static batches, the
+ * proxies, the selection and the settings, which RenderBundleCache folds in one generation. A subtree is only
+ * recorded once the key stayed the same for a frame, so the moving ones never pay for it.
+ *
+ * The camera is not part of the key. Each bundle keeps what the camera decided for its renderers and proxies
+ * (hidden by the occlusion culling, level of detail, visible meshlets, proxy drawn or not) and compares it once
+ * the camera moves, without traversing the subtree: it is replayed as long as the same draws come out. The
+ * programs take the matrices of the current camera, so only the draws setting their model-view matrix as a
+ * uniform, without ObjectDataBuffer, need the very camera of the recording. The draws keep the order of the
+ * recording, only sorted front to back for the camera it had. A bundle outdated by the camera waits for it to
+ * stop before being recorded again.
+ */
+class RenderBundle
+{
+public:
+	struct Settings
+	{
+		bool enabled = true;
+		int minRenderers = 16;      // Smaller subtrees go through the queue, a bundle costs its own state changes
+		int maxRenderers = 4096;    // Larger subtrees are split, so a change only records a part of the scene again
+	};
+
+	static Settings& settings();
+
+	/**
+	 * The bundle collecting the packets of its subtree, null when none is.
+	 */
+	static inline RenderBundle* recording() { return s_recording; }
+
+	/**
+	 * Called by RenderBundleCache when something outside of the subtrees changes what they draw.
+	 */
+	static inline void invalidateAll() { ++s_generation; }
+
+	/**
+	 * Called by RenderBundleCache when the occlusion results changed: the outcomes are compared again, even for
+	 * the same camera.
+	 */
+	static inline void recheckAll() { ++s_checkGeneration; }
+
+	explicit RenderBundle(SceneObject& root);
+	~RenderBundle();
+
+	RenderBundle(const RenderBundle&) = delete;
+	RenderBundle& operator=(const RenderBundle&) = delete;
+
+	/**
+	 * Called by the root instead of rendering its subtree, while a RenderQueue records. False when the subtree
+	 * has to be traversed.
+	 */
+	bool replay(const Camera& camera, const glm::mat4& modelMatrix);
+
+	/**
+	 * Around the traversal of the subtree when replay() returned false: its packets are collected when the key
+	 * did not change since the last frame.
+	 */
+	void beginRecording(const Camera& camera, const glm::mat4& modelMatrix);
+	void endRecording(const Camera& camera);
+
+	// Set by MeshRenderer when its static batch draws it, the batch has to be told again at every replay
+	void addStaticSlot(StaticBatch& batch, uint32_t slot);
+
+	// Set by the renderers and the proxies the traversal visits, their outcomes are compared for another camera
+	void addRenderer(MeshRenderer& renderer);
+	void addProxy(const HlodProxy& proxy, bool drawn);
+
+	inline SceneObject& root() const { return m_root; }
+
+private:
+	friend class RenderQueue;
+
+	struct StaticSlot
+	{
+		StaticBatch* batch = nullptr;
+		uint32_t slot = 0;
+	};
+
+	struct RendererOutcome
+	{
+		MeshRenderer* renderer = nullptr;
+		uint64_t outcome = 0;      // See MeshRenderer::viewOutcome
+	};
+
+	struct ProxyOutcome
+	{
+		const HlodProxy* proxy = nullptr;
+		bool drawn = false;
+	};
+
+	struct Recording
+	{
+		uint64_t version = ~uint64_t(0);
+		uint64_t generation = ~uint64_t(0);
+		glm::mat4 modelMatrix = glm::mat4(0.0f);
+		bool valid = false;
+
+		glm::mat4 viewMatrix = glm::mat4(0.0f);                // Of the recording
+		glm::mat4 checkedViewMatrix = glm::mat4(0.0f);         // Camera of the last frame the outcomes were checked
+		glm::mat4 checkedProjectionMatrix = glm::mat4(0.0f);
+		uint64_t checkGeneration = ~uint64_t(0);
+		bool outdated = false;                                 // By the camera, since the last recording
+
+		std::vector<RenderQueue::DrawPacket> packets;
+		RenderQueue::RecordedBuffer buffer;
+		std::vector<StaticSlot> staticSlots;
+		std::vector<RendererOutcome> renderers;
+		std::vector<ProxyOutcome> proxies;
+		HlodProxy::Statistics hlodStatistics;
+	};
+
+	Recording& current();
+	bool sameKey(const Recording& recording, const glm::mat4& modelMatrix) const;
+
+	// Whether the camera still gives the outcomes of the recording, only compared when it moved since the last check
+	bool sameOutcomes(Recording& recording, const Camera& camera, const RecordingView& view) const;
+
+private:
+	SceneObject& m_root;
+	Recording m_recordings[2];    // Per MeshRenderer::RenderPass
+	HlodProxy::Statistics m_hlodStatisticsBefore;
+
+	inline static RenderBundle* s_recording = nullptr;
+	inline static uint64_t s_generation = 0;
+	inline static uint64_t s_checkGeneration = 0;
+};
+
+/**
+ * Puts bundles on the subtrees worth one and invalidates them all when the frame changes what they draw.
+ */
+class RenderBundleCache
+{
+public:
+	/**
+	 * Once per frame, before the scene is rendered. The state version changes with whatever the systems drawing
+	 * renderers in place of the subtrees decided since the last frame (static batches, proxies). The occlusion
+	 * version changes with the renderers hidden by the occlusion culling.
+	 */
+	void update(SceneObject& sceneRoot, uint64_t stateVersion, uint64_t occlusionVersion, double time);
+
+	void clear();
+
+	inline std::size_t bundleCount() const { return m_bundles.size(); }
+
+private:
+	// Everything outside of the subtrees that changes what they draw, the camera aside
+	struct FrameKey
+	{
+		uint64_t selectionVersion = 0;
+		uint64_t stateVersion = 0;
+		MeshRenderer::LodSettings lodSettings;
+		MeshRenderer::CullingSettings cullingSettings;
+		bool hlodEnabled = false;
+		float hlodPixelError = 0.0f;
+		bool staticBatching = false;
+		bool objectData = false;
+
+		bool operator==(const FrameKey& other) const;
+	};
+
+	void scan(SceneObject& sceneRoot);
+
+private:
+	std::map<SceneObject*, std::unique_ptr<RenderBundle>> m_bundles;
+	FrameKey m_frameKey;
+	uint64_t m_occlusionVersion = 0;
+
+	uint64_t m_scannedVersion = ~uint64_t(0);
+	double m_scanTime = -1.0;
+	int m_scannedMinRenderers = 0;
+	int m_scannedMaxRenderers = 0;
+};
+
+#endif
@@ -0,0 +1,343 @@
+/**
+ * @file RenderQueue.cpp
+ *
+ * @brief Draws of a scene traversal, sorted by the state they need before being submitted.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include "RenderQueue.h"
+
+#include <glm/geometric.hpp>
+#include <glm/vec4.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "Mesh.h"
+#include "Camera.h"
+#include "RenderBundle.h"
+#include "ThreadPool.h"
+
+namespace
+{
+	// Buckets per square root of a unit: finer up close, where the order matters most for the depth test
+	constexpr float DEPTH_BUCKETS_PER_ROOT_UNIT = 64.0f;
+
+	constexpr int RADIX_BITS = 8;
+	constexpr int RADIX_DIGITS = 64 / RADIX_BITS;
+	constexpr std::size_t RADIX_SIZE = std::size_t(1) << RADIX_BITS;
+
+	uint64_t stateOf(const void* pointer)
+	{
+		return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(pointer));
+	}
+}
+
+RenderQueue::Settings& RenderQueue::settings()
+{
+	static Settings settings;
+	return settings;
+}
+
+RenderQueue::Statistics& RenderQueue::statistics()
+{
+	static Statistics statistics;
+	return statistics;
+}
+
+void RenderQueue::render(const Camera& camera, SceneObject& sceneRoot)
+{
+	if (!settings().enabled)
+	{
+		sceneRoot.render(camera);
+		return;
+	}
+
+	m_packets.clear();
+	m_materialIds.clear();
+	m_textureSetIds.clear();
+	m_meshIds.clear();
+	m_bundles.clear();
+	m_recordedBundles.clear();
+	m_bufferCount = 0;
+
+	const auto traversalTime = std::chrono::steady_clock::now();
+	s_recording = this;
+	sceneRoot.render(camera);
+	s_recording = nullptr;
+
+	const RecordingView view(camera);
+	const auto startTime = std::chrono::steady_clock::now();
+	recordBundles(view);
+	recordPackets(view);
+	const auto recordedTime = std::chrono::steady_clock::now();
+
+	// The bundles first, they hold most of the static geometry. Those recorded for another camera take this one.
+	auto& queueStatistics = statistics();
+	for (const auto* bundle : m_bundles)
+	{
+		const RecordedBuffer& buffer = bundle->m_recordings[MeshRenderer::renderPass() == MeshRenderer::RenderPass::Shading ? 0 : 1].buffer;
+		replay(buffer, view);
+		queueStatistics.bundledDraws += buffer.commands.drawCount();
+	}
+	for (std::size_t i = 0; i < m_bufferCount; ++i)
+	{
+		replay(m_buffers[i], view);
+	}
+
+	queueStatistics.bundlesReplayed += m_bundles.size();
+	queueStatistics.bundlesRecorded += m_recordedBundles.size();
+	queueStatistics.commandBuffers += m_bundles.size() + m_bufferCount;
+	queueStatistics.traversalMilliseconds += std::chrono::duration<double, std::milli>(startTime - traversalTime).count();
+	queueStatistics.recordMilliseconds += std::chrono::duration<double, std::milli>(recordedTime - startTime).count();
+	queueStatistics.replayMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - recordedTime).count();
+}
+
+RenderQueue::BenchmarkResult RenderQueue::benchmarkRecording(const Camera& camera, SceneObject& sceneRoot, std::size_t packetCount, int iterations)
+{
+	BenchmarkResult result;
+	std::vector<MeshRenderer*> renderers;
+	auto collect = [&](SceneObject& sceneObject, auto& collectRef) -> void
+	{
+		if (auto* renderer = dynamic_cast<MeshRenderer*>(&sceneObject))
+			renderers.push_back(renderer);
+		for (auto* child : sceneObject.children())
+			collectRef(*child, collectRef);
+	};
+	collect(sceneRoot, collect);
+	if (renderers.empty() || packetCount == 0)
+	{
+		return result;
+	}
+
+	// The keys of a real traversal, only with the renderers repeated
+	RenderQueue queue;
+	queue.m_packets.reserve(packetCount);
+	for (std::size_t i = 0; i < packetCount; ++i)
+	{
+		queue.push(*renderers[i % renderers.size()], camera);
+	}
+	sortPackets(queue.m_packets, queue.m_sortedPackets);
+
+	const std::size_t packetsPerBuffer = static_cast<std::size_t>(std::max(settings().packetsPerBuffer, 1));
+	result.packets = queue.m_packets.size();
+	result.renderers = renderers.size();
+	result.threads = ThreadPool::instance().threadCount();
+	result.buffers = (result.packets + packetsPerBuffer - 1) / packetsPerBuffer;
+	queue.m_buffers.resize(result.buffers);
+
+	// The per-buffer statistics stay in the buffers, the counters of the frame are left alone
+	const RecordingView view(camera);
+	const int runs = std::max(iterations, 1);
+	const auto serialStart = std::chrono::steady_clock::now();
+	for (int iteration = 0; iteration < runs; ++iteration)
+	{
+		record(queue.m_packets, 0, queue.m_packets.size(), view, queue.m_buffers[0]);
+	}
+	const auto parallelStart = std::chrono::steady_clock::now();
+	for (int iteration = 0; iteration < runs; ++iteration)
+	{
+		ThreadPool::instance().parallelFor(queue.m_packets.size(), packetsPerBuffer, [&queue, &view, packetsPerBuffer](std::size_t begin, std::size_t end)
+		{
+			record(queue.m_packets, begin, end, view, queue.m_buffers[begin / packetsPerBuffer]);
+		});
+	}
+	const auto endTime = std::chrono::steady_clock::now();
+
+	result.serialMilliseconds = std::chrono::duration<double, std::milli>(parallelStart - serialStart).count() / runs;
+	result.parallelMilliseconds = std::chrono::duration<double, std::milli>(endTime - parallelStart).count() / runs;
+	return result;
+}
+
+void RenderQueue::push(MeshRenderer& renderer, const Camera& camera)
+{
+	const bool constant = renderer.usesConstantMaterial();
+	const uint32_t material = idOf(m_materialIds, stateOf(&renderer.drawMaterial()), MATERIAL_MASK);
+	const uint32_t textureSet = constant ? 0 : idOf(m_textureSetIds, static_cast<uint64_t>(renderer.textureIndex()) << 32 | renderer.normalsTextureIndex(), TEXTURE_SET_MASK);
+	const uint32_t mesh = idOf(m_meshIds, stateOf(renderer.mesh().get()), MESH_MASK);
+	const uint32_t lod = std::min(static_cast<uint32_t>(renderer.lodLevel()), LOD_MASK);
+
+	const glm::vec3 center = glm::vec3(renderer.modelMatrix() * glm::vec4(renderer.mesh()->boundsCenter(), 1.0f));
+	const float distance = glm::length(center - camera.position());
+	const uint32_t depth = static_cast<uint32_t>(std::min(std::sqrt(distance) * DEPTH_BUCKETS_PER_ROOT_UNIT, static_cast<float>(DEPTH_MASK)));
+
+	DrawPacket packet;
+	packet.key = static_cast<uint64_t>(MeshRenderer::renderPass()) << PASS_SHIFT
+		| static_cast<uint64_t>(material) << MATERIAL_SHIFT
+		| static_cast<uint64_t>(textureSet) << TEXTURE_SET_SHIFT
+		| static_cast<uint64_t>(mesh) << MESH_SHIFT
+		| static_cast<uint64_t>(lod) << LOD_SHIFT
+		| depth;
+	packet.renderer = &renderer;
+
+	// The packets of a subtree being bundled are sorted and recorded with the bundle
+	RenderBundle* bundle = RenderBundle::recording();
+	(bundle != nullptr ? bundle->current().packets : m_packets).push_back(packet);
+}
+
+uint32_t RenderQueue::idOf(std::unordered_map<uint64_t, uint32_t>& ids, uint64_t state, uint32_t mask)
+{
+	const auto result = ids.emplace(state, static_cast<uint32_t>(ids.size() + 1));
+	return std::min(result.first->second, mask);
+}
+
+RenderQueue::Switches RenderQueue::countSwitches() const
+{
+	// From the keys: a program per material, the textures of the textured materials and, as the meshes bind
+	// them, a vertex array per mesh, material and full or simplified geometry
+	Switches switches;
+	uint64_t program = ~uint64_t(0);
+	uint64_t vertexArray = ~uint64_t(0);
+	uint64_t textureSet = 0;
+	for (const auto& packet : m_packets)
+	{
+		const uint64_t packetProgram = packet.key >> MATERIAL_SHIFT;
+		const uint64_t packetTextureSet = (packet.key >> TEXTURE_SET_SHIFT) & TEXTURE_SET_MASK;
+		const uint64_t packetVertexArray = packetProgram << 17 | ((packet.key >> MESH_SHIFT) & MESH_MASK) << 1 | (((packet.key >> LOD_SHIFT) & LOD_MASK) != 0 ? 1 : 0);
+
+		if (packetProgram != program)
+			++switches.programs;
+		if (packetVertexArray != vertexArray)
+			++switches.vertexArrays;
+		if (packetTextureSet != 0 && packetTextureSet != textureSet)
+			++switches.textures;
+
+		program = packetProgram;
+		vertexArray = packetVertexArray;
+		if (packetTextureSet != 0)
+			textureSet = packetTextureSet;
+	}
+	return switches;
+}
+
+void RenderQueue::addBundle(RenderBundle& bundle, bool recorded)
+{
+	m_bundles.push_back(&bundle);
+	if (recorded)
+	{
+		m_recordedBundles.push_back(&bundle);
+	}
+}
+
+void RenderQueue::sortPackets(std::vector<DrawPacket>& packets, std::vector<DrawPacket>& scratch)
+{
+	if (packets.empty())
+	{
+		return;
+	}
+
+	// Least significant digit first, the histograms of all the digits in a single pass
+	std::size_t counts[RADIX_DIGITS][RADIX_SIZE] = {};
+	for (const auto& packet : packets)
+	{
+		for (int digit = 0; digit < RADIX_DIGITS; ++digit)
+			++counts[digit][(packet.key >> (digit * RADIX_BITS)) & (RADIX_SIZE - 1)];
+	}
+
+	scratch.resize(packets.size());
+	for (int digit = 0; digit < RADIX_DIGITS; ++digit)
+	{
+		const int shift = digit * RADIX_BITS;
+
+		// Most digits are the same for every packet, the pass and the high bits of the ids
+		if (counts[digit][(packets.front().key >> shift) & (RADIX_SIZE - 1)] == packets.size())
+			continue;
+
+		std::size_t offset = 0;
+		for (auto& count : counts[digit])
+		{
+			const std::size_t bucketSize = count;
+			count = offset;
+			offset += bucketSize;
+		}
+		for (const auto& packet : packets)
+			scratch[counts[digit][(packet.key >> shift) & (RADIX_SIZE - 1)]++] = packet;
+		packets.swap(scratch);
+	}
+}
+
+void RenderQueue::record(const std::vector<DrawPacket>& packets, std::size_t begin, std::size_t end, const RecordingView& view, RecordedBuffer& buffer)
+{
+	buffer.commands.clear();
+	buffer.lodStatistics = MeshRenderer::LodStatistics();
+	buffer.cullingStatistics = MeshRenderer::CullingStatistics();
+	for (std::size_t i = begin; i < end; ++i)
+		packets[i].renderer->recordDraw(buffer.commands, view, buffer.lodStatistics, buffer.cullingStatistics);
+}
+
+void RenderQueue::replay(const RecordedBuffer& buffer, const RecordingView& view)
+{
+	buffer.commands.replay(&view);
+
+	auto& lodStatistics = MeshRenderer::lodStatistics();
+	lodStatistics.drawnTriangles += buffer.lodStatistics.drawnTriangles;
+	lodStatistics.savedTriangles += buffer.lodStatistics.savedTriangles;
+	for (std::size_t level = 0; level <= MeshSimplifier::MAX_LOD_LEVELS; ++level)
+		lodStatistics.renderersPerLevel[level] += buffer.lodStatistics.renderersPerLevel[level];
+
+	auto& cullingStatistics = MeshRenderer::cullingStatistics();
+	cullingStatistics.testedTriangles += buffer.cullingStatistics.testedTriangles;
+	cullingStatistics.culledTriangles += buffer.cullingStatistics.culledTriangles;
+
+	statistics().commands += buffer.commands.commandCount();
+}
+
+void RenderQueue::recordBundles(const RecordingView& view)
+{
+	// A bundle is recorded in one buffer, the bundles recorded this frame in parallel
+	const std::size_t pass = MeshRenderer::renderPass() == MeshRenderer::RenderPass::Shading ? 0 : 1;
+	ThreadPool::instance().parallelFor(m_recordedBundles.size(), 1, [this, &view, pass](std::size_t begin, std::size_t end)
+	{
+		std::vector<DrawPacket> scratch;
+		for (std::size_t i = begin; i < end; ++i)
+		{
+			auto& recording = m_recordedBundles[i]->m_recordings[pass];
+			sortPackets(recording.packets, scratch);
+			record(recording.packets, 0, recording.packets.size(), view, recording.buffer);
+			recording.valid = true;
+		}
+	});
+}
+
+void RenderQueue::recordPackets(const RecordingView& view)
+{
+	if (m_packets.empty())
+	{
+		return;
+	}
+
+	auto& queueStatistics = statistics();
+	const Switches traversalSwitches = countSwitches();
+
+	const auto startTime = std::chrono::steady_clock::now();
+	sortPackets(m_packets, m_sortedPackets);
+	queueStatistics.sortMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+	const Switches sortedSwitches = countSwitches();
+	queueStatistics.packets += m_packets.size();
+	queueStatistics.programSwitches += sortedSwitches.programs;
+	queueStatistics.vertexArraySwitches += sortedSwitches.vertexArrays;
+	queueStatistics.textureSwitches += sortedSwitches.textures;
+	queueStatistics.traversalProgramSwitches += traversalSwitches.programs;
+	queueStatistics.traversalVertexArraySwitches += traversalSwitches.vertexArrays;
+	queueStatistics.traversalTextureSwitches += traversalSwitches.textures;
+
+	const auto& queueSettings = settings();
+	const std::size_t packetsPerBuffer = queueSettings.parallelRecording
+		? static_cast<std::size_t>(std::max(queueSettings.packetsPerBuffer, 1))
+		: m_packets.size();
+	m_bufferCount = (m_packets.size() + packetsPerBuffer - 1) / packetsPerBuffer;
+	if (m_buffers.size() < m_bufferCount)
+	{
+		m_buffers.resize(m_bufferCount);
+	}
+
+	ThreadPool::instance().parallelFor(m_packets.size(), packetsPerBuffer, [this, &view, packetsPerBuffer](std::size_t begin, std::size_t end)
+	{
+		record(m_packets, begin, end, view, m_buffers[begin / packetsPerBuffer]);
+	});
+}
@@ -0,0 +1,175 @@
+#pragma once
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+/**
+ * @file RenderQueue.h
+ *
+ * @brief Draws of a scene traversal, sorted by the state they need before being submitted.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "CommandBuffer.h"
+#include "MeshRenderer.h"
+
+class Camera;
+class RenderBundle;
+class SceneObject;
+
+/**
+ * While the queue records, the renderers of the traversal push a packet instead of drawing. Each packet has a
+ * 64 bit key, from the most significant bits: pass (2), material (14), texture set (16), mesh (16), level of
+ * detail (4) and depth bucket (12). Once sorted, the draws needing the same program, textures and vertex array
+ * follow each other and the state only changes between the runs, the nearest first within a run.
+ *
+ * The ids of the key are given in the order of the traversal and only live for one frame. The submission
+ * compares the actual state, so an id clamped to its field only costs a few switches.
+ *
+ * The sorted packets are cut in consecutive parts recorded in command buffers by the thread pool, then the
+ * buffers are replayed in order on the thread owning the context. The traversal itself stays on that thread:
+ * it updates the transforms, the static batches and the hierarchical proxies.
+ *
+ * The subtrees with a RenderBundle are sorted and recorded on their own, and replayed before the rest of the queue.
+ */
+class RenderQueue
+{
+public:
+	struct Settings
+	{
+		bool enabled = true;            // Otherwise the renderers draw during the traversal
+		bool parallelRecording = true;
+		int packetsPerBuffer = 1024;    // Fewer draws are not worth a task of the pool
+	};
+
+	// Reset by the window every frame, of all the traversals of the frame
+	struct Statistics
+	{
+		std::size_t packets = 0;
+		std::size_t programSwitches = 0;                // Of the sorted order
+		std::size_t vertexArraySwitches = 0;
+		std::size_t textureSwitches = 0;
+		std::size_t traversalProgramSwitches = 0;       // Of the order of the traversal, as drawn without the queue
+		std::size_t traversalVertexArraySwitches = 0;
+		std::size_t traversalTextureSwitches = 0;
+		std::size_t commandBuffers = 0;
+		std::size_t commands = 0;
+		double traversalMilliseconds = 0.0;   // Including the checks of the bundles
+		double sortMilliseconds = 0.0;
+		double recordMilliseconds = 0.0;
+		double replayMilliseconds = 0.0;
+		std::size_t bundlesReplayed = 0;      // Including the ones recorded this frame
+		std::size_t bundlesRecorded = 0;
+		std::size_t bundlesOutdated = 0;      // By the camera, traversed instead
+		std::size_t bundledDraws = 0;
+	};
+
+	struct BenchmarkResult
+	{
+		std::size_t packets = 0;
+		std::size_t renderers = 0;            // Of the scene, each pushed again until there are enough packets
+		std::size_t threads = 0;
+		std::size_t buffers = 0;              // Of the parallel recording
+		double serialMilliseconds = 0.0;      // Per recording, averaged
+		double parallelMilliseconds = 0.0;
+	};
+
+	static Settings& settings();
+	static Statistics& statistics();
+
+	/**
+	 * Time the recording of packetCount sorted draws of the renderers of the scene, in one buffer on the calling
+	 * thread and cut in packetsPerBuffer parts on the thread pool. Nothing is replayed.
+	 */
+	static BenchmarkResult benchmarkRecording(const Camera& camera, SceneObject& sceneRoot, std::size_t packetCount, int iterations);
+
+	/**
+	 * The queue of the traversal in progress, null when the renderers draw themselves.
+	 */
+	static inline RenderQueue* recording() { return s_recording; }
+
+	/**
+	 * Traverse the scene for the current MeshRenderer::renderPass(), then draw what it pushed in the order of the keys.
+	 */
+	void render(const Camera& camera, SceneObject& sceneRoot);
+
+	/**
+	 * Called by a renderer during the traversal, once its level of detail is selected.
+	 */
+	void push(MeshRenderer& renderer, const Camera& camera);
+
+	/**
+	 * Called by a bundle during the traversal: replay it with the queue, recording it first when it has just
+	 * collected the packets of its subtree.
+	 */
+	void addBundle(RenderBundle& bundle, bool recorded);
+
+	struct DrawPacket
+	{
+		uint64_t key = 0;
+		MeshRenderer* renderer = nullptr;
+	};
+
+	// Sorted packets recorded in a command buffer, and what recording them counted
+	struct RecordedBuffer
+	{
+		CommandBuffer commands;
+		MeshRenderer::LodStatistics lodStatistics;
+		MeshRenderer::CullingStatistics cullingStatistics;
+	};
+
+private:
+	static constexpr int PASS_SHIFT = 62;
+	static constexpr int MATERIAL_SHIFT = 48;
+	static constexpr int TEXTURE_SET_SHIFT = 32;
+	static constexpr int MESH_SHIFT = 16;
+	static constexpr int LOD_SHIFT = 12;
+
+	static constexpr uint32_t MATERIAL_MASK = (1u << 14) - 1;
+	static constexpr uint32_t TEXTURE_SET_MASK = (1u << 16) - 1;
+	static constexpr uint32_t MESH_MASK = (1u << 16) - 1;
+	static constexpr uint32_t LOD_MASK = (1u << 4) - 1;
+	static constexpr uint32_t DEPTH_MASK = (1u << 12) - 1;
+
+	struct Switches
+	{
+		std::size_t programs = 0;
+		std::size_t vertexArrays = 0;
+		std::size_t textures = 0;
+	};
+
+	// Dense id of a state, 0 is kept for the packets without it
+	static uint32_t idOf(std::unordered_map<uint64_t, uint32_t>& ids, uint64_t state, uint32_t mask);
+
+	static void sortPackets(std::vector<DrawPacket>& packets, std::vector<DrawPacket>& scratch);
+	static void record(const std::vector<DrawPacket>& packets, std::size_t begin, std::size_t end, const RecordingView& view, RecordedBuffer& buffer);
+	static void replay(const RecordedBuffer& buffer, const RecordingView& view);
+
+	Switches countSwitches() const;
+	void recordBundles(const RecordingView& view);
+	void recordPackets(const RecordingView& view);
+
+private:
+	std::vector<DrawPacket> m_packets;
+	std::vector<DrawPacket> m_sortedPackets;   // Scratch of the sort, kept from frame to frame
+	std::vector<RecordedBuffer> m_buffers;     // Only grows, the buffers keep their memory
+	std::size_t m_bufferCount = 0;             // Used by this traversal
+
+	std::vector<RenderBundle*> m_bundles;          // Replayed by this traversal, in order
+	std::vector<RenderBundle*> m_recordedBundles;  // Of those, the ones to record first
+
+	std::unordered_map<uint64_t, uint32_t> m_materialIds;
+	std::unordered_map<uint64_t, uint32_t> m_textureSetIds;
+	std::unordered_map<uint64_t, uint32_t> m_meshIds;
+
+	inline static RenderQueue* s_recording = nullptr;
+};
+
+#endif
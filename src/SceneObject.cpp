@@ -10,6 +10,10 @@
 
 #include "SceneObject.h"
 
+#include "Hlod.h"
+#include "RenderBundle.h"
+#include "TransformHierarchy.h"
+
 #include <algorithm>
 #include <iostream>
 #include <glm/gtx/string_cast.hpp>
@@ -17,7 +21,7 @@
 unsigned int SceneObject::NEXT_ID = 1;
 
 SceneObject::SceneObject()
-: m_id(NEXT_ID), m_selected(false), m_name("Object " + std::to_string(m_id-7)), m_transform(*this), m_transform_global(*this), m_transform_global_previous(*this)
+: m_id(NEXT_ID), m_selected(false), m_name("Object " + std::to_string(m_id-7))
 {
 	if (m_id == 1)
 	{
@@ -38,31 +42,57 @@ SceneObject::SceneObject(SceneObject& parent)
 
 void SceneObject::render(const Camera& camera, const glm::mat4& previousModelMatrix, const bool worldDirty)
 {
-	glm::mat4 localModelMatrix;
+	bool parentDirty;
+	if (m_hierarchyFrame == TransformHierarchy::frame())
+	{
+		// Already computed this frame, with the transforms of the whole scene
+		parentDirty = m_movedInHierarchy;
+	}
+	else
+	{
+		glm::mat4 localModelMatrix;
 
-	//If local dirty, global has been updated. If global dirty, local has been updated. In both cases, the children's global has to be updated as well.
-	bool parentDirty = isLocalDirty() || isGlobalDirty() || worldDirty;
+		// The children's model matrices have to be updated as well
+		parentDirty = isGlobalDirty() || worldDirty;
 
-	if (isLocalDirty())
-	{
-		computeLocalTransform();
+		m_transform.computeModelMatrix(localModelMatrix);
+
+		m_modelMatrix = previousModelMatrix * localModelMatrix;
+
+		m_dirty_global = false;
 	}
-	
-	m_transform.computeModelMatrix(localModelMatrix);
-	
-	m_modelMatrix = previousModelMatrix * localModelMatrix;
 
-	if (isGlobalDirty() || worldDirty)
+	// The bundle replaces the whole subtree, this object included. A moved subtree is traversed to update its model matrices.
+	RenderBundle* bundle = parentDirty ? nullptr : m_renderBundle;
+	if (bundle != nullptr && bundle->replay(camera, m_modelMatrix))
+	{
+		return;
+	}
+	if (bundle != nullptr)
 	{
-		computeGlobalTransform();
+		bundle->beginRecording(camera, m_modelMatrix);
 	}
 
-	for (const auto child : m_children)
+	// Children moved this frame have to be visited to update their model matrix, the proxy waits for the next one
+	const bool proxyDrawn = m_hlodProxy != nullptr && !parentDirty && m_hlodProxy->render(camera, m_modelMatrix);
+	if (m_hlodProxy != nullptr && !parentDirty && RenderBundle::recording() != nullptr)
 	{
-		child->render(camera, m_modelMatrix, parentDirty);
+		RenderBundle::recording()->addProxy(*m_hlodProxy, proxyDrawn);
+	}
+	if (!proxyDrawn)
+	{
+		for (const auto child : m_children)
+		{
+			child->render(camera, m_modelMatrix, parentDirty);
+		}
 	}
 
 	renderImplementation(camera, m_modelMatrix);
+
+	if (bundle != nullptr)
+	{
+		bundle->endRecording(camera);
+	}
 }
 
 void SceneObject::renderId(const Camera& camera, const glm::mat4& previousModelMatrix, bool bypassCanBePicked)
@@ -85,49 +115,6 @@ void SceneObject::renderId(const Camera& camera, const glm::mat4& previousModelM
 	}
 }
 
-void SceneObject::animate(const float deltaTime)
-{
-	for (const auto child : m_children)
-	{
-		child->animate(deltaTime);
-	}
-
-	if (m_isAnimatingRotation)
-	{
-		animateRotation(deltaTime);
-	}
-}
-
-void SceneObject::stopAnimation()
-{
-	m_isAnimatingRotation = false;
-}
-
-void SceneObject::addRotationAnimation(const glm::vec3& anglesOfRotation, float secondsOfDuration, const glm::vec3& scaleChange)
-{
-	addRotationAnimation(anglesOfRotation, secondsOfDuration, []() { std::cout << "Animation finished" << std::endl; }, scaleChange);
-}
-
-void SceneObject::addRotationAnimation(const glm::vec3& anglesOfRotation, float secondsOfDuration, std::function<void()> rotationFinishedCallback, const glm::vec3& scaleChange)
-{
-	if (m_isAnimatingRotation)
-		return;
-
-	m_isAnimatingRotation = true;
-	m_rotationAnimationDuration = secondsOfDuration;
-	m_rotationAnimationTimer = 0.0f;
-
-	m_rotationAnimationStart = m_transform.rotation();
-	m_rotationAnimationEnd = m_transform.rotation() + anglesOfRotation;
-
-	m_rotationAnimationScaleStart = m_transform.scale();
-	m_rotationAnimationScaleEnd = m_rotationAnimationScaleStart + scaleChange;
-
-	m_rotationFinishedCallback = rotationFinishedCallback;
-
-	dirtyGlobal();
-}
-
 SceneObject* SceneObject::findChildWithId(unsigned int idToSearch)
 {
 	if (m_id == idToSearch)
@@ -177,7 +164,13 @@ bool SceneObject::reParent(SceneObject& newParent)
 		{
 			newParent.reParent(*m_parent);
 		}
-		transformConversion(&newParent);
+		// Stays where it is in the world, like in Unreal and Unity. Both ends are composed from the transforms:
+		// one of them may have been edited this frame, after the model matrices were computed.
+		const glm::mat4 worldMatrix = parentMatrix() * localMatrix();
+		if (!toLocalTransform(newParent.parentMatrix() * newParent.localMatrix(), worldMatrix, m_transform))
+		{
+			std::cerr << "The new parent of " << m_name << " has a null scale, its local transform is kept" << std::endl;
+		}
 		m_parent->removeChild(*this);
 	}
 	else
@@ -206,91 +199,72 @@ void SceneObject::unselectAllChildren()
 	}
 }
 
+void SceneObject::markChanged()
+{
+	for (SceneObject* object = this; object != nullptr; object = object->m_parent)
+	{
+		++object->m_version;
+	}
+}
+
 void SceneObject::addChild(SceneObject& child)
 {
 	m_children.push_back(&child);
+	++s_structureVersion;
+	markChanged();
 }
 
 void SceneObject::removeChild(SceneObject& child)
 {
 	m_children.erase(std::remove_if(m_children.begin(), m_children.end(), [&child](SceneObject* object) { return object == &child; }));
+	++s_structureVersion;
+	markChanged();
+}
+
+
+Transform SceneObject::globalTransform() const
+{
+	return Transform::fromMatrix(m_modelMatrix);
 }
 
-void SceneObject::animateRotation(const float deltaTime)
+void SceneObject::globalTransform(const Transform& newGlobalTransform)
 {
-	m_rotationAnimationTimer += deltaTime;
-	auto progress = m_rotationAnimationTimer / m_rotationAnimationDuration;
+	glm::mat4 globalMatrix;
+	newGlobalTransform.computeModelMatrix(globalMatrix);
 
-	const auto animationFinished = progress >= 1.0f;
-	if (animationFinished)
+	const glm::mat4 parentWorldMatrix = m_parent != nullptr ? m_parent->m_modelMatrix : glm::mat4(1.0f);
+	if (!toLocalTransform(parentWorldMatrix, globalMatrix, m_transform))
 	{
-		m_isAnimatingRotation = false;
-		progress = 1.0f;
+		std::cerr << "A parent of " << m_name << " has a null scale, it cannot be moved in the world" << std::endl;
+		return;
 	}
-
-	const auto sinProgress = sinf(progress * glm::pi<float>() * 0.5f);
-	transform().rotation() = (1.0f - sinProgress) * m_rotationAnimationStart + sinProgress * m_rotationAnimationEnd;
-	transform().scale() = (1.0f - sinProgress) * m_rotationAnimationScaleStart + sinProgress * m_rotationAnimationScaleEnd;
-
 	dirtyGlobal();
+}
 
-	if (animationFinished)
+bool SceneObject::toLocalTransform(const glm::mat4& parentWorldMatrix, const glm::mat4& worldMatrix, Transform& outLocalTransform)
+{
+	// The last row of an affine matrix is (0, 0, 0, 1), only the linear part decides
+	if (glm::determinant(glm::mat3(parentWorldMatrix)) == 0.0f)
 	{
-		m_rotationFinishedCallback();
+		return false;
 	}
+	outLocalTransform = Transform::fromMatrix(glm::inverse(parentWorldMatrix) * worldMatrix);
+	return true;
 }
 
-
-void SceneObject::computeLocalTransform()
+glm::mat4 SceneObject::localMatrix() const
 {
-
-	if (!m_parent || m_parent == m_root)
-	{
-		m_transform = m_transform_global;
-	}
-	else if(m_transform_global != m_transform_global_previous)
-	{
-		m_transform = m_transform + (m_transform_global- m_transform_global_previous);
-		m_transform_global_previous = m_transform_global;
-	}
-	
-	m_dirty_local = false;
+	glm::mat4 localModelMatrix;
+	m_transform.computeModelMatrix(localModelMatrix);
+	return localModelMatrix;
 }
 
-void SceneObject::computeGlobalTransform()
+glm::mat4 SceneObject::parentMatrix() const
 {
-	//fetch parent
-	if (!m_parent || m_parent == m_root)
+	glm::mat4 matrix(1.0f);
+	for (const SceneObject* parent = m_parent; parent != nullptr; parent = parent->m_parent)
 	{
-		m_transform_global = m_transform;
+		matrix = parent->localMatrix() * matrix;
 	}
-	else
-	{
-		Transform newGlobalTransform(*this);
-		newGlobalTransform = newGlobalTransform + m_transform;
-		auto addTransformFromHierachy = [&](SceneObject* parent, auto&& addTransformFromHierachy)
-		{
-			if (parent == nullptr || &parent == &m_root)
-			{
-				return;
-			}
-			addTransformFromHierachy(parent->m_parent, addTransformFromHierachy);
-			newGlobalTransform = newGlobalTransform + parent->transform();
-		};
-		addTransformFromHierachy(m_parent, addTransformFromHierachy);
-		m_transform_global = newGlobalTransform;
-	}
-	
-	m_transform_global_previous = m_transform_global;
-	m_dirty_global = false;
+	return matrix;
 }
-
-void SceneObject::transformConversion(SceneObject* newReference)
-
-{
-	m_transform = m_transform_global - newReference->transformGlobal();
-
-	
-	//Could try to make it return to its original spot like in Blender or just stay there like in Unreal and Unity
-
-}
\ No newline at end of file
@@ -15,11 +15,13 @@
 #include <vector>
 #include <glm/gtc/quaternion.hpp>
 
-#include <functional>
+#include <cstdint>
 #include <string>
 #include "Transform.h"
 
 class Camera;
+class HlodProxy;
+class RenderBundle;
 
 class SceneObject
 {
@@ -31,12 +33,6 @@ public:
 
 	void render(const Camera& camera, const glm::mat4& previousModelMatrix = glm::mat4(1.0f), const bool worldDirty = false);
 	void renderId(const Camera& camera, const glm::mat4& previousModelMatrix = glm::mat4(1.0f), bool bypassCanBePicked = false);
-	void animate(const float deltaTime);
-
-	void stopAnimation();
-	void addRotationAnimation(const glm::vec3& anglesOfRotation, float secondsOfDuration, const glm::vec3& scaleChange = glm::vec3(0.0f));
-	void addRotationAnimation(const glm::vec3& anglesOfRotation, float secondsOfDuration, std::function<void()> rotationFinishedCallback, const glm::vec3& scaleChange = glm::vec3(0.0f));
-
 	SceneObject* findChildWithId(unsigned int idToSearch);
 	bool isAChild(SceneObject& potentialChild);
 
@@ -49,8 +45,9 @@ public:
 	inline const Transform& transform() const { return m_transform; }
 	inline glm::vec3& translation() {  return m_transform.translation(); }
 	inline const glm::vec3& translation() const { return m_transform.translation(); }
-	inline glm::vec3& rotation() {  return m_transform.rotation(); }
-	inline const glm::vec3& rotation() const { return m_transform.rotation(); }
+	inline glm::vec3 rotation() const { return m_transform.rotation(); }
+	inline void rotation(const glm::vec3& newRotation) { m_transform.rotation(newRotation); }
+	inline const glm::quat& orientation() const { return m_transform.orientation(); }
 	inline glm::vec3& scale() { return m_transform.scale(); }
 	inline const glm::vec3& scale() const { return m_transform.scale(); }
 
@@ -58,18 +55,21 @@ public:
 
 
 	//Global Transform
-	inline Transform& transformGlobal() { return m_transform_global; }
-	inline const Transform& transformGlobal() const { return m_transform_global; }
-	inline glm::vec3& translationGlobal() { return m_transform_global.translation(); }
-	inline const glm::vec3& translationGlobal() const { return m_transform_global.translation(); }
-	inline glm::vec3& rotationGlobal() { return m_transform_global.rotation(); }
-	inline const glm::vec3& rotationGlobal() const { return m_transform_global.rotation(); }
-	inline glm::vec3& scaleGlobal() { return m_transform_global.scale(); }
-	inline const glm::vec3& scaleGlobal() const { return m_transform_global.scale(); }
-	
+	/**
+	 * Decomposed from the model matrix of the last frame, for the inspector: nothing computes it every frame.
+	 */
+	Transform globalTransform() const;
+
+	/**
+	 * Move the object to a transform in the world, kept as the local transform giving it under the model matrix
+	 * of the parent. Left where it is when a parent has a null scale.
+	 */
+	void globalTransform(const Transform& newGlobalTransform);
+
 
 	inline const glm::mat4& modelMatrix() const { return m_modelMatrix; }
 
+	inline SceneObject* parent() const { return m_parent; }
 	inline std::vector<SceneObject*>& children() { return m_children; }
 	inline const std::vector<SceneObject*>& children() const { return m_children; }
 
@@ -80,22 +80,51 @@ public:
 
 
 	inline bool selected() const { return m_selected; }
-	inline void select() { m_selected = true; }
-	inline void unselect() { m_selected = false; }
+	inline void select() { if (!m_selected) { m_selected = true; ++s_selectionVersion; } }
+	inline void unselect() { if (m_selected) { m_selected = false; ++s_selectionVersion; } }
 	void unselectAllChildren();
 
 	inline void canBePicked(const bool value) { m_canBePicked = value; }
 	inline const bool canBePicked() {return m_canBePicked;}
 
 	/**
-	 * To be called whenever there's an outside change to the global transform to update the local transform.
+	 * To be called whenever there's an outside change to the local transform to update the model matrices.
+	 */
+	inline void dirtyGlobal() { m_dirty_global = true; markChanged(); }
+
+	/**
+	 * True when the transform changed since the last render, the model matrix is about to change.
+	 */
+	inline bool isDirty() const { return m_dirty_global; }
+
+	/**
+	 * Incremented on every change of the object or of one of its descendants (transform, children, appearance),
+	 * so what is built from a subtree knows when to build it again.
+	 */
+	inline uint64_t version() const { return m_version; }
+	void markChanged();
+
+	/**
+	 * Drawn in place of the children when it is close enough to them, see HlodProxy. Not owned.
 	 */
-	inline void dirtyLocal() { m_dirty_local = true; }
+	inline void hlodProxy(HlodProxy* proxy) { m_hlodProxy = proxy; }
+	inline HlodProxy* hlodProxy() const { return m_hlodProxy; }
 
 	/**
-	 * To be called whenever there's an outside change to the local transform to update the global transform.
+	 * Replayed in place of the subtree while nothing it depends on changed, see RenderBundle. Not owned.
 	 */
-	inline void dirtyGlobal() { m_dirty_global = true; }
+	inline void renderBundle(RenderBundle* bundle) { m_renderBundle = bundle; }
+	inline RenderBundle* renderBundle() const { return m_renderBundle; }
+
+	/**
+	 * Incremented when any object is selected or unselected, the selection is not part of version().
+	 */
+	static inline uint64_t selectionVersion() { return s_selectionVersion; }
+
+	/**
+	 * Incremented when any object gains or loses a child, see TransformHierarchy.
+	 */
+	static inline uint64_t structureVersion() { return s_structureVersion; }
 
 protected:
 
@@ -104,37 +133,29 @@ protected:
 	virtual void renderIdImplementation(const Camera& camera, const glm::mat4& modelMatrix) {}
 
 private:
+	friend class TransformHierarchy;
+
 	void addChild(SceneObject& child);
 	void removeChild(SceneObject& child);
 
-	void animateRotation(const float deltaTime);
-
 	/**
-	 * Recompute the local transform to accommodate the global transform's changes.
+	 * Composed from the transforms up to the root, in O(depth): only for reParent, which can follow edits of
+	 * this frame that the model matrices have not seen yet.
 	 */
-	void computeLocalTransform();
+	glm::mat4 parentMatrix() const;
+	glm::mat4 localMatrix() const;
 
 	/**
-	 * Recompute the global transform to accommodate the local transform's changes.
+	 * The local transform placing the object at worldMatrix under parentWorldMatrix. False, without touching
+	 * outLocalTransform, when the parent cannot be inverted: one of its scales is null.
 	 */
-	void computeGlobalTransform();
-	
-	/**
-	 * Local is dirty from the moment when the global transform is modified up
-	 * to the local transform is recomputed.
-	 */
-	bool isLocalDirty() { return m_dirty_local; }
+	static bool toLocalTransform(const glm::mat4& parentWorldMatrix, const glm::mat4& worldMatrix, Transform& outLocalTransform);
 
 	/**
 	 * Global is dirty from the moment when the local transform is modified up
-	 * to the global transform is recomputed.
+	 * to the model matrix is recomputed.
 	 */
 	bool isGlobalDirty() { return m_dirty_global; }
-	
-	/**
-	 * Generates a new transform for the calling object in the passed-in object's local space.
-	 */
-	void transformConversion(SceneObject* newReference);
 
 protected:
 	unsigned int m_id;
@@ -149,24 +170,20 @@ protected:
 	inline static SceneObject* m_root = nullptr;
 
 	Transform m_transform;
-	Transform m_transform_global;
-	Transform m_transform_global_previous;
 
 	glm::mat4 m_modelMatrix = glm::mat4(1.0f);
+	uint64_t m_hierarchyFrame = 0;      // Of TransformHierarchy, when it computed m_modelMatrix
+	bool m_movedInHierarchy = false;
 
-	bool m_dirty_local = false;
-	bool m_dirty_global = true;
+	uint64_t m_version = 0;
+	HlodProxy* m_hlodProxy = nullptr;
+	RenderBundle* m_renderBundle = nullptr;
 
-	glm::vec3 m_rotationAnimationStart = glm::vec3(0.0f);
-	glm::vec3 m_rotationAnimationEnd = glm::vec3(0.0f);
-	glm::vec3 m_rotationAnimationScaleStart = glm::vec3(1.0f);
-	glm::vec3 m_rotationAnimationScaleEnd = glm::vec3(1.0f);
-	bool m_isAnimatingRotation = false;
-	float m_rotationAnimationDuration = 0.0f;
-	float m_rotationAnimationTimer = 0.0f;
-	std::function<void()> m_rotationFinishedCallback;
+	bool m_dirty_global = true;
 
 	unsigned static int NEXT_ID;
+	inline static uint64_t s_selectionVersion = 0;
+	inline static uint64_t s_structureVersion = 0;
 };
 
 #endif
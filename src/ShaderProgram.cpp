@@ -22,6 +22,10 @@
 #include "ShaderProgram.h"
 #include <iostream>
 
+#include <GLFW/glfw3.h>
+
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
 // utility function for checking shader compilation/linking errors.
 // ------------------------------------------------------------------------
 bool checkCompileErrors(GLuint shader, std::string type)
@@ -57,7 +61,64 @@ ShaderProgram::ShaderProgram()
 	m_ID = glCreateProgram();
 }
 
+ShaderProgram::~ShaderProgram()
+{
+	// The materials can outlive the window, there is nothing left to delete then
+	if (glfwGetCurrentContext() == nullptr)
+	{
+		return;
+	}
+
+	for (const auto& shader : m_shaders_ids)
+	{
+		glDeleteShader(shader.second);
+	}
+	glDeleteProgram(m_ID);
+}
+
+void ShaderProgram::enableParallelCompile()
+{
+	const char* extensionName = glfwExtensionSupported("GL_KHR_parallel_shader_compile") ? "glMaxShaderCompilerThreadsKHR"
+		: glfwExtensionSupported("GL_ARB_parallel_shader_compile") ? "glMaxShaderCompilerThreadsARB"
+		: nullptr;
+	if (extensionName == nullptr)
+	{
+		s_parallelCompile = false;
+		return;
+	}
+
+	const auto maxShaderCompilerThreads = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>(glfwGetProcAddress(extensionName));
+	if (maxShaderCompilerThreads != nullptr)
+	{
+		// 0xFFFFFFFF lets the implementation pick the number of threads
+		maxShaderCompilerThreads(0xFFFFFFFF);
+	}
+	s_parallelCompile = true;
+}
+
 bool ShaderProgram::addShaderFromSource(GLenum shader_type, const std::string& path) {
+	// Read file
+	std::string code;
+	std::ifstream file;
+	file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+	try
+	{
+		file.open(path);
+		std::stringstream ss;
+		ss << file.rdbuf();
+		file.close();
+		code = ss.str();
+	} 
+	catch (std::ifstream::failure& e)
+	{
+		std::cerr << "Impossible to read: " << path << std::endl;
+		std::cerr << e.what() << std::endl;
+		return false;
+	}
+	return addShaderFromCode(shader_type, code.data(), code.size());
+}
+
+bool ShaderProgram::addShaderFromCode(GLenum shader_type, const char* code, std::size_t length) {
 	std::string shader_type_str = [&]() -> std::string {
 		if (shader_type == GL_VERTEX_SHADER) {
 			return "VERTEX";
@@ -86,38 +147,86 @@ bool ShaderProgram::addShaderFromSource(GLenum shader_type, const std::string& p
 		return false;
 	}
 
-	// Read file
-	std::string code;
-	std::ifstream file;
-	file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	try
-	{
-		file.open(path);
-		std::stringstream ss;
-		ss << file.rdbuf();
-		file.close();
-		code = ss.str();
-	} 
-	catch (std::ifstream::failure& e)
-	{
-		std::cerr << "Impossible to read: " << path << std::endl;
-		std::cerr << e.what() << std::endl;
-		return false;
-	}
 	GLuint shader_id = glCreateShader(shader_type);
-	const char* code_c_str = code.c_str();
-	glShaderSource(shader_id, 1, &code_c_str, NULL);
+	// The length is given so the code doesn't need to be null terminated (it can point in the asset pack)
+	const GLint code_length = static_cast<GLint>(length);
+	glShaderSource(shader_id, 1, &code, &code_length);
+	// The status is only queried in finishLink() so the driver can compile
+	// every shader of the program (and of other programs) in the background
 	glCompileShader(shader_id);
-	bool success = checkCompileErrors(shader_id, shader_type_str);
 	glAttachShader(m_ID, shader_id);
-	if (success) {
-		m_shaders_ids[shader_type_str] = shader_id;
+	m_shaders_ids[shader_type_str] = shader_id;
+	return true;
+}
+
+std::map<std::string, GLint> ShaderProgram::activeAttributeLocations() const
+{
+	std::map<std::string, GLint> locations;
+
+	GLint count = 0;
+	glGetProgramiv(m_ID, GL_ACTIVE_ATTRIBUTES, &count);
+	for (GLint i = 0; i < count; ++i)
+	{
+		char name[256];
+		GLsizei length = 0;
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveAttrib(m_ID, static_cast<GLuint>(i), sizeof(name), &length, &size, &type, name);
+
+		const GLint location = glGetAttribLocation(m_ID, name);
+		if (location >= 0)
+		{
+			locations[std::string(name, length)] = location;
+		}
+	}
+
+	return locations;
+}
+
+void ShaderProgram::bindAttributeLocations(const std::map<std::string, GLint>& locations) const
+{
+	for (const auto& location : locations)
+	{
+		glBindAttribLocation(m_ID, static_cast<GLuint>(location.second), location.first.c_str());
 	}
-	return success;
 }
 
 bool ShaderProgram::link() {
+	requestLink();
+	return finishLink();
+}
+
+void ShaderProgram::requestLink()
+{
 	glLinkProgram(m_ID);
-	m_linked = checkCompileErrors(m_ID, "PROGRAM");
+	m_linkRequested = true;
+}
+
+bool ShaderProgram::isLinkComplete() const
+{
+	if (!m_linkRequested || !s_parallelCompile)
+	{
+		return true;
+	}
+
+	GLint completed = GL_FALSE;
+	glGetProgramiv(m_ID, GL_COMPLETION_STATUS_KHR, &completed);
+	return completed == GL_TRUE;
+}
+
+bool ShaderProgram::finishLink()
+{
+	if (!m_linkRequested)
+	{
+		requestLink();
+	}
+
+	bool success = true;
+	for (const auto& shader : m_shaders_ids)
+	{
+		success &= checkCompileErrors(shader.second, shader.first);
+	}
+
+	m_linked = checkCompileErrors(m_ID, "PROGRAM") && success;
 	return m_linked;
 }
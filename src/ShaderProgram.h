@@ -50,6 +50,11 @@ inline void CheckOpenGLError(const char* stmt, const char* fname, int line)
 #define GL_CHECK(stmt) stmt
 #endif
 
+// GL_KHR_parallel_shader_compile is not part of the core profile exposed by glad
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
 // Helper object that simplify the shader loading and interactions
 // Can be extended if necessary
 class ShaderProgram
@@ -58,17 +63,44 @@ public:
    // ------------------------------------------------------------------------
    // constructor
    ShaderProgram();
+   ~ShaderProgram();
+
+   ShaderProgram(const ShaderProgram&) = delete;
+   ShaderProgram& operator=(const ShaderProgram&) = delete;
+
+   // ------------------------------------------------------------------------
+   // ask the driver to compile and link on its own threads when
+   // GL_KHR_parallel_shader_compile is available (call once glad is loaded)
+   static void enableParallelCompile();
+   static bool parallelCompileSupported() { return s_parallelCompile; }
    
    // ------------------------------------------------------------------------
    // attach shader from sources 
-   // return true if sucessfull
+   // return true if the file could be read, compile errors are reported by link()
    bool addShaderFromSource(GLenum type, const std::string& path);
+
+   // ------------------------------------------------------------------------
+   // attach shader from code already in memory (length bytes, no null terminator needed)
+   bool addShaderFromCode(GLenum type, const char* code, std::size_t length);
    
+   // ------------------------------------------------------------------------
+   // keep the attribute locations of another program (used when hot reloading
+   // so that the VAOs built against the previous program stay valid)
+   std::map<std::string, GLint> activeAttributeLocations() const;
+   void bindAttributeLocations(const std::map<std::string, GLint>& locations) const;
+
    // ------------------------------------------------------------------------
    // link the different shaders to make a full program 
    // return true if sucessfull
    bool link();
 
+   // ------------------------------------------------------------------------
+   // non-blocking variant of link(): requestLink() starts the link, 
+   // isLinkComplete() can be polled every frame and finishLink() gives the result
+   void requestLink();
+   bool isLinkComplete() const;
+   bool finishLink();
+
    // ------------------------------------------------------------------------
    // get program ID to interact directly with the shader program
    inline GLuint programId() const { return m_ID; }
@@ -113,6 +145,9 @@ public:
     // ------------------------------------------------------------------------
     inline void setVec3(const std::string& name, const glm::vec3& value) const { glUniform3fv(glGetUniformLocation(m_ID, name.c_str()), 1, &value[0]); }
 
+    // ------------------------------------------------------------------------
+    inline void setIVec3(const std::string& name, const glm::ivec3& value) const { glUniform3iv(glGetUniformLocation(m_ID, name.c_str()), 1, &value[0]); }
+
     // ------------------------------------------------------------------------
     inline void setVec2(const std::string& name, const glm::vec2& value) const { glUniform2fv(glGetUniformLocation(m_ID, name.c_str()), 1, &value[0]); }
 
@@ -121,7 +156,11 @@ private:
     GLuint m_ID;
     // Does the shader is link?
     bool m_linked = false;
+    // Was glLinkProgram issued?
+    bool m_linkRequested = false;
     // List of the different shaders (can be reused if necessary)
     std::map<std::string, GLuint> m_shaders_ids;
+
+    inline static bool s_parallelCompile = false;
 };
 #endif
\ No newline at end of file
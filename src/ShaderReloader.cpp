@@ -0,0 +1,276 @@
+/**
+ * @file ShaderReloader.cpp
+ *
+ * @brief Watches the shader sources and rebuilds the materials that use them without stalling a frame.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include "ShaderReloader.h"
+
+#include <GLFW/glfw3.h>
+
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "Material.h"
+
+ShaderReloader::ShaderReloader() = default;
+
+ShaderReloader::~ShaderReloader()
+{
+	shutdown();
+}
+
+bool ShaderReloader::init(GLFWwindow* mainWindow)
+{
+#ifdef __linux__
+	m_inotifyDescriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (m_inotifyDescriptor >= 0)
+	{
+		// Editors often save through a temporary file that is then renamed over the original
+		m_watchDescriptor = inotify_add_watch(m_inotifyDescriptor, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+	}
+	if (m_watchDescriptor < 0)
+	{
+		std::cerr << "Unable to watch " << directory << " with inotify, falling back to polling" << std::endl;
+	}
+#endif
+
+	if (m_watchDescriptor < 0)
+	{
+		std::error_code error;
+		for (const auto& entry : std::filesystem::directory_iterator(directory, error))
+		{
+			m_lastWriteTimes[entry.path().filename().string()] = entry.last_write_time(error);
+		}
+	}
+
+	if (ShaderProgram::parallelCompileSupported())
+	{
+		return true;
+	}
+
+	// No parallel compile: build the new programs on a worker thread with its own shared context
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	m_workerContext = glfwCreateWindow(1, 1, "Shader compilation", nullptr, mainWindow);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+	if (m_workerContext == nullptr)
+	{
+		std::cerr << "Unable to create the shader compilation context, shaders will not be hot reloaded" << std::endl;
+		return false;
+	}
+
+	m_worker = std::thread(&ShaderReloader::workerLoop, this);
+	return true;
+}
+
+void ShaderReloader::shutdown()
+{
+	if (m_worker.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopWorker = true;
+		}
+		m_jobAvailable.notify_all();
+		m_worker.join();
+	}
+
+	if (m_workerContext != nullptr)
+	{
+		glfwDestroyWindow(m_workerContext);
+		m_workerContext = nullptr;
+	}
+
+	m_results.clear();
+
+#ifdef __linux__
+	if (m_inotifyDescriptor >= 0)
+	{
+		close(m_inotifyDescriptor);
+		m_inotifyDescriptor = -1;
+		m_watchDescriptor = -1;
+	}
+#endif
+}
+
+void ShaderReloader::addMaterial(const std::shared_ptr<Material>& material)
+{
+	m_materials.push_back(material);
+}
+
+void ShaderReloader::update()
+{
+	std::set<std::string> changedFiles;
+	collectChangedFiles(changedFiles);
+
+	for (const auto& material : m_materials)
+	{
+		for (const auto& fileName : changedFiles)
+		{
+			if (material->usesShaderFile(fileName))
+			{
+				scheduleReload(*material);
+				break;
+			}
+		}
+	}
+
+	if (m_workerContext != nullptr)
+	{
+		std::vector<ReloadResult> results;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			results.swap(m_results);
+			for (const auto& result : results)
+			{
+				m_inFlight.erase(result.material);
+			}
+		}
+
+		for (auto& result : results)
+		{
+			if (result.shaderProgram != nullptr)
+			{
+				result.material->beginReload(std::move(result.shaderProgram));
+			}
+
+			// A failed build never starts reloading: a save made meanwhile, often the fix, is scheduled now
+			if (!result.material->isReloading() && m_reloadAgain.erase(result.material) > 0)
+			{
+				scheduleReload(*result.material);
+			}
+		}
+	}
+
+	for (const auto& material : m_materials)
+	{
+		if (!material->isReloading())
+		{
+			continue;
+		}
+
+		// Only swaps once the driver reports the link as completed, the old program is used until then
+		material->updateReload();
+
+		if (!material->isReloading() && m_reloadAgain.erase(material.get()) > 0)
+		{
+			scheduleReload(*material);
+		}
+	}
+}
+
+void ShaderReloader::collectChangedFiles(std::set<std::string>& changedFiles)
+{
+#ifdef __linux__
+	if (m_watchDescriptor >= 0)
+	{
+		alignas(inotify_event) char buffer[4096];
+		ssize_t length;
+		while ((length = read(m_inotifyDescriptor, buffer, sizeof(buffer))) > 0)
+		{
+			for (char* it = buffer; it < buffer + length; )
+			{
+				const auto* event = reinterpret_cast<const inotify_event*>(it);
+				if (event->len > 0)
+				{
+					changedFiles.insert(event->name);
+				}
+				it += sizeof(inotify_event) + event->len;
+			}
+		}
+		return;
+	}
+#endif
+
+	const double time = glfwGetTime();
+	if (time - m_lastPollTime < pollInterval)
+	{
+		return;
+	}
+	m_lastPollTime = time;
+
+	std::error_code error;
+	for (const auto& entry : std::filesystem::directory_iterator(directory, error))
+	{
+		const auto fileName = entry.path().filename().string();
+		const auto writeTime = entry.last_write_time(error);
+
+		auto lastWriteTime = m_lastWriteTimes.find(fileName);
+		if (lastWriteTime == m_lastWriteTimes.end() || lastWriteTime->second != writeTime)
+		{
+			m_lastWriteTimes[fileName] = writeTime;
+			changedFiles.insert(fileName);
+		}
+	}
+}
+
+void ShaderReloader::scheduleReload(Material& material)
+{
+	if (material.isReloading() || m_inFlight.count(&material) > 0)
+	{
+		// Rebuild again with the latest sources once the current one is done
+		m_reloadAgain.insert(&material);
+		return;
+	}
+
+	if (m_workerContext == nullptr)
+	{
+		auto shaderProgram = material.createShaderProgram(material.attributeLocations());
+		if (shaderProgram != nullptr)
+		{
+			material.beginReload(std::move(shaderProgram));
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_inFlight.insert(&material);
+		m_jobs.push_back({ &material, material.attributeLocations() });
+	}
+	m_jobAvailable.notify_one();
+}
+
+void ShaderReloader::workerLoop()
+{
+	glfwMakeContextCurrent(m_workerContext);
+
+	while (true)
+	{
+		ReloadJob job;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_jobAvailable.wait(lock, [this]() { return m_stopWorker || !m_jobs.empty(); });
+			if (m_stopWorker)
+			{
+				break;
+			}
+
+			job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+		}
+
+		auto shaderProgram = job.material->createShaderProgram(job.attributeLocations);
+		if (shaderProgram != nullptr && !shaderProgram->finishLink())
+		{
+			std::cerr << "Shader reload failed, keeping the previous program" << std::endl;
+			shaderProgram = nullptr;
+		}
+
+		// The program must be complete before the main context starts using it
+		glFinish();
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_results.push_back({ job.material, std::move(shaderProgram) });
+	}
+
+	glfwMakeContextCurrent(nullptr);
+}
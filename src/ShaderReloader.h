@@ -0,0 +1,93 @@
+#pragma once
+#ifndef SHADERRELOADER_H
+#define SHADERRELOADER_H
+
+/**
+ * @file ShaderReloader.h
+ *
+ * @brief Watches the shader sources and rebuilds the materials that use them without stalling a frame.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include <glad/glad.h>
+
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Material;
+class ShaderProgram;
+struct GLFWwindow;
+
+class ShaderReloader
+{
+public:
+	ShaderReloader();
+	~ShaderReloader();
+
+	/**
+	 * Start watching SHADERS_DIR. When the driver can't compile in parallel, a hidden window
+	 * sharing the context of mainWindow is created so the rebuild happens on a worker thread.
+	 */
+	bool init(GLFWwindow* mainWindow);
+	void shutdown();
+
+	void addMaterial(const std::shared_ptr<Material>& material);
+
+	/**
+	 * To be called once per frame on the thread that owns the GL context.
+	 * Never waits on the driver: finished programs are swapped in, the others are checked again next frame.
+	 */
+	void update();
+
+private:
+	struct ReloadJob
+	{
+		Material* material;
+		std::map<std::string, GLint> attributeLocations;
+	};
+
+	struct ReloadResult
+	{
+		Material* material;
+		std::unique_ptr<ShaderProgram> shaderProgram;
+	};
+
+	void collectChangedFiles(std::set<std::string>& changedFiles);
+	void scheduleReload(Material& material);
+	void workerLoop();
+
+private:
+	const std::string directory = SHADERS_DIR;
+
+	std::vector<std::shared_ptr<Material>> m_materials;
+	std::set<Material*> m_reloadAgain;
+
+	int m_inotifyDescriptor = -1;
+	int m_watchDescriptor = -1;
+	std::map<std::string, std::filesystem::file_time_type> m_lastWriteTimes;
+	double m_lastPollTime = 0.0;
+
+	GLFWwindow* m_workerContext = nullptr;
+	std::thread m_worker;
+	std::mutex m_mutex;
+	std::condition_variable m_jobAvailable;
+	std::deque<ReloadJob> m_jobs;
+	std::vector<ReloadResult> m_results;
+	std::set<Material*> m_inFlight;
+	bool m_stopWorker = false;
+
+	const double pollInterval = 0.5;
+};
+
+#endif
@@ -9,7 +9,7 @@
  */
 
 #include "SkyboxMaterial.h"
-#include "stb_image.h"
+#include "TextureLoader.h"
 
 #include <glad/glad.h>
 #include <iostream>
@@ -68,34 +68,11 @@ void SkyboxMaterial::setViewDir(const glm::vec3& viewDir) const
     m_shaderProgram->setVec3(viewDirAttributeName, viewDir);
 }
 
-void SkyboxMaterial::loadTexture(unsigned int& textureId, const std::string& fileName){
-    std::string asset_dir = ASSETS_DIR;
-
-    glGenTextures(1,&textureId);
-
-    stbi_set_flip_vertically_on_load(true);
-
-
-    int width, height, nrChannels;
-    std::string pathToAsset = asset_dir + fileName;
-    unsigned char *data = stbi_load(&pathToAsset[0], &width, &height, &nrChannels, 0);
-    if (data)
-    {
-        glBindTexture(GL_TEXTURE_2D, textureId);
-        glTexImage2D(GL_TEXTURE_2D,0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-        std::cout << "Texture loaded at fileName: " << fileName << std::endl;
-    }
-    else {
-        std::cout << "Failed to load at fileName : " << fileName << std::endl;
-        stbi_image_free(data);
-    }
+void SkyboxMaterial::queueTextures(TextureLoader& textureLoader)
+{
+    const std::string assetDir = ASSETS_DIR;
+    textureLoader.add(assetDir + "sky_color_forward.png", TextureIdForward, GL_MIRRORED_REPEAT, GL_LINEAR, GL_LINEAR, 3);
+    textureLoader.add(assetDir + "sky_color_backward.png", TextureIdBackward, GL_MIRRORED_REPEAT, GL_LINEAR, GL_LINEAR, 3);
 }
 
 void SkyboxMaterial::bindTextureAndDraw() const{
@@ -122,9 +99,7 @@ bool SkyboxMaterial::init_impl()
 
     initGeometrySphere();
 
-    loadTexture(TextureIdForward, "sky_color_forward.png");
     m_shaderProgram->setInt(skyDomeTex1AttributeName, 0);
-    loadTexture(TextureIdBackward, "sky_color_backward.png");
     m_shaderProgram->setInt(skyDomeTex2AttributeName, 1);
 
 	return true;
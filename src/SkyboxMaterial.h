@@ -15,6 +15,8 @@
 #include "Material.h"
 #include "MainWindow.h"
 
+class TextureLoader;
+
 class SkyboxMaterial : public Material {
 public:
 
@@ -32,6 +34,11 @@ public:
 
     void bindTextureAndDraw() const;
 
+    /**
+     * Start decoding the sky textures with the other startup textures, they are uploaded by the loader.
+     */
+    void queueTextures(TextureLoader& textureLoader);
+
 protected:
 	bool init_impl() override;
 
@@ -40,7 +47,6 @@ protected:
 
 private:
 
-    void loadTexture(unsigned int& textureId, const std::string& fileName);
     void initGeometrySphere();
 
 	int m_vPositionLocation = -1;
@@ -0,0 +1,454 @@
+/**
+ * @file StaticBatching.cpp
+ *
+ * @brief Renderers that stopped moving, merged per material into pre-transformed vertex buffers.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include "StaticBatching.h"
+
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+
+#include <algorithm>
+#include <iterator>
+#include <tuple>
+
+#include "Camera.h"
+#include "Material.h"
+#include "Mesh.h"
+#include "MeshRenderer.h"
+#include "ThreadPool.h"
+#include "TransformKernels.h"
+
+namespace
+{
+	StaticBatchKey keyOf(const MeshRenderer& renderer)
+	{
+		StaticBatchKey key;
+		key.material = renderer.material().get();
+		key.textureIndex = renderer.textureIndex();
+		key.normalsTextureIndex = renderer.normalsTextureIndex();
+		key.materialIndex = renderer.materialIndex();
+		return key;
+	}
+}
+
+bool StaticBatchKey::operator<(const StaticBatchKey& other) const
+{
+	return std::make_tuple(material, textureIndex, normalsTextureIndex, materialIndex)
+		< std::make_tuple(other.material, other.textureIndex, other.normalsTextureIndex, other.materialIndex);
+}
+
+StaticBatch::StaticBatch(const StaticBatchKey& key)
+	: m_key(key)
+{
+}
+
+StaticBatch::~StaticBatch()
+{
+	for (std::size_t i = 0; i < m_members.size(); ++i)
+	{
+		if (m_alive[i])
+			evict(*m_members[i].renderer);
+	}
+	for (auto* renderer : std::vector<MeshRenderer*>(m_additions))
+	{
+		evict(*renderer);
+	}
+	for (auto* renderer : m_inBuild)
+	{
+		if (renderer->m_staticBatch == this && renderer->m_staticSlot == MeshRenderer::NO_STATIC_SLOT)
+			evict(*renderer);
+	}
+	release();
+}
+
+void StaticBatch::evict(MeshRenderer& renderer)
+{
+	if (renderer.m_staticSlot != MeshRenderer::NO_STATIC_SLOT)
+	{
+		m_alive[renderer.m_staticSlot] = 0;
+		--m_aliveCount;
+	}
+	else
+	{
+		// Still waiting, or in the build in progress: the build is checked against the stamp when it is installed
+		m_additions.erase(std::remove(m_additions.begin(), m_additions.end(), &renderer), m_additions.end());
+	}
+
+	renderer.m_staticBatch = nullptr;
+	renderer.m_staticSlot = MeshRenderer::NO_STATIC_SLOT;
+	m_dirty = true;
+}
+
+std::size_t StaticBatch::render(const Camera& camera)
+{
+	const std::size_t rendererCount = collectDrawRanges();
+	if (rendererCount == 0)
+		return 0;
+
+	// Same uniforms as the renderers, with the vertices already in world space
+	const Material& material = *m_key.material;
+	const MaterialRecord& record = MaterialRegistry::instance().record(m_key.materialIndex);
+	material.setAppearance(record.ambiantColor, record.diffuseColor, record.specularColor, record.specularTerm());
+	material.setTexture(m_key.textureIndex);
+	material.setNormalsTexture(m_key.normalsTextureIndex);
+
+	material.bind();
+	const glm::mat4 viewMatrix = camera.viewMatrix();
+	material.setModelViewMatrix(viewMatrix);
+	material.setViewMatrix(viewMatrix);
+	material.setProjectionMatrix(camera.projectionMatrix());
+	material.setNormalMatrix(TransformKernels::normalMatrix(glm::mat3(viewMatrix)));
+
+	glBindVertexArray(m_vao);
+	glMultiDrawElements(GL_TRIANGLES, m_drawCounts.data(), GL_UNSIGNED_INT, m_drawOffsets.data(), static_cast<GLsizei>(m_drawCounts.size()));
+
+	return rendererCount;
+}
+
+void StaticBatch::renderDepth(const Camera& camera, const Material& depthMaterial)
+{
+	if (m_vao == 0 || collectDrawRanges() == 0)
+		return;
+
+	if (m_depthVao == 0)
+	{
+		// The positions come first in the vertex buffer
+		glGenVertexArrays(1, &m_depthVao);
+		glBindVertexArray(m_depthVao);
+		glBindBuffer(GL_ARRAY_BUFFER, m_buffers[0]);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_buffers[1]);
+
+		const int positionAttributeLocation = depthMaterial.positionAttribLocation();
+		glVertexAttribPointer(positionAttributeLocation, 3, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0));
+		glEnableVertexAttribArray(positionAttributeLocation);
+	}
+
+	// The same matrices as render, so both passes find the same depths
+	depthMaterial.bind();
+	depthMaterial.setModelViewMatrix(camera.viewMatrix());
+	depthMaterial.setProjectionMatrix(camera.projectionMatrix());
+
+	glBindVertexArray(m_depthVao);
+	glMultiDrawElements(GL_TRIANGLES, m_drawCounts.data(), GL_UNSIGNED_INT, m_drawOffsets.data(), static_cast<GLsizei>(m_drawCounts.size()));
+}
+
+std::size_t StaticBatch::collectDrawRanges()
+{
+	m_drawCounts.clear();
+	m_drawOffsets.clear();
+
+	std::size_t rendererCount = 0;
+	uint32_t rangeEnd = 0;
+	for (std::size_t i = 0; i < m_members.size(); ++i)
+	{
+		if (!m_visible[i] || !m_alive[i])
+			continue;
+
+		const Member& member = m_members[i];
+		if (!m_drawCounts.empty() && rangeEnd == member.firstIndex)
+		{
+			m_drawCounts.back() += static_cast<GLsizei>(member.indexCount);
+		}
+		else
+		{
+			m_drawCounts.push_back(static_cast<GLsizei>(member.indexCount));
+			m_drawOffsets.push_back(BUFFER_OFFSET(sizeof(uint32_t) * member.firstIndex));
+		}
+		rangeEnd = member.firstIndex + member.indexCount;
+		++rendererCount;
+	}
+	return rendererCount;
+}
+
+void StaticBatch::release()
+{
+	if (m_depthVao != 0)
+	{
+		glDeleteVertexArrays(1, &m_depthVao);
+		m_depthVao = 0;
+	}
+	if (m_vao != 0)
+	{
+		glDeleteVertexArrays(1, &m_vao);
+		glDeleteBuffers(2, m_buffers);
+		m_vao = 0;
+		std::fill(std::begin(m_buffers), std::end(m_buffers), 0u);
+	}
+}
+
+StaticBatcher::Settings& StaticBatcher::settings()
+{
+	static Settings settings;
+	return settings;
+}
+
+StaticBatcher::Statistics& StaticBatcher::statistics()
+{
+	static Statistics statistics;
+	return statistics;
+}
+
+void StaticBatcher::update()
+{
+	std::vector<BuildResult> results;
+	{
+		std::lock_guard<std::mutex> lock(m_pending->mutex);
+		results.swap(m_pending->results);
+	}
+	for (auto& result : results)
+	{
+		--m_buildsInProgress;
+		install(result);
+	}
+
+	// The traversals of this frame tell again which renderers are visible
+	for (auto* batch : m_batches)
+	{
+		std::fill(batch->m_visible.begin(), batch->m_visible.end(), 0);
+	}
+
+	const auto& batcherSettings = settings();
+	const std::size_t maxRenderers = static_cast<std::size_t>(std::max(batcherSettings.maxRenderers, 1));
+	for (auto* renderer : MeshRenderer::staticCandidates())
+	{
+		// Changed since it was queued, or listed twice
+		if (!renderer->m_staticQueued || renderer->m_staticBatch != nullptr)
+			continue;
+		renderer->m_staticQueued = false;
+		if (!batcherSettings.enabled)
+			continue;
+
+		// The first batch of the key with some room, the evictions leave room in the old ones
+		auto& batches = m_batchesByKey[keyOf(*renderer)];
+		auto batch = std::find_if(batches.begin(), batches.end(), [&](const auto& candidate) { return candidate->rendererCount() < maxRenderers; });
+		if (batch == batches.end())
+		{
+			batches.push_back(std::make_unique<StaticBatch>(keyOf(*renderer)));
+			m_batches.push_back(batches.back().get());
+			batch = std::prev(batches.end());
+		}
+
+		(*batch)->m_additions.push_back(renderer);
+		(*batch)->m_dirty = true;
+		renderer->m_staticBatch = batch->get();
+		renderer->m_staticSlot = MeshRenderer::NO_STATIC_SLOT;
+	}
+	MeshRenderer::staticCandidates().clear();
+
+	for (auto* batch : m_batches)
+	{
+		if (batch->m_dirty && !batch->m_building)
+			startBuild(*batch);
+	}
+}
+
+void StaticBatcher::render(const Camera& camera)
+{
+	if (!settings().enabled)
+		return;
+
+	auto& batcherStatistics = statistics();
+	for (auto* batch : m_batches)
+	{
+		const std::size_t rendererCount = batch->render(camera);
+		if (rendererCount > 0)
+		{
+			batcherStatistics.batchDraws += 1;
+			batcherStatistics.batchedRenderers += rendererCount;
+		}
+	}
+}
+
+void StaticBatcher::renderDepth(const Camera& camera, const Material& depthMaterial)
+{
+	if (!settings().enabled)
+		return;
+
+	for (auto* batch : m_batches)
+	{
+		batch->renderDepth(camera, depthMaterial);
+	}
+}
+
+void StaticBatcher::clear()
+{
+	m_batches.clear();
+	m_batchesByKey.clear();
+	++m_version;
+}
+
+void StaticBatcher::startBuild(StaticBatch& batch)
+{
+	// The matrices as the renderers last saw them: they have not changed since, or they would have left the batch
+	auto input = std::make_shared<BuildInput>();
+	input->batch = &batch;
+	auto addSource = [&](MeshRenderer& renderer)
+	{
+		input->sources.push_back({ &renderer, renderer.m_staticStamp, renderer.mesh(), renderer.m_staticModelMatrix });
+	};
+	for (std::size_t i = 0; i < batch.m_members.size(); ++i)
+	{
+		if (batch.m_alive[i])
+			addSource(*batch.m_members[i].renderer);
+	}
+	for (auto* renderer : batch.m_additions)
+	{
+		addSource(*renderer);
+	}
+	batch.m_inBuild.swap(batch.m_additions);
+	batch.m_additions.clear();
+
+	batch.m_dirty = false;
+	batch.m_building = true;
+	++m_buildsInProgress;
+	ThreadPool::instance().enqueue([input, pending = m_pending]()
+	{
+		BuildResult result;
+		build(*input, result);
+
+		std::lock_guard<std::mutex> lock(pending->mutex);
+		pending->results.push_back(std::move(result));
+	});
+}
+
+void StaticBatcher::install(BuildResult& result)
+{
+	// Deleted by clear while it was built
+	if (std::find(m_batches.begin(), m_batches.end(), result.batch) == m_batches.end())
+		return;
+
+	StaticBatch& batch = *result.batch;
+	batch.m_building = false;
+	batch.m_inBuild.clear();
+	batch.release();
+	++m_version;
+
+	batch.m_members = std::move(result.members);
+	batch.m_alive.assign(batch.m_members.size(), 0);
+	batch.m_visible.assign(batch.m_members.size(), 0);
+	batch.m_aliveCount = 0;
+	for (std::size_t i = 0; i < batch.m_members.size(); ++i)
+	{
+		// Evicted during the build: it draws itself, the batch is already dirty
+		MeshRenderer& renderer = *batch.m_members[i].renderer;
+		if (renderer.m_staticBatch != &batch || renderer.m_staticStamp != batch.m_members[i].stamp)
+			continue;
+
+		renderer.m_staticSlot = static_cast<uint32_t>(i);
+		batch.m_alive[i] = 1;
+		++batch.m_aliveCount;
+	}
+
+	if (result.indices.empty())
+		return;
+
+	const Material& material = *batch.m_key.material;
+	const std::size_t vertexCount = result.vertexCount;
+
+	glGenVertexArrays(1, &batch.m_vao);
+	glGenBuffers(2, batch.m_buffers);
+	glBindVertexArray(batch.m_vao);
+
+	glBindBuffer(GL_ARRAY_BUFFER, batch.m_buffers[0]);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(float) * result.vertexData.size(), result.vertexData.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.m_buffers[1]);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * result.indices.size(), result.indices.data(), GL_STATIC_DRAW);
+
+	const int positionAttributeLocation = material.positionAttribLocation();
+	glVertexAttribPointer(positionAttributeLocation, 3, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0));
+	glEnableVertexAttribArray(positionAttributeLocation);
+
+	const int uvAttributeLocation = material.uvAttribLocation();
+	glVertexAttribPointer(uvAttributeLocation, 2, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(sizeof(float) * 3 * vertexCount));
+	glEnableVertexAttribArray(uvAttributeLocation);
+
+	const int normalAttributeLocation = material.normalAttribLocation();
+	glVertexAttribPointer(normalAttributeLocation, 3, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(sizeof(float) * 5 * vertexCount));
+	glEnableVertexAttribArray(normalAttributeLocation);
+
+	const int tangentAttributeLocation = material.tangentAttribLocation();
+	glVertexAttribPointer(tangentAttributeLocation, 3, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(sizeof(float) * 8 * vertexCount));
+	glEnableVertexAttribArray(tangentAttributeLocation);
+
+	glBindVertexArray(0);
+}
+
+void StaticBatcher::build(const BuildInput& input, BuildResult& result)
+{
+	result.batch = input.batch;
+
+	std::size_t vertexCount = 0;
+	std::size_t indexCount = 0;
+	for (const auto& source : input.sources)
+	{
+		vertexCount += source.mesh->vertices().size() / 3;
+		indexCount += source.mesh->indices().size();
+	}
+
+	std::vector<float> positions;
+	std::vector<float> uvs;
+	std::vector<float> normals;
+	std::vector<float> tangents;
+	positions.reserve(3 * vertexCount);
+	uvs.reserve(2 * vertexCount);
+	normals.reserve(3 * vertexCount);
+	tangents.reserve(3 * vertexCount);
+	result.indices.reserve(indexCount);
+	result.members.reserve(input.sources.size());
+
+	for (const auto& source : input.sources)
+	{
+		const Mesh& mesh = *source.mesh;
+		const std::size_t sourceVertexCount = mesh.vertices().size() / 3;
+		const auto firstVertex = static_cast<uint32_t>(positions.size() / 3);
+		const glm::mat3 tangentMatrix = glm::mat3(source.modelMatrix);
+		const glm::mat3 normalMatrix = TransformKernels::normalMatrix(tangentMatrix);
+
+		for (std::size_t v = 0; v < sourceVertexCount; ++v)
+		{
+			const glm::vec3 position = glm::vec3(source.modelMatrix * glm::vec4(mesh.vertices()[3 * v], mesh.vertices()[3 * v + 1], mesh.vertices()[3 * v + 2], 1.0f));
+			positions.insert(positions.end(), { position.x, position.y, position.z });
+			uvs.insert(uvs.end(), { mesh.uvs()[2 * v], mesh.uvs()[2 * v + 1] });
+
+			glm::vec3 normal = normalMatrix * glm::vec3(mesh.normals()[3 * v], mesh.normals()[3 * v + 1], mesh.normals()[3 * v + 2]);
+			normal = glm::length(normal) > 0.0f ? glm::normalize(normal) : normal;
+			normals.insert(normals.end(), { normal.x, normal.y, normal.z });
+
+			// A null tangent makes the shader ignore the normal map, like the meshes without tangents
+			glm::vec3 tangent(0.0f);
+			if (!mesh.tangents().empty())
+			{
+				tangent = tangentMatrix * glm::vec3(mesh.tangents()[3 * v], mesh.tangents()[3 * v + 1], mesh.tangents()[3 * v + 2]);
+				tangent = glm::length(tangent) > 0.0f ? glm::normalize(tangent) : tangent;
+			}
+			tangents.insert(tangents.end(), { tangent.x, tangent.y, tangent.z });
+		}
+
+		StaticBatch::Member member;
+		member.renderer = source.renderer;
+		member.stamp = source.stamp;
+		member.firstIndex = static_cast<uint32_t>(result.indices.size());
+		for (const GLuint index : mesh.indices())
+		{
+			if (index < sourceVertexCount)
+				result.indices.push_back(firstVertex + index);
+		}
+		result.indices.resize(member.firstIndex + (result.indices.size() - member.firstIndex) / 3 * 3);
+		member.indexCount = static_cast<uint32_t>(result.indices.size()) - member.firstIndex;
+		result.members.push_back(member);
+	}
+
+	// Laid out like the cubes: positions, uvs, normals, then tangents
+	result.vertexCount = positions.size() / 3;
+	result.vertexData.reserve(11 * result.vertexCount);
+	for (const auto* attribute : { &positions, &uvs, &normals, &tangents })
+	{
+		result.vertexData.insert(result.vertexData.end(), attribute->begin(), attribute->end());
+	}
+}
@@ -0,0 +1,207 @@
+#pragma once
+#ifndef STATICBATCHING_H
+#define STATICBATCHING_H
+
+/**
+ * @file StaticBatching.h
+ *
+ * @brief Renderers that stopped moving, merged per material into pre-transformed vertex buffers.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include <glad/glad.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class Camera;
+class Material;
+class Mesh;
+class MeshRenderer;
+
+/**
+ * What the renderers of a batch have in common: everything the shader receives besides the matrices.
+ */
+struct StaticBatchKey
+{
+	const Material* material = nullptr;
+	unsigned int textureIndex = 0;
+	unsigned int normalsTextureIndex = 0;
+	uint32_t materialIndex = 0;     // In the MaterialRegistry, which gives the same index to the same colors
+
+	bool operator<(const StaticBatchKey& other) const;
+};
+
+/**
+ * At most maxRenderers renderers of the same key, in world space. A renderer that changes is evicted at once:
+ * its range of indices is left out of the draws until the batch is built again without it.
+ */
+class StaticBatch
+{
+public:
+	explicit StaticBatch(const StaticBatchKey& key);
+	~StaticBatch();
+	StaticBatch(const StaticBatch&) = delete;
+	StaticBatch& operator=(const StaticBatch&) = delete;
+
+	/**
+	 * Called by a renderer of the batch when it is visited and has not changed, the batch draws it this frame.
+	 * The flags are cleared by StaticBatcher::update, so every pass of the frame draws the same renderers.
+	 */
+	inline void markVisible(uint32_t slot) { m_visible[slot] = 1; }
+
+	/**
+	 * Called by a renderer of the batch (or waiting for it) when it moves or changes, it draws itself from now on.
+	 */
+	void evict(MeshRenderer& renderer);
+
+	inline const StaticBatchKey& key() const { return m_key; }
+	inline std::size_t rendererCount() const { return m_aliveCount + m_additions.size() + m_inBuild.size(); }
+
+private:
+	friend class StaticBatcher;
+
+	struct Member
+	{
+		MeshRenderer* renderer = nullptr;
+		uint64_t stamp = 0;              // Changes of the renderer when it was built, an older build is not used for it
+		uint32_t firstIndex = 0;
+		uint32_t indexCount = 0;
+	};
+
+	/**
+	 * Draw the visible ranges, the neighbours merged in one range. Returns the number of renderers drawn.
+	 */
+	std::size_t render(const Camera& camera);
+
+	/**
+	 * Draw the same ranges with only the positions, for a depth pass.
+	 */
+	void renderDepth(const Camera& camera, const Material& depthMaterial);
+	std::size_t collectDrawRanges();
+	void release();
+
+private:
+	StaticBatchKey m_key;
+
+	GLuint m_vao = 0;
+	GLuint m_depthVao = 0;           // Positions only, made on the first depth pass
+	GLuint m_buffers[2] = {};
+	std::vector<Member> m_members;   // In the order of their indices
+	std::vector<char> m_alive;
+	std::vector<char> m_visible;     // Set by the renderers during the traversals of the frame
+	std::size_t m_aliveCount = 0;
+
+	std::vector<MeshRenderer*> m_additions;   // Waiting for the next build
+	std::vector<MeshRenderer*> m_inBuild;     // Additions taken by the build in progress
+	bool m_dirty = false;
+	bool m_building = false;
+
+	// Rebuilt every draw, kept to reuse their memory
+	std::vector<GLsizei> m_drawCounts;
+	std::vector<const void*> m_drawOffsets;
+};
+
+/**
+ * Puts the renderers that stopped changing in batches and builds the batches on the thread pool.
+ * The renderers find their way here through MeshRenderer::staticCandidates.
+ */
+class StaticBatcher
+{
+public:
+	struct Settings
+	{
+		bool enabled = true;
+		int idleFrames = 60;          // Frames without a change before a renderer is batched
+		int maxRenderers = 1024;      // Per batch, so a change only rebuilds a part of the static geometry
+	};
+
+	// Reset by the window every frame
+	struct Statistics
+	{
+		std::size_t batchDraws = 0;
+		std::size_t batchedRenderers = 0;
+	};
+
+	static Settings& settings();
+	static Statistics& statistics();
+
+	/**
+	 * Once per frame, before the scene is rendered: install the finished builds, batch the candidates, start the builds.
+	 */
+	void update();
+
+	/**
+	 * After the scene graph, whose traversal tells each batch which renderers are visible.
+	 */
+	void render(const Camera& camera);
+
+	/**
+	 * Same as render, with only the positions and the given material (see DepthPrepass).
+	 */
+	void renderDepth(const Camera& camera, const Material& depthMaterial);
+
+	/**
+	 * Give the renderers back their own draws and delete the batches, while the context is still alive.
+	 */
+	void clear();
+
+	inline std::size_t batchCount() const { return m_batches.size(); }
+	inline std::size_t buildsInProgress() const { return m_buildsInProgress; }
+
+	// Changes whenever the renderers drawn by the batches do (see RenderBundle)
+	inline uint64_t version() const { return m_version; }
+
+private:
+	struct BuildInput
+	{
+		struct Source
+		{
+			MeshRenderer* renderer = nullptr;
+			uint64_t stamp = 0;
+			std::shared_ptr<const Mesh> mesh;
+			glm::mat4 modelMatrix = glm::mat4(1.0f);
+		};
+
+		StaticBatch* batch = nullptr;
+		std::vector<Source> sources;
+	};
+
+	struct BuildResult
+	{
+		StaticBatch* batch = nullptr;
+		std::vector<StaticBatch::Member> members;
+		std::vector<float> vertexData;   // Positions, uvs, normals and tangents one after the other, like a cube
+		std::size_t vertexCount = 0;
+		std::vector<uint32_t> indices;
+	};
+
+	struct PendingResults
+	{
+		std::mutex mutex;
+		std::vector<BuildResult> results;
+	};
+
+	void startBuild(StaticBatch& batch);
+	void install(BuildResult& result);
+
+	static void build(const BuildInput& input, BuildResult& result);
+
+private:
+	std::map<StaticBatchKey, std::vector<std::unique_ptr<StaticBatch>>> m_batchesByKey;
+	std::vector<StaticBatch*> m_batches;
+	std::shared_ptr<PendingResults> m_pending = std::make_shared<PendingResults>();
+	std::size_t m_buildsInProgress = 0;
+	uint64_t m_version = 0;
+};
+
+#endif
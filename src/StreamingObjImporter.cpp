@@ -0,0 +1,561 @@
+/**
+ * @file StreamingObjImporter.cpp
+ *
+ * @brief Imports an OBJ file of any size within a memory budget, handing out finished groups as it goes.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include "StreamingObjImporter.h"
+
+#include <glm/common.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+
+#include "ObjParsing.h"
+
+using namespace OBJLoader::Parsing;
+
+namespace
+{
+	// Append-only array whose least recently used blocks go to a temporary file once it holds too much.
+	// Faces mostly reference vertices written shortly before them, so the blocks read back are few.
+	template <class T>
+	class SpilledArray
+	{
+	public:
+		static constexpr std::size_t BLOCK_SIZE = 1 << 16;
+		static constexpr std::size_t BLOCK_BYTES = BLOCK_SIZE * sizeof(T);
+
+		explicit SpilledArray(std::size_t maxResidentBytes)
+			: m_maxResidentBlocks(std::max<std::size_t>(2, maxResidentBytes / BLOCK_BYTES))
+		{
+		}
+
+		~SpilledArray()
+		{
+			if (m_spillFile != nullptr)
+			{
+				std::fclose(m_spillFile);
+			}
+		}
+
+		SpilledArray(const SpilledArray&) = delete;
+		SpilledArray& operator=(const SpilledArray&) = delete;
+
+		inline std::size_t size() const { return m_size; }
+		inline std::size_t residentBytes() const { return m_residentBlocks * BLOCK_BYTES; }
+
+		void push_back(const T& value)
+		{
+			if (m_size % BLOCK_SIZE == 0)
+			{
+				m_blocks.emplace_back();
+				m_blocks.back().values.reserve(BLOCK_SIZE);
+				m_blocks.back().lastUse = ++m_clock;
+				++m_residentBlocks;
+				evict();
+			}
+			m_blocks.back().values.push_back(value);
+			++m_size;
+		}
+
+		T at(std::size_t index)
+		{
+			Block& block = m_blocks[index / BLOCK_SIZE];
+			block.lastUse = ++m_clock;
+			if (block.values.empty())
+			{
+				load(block);
+			}
+			return block.values[index % BLOCK_SIZE];
+		}
+
+	private:
+		struct Block
+		{
+			std::vector<T> values;
+			long long fileOffset = -1;
+			uint64_t lastUse = 0;
+		};
+
+		static bool seek(FILE* file, long long offset)
+		{
+#ifdef _WIN32
+			return _fseeki64(file, offset, SEEK_SET) == 0;
+#else
+			return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+		}
+
+		void evict()
+		{
+			while (m_residentBlocks > m_maxResidentBlocks)
+			{
+				// The last block is still being filled, it stays
+				Block* oldest = nullptr;
+				for (std::size_t i = 0; i + 1 < m_blocks.size(); ++i)
+				{
+					Block& block = m_blocks[i];
+					if (!block.values.empty() && (oldest == nullptr || block.lastUse < oldest->lastUse))
+					{
+						oldest = &block;
+					}
+				}
+				if (oldest == nullptr || !spill(*oldest))
+				{
+					return;
+				}
+
+				std::vector<T>().swap(oldest->values);
+				--m_residentBlocks;
+			}
+		}
+
+		bool spill(Block& block)
+		{
+			// Full blocks never change, one copy on the disk is enough
+			if (block.fileOffset >= 0)
+			{
+				return true;
+			}
+
+			if (m_spillFile == nullptr && !m_spillFailed)
+			{
+				m_spillFile = std::tmpfile();
+				if (m_spillFile == nullptr)
+				{
+					std::cerr << "Unable to create the temporary file of the import, the memory budget will be exceeded" << std::endl;
+					m_spillFailed = true;
+				}
+			}
+			if (m_spillFile == nullptr || !seek(m_spillFile, m_spillSize)
+				|| std::fwrite(block.values.data(), sizeof(T), block.values.size(), m_spillFile) != block.values.size())
+			{
+				return false;
+			}
+
+			block.fileOffset = m_spillSize;
+			m_spillSize += static_cast<long long>(block.values.size() * sizeof(T));
+			return true;
+		}
+
+		void load(Block& block)
+		{
+			block.values.resize(BLOCK_SIZE);
+			if (!seek(m_spillFile, block.fileOffset) || std::fread(block.values.data(), sizeof(T), BLOCK_SIZE, m_spillFile) != BLOCK_SIZE)
+			{
+				std::cerr << "Unable to read back the vertex attributes of the import" << std::endl;
+				std::fill(block.values.begin(), block.values.end(), T());
+			}
+			++m_residentBlocks;
+			evict();
+		}
+
+	private:
+		std::vector<Block> m_blocks;
+		std::size_t m_size = 0;
+		std::size_t m_residentBlocks = 0;
+		const std::size_t m_maxResidentBlocks;
+		uint64_t m_clock = 0;
+
+		FILE* m_spillFile = nullptr;
+		long long m_spillSize = 0;
+		bool m_spillFailed = false;
+	};
+
+	// Building a part uses the triangle soup, then the uploaded layout: positions, uvs, normals and an index,
+	// then the simplification and the indices of its levels (less than one more index per vertex).
+	// The meshlets are built after the simplification and need less than it.
+	constexpr std::size_t BYTES_PER_PART_VERTEX = sizeof(OBJLoader::Vertex) + 8 * sizeof(float) + 2 * sizeof(uint32_t)
+		+ MeshSimplifier::SCRATCH_BYTES_PER_VERTEX;
+
+	std::size_t partBytes(const StreamingObjImporter::MeshPart& part)
+	{
+		return part.vertexData.capacity() * sizeof(float) + (part.indices.capacity() + part.lods.indices.capacity()) * sizeof(uint32_t)
+			+ part.meshlets.capacity() * sizeof(Meshlets::Meshlet);
+	}
+
+	std::string extractPath(const std::string& filepathname)
+	{
+		std::size_t pos = filepathname.find_last_of("/\\");
+
+		if (pos == std::string::npos)
+			return std::string(".");
+
+		return filepathname.substr(0, pos);
+	}
+}
+
+MeshCache::MeshView StreamingObjImporter::MeshPart::view() const
+{
+	MeshCache::MeshView meshView;
+	meshView.name = name;
+	meshView.vertexData = vertexData.data();
+	meshView.vertexDataSize = vertexData.size() * sizeof(float);
+	meshView.vertexCount = vertexCount;
+	meshView.indices = indices.data();
+	meshView.indexCount = indices.size();
+	meshView.lodIndices = lods.indices.data();
+	meshView.lodIndexCount = lods.indices.size();
+	meshView.lods = lods.levels;
+	meshView.meshlets = meshlets.data();
+	meshView.meshletCount = meshlets.size();
+	meshView.boundsMin = boundsMin;
+	meshView.boundsMax = boundsMax;
+	return meshView;
+}
+
+StreamingObjImporter::~StreamingObjImporter()
+{
+	cancel();
+}
+
+bool StreamingObjImporter::start(const std::string& path, std::size_t memoryBudget)
+{
+	if (m_running)
+	{
+		return false;
+	}
+	if (m_worker.joinable())
+	{
+		m_worker.join();
+	}
+
+	// Shares of the budget: 1/16 to read the file, 1/8 per part being built or waiting for the GPU,
+	// what is left to the vertex attributes
+	memoryBudget = std::max(memoryBudget, MIN_MEMORY_BUDGET);
+	m_windowSize = std::min<std::size_t>(std::max<std::size_t>(memoryBudget / 16, 1u << 20), 64u << 20);
+	m_partVertexLimit = (memoryBudget / 8) / BYTES_PER_PART_VERTEX / 3 * 3;
+	m_attributeBudget = memoryBudget - m_windowSize - (queuedParts + 1) * (memoryBudget / 8);
+
+	m_parts = std::make_unique<BoundedQueue<MeshPart>>(queuedParts);
+	m_cancel = false;
+	m_failed = false;
+	m_bytesRead = 0;
+	m_totalBytes = 0;
+	m_triangleCount = 0;
+	m_partCount = 0;
+	m_memoryInUse = 0;
+	m_queuedBytes = 0;
+
+	m_running = true;
+	m_worker = std::thread(&StreamingObjImporter::importLoop, this, path);
+	return true;
+}
+
+void StreamingObjImporter::cancel()
+{
+	if (!m_worker.joinable())
+	{
+		return;
+	}
+
+	m_cancel = true;
+
+	// The worker may be waiting for room in the queue
+	MeshPart part;
+	while (m_running)
+	{
+		while (m_parts->tryPop(part))
+		{
+		}
+		std::this_thread::yield();
+	}
+	m_worker.join();
+
+	while (m_parts->tryPop(part))
+	{
+	}
+	m_queuedBytes = 0;
+}
+
+bool StreamingObjImporter::popPart(MeshPart& outPart)
+{
+	if (m_parts == nullptr || !m_parts->tryPop(outPart))
+	{
+		return false;
+	}
+	m_queuedBytes -= partBytes(outPart);
+	return true;
+}
+
+StreamingObjImporter::Progress StreamingObjImporter::progress() const
+{
+	Progress progress;
+	progress.bytesRead = m_bytesRead;
+	progress.totalBytes = m_totalBytes;
+	progress.triangleCount = m_triangleCount;
+	progress.partCount = m_partCount;
+	progress.memoryInUse = m_memoryInUse + m_queuedBytes;
+	progress.running = m_running;
+	progress.failed = m_failed;
+	return progress;
+}
+
+void StreamingObjImporter::importLoop(std::string path)
+{
+	FILE* file = std::fopen(path.c_str(), "rb");
+	if (file == nullptr)
+	{
+		std::cout << "Error: Failed to open file " << path << " for reading!" << std::endl;
+		m_failed = true;
+		m_running = false;
+		return;
+	}
+
+	std::error_code error;
+	m_totalBytes = static_cast<std::size_t>(std::filesystem::file_size(path, error));
+
+	// Same proportions as the attributes of a vertex: 12 bytes of position, 12 of normal, 8 of uv
+	SpilledArray<Point3D> positions(m_attributeBudget / 32 * 12);
+	SpilledArray<Point3D> normals(m_attributeBudget / 32 * 12);
+	SpilledArray<Point2D> uvs(m_attributeBudget / 32 * 8);
+	positions.push_back(Point3D());
+	normals.push_back(Point3D());
+	uvs.push_back(Point2D());
+
+	// Same default material as OBJLoader::Loader
+	std::vector<OBJLoader::Material> materials(1);
+	OBJLoader::Material& defaultMat = materials.front();
+	std::fill(defaultMat.Ka, defaultMat.Ka + 4, 1.0f);
+	std::fill(defaultMat.Ke, defaultMat.Ke + 3, 0.0f);
+	defaultMat.Ke[3] = 1.0f;
+	std::fill(defaultMat.Kd, defaultMat.Kd + 4, 1.0f);
+	std::fill(defaultMat.Ks, defaultMat.Ks + 4, 1.0f);
+	defaultMat.Kn = 128;
+	defaultMat.name = "(Default)";
+
+	const std::string directory = extractPath(path);
+	unsigned int currentMaterial = 0;
+	std::string currentGroup;
+
+	std::vector<OBJLoader::Vertex> soup;
+	soup.reserve(m_partVertexLimit);
+	std::vector<FaceCorner> corners;
+
+	auto updateMemory = [&]()
+	{
+		m_memoryInUse = m_windowSize + soup.capacity() * sizeof(OBJLoader::Vertex)
+			+ positions.residentBytes() + normals.residentBytes() + uvs.residentBytes();
+	};
+
+	auto makeVertex = [&](const FaceCorner& corner)
+	{
+		// Indices out of the lists use the default values, like OBJLoader::Loader
+		const Point3D position = positions.at(corner.vertex < positions.size() ? corner.vertex : 0);
+		const Point3D normal = normals.at(corner.normal < normals.size() ? corner.normal : 0);
+		const Point2D uv = uvs.at(corner.uv < uvs.size() ? corner.uv : 0);
+
+		OBJLoader::Vertex v;
+		v.position[0] = position.x;
+		v.position[1] = position.y;
+		v.position[2] = position.z;
+		v.normal[0] = normal.x;
+		v.normal[1] = normal.y;
+		v.normal[2] = normal.z;
+		v.uv[0] = uv.x;
+		v.uv[1] = uv.y;
+		return v;
+	};
+
+	// Hand the triangles gathered so far to the GL thread, waits while the queue is full
+	auto flush = [&]()
+	{
+		if (soup.empty() || m_cancel)
+		{
+			soup.clear();
+			return;
+		}
+
+		MeshPart part;
+		part.name = currentGroup;
+		part.material = materials[currentMaterial];
+		part.vertexCount = soup.size();
+		part.vertexData.resize(8 * soup.size());
+		part.indices.resize(soup.size());
+
+		float* partPositions = part.vertexData.data();
+		float* partUVs = partPositions + 3 * soup.size();
+		float* partNormals = partPositions + 5 * soup.size();
+		glm::vec3 boundsMin(std::numeric_limits<float>::max());
+		glm::vec3 boundsMax(std::numeric_limits<float>::lowest());
+		for (std::size_t i = 0; i < soup.size(); ++i)
+		{
+			std::copy(soup[i].position, soup[i].position + 3, partPositions + 3 * i);
+			std::copy(soup[i].uv, soup[i].uv + 2, partUVs + 2 * i);
+			std::copy(soup[i].normal, soup[i].normal + 3, partNormals + 3 * i);
+			part.indices[i] = static_cast<uint32_t>(i);
+
+			const glm::vec3 position(soup[i].position[0], soup[i].position[1], soup[i].position[2]);
+			boundsMin = glm::min(boundsMin, position);
+			boundsMax = glm::max(boundsMax, position);
+		}
+		part.boundsMin = boundsMin;
+		part.boundsMax = boundsMax;
+
+		soup.clear();
+
+		MeshSimplifier::VertexInput input;
+		input.positions = { reinterpret_cast<const unsigned char*>(partPositions), sizeof(float) * 3, sizeof(float) * 3 };
+		input.attributes[0] = { reinterpret_cast<const unsigned char*>(partNormals), sizeof(float) * 3, sizeof(float) * 3 };
+		input.attributes[1] = { reinterpret_cast<const unsigned char*>(partUVs), sizeof(float) * 2, sizeof(float) * 2 };
+		input.vertexCount = part.vertexCount;
+		part.lods = MeshSimplifier::buildLodChain(input, part.indices.data(), part.indices.size());
+
+		auto meshletSet = Meshlets::build(input.positions, input.vertexCount, part.indices.data(), part.indices.size());
+		if (!meshletSet.meshlets.empty())
+		{
+			part.indices.swap(meshletSet.indices);
+			part.meshlets = std::move(meshletSet.meshlets);
+		}
+
+		m_triangleCount += part.vertexCount / 3;
+		m_partCount += 1;
+
+		m_queuedBytes += partBytes(part);
+		updateMemory();
+		m_parts->push(std::move(part));
+	};
+
+	auto parseLine = [&](const char* line, const char* lineEnd)
+	{
+		const std::size_t length = static_cast<std::size_t>(lineEnd - line);
+		const char first = length > 0 ? line[0] : '\0';
+		const char second = length > 1 ? line[1] : '\0';
+
+		if (first == 'v' && (second == ' ' || second == 'n' || second == 't'))
+		{
+			const char* it = line + std::min<std::size_t>(length, second == ' ' ? 2 : 3);
+			if (second == 't')
+			{
+				Point2D uv;
+				parseFloat(it, lineEnd, uv.x) && parseFloat(it, lineEnd, uv.y);
+				uvs.push_back(uv);
+			}
+			else
+			{
+				Point3D v;
+				parseFloat(it, lineEnd, v.x) && parseFloat(it, lineEnd, v.y) && parseFloat(it, lineEnd, v.z);
+				(second == ' ' ? positions : normals).push_back(v);
+			}
+		}
+		else if (first == 'u')
+		{
+			// The faces before keep the previous material
+			flush();
+			currentMaterial = 0;
+			const std::string name = secondWord(line, lineEnd);
+			for (unsigned int i = 0; i < materials.size(); ++i)
+			{
+				if (materials[i].name == name)
+				{
+					currentMaterial = i;
+					break;
+				}
+			}
+		}
+		else if (first == 'g')
+		{
+			// The previous group is complete, as far as this import is concerned
+			flush();
+			currentGroup = secondWord(line, lineEnd);
+		}
+		else if (first == 'm')
+		{
+			OBJLoader::loadMaterialFile(directory + "/" + secondWord(line, lineEnd), materials);
+		}
+		else if (first == 'f' && length >= 2)
+		{
+			corners.clear();
+			for (const char* it = line + 2; it < lineEnd; )
+			{
+				const char* cornerEnd = std::find(it, lineEnd, ' ');
+				corners.push_back(parseCorner(it, cornerEnd));
+				it = cornerEnd == lineEnd ? lineEnd : cornerEnd + 1;
+			}
+			if (corners.size() < 3)
+				return;
+
+			if (soup.size() + 3 * (corners.size() - 2) > m_partVertexLimit)
+			{
+				flush();
+			}
+
+			// Triangle fan, like OBJLoader::Loader
+			for (unsigned int i = 0; i < 3; ++i)
+			{
+				soup.push_back(makeVertex(corners[i]));
+			}
+			for (std::size_t i = 3; i < corners.size(); ++i)
+			{
+				soup.push_back(makeVertex(corners[0]));
+				soup.push_back(makeVertex(corners[i - 1]));
+				soup.push_back(makeVertex(corners[i]));
+			}
+		}
+	};
+
+	// Read the file one window at a time, the incomplete line at the end is moved to the start of the next one
+	std::vector<char> window(m_windowSize);
+	std::size_t carried = 0;
+	while (!m_cancel)
+	{
+		const std::size_t read = std::fread(window.data() + carried, 1, window.size() - carried, file);
+		const bool endOfFile = read < window.size() - carried;
+		const std::size_t available = carried + read;
+		if (available == 0)
+			break;
+
+		const char* begin = window.data();
+		const char* end = begin + available;
+		const char* processEnd = end;
+		if (!endOfFile)
+		{
+			const char* lastLineEnd = end;
+			while (lastLineEnd != begin && *(lastLineEnd - 1) != '\n')
+				--lastLineEnd;
+
+			// A line longer than the whole window is cut in two
+			if (lastLineEnd != begin)
+				processEnd = lastLineEnd;
+		}
+
+		for (const char* line = begin; line < processEnd && !m_cancel; )
+		{
+			const char* lineEnd = std::find(line, processEnd, '\n');
+			parseLine(line, lineEnd);
+			line = lineEnd == processEnd ? lineEnd : lineEnd + 1;
+		}
+
+		carried = static_cast<std::size_t>(end - processEnd);
+		std::memmove(window.data(), processEnd, carried);
+		m_bytesRead += static_cast<std::size_t>(processEnd - begin);
+		updateMemory();
+
+		if (endOfFile && carried == 0)
+			break;
+	}
+
+	flush();
+
+	if (std::ferror(file))
+	{
+		std::cout << "Error: Failed to read " << path << std::endl;
+		m_failed = true;
+	}
+	std::fclose(file);
+
+	if (!m_cancel)
+	{
+		std::cout << "Streamed " << path << ": " << m_triangleCount << " triangles in " << m_partCount << " parts" << std::endl;
+	}
+	m_running = false;
+}
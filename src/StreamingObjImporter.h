@@ -0,0 +1,118 @@
+#pragma once
+#ifndef STREAMINGOBJIMPORTER_H
+#define STREAMINGOBJIMPORTER_H
+
+/**
+ * @file StreamingObjImporter.h
+ *
+ * @brief Imports an OBJ file of any size within a memory budget, handing out finished groups as it goes.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include <glm/vec3.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BoundedQueue.h"
+#include "MeshCache.h"
+#include "Meshlets.h"
+#include "MeshSimplifier.h"
+#include "OBJLoader.h"
+
+class StreamingObjImporter
+{
+public:
+	/**
+	 * Triangles of a group ready to be uploaded, laid out like a mesh of the cache, with their levels of detail and meshlets.
+	 * A group larger than the budget allows is handed out in several parts with the same name.
+	 */
+	struct MeshPart
+	{
+		std::string name;
+		OBJLoader::Material material;
+		std::vector<float> vertexData;
+		std::vector<uint32_t> indices;
+		MeshSimplifier::LodChain lods;
+		std::vector<Meshlets::Meshlet> meshlets;
+		std::size_t vertexCount = 0;
+		glm::vec3 boundsMin = glm::vec3(0.0f);
+		glm::vec3 boundsMax = glm::vec3(0.0f);
+
+		MeshCache::MeshView view() const;
+	};
+
+	struct Progress
+	{
+		std::size_t bytesRead = 0;
+		std::size_t totalBytes = 0;
+		std::size_t triangleCount = 0;
+		std::size_t partCount = 0;
+		std::size_t memoryInUse = 0;
+		bool running = false;
+		bool failed = false;
+	};
+
+	static constexpr std::size_t MIN_MEMORY_BUDGET = 64u << 20;
+
+	StreamingObjImporter() = default;
+	~StreamingObjImporter();
+
+	StreamingObjImporter(const StreamingObjImporter&) = delete;
+	StreamingObjImporter& operator=(const StreamingObjImporter&) = delete;
+
+	/**
+	 * Start importing on a worker thread. memoryBudget bounds what the import holds at once:
+	 * the read window, the triangles waiting for the GPU and the vertex attributes
+	 * (the oldest ones are spilled to a temporary file past their share).
+	 */
+	bool start(const std::string& path, std::size_t memoryBudget);
+
+	/**
+	 * Stop the import and drop the parts not taken yet.
+	 */
+	void cancel();
+
+	/**
+	 * Take the next finished part, without waiting. To be called from the GL thread.
+	 */
+	bool popPart(MeshPart& outPart);
+
+	Progress progress() const;
+	inline bool isRunning() const { return m_running.load(); }
+
+private:
+	void importLoop(std::string path);
+
+private:
+	std::thread m_worker;
+	std::unique_ptr<BoundedQueue<MeshPart>> m_parts;
+
+	// Budget shares, computed by start()
+	std::size_t m_windowSize = 0;
+	std::size_t m_partVertexLimit = 0;
+	std::size_t m_attributeBudget = 0;
+
+	std::atomic<bool> m_running{ false };
+	std::atomic<bool> m_cancel{ false };
+	std::atomic<bool> m_failed{ false };
+	std::atomic<std::size_t> m_bytesRead{ 0 };
+	std::atomic<std::size_t> m_totalBytes{ 0 };
+	std::atomic<std::size_t> m_triangleCount{ 0 };
+	std::atomic<std::size_t> m_partCount{ 0 };
+	std::atomic<std::size_t> m_memoryInUse{ 0 };
+	std::atomic<std::size_t> m_queuedBytes{ 0 };
+
+	// Parts waiting in the queue, on top of the one being filled
+	const std::size_t queuedParts = 2;
+};
+
+#endif
@@ -0,0 +1,169 @@
+/**
+ * @file TextureLoader.cpp
+ *
+ * @brief Decodes images on the thread pool and uploads them on the GL thread as they arrive.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include "TextureLoader.h"
+
+#include <stb_image.h>
+#include <GLFW/glfw3.h>
+
+#include <iostream>
+
+#include "AssetPack.h"
+#include "ThreadPool.h"
+
+// GL_EXT_texture_compression_s3tc is not part of the core profile exposed by glad
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+TextureLoader::TextureLoader(std::size_t maxDecodedImages)
+	: m_decodedImages(maxDecodedImages), m_s3tcSupported(glfwExtensionSupported("GL_EXT_texture_compression_s3tc"))
+{
+}
+
+TextureLoader::~TextureLoader()
+{
+	// The decoding tasks reference the queue, wait for all of them before it goes away
+	for (; m_received < m_requests.size(); ++m_received)
+	{
+		stbi_image_free(m_decodedImages.pop().data);
+	}
+}
+
+void TextureLoader::add(const std::string& path, unsigned int& textureID, GLint uvMode, GLint minMode, GLint magMode, int channels)
+{
+	glGenTextures(1, &textureID);
+
+	const std::size_t requestIndex = m_requests.size();
+	m_requests.push_back({ path, textureID, uvMode, minMode, magMode, channels });
+
+	const std::string fileName = path.substr(path.find_last_of("/\\") + 1);
+	const std::string cookedPath = cookedDirectory + CookedTexture::cookedFileName(fileName);
+	const bool allowS3TC = m_s3tcSupported;
+	ThreadPool::instance().enqueue([this, requestIndex, path, cookedPath, channels, allowS3TC]()
+		{
+			DecodedImage image;
+			image.request = requestIndex;
+			image.isCooked = readCooked(cookedPath, image.cooked)
+				&& (allowS3TC || image.cooked.format == CookedTexture::Format::BC5);
+
+			m_decodedImages.push(image.isCooked ? std::move(image) : decode(requestIndex, path, channels));
+		});
+}
+
+bool TextureLoader::uploadAll()
+{
+	bool success = true;
+	for (; m_received < m_requests.size(); ++m_received)
+	{
+		const DecodedImage image = m_decodedImages.pop();
+		const Request& request = m_requests[image.request];
+
+		if (image.isCooked)
+		{
+			uploadCooked(request, image);
+			std::cout << "Cooked texture loaded for path: " << request.path << std::endl;
+		}
+		else if (image.data)
+		{
+			upload(request, image);
+			std::cout << "Texture loaded at path: " << request.path << std::endl;
+		}
+		else
+		{
+			std::cout << "Texture failed to load at path: " << request.path << std::endl;
+			success = false;
+		}
+
+		stbi_image_free(image.data);
+	}
+
+	return success;
+}
+
+TextureLoader::DecodedImage TextureLoader::decode(std::size_t requestIndex, const std::string& path, int channels)
+{
+	// Ask the library to flip the image vertically
+	// This is necessary as TexImage2D assume "The first element corresponds to the lower left corner of the texture image"
+	// whereas stb_image load the image such "the first pixel pointed to is top-left-most in the image"
+	// The flag is per thread: the global stbi_set_flip_vertically_on_load is not safe to use from the workers
+	stbi_set_flip_vertically_on_load_thread(true);
+
+	DecodedImage image;
+	image.request = requestIndex;
+
+	int fileChannels;
+	AssetPack::Span span;
+	if (AssetPack::findMounted(path, span))
+	{
+		image.data = stbi_load_from_memory(span.bytes(), static_cast<int>(span.size), &image.width, &image.height, &fileChannels, channels);
+	}
+	else
+	{
+		image.data = stbi_load(path.c_str(), &image.width, &image.height, &fileChannels, channels);
+	}
+	return image;
+}
+
+bool TextureLoader::readCooked(const std::string& cookedPath, CookedTexture::Texture& outTexture)
+{
+	// From the pack the levels point straight in the mapped file
+	AssetPack::Span span;
+	if (AssetPack::findMounted(cookedPath, span))
+	{
+		return CookedTexture::parse(span.bytes(), span.size, outTexture, AssetPack::assetName(cookedPath));
+	}
+	return CookedTexture::read(cookedPath, outTexture);
+}
+
+void TextureLoader::upload(const Request& request, const DecodedImage& image) const
+{
+	const GLenum format = request.channels == 3 ? GL_RGB : GL_RGBA;
+
+	glBindTexture(GL_TEXTURE_2D, request.textureID);
+	glTexImage2D(GL_TEXTURE_2D, 0, static_cast<GLint>(format), image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.data);
+	if (request.minMode == GL_LINEAR_MIPMAP_LINEAR) {
+		glGenerateMipmap(GL_TEXTURE_2D);
+	}
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, request.uvMode);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, request.uvMode);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, request.minMode);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, request.magMode);
+}
+
+void TextureLoader::uploadCooked(const Request& request, const DecodedImage& image) const
+{
+	const GLenum internalFormat = image.cooked.format == CookedTexture::Format::BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+		: image.cooked.format == CookedTexture::Format::BC3 ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+		: GL_COMPRESSED_RG_RGTC2;
+
+	glBindTexture(GL_TEXTURE_2D, request.textureID);
+
+	// The mip chain was filtered offline, only use as many levels as the sampling mode needs
+	const bool useMips = request.minMode == GL_LINEAR_MIPMAP_LINEAR;
+	const auto levelCount = useMips ? image.cooked.mipLevels.size() : 1;
+	for (std::size_t level = 0; level < levelCount; ++level)
+	{
+		const auto& mipLevel = image.cooked.mipLevels[level];
+		glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), internalFormat,
+			static_cast<GLsizei>(mipLevel.width), static_cast<GLsizei>(mipLevel.height), 0,
+			static_cast<GLsizei>(mipLevel.byteSize), mipLevel.blocks);
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(levelCount) - 1);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, request.uvMode);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, request.uvMode);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, request.minMode);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, request.magMode);
+}
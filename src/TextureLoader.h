@@ -0,0 +1,86 @@
+#pragma once
+#ifndef TEXTURELOADER_H
+#define TEXTURELOADER_H
+
+/**
+ * @file TextureLoader.h
+ *
+ * @brief Decodes images on the thread pool and uploads them on the GL thread as they arrive.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "BoundedQueue.h"
+#include "CookedTexture.h"
+
+class TextureLoader
+{
+public:
+	/**
+	 * maxDecodedImages bounds how many decoded images can wait for their upload (a 2048x2048 RGBA image is 16 MB).
+	 */
+	explicit TextureLoader(std::size_t maxDecodedImages = 4);
+	~TextureLoader();
+
+	TextureLoader(const TextureLoader&) = delete;
+	TextureLoader& operator=(const TextureLoader&) = delete;
+
+	/**
+	 * Generate the texture name and start decoding the image right away.
+	 * channels is the number of components to decode to (3 for GL_RGB, 4 for GL_RGBA).
+	 * When the TextureCooker tool produced a block-compressed version of the image in
+	 * COOKED_ASSETS_DIR, it is uploaded with its precomputed mips instead.
+	 * Both are read from the mounted asset pack when they are in it.
+	 */
+	void add(const std::string& path, unsigned int& textureID, GLint uvMode, GLint minMode, GLint magMode, int channels = 4);
+
+	/**
+	 * Upload every added texture, in the order their decoding finishes. Must be called from the GL thread.
+	 * Returns false if one of the images could not be decoded.
+	 */
+	bool uploadAll();
+
+private:
+	struct Request
+	{
+		std::string path;
+		unsigned int textureID;
+		GLint uvMode;
+		GLint minMode;
+		GLint magMode;
+		int channels;
+	};
+
+	struct DecodedImage
+	{
+		std::size_t request = 0;
+		unsigned char* data = nullptr;
+		int width = 0;
+		int height = 0;
+		bool isCooked = false;
+		CookedTexture::Texture cooked;
+	};
+
+	static DecodedImage decode(std::size_t requestIndex, const std::string& path, int channels);
+	static bool readCooked(const std::string& cookedPath, CookedTexture::Texture& outTexture);
+	void upload(const Request& request, const DecodedImage& image) const;
+	void uploadCooked(const Request& request, const DecodedImage& image) const;
+
+private:
+	std::vector<Request> m_requests;
+	BoundedQueue<DecodedImage> m_decodedImages;
+	std::size_t m_received = 0;
+	bool m_s3tcSupported = false;
+
+	const std::string cookedDirectory = COOKED_ASSETS_DIR;
+};
+
+#endif
@@ -13,6 +13,8 @@
 #include <glad/glad.h>
 #include <iostream>
 
+#include "ClusteredLighting.h"
+
 void TextureMaterial::bind() const
 {
 	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
@@ -66,6 +68,19 @@ void TextureMaterial::setSpecular(const float specular) const
     m_shaderProgram->setFloat(uSpecularAttributeName, specular);
 }
 
+void TextureMaterial::setLightClusters(const LightClusters& lightClusters) const
+{
+	// A grid without cells turns the point lights off
+	const glm::ivec3 clusterCount = lightClusters.active()
+		? glm::ivec3(LightClusters::TILES_X, LightClusters::TILES_Y, LightClusters::SLICES)
+		: glm::ivec3(0);
+	m_shaderProgram->setIVec3(uClusterCountAttributeName, clusterCount);
+	m_shaderProgram->setVec2(uClusterTileSizeAttributeName, lightClusters.tileSize());
+	m_shaderProgram->setFloat(uClusterDepthScaleAttributeName, lightClusters.depthScale());
+	m_shaderProgram->setFloat(uClusterDepthBiasAttributeName, lightClusters.depthBias());
+	m_shaderProgram->setBool(uShowLightCountAttributeName, lightClusters.active() && LightClusters::settings().showLightCount);
+}
+
 void TextureMaterial::setAppearance(const glm::vec4& ambiantColor, const glm::vec4& diffuseColor, const glm::vec4& specularColor, float specularTerm) const
 {
 	m_shaderProgram->setVec4(uKaAttributeName, ambiantColor);
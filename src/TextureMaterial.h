@@ -14,6 +14,8 @@
 
 #include "Material.h"
 
+class LightClusters;
+
 class TextureMaterial : public Material {
 public:
 
@@ -29,6 +31,11 @@ public:
 	void setDirectionalLightIntensity(float) const;
 	void setSpecular(float specular) const;
 
+	/**
+	 * Cell grid of the point lights for this frame, the material has to be bound.
+	 */
+	void setLightClusters(const LightClusters& lightClusters) const;
+
 	void setAppearance(const glm::vec4& ambiantColor, const glm::vec4& diffuseColor, const glm::vec4& specularColor, float specularTerm) const override;
 	void setTexture(unsigned int textureId) const override;
 	void setNormalsTexture(unsigned int textureId) const override;
@@ -61,6 +68,12 @@ private:
     const std::string uDirectionalLightIntensityAttributeName = "uDLightIntensity";
 	const std::string uSpecularAttributeName = "uSpecular";
 
+	const std::string uClusterCountAttributeName = "uClusterCount";
+	const std::string uClusterTileSizeAttributeName = "uClusterTileSize";
+	const std::string uClusterDepthScaleAttributeName = "uClusterDepthScale";
+	const std::string uClusterDepthBiasAttributeName = "uClusterDepthBias";
+	const std::string uShowLightCountAttributeName = "uShowLightCount";
+
 	const std::string uTexAttributeName = "uTex";
 	const std::string uNormalsTexAttributeName = "uNormalsTex";
 
@@ -0,0 +1,129 @@
+/**
+ * @file ThreadPool.cpp
+ *
+ * @brief Fixed set of worker threads shared by the loaders and the per-frame jobs.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+{
+	threadCount = std::max(threadCount, 1u);
+	m_threads.reserve(threadCount);
+	for (unsigned int i = 0; i < threadCount; ++i)
+	{
+		m_threads.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_taskAvailable.notify_all();
+
+	for (auto& thread : m_threads)
+	{
+		thread.join();
+	}
+}
+
+ThreadPool& ThreadPool::instance()
+{
+	static ThreadPool threadPool;
+	return threadPool;
+}
+
+unsigned int ThreadPool::defaultThreadCount()
+{
+	const unsigned int hardwareThreads = std::thread::hardware_concurrency();
+	return hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+}
+
+void ThreadPool::enqueue(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_tasks.push_back(std::move(task));
+	}
+	m_taskAvailable.notify_one();
+}
+
+void ThreadPool::parallelFor(std::size_t count, std::size_t grainSize, const std::function<void(std::size_t, std::size_t)>& body)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	grainSize = std::max<std::size_t>(grainSize, 1);
+	const std::size_t rangeCount = (count + grainSize - 1) / grainSize;
+	if (rangeCount == 1)
+	{
+		body(0, count);
+		return;
+	}
+
+	struct Ranges
+	{
+		std::atomic<std::size_t> next{ 0 };
+		std::atomic<std::size_t> done{ 0 };
+	};
+	auto ranges = std::make_shared<Ranges>();
+
+	auto runRanges = [ranges, count, grainSize, rangeCount, &body]()
+	{
+		std::size_t range;
+		while ((range = ranges->next.fetch_add(1)) < rangeCount)
+		{
+			const std::size_t begin = range * grainSize;
+			body(begin, std::min(begin + grainSize, count));
+			ranges->done.fetch_add(1, std::memory_order_release);
+		}
+	};
+
+	const std::size_t helperCount = std::min<std::size_t>(rangeCount - 1, m_threads.size());
+	for (std::size_t i = 0; i < helperCount; ++i)
+	{
+		enqueue(runRanges);
+	}
+
+	runRanges();
+
+	// The helpers that have not started yet will find no range left, only wait for those still running
+	while (ranges->done.load(std::memory_order_acquire) < rangeCount)
+	{
+		std::this_thread::yield();
+	}
+}
+
+void ThreadPool::workerLoop()
+{
+	while (true)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_taskAvailable.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+			if (m_stop && m_tasks.empty())
+			{
+				return;
+			}
+
+			task = std::move(m_tasks.front());
+			m_tasks.pop_front();
+		}
+
+		task();
+	}
+}
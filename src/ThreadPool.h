@@ -0,0 +1,59 @@
+#pragma once
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+/**
+ * @file ThreadPool.h
+ *
+ * @brief Fixed set of worker threads shared by the loaders and the per-frame jobs.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+	explicit ThreadPool(unsigned int threadCount = defaultThreadCount());
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/**
+	 * Pool shared by the whole application, sized to leave one core to the thread owning the GL context.
+	 */
+	static ThreadPool& instance();
+	static unsigned int defaultThreadCount();
+
+	inline unsigned int threadCount() const { return static_cast<unsigned int>(m_threads.size()); }
+
+	void enqueue(std::function<void()> task);
+
+	/**
+	 * Split [0, count) in ranges of at most grainSize elements and run body(begin, end) on them.
+	 * The calling thread works on the ranges as well and returns once all of them are done.
+	 */
+	void parallelFor(std::size_t count, std::size_t grainSize, const std::function<void(std::size_t, std::size_t)>& body);
+
+private:
+	void workerLoop();
+
+private:
+	std::vector<std::thread> m_threads;
+	std::deque<std::function<void()>> m_tasks;
+	std::mutex m_mutex;
+	std::condition_variable m_taskAvailable;
+	bool m_stop = false;
+};
+
+#endif
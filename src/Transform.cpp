@@ -10,65 +10,72 @@
 
 #include "Transform.h"
 
-#include <glm/ext/matrix_transform.hpp>
 #include <glm/gtx/euler_angles.hpp>
 
-#include "SceneObject.h"
-#include "ExtraOperators.h"
+#include <cmath>
 
-Transform::Transform(SceneObject& sceneObject, bool dirty)
-	: m_translation(0.0f), m_rotation(0.0f), m_scale(1.0f), m_sceneObject(sceneObject)
-{ }
+#include "ExtraOperators.h"
 
-Transform& Transform::operator=(const Transform& b)
+namespace
 {
-	m_translation = b.translation();
-	m_rotation = b.rotation();
-	m_scale = b.scale();
-
-	return *this;
+	constexpr float ORIENTATION_EPSILON = 1e-6f;
 }
 
-Transform Transform::operator+(const Transform& b)
+Transform Transform::fromMatrix(const glm::mat4& matrix)
 {
-	Transform sum(m_sceneObject); //TODO FIX HACK/ TERRIBLE DESIGN SORRY
+	Transform transform;
+	transform.m_translation = glm::vec3(matrix[3]);
 
-	sum.translation() = m_translation + b.translation();
-	sum.rotation() = m_rotation + b.rotation();
-	sum.scale() = m_scale;
+	const glm::mat3 linear(matrix);
+	transform.m_scale = glm::vec3(glm::length(linear[0]), glm::length(linear[1]), glm::length(linear[2]));
+	if (glm::determinant(linear) < 0.0f)
+	{
+		transform.m_scale.x = -transform.m_scale.x;
+	}
 
-	return sum;
+	// A null scale leaves nothing of the rotation on its axis
+	glm::mat3 rotation(1.0f);
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		if (transform.m_scale[axis] != 0.0f)
+			rotation[axis] = linear[axis] / transform.m_scale[axis];
+	}
+	transform.m_orientation = glm::normalize(glm::quat_cast(rotation));
+	return transform;
 }
 
-Transform Transform::operator-(const Transform& b)
+glm::vec3 Transform::rotation() const
 {
-	Transform substraction(m_sceneObject); //TODO FIX HACK / TERRIBLE DESIGN SORRY
-
-	substraction.translation() = m_translation - b.translation();
-	substraction.rotation() = m_rotation - b.rotation();
-	substraction.scale() = m_scale;
+	glm::vec3 angles;
+	glm::extractEulerAngleXYZ(glm::mat4_cast(m_orientation), angles.x, angles.y, angles.z);
+	return glm::degrees(angles);
+}
 
-	return substraction;
+void Transform::rotation(const glm::vec3& newRotation)
+{
+	const glm::vec3 angles = glm::radians(newRotation);
+	m_orientation = glm::normalize(glm::quat_cast(glm::eulerAngleXYZ(angles.x, angles.y, angles.z)));
 }
 
-bool Transform::operator==(const Transform& b)
+bool Transform::operator==(const Transform& b) const
 {
-	return ((this->translation() == b.translation())
-		&& (this->rotation() == b.rotation())
-		&& (this->scale() == b.scale()));
+	// q and -q are the same rotation
+	return m_translation == b.translation()
+		&& std::abs(glm::dot(m_orientation, b.orientation())) > 1.0f - ORIENTATION_EPSILON
+		&& m_scale == b.scale();
 }
 
-bool Transform::operator!=(const Transform& b)
+bool Transform::operator!=(const Transform& b) const
 {
-	return ((this->translation() != b.translation())
-		|| (this->rotation() != b.rotation())
-		|| (this->scale() != b.scale()));
+	return !(*this == b);
 }
 
-void Transform::computeModelMatrix(glm::mat4& outModelMatrix)
+void Transform::computeModelMatrix(glm::mat4& outModelMatrix) const
 {
-	outModelMatrix = glm::mat4(1.0f);
-	outModelMatrix = glm::translate(outModelMatrix, m_translation);
-	outModelMatrix = outModelMatrix * glm::eulerAngleXYZ(glm::radians(m_rotation.x), glm::radians(m_rotation.y), glm::radians(m_rotation.z));
-	outModelMatrix = glm::scale(outModelMatrix, m_scale);
+	// Translation, rotation then scale, without the general matrix products
+	const glm::mat3 rotation = glm::mat3_cast(m_orientation);
+	outModelMatrix[0] = glm::vec4(rotation[0] * m_scale.x, 0.0f);
+	outModelMatrix[1] = glm::vec4(rotation[1] * m_scale.y, 0.0f);
+	outModelMatrix[2] = glm::vec4(rotation[2] * m_scale.z, 0.0f);
+	outModelMatrix[3] = glm::vec4(m_translation, 1.0f);
 }
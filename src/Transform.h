@@ -13,44 +13,45 @@
  */
 
 #include <glm/glm.hpp>
-
-class SceneObject;
+#include <glm/gtc/quaternion.hpp>
 
 class Transform
 {
 public:
-	Transform(SceneObject& sceneObject, bool dirty = false);
-	Transform() = delete;
+	Transform() = default;
 
-	inline SceneObject& sceneObject() const { return m_sceneObject; }
+	/**
+	 * Translation, orientation and scale of an affine matrix. A mirror is kept as a negative scale on x, a shear is lost.
+	 */
+	static Transform fromMatrix(const glm::mat4& matrix);
 
 	inline glm::vec3& translation() { return m_translation; }
-	inline glm::vec3& rotation() { return m_rotation; }
 	inline glm::vec3& scale() { return m_scale; }
 
 	inline const glm::vec3& translation() const { return m_translation; }
-	inline const glm::vec3& rotation() const { return m_rotation; }
+	inline const glm::quat& orientation() const { return m_orientation; }
 	inline const glm::vec3& scale() const { return m_scale; }
 
+	/**
+	 * Euler angles in degrees, applied as glm::eulerAngleXYZ. Taken from the orientation: the same rotation as the
+	 * angles last set, not always the same angles.
+	 */
+	glm::vec3 rotation() const;
+
 	inline void translation(const glm::vec3& newTranslation) { m_translation = newTranslation; }
-	inline void rotation(const glm::vec3& newRotation) { m_rotation = newRotation; }
+	void rotation(const glm::vec3& newRotation);
+	inline void orientation(const glm::quat& newOrientation) { m_orientation = glm::normalize(newOrientation); }
 	inline void scale(const glm::vec3& newScale) { m_scale = newScale; }
 
-	Transform& operator=(const Transform& b);
-	Transform operator+(const Transform& b);
-	Transform operator-(const Transform& b);
-	bool operator==(const Transform& b);
-	bool operator!=(const Transform& b);
-	
+	bool operator==(const Transform& b) const;
+	bool operator!=(const Transform& b) const;
 
-	void computeModelMatrix(glm::mat4& outModelMatrix);
+	void computeModelMatrix(glm::mat4& outModelMatrix) const;
 
 private:
 	glm::vec3 m_translation = glm::vec3(0.0f);
-	glm::vec3 m_rotation = glm::vec3(0.0f);
-	glm::vec3 m_scale = glm::vec3(0.0f);
-
-	SceneObject& m_sceneObject;
+	glm::quat m_orientation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+	glm::vec3 m_scale = glm::vec3(1.0f);
 };
 
 #endif
@@ -0,0 +1,396 @@
+/**
+ * @file TransformHierarchy.cpp
+ *
+ * @brief Local transforms and world matrices of the scene in flat arrays, parents first, updated in one pass before the draws.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include "TransformHierarchy.h"
+
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/gtx/euler_angles.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+
+#include "SceneObject.h"
+#include "ThreadPool.h"
+
+namespace
+{
+	// Stands for a scene object in the benchmark: allocated on its own, children behind pointers, a virtual call per node
+	class RecursiveNode
+	{
+	public:
+		virtual ~RecursiveNode() = default;
+
+		void update(const glm::mat4& parentMatrix)
+		{
+			// As Transform::computeModelMatrix and SceneObject::render
+			glm::mat4 localMatrix = glm::translate(glm::mat4(1.0f), translation);
+			localMatrix = localMatrix * glm::mat4_cast(orientation);
+			localMatrix = glm::scale(localMatrix, scale);
+			modelMatrix = parentMatrix * localMatrix;
+
+			for (const auto child : children)
+			{
+				child->update(modelMatrix);
+			}
+			renderImplementation(modelMatrix);
+		}
+
+		glm::vec3 translation = glm::vec3(0.0f);
+		glm::quat orientation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+		glm::vec3 scale = glm::vec3(1.0f);
+		glm::mat4 modelMatrix = glm::mat4(1.0f);
+		std::vector<RecursiveNode*> children;
+
+	protected:
+		virtual void renderImplementation(const glm::mat4&) {}
+	};
+}
+
+TransformHierarchy::Settings& TransformHierarchy::settings()
+{
+	static Settings settings;
+	return settings;
+}
+
+TransformHierarchy::Statistics& TransformHierarchy::statistics()
+{
+	static Statistics statistics;
+	return statistics;
+}
+
+void TransformHierarchy::update(SceneObject& root)
+{
+	update(root, ThreadPool::instance());
+}
+
+void TransformHierarchy::update(SceneObject& root, ThreadPool& pool)
+{
+	// Even when disabled, so the matrices of the previous updates are not taken as current
+	++s_frame;
+	const auto& hierarchySettings = settings();
+	if (!hierarchySettings.enabled)
+	{
+		return;
+	}
+
+	const std::size_t nodesPerJob = static_cast<std::size_t>(std::max(hierarchySettings.nodesPerJob, 1));
+	if (&root != m_root || SceneObject::structureVersion() != m_structureVersion)
+	{
+		rebuild(root);
+	}
+	if (nodesPerJob != m_nodesPerJob)
+	{
+		m_nodesPerJob = nodesPerJob;
+		partition(m_parents, m_nodesPerJob, m_topNodes, m_jobs);
+	}
+
+	auto& hierarchyStatistics = statistics();
+	const auto startTime = std::chrono::steady_clock::now();
+	if (!hierarchySettings.parallel)
+	{
+		updateRange(0, static_cast<uint32_t>(m_objects.size()));
+		hierarchyStatistics.serialMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+	}
+	else
+	{
+		// The jobs only read the world matrices and the moved flags of the nodes above them
+		for (const uint32_t node : m_topNodes)
+		{
+			updateRange(node, node + 1);
+		}
+		const auto serialTime = std::chrono::steady_clock::now();
+
+		pool.parallelFor(m_jobs.size(), 1, [this](std::size_t begin, std::size_t end)
+		{
+			for (std::size_t job = begin; job < end; ++job)
+				updateRange(m_jobs[job].begin, m_jobs[job].end);
+		});
+
+		hierarchyStatistics.topNodes = m_topNodes.size();
+		hierarchyStatistics.jobs = m_jobs.size();
+		hierarchyStatistics.serialMilliseconds += std::chrono::duration<double, std::milli>(serialTime - startTime).count();
+		hierarchyStatistics.parallelMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - serialTime).count();
+	}
+
+	hierarchyStatistics.nodes = m_objects.size();
+	hierarchyStatistics.movedNodes += static_cast<std::size_t>(std::count(m_moved.begin(), m_moved.end(), uint8_t(1)));
+}
+
+TransformHierarchy::BenchmarkResult TransformHierarchy::benchmark(std::size_t nodeCount, BenchmarkShape shape, int iterations)
+{
+	BenchmarkResult result;
+	result.nodeCount = std::max(nodeCount, std::size_t(1));
+	iterations = std::max(iterations, 1);
+
+	constexpr std::size_t WIDE_CHILDREN = 64;
+	constexpr std::size_t DEEP_CHAIN_LENGTH = 100;
+
+	std::mt19937 generator(1234u);
+	std::uniform_real_distribution<float> position(-10.0f, 10.0f);
+	std::uniform_real_distribution<float> angle(-180.0f, 180.0f);
+	std::uniform_real_distribution<float> scale(0.9f, 1.1f);
+
+	// The same tree twice: as recursive nodes, and as scene objects for update() to gather and scatter
+	std::vector<std::unique_ptr<RecursiveNode>> nodes(result.nodeCount);
+	std::vector<std::unique_ptr<SceneObject>> objects(result.nodeCount);
+	std::vector<std::size_t> depths(result.nodeCount, 0);
+	const auto copyTransform = [&](std::size_t i)
+	{
+		Transform& transform = objects[i]->transform();
+		transform.translation(nodes[i]->translation);
+		transform.orientation(nodes[i]->orientation);
+		transform.scale(nodes[i]->scale);
+		nodes[i]->orientation = transform.orientation();   // Normalized again by the transform
+	};
+
+	for (std::size_t i = 0; i < result.nodeCount; ++i)
+	{
+		nodes[i] = std::make_unique<RecursiveNode>();
+		nodes[i]->translation = glm::vec3(position(generator), position(generator), position(generator));
+		nodes[i]->orientation = glm::quat_cast(glm::eulerAngleXYZ(glm::radians(angle(generator)), glm::radians(angle(generator)), glm::radians(angle(generator))));
+		nodes[i]->scale = glm::vec3(scale(generator));
+
+		if (i == 0)
+		{
+			objects[i] = std::make_unique<SceneObject>();
+			copyTransform(i);
+			continue;
+		}
+
+		std::size_t parent;
+		switch (shape)
+		{
+		case BenchmarkShape::Wide:
+			parent = (i - 1) / WIDE_CHILDREN;
+			break;
+		case BenchmarkShape::Deep:
+			parent = i % DEEP_CHAIN_LENGTH != 0 ? i - 1 : std::uniform_int_distribution<std::size_t>(0, i - 1)(generator);
+			break;
+		default:
+			parent = std::uniform_int_distribution<std::size_t>(0, i - 1)(generator);
+			break;
+		}
+		nodes[parent]->children.push_back(nodes[i].get());
+		objects[i] = std::make_unique<SceneObject>(*objects[parent]);
+		copyTransform(i);
+		depths[i] = depths[parent] + 1;
+		result.maxDepth = std::max(result.maxDepth, depths[i]);
+	}
+
+	// Flattened as rebuild() does, depth first
+	std::vector<const RecursiveNode*> order;
+	std::vector<uint32_t> parents;
+	TransformKernels::TrsStreams trs;
+	order.reserve(result.nodeCount);
+	parents.reserve(result.nodeCount);
+	trs.resize(result.nodeCount);
+
+	std::vector<std::pair<const RecursiveNode*, uint32_t>> stack;
+	stack.emplace_back(nodes.front().get(), NO_PARENT);
+	while (!stack.empty())
+	{
+		const auto [node, parent] = stack.back();
+		stack.pop_back();
+
+		const auto index = static_cast<uint32_t>(order.size());
+		order.push_back(node);
+		parents.push_back(parent);
+		trs.set(index, node->translation, node->orientation, node->scale);
+
+		for (auto child = node->children.rbegin(); child != node->children.rend(); ++child)
+		{
+			stack.emplace_back(*child, index);
+		}
+	}
+
+	std::vector<uint32_t> topNodes;
+	std::vector<Range> jobs;
+	partition(parents, static_cast<std::size_t>(std::max(settings().nodesPerJob, 1)), topNodes, jobs);
+	result.threads = ThreadPool::instance().threadCount() + 1;
+	result.topNodes = topNodes.size();
+	result.jobs = jobs.size();
+
+	std::vector<TransformKernels::AffineMatrix> worldMatrices(result.nodeCount);
+	const auto startTime = std::chrono::steady_clock::now();
+	for (int iteration = 0; iteration < iterations; ++iteration)
+	{
+		nodes.front()->update(glm::mat4(1.0f));
+	}
+	const auto recursiveTime = std::chrono::steady_clock::now();
+	for (int iteration = 0; iteration < iterations; ++iteration)
+	{
+		computeWorldMatrices(parents, trs, worldMatrices, 0, result.nodeCount);
+	}
+	const auto linearTime = std::chrono::steady_clock::now();
+	for (int iteration = 0; iteration < iterations; ++iteration)
+	{
+		for (const uint32_t node : topNodes)
+		{
+			computeWorldMatrices(parents, trs, worldMatrices, node, node + 1);
+		}
+		ThreadPool::instance().parallelFor(jobs.size(), 1, [&](std::size_t begin, std::size_t end)
+		{
+			for (std::size_t job = begin; job < end; ++job)
+				computeWorldMatrices(parents, trs, worldMatrices, jobs[job].begin, jobs[job].end);
+		});
+	}
+	const auto parallelTime = std::chrono::steady_clock::now();
+
+	result.recursiveMilliseconds = std::chrono::duration<double, std::milli>(recursiveTime - startTime).count() / iterations;
+	result.linearMilliseconds = std::chrono::duration<double, std::milli>(linearTime - recursiveTime).count() / iterations;
+	result.parallelMilliseconds = std::chrono::duration<double, std::milli>(parallelTime - linearTime).count() / iterations;
+
+	// The frame path, copies from and to the objects included. The settings and statistics of the scene are left as they were
+	const Settings sceneSettings = settings();
+	const Statistics sceneStatistics = statistics();
+	TransformHierarchy hierarchy;
+	settings().enabled = true;
+	for (const bool parallel : { false, true })
+	{
+		settings().parallel = parallel;
+		hierarchy.update(*objects.front());   // Flattens the tree
+		const auto updateStartTime = std::chrono::steady_clock::now();
+		for (int iteration = 0; iteration < iterations; ++iteration)
+		{
+			hierarchy.update(*objects.front());
+		}
+		const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - updateStartTime).count() / iterations;
+		(parallel ? result.parallelUpdateMilliseconds : result.updateMilliseconds) = milliseconds;
+	}
+
+	// Past the cores of the machine, the workers only take turns
+	for (const unsigned int workers : { 1u, 2u, 4u, 8u, 16u })
+	{
+		ThreadPool pool(workers);
+		hierarchy.update(*objects.front(), pool);
+		const auto updateStartTime = std::chrono::steady_clock::now();
+		for (int iteration = 0; iteration < iterations; ++iteration)
+		{
+			hierarchy.update(*objects.front(), pool);
+		}
+		result.workerSweep.push_back({ workers, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - updateStartTime).count() / iterations });
+	}
+	settings() = sceneSettings;
+	statistics() = sceneStatistics;
+
+	for (std::size_t i = 0; i < result.nodeCount; ++i)
+	{
+		for (int column = 0; column < 4; ++column)
+		{
+			const glm::vec4 difference = glm::abs(TransformKernels::toMat4(worldMatrices[i])[column] - order[i]->modelMatrix[column]);
+			result.maxDifference = std::max(result.maxDifference, std::max(std::max(difference.x, difference.y), std::max(difference.z, difference.w)));
+			const glm::vec4 objectDifference = glm::abs(objects[i]->modelMatrix()[column] - nodes[i]->modelMatrix[column]);
+			result.maxDifference = std::max(result.maxDifference, std::max(std::max(objectDifference.x, objectDifference.y), std::max(objectDifference.z, objectDifference.w)));
+		}
+	}
+	return result;
+}
+
+void TransformHierarchy::rebuild(SceneObject& root)
+{
+	m_root = &root;
+	m_structureVersion = SceneObject::structureVersion();
+	m_objects.clear();
+	m_parents.clear();
+
+	// Depth first, the children pushed backwards to keep their order
+	m_stack.clear();
+	m_stack.emplace_back(&root, NO_PARENT);
+	while (!m_stack.empty())
+	{
+		const auto [object, parent] = m_stack.back();
+		m_stack.pop_back();
+
+		const auto index = static_cast<uint32_t>(m_objects.size());
+		m_objects.push_back(object);
+		m_parents.push_back(parent);
+
+		const auto& children = object->children();
+		for (auto child = children.rbegin(); child != children.rend(); ++child)
+		{
+			m_stack.emplace_back(*child, index);
+		}
+	}
+
+	const std::size_t count = m_objects.size();
+	m_trs.resize(count);
+	m_worldMatrices.resize(count);
+	m_moved.resize(count);
+	m_nodesPerJob = 0;   // Partitioned again
+	++statistics().rebuilds;
+}
+
+void TransformHierarchy::updateRange(uint32_t begin, uint32_t end)
+{
+	// The parents of the range are either in it, earlier, or already updated
+	for (uint32_t i = begin; i < end; ++i)
+	{
+		SceneObject& object = *m_objects[i];
+		const uint32_t parent = m_parents[i];
+
+		// The dirty flags as the render traversal handled them, the ancestors come first
+		const bool parentMoved = parent != NO_PARENT && m_moved[parent] != 0;
+		m_moved[i] = object.isDirty() || parentMoved ? 1 : 0;
+		object.m_dirty_global = false;
+
+		const Transform& transform = object.transform();
+		m_trs.set(i, transform.translation(), transform.orientation(), transform.scale());
+	}
+
+	computeWorldMatrices(m_parents, m_trs, m_worldMatrices, begin, end);
+
+	for (uint32_t i = begin; i < end; ++i)
+	{
+		SceneObject& object = *m_objects[i];
+		object.m_modelMatrix = TransformKernels::toMat4(m_worldMatrices[i]);
+		object.m_hierarchyFrame = s_frame;
+		object.m_movedInHierarchy = m_moved[i] != 0;
+	}
+}
+
+void TransformHierarchy::partition(const std::vector<uint32_t>& parents, std::size_t nodesPerJob, std::vector<uint32_t>& topNodes, std::vector<Range>& jobs)
+{
+	topNodes.clear();
+	jobs.clear();
+
+	// Backwards, the children come after their parent
+	const auto count = static_cast<uint32_t>(parents.size());
+	std::vector<uint32_t> subtreeSizes(count, 1);
+	for (uint32_t i = count; i-- > 1; )
+	{
+		subtreeSizes[parents[i]] += subtreeSizes[i];
+	}
+
+	for (uint32_t i = 0; i < count; )
+	{
+		if (subtreeSizes[i] > nodesPerJob)
+		{
+			topNodes.push_back(i);
+			++i;
+			continue;
+		}
+
+		// Right after the previous job, a sibling subtree or one of a sibling of an ancestor: merged
+		const uint32_t end = i + subtreeSizes[i];
+		if (!jobs.empty() && jobs.back().end == i && end - jobs.back().begin <= nodesPerJob)
+			jobs.back().end = end;
+		else
+			jobs.push_back({ i, end });
+		i = end;
+	}
+}
+
+void TransformHierarchy::computeWorldMatrices(const std::vector<uint32_t>& parents, const TransformKernels::TrsStreams& trs,
+	std::vector<TransformKernels::AffineMatrix>& worldMatrices, std::size_t begin, std::size_t end)
+{
+	TransformKernels::composeWorlds(parents.data(), trs, worldMatrices.data(), begin, end);
+}
@@ -0,0 +1,156 @@
+#pragma once
+#ifndef TRANSFORMHIERARCHY_H
+#define TRANSFORMHIERARCHY_H
+
+/**
+ * @file TransformHierarchy.h
+ *
+ * @brief Local transforms and world matrices of the scene in flat arrays, parents first, updated in one pass before the draws.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "TransformKernels.h"
+
+class SceneObject;
+class ThreadPool;
+
+/**
+ * The objects are flattened in depth-first order, so a parent always comes before its children. A world matrix is
+ * then the world matrix of an earlier entry times the local one: a single loop over the arrays computes all of
+ * them, without recursion nor virtual calls, before the scene is drawn. The local matrices are composed four or
+ * eight at a time from one array per component and multiplied in registers, see TransformKernels.
+ *
+ * The objects keep their transforms, they are copied in the arrays every frame and the world matrices copied back
+ * as their model matrices. The render traversal finds them up to date and only draws. The order is only rebuilt
+ * when an object gains or loses a child.
+ *
+ * In depth-first order a subtree is a contiguous range. The subtrees of at most nodesPerJob nodes whose parent is
+ * bigger are jobs, the siblings merged up to that size, updated in parallel once the few bigger nodes above them
+ * are done in order on the calling thread. A single long chain stays sequential.
+ */
+class TransformHierarchy
+{
+public:
+	static constexpr uint32_t NO_PARENT = ~uint32_t(0);
+
+	struct Settings
+	{
+		bool enabled = true;    // Otherwise the render traversal computes the matrices on its way down
+		bool parallel = true;
+		int nodesPerJob = 4096;
+	};
+
+	// Reset by the window every frame
+	struct Statistics
+	{
+		std::size_t nodes = 0;
+		std::size_t movedNodes = 0;
+		std::size_t rebuilds = 0;
+		std::size_t topNodes = 0;       // Updated before the jobs, on the calling thread
+		std::size_t jobs = 0;
+		double serialMilliseconds = 0.0;
+		double parallelMilliseconds = 0.0;
+	};
+
+	enum class BenchmarkShape
+	{
+		Random,     // The parent of a node is any earlier node, a few dozen levels at 1M nodes
+		Wide,       // 64 children per node, a handful of levels
+		Deep        // Chains of 100 nodes hanging from random earlier nodes
+	};
+
+	struct WorkerTiming
+	{
+		unsigned int workers = 0;             // Besides the calling thread, which takes jobs as well
+		double milliseconds = 0.0;
+	};
+
+	struct BenchmarkResult
+	{
+		std::size_t nodeCount = 0;
+		std::size_t maxDepth = 0;
+		std::size_t threads = 0;
+		std::size_t topNodes = 0;
+		std::size_t jobs = 0;
+		double recursiveMilliseconds = 0.0;   // Per update, averaged
+		double linearMilliseconds = 0.0;      // Of the arrays alone
+		double parallelMilliseconds = 0.0;
+		double updateMilliseconds = 0.0;      // Of update() on scene objects, the copies to and from the arrays included
+		double parallelUpdateMilliseconds = 0.0;
+		float maxDifference = 0.0f;           // Between the world matrices of the recursion and of the other updates
+		std::vector<WorkerTiming> workerSweep;   // Parallel update() on pools of 1, 2, 4, 8 and 16 workers
+	};
+
+	static Settings& settings();
+	static Statistics& statistics();
+
+	/**
+	 * Incremented by every update(), the objects hold the frame their model matrix was computed in.
+	 */
+	static inline uint64_t frame() { return s_frame; }
+
+	/**
+	 * Compute the model matrices of the objects under the root, before the scene is drawn.
+	 */
+	void update(SceneObject& root);
+
+	/**
+	 * The same with the jobs on the workers of pool instead of the shared one.
+	 */
+	void update(SceneObject& root, ThreadPool& pool);
+
+	inline std::size_t nodeCount() const { return m_objects.size(); }
+
+	/**
+	 * Time the update of a tree of nodeCount nodes: as the recursion of SceneObject::render over separately
+	 * allocated nodes, as the linear and parallel passes over the arrays, and as update() on the same tree of
+	 * scene objects, serial and parallel, the parallel one again over pools of 1 to 16 workers. Takes about a
+	 * gigabyte at 1M nodes.
+	 */
+	static BenchmarkResult benchmark(std::size_t nodeCount, BenchmarkShape shape, int iterations);
+
+private:
+	struct Range
+	{
+		uint32_t begin;
+		uint32_t end;
+	};
+
+	void rebuild(SceneObject& root);
+	void updateRange(uint32_t begin, uint32_t end);
+
+	static void partition(const std::vector<uint32_t>& parents, std::size_t nodesPerJob, std::vector<uint32_t>& topNodes, std::vector<Range>& jobs);
+	static void computeWorldMatrices(const std::vector<uint32_t>& parents, const TransformKernels::TrsStreams& trs,
+		std::vector<TransformKernels::AffineMatrix>& worldMatrices, std::size_t begin, std::size_t end);
+
+private:
+	SceneObject* m_root = nullptr;
+	uint64_t m_structureVersion = ~uint64_t(0);
+	std::size_t m_nodesPerJob = 0;          // Of the partition
+
+	std::vector<SceneObject*> m_objects;
+	std::vector<uint32_t> m_parents;        // Index of an earlier entry, NO_PARENT for the root
+	TransformKernels::TrsStreams m_trs;
+	std::vector<TransformKernels::AffineMatrix> m_worldMatrices;
+	std::vector<uint8_t> m_moved;           // The object or one of its ancestors moved this frame
+
+	std::vector<uint32_t> m_topNodes;       // In order
+	std::vector<Range> m_jobs;
+
+	std::vector<std::pair<SceneObject*, uint32_t>> m_stack;
+
+	inline static uint64_t s_frame = 0;
+};
+
+#endif
@@ -0,0 +1,465 @@
+/**
+ * @file TransformKernels.cpp
+ *
+ * @brief Model matrices built straight from translations, orientations and scales, four or eight objects at a time with SSE2 or AVX2.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include "TransformKernels.h"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TRANSFORM_SSE2 1
+#endif
+
+// Only when the whole build targets it, with -mavx2 or /arch:AVX2: there is no dispatch at run time
+#if defined(TRANSFORM_SSE2) && defined(__AVX2__)
+#include <immintrin.h>
+#define TRANSFORM_AVX2 1
+#endif
+
+namespace
+{
+	constexpr uint32_t NO_PARENT = ~uint32_t(0);
+
+	// Columns of the same length and orthogonal up to this fraction of their squared length: a uniform scale
+	constexpr float UNIFORM_SCALE_TOLERANCE = 1e-5f;
+
+	constexpr TransformKernels::AffineMatrix IDENTITY = { { { 1.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f, 0.0f } } };
+
+	void composeTrsScalar(const TransformKernels::TrsStreams& trs, std::size_t i, TransformKernels::AffineMatrix& matrix)
+	{
+		const float x = trs.orientation[0][i], y = trs.orientation[1][i], z = trs.orientation[2][i], w = trs.orientation[3][i];
+		const float xx = x * x, yy = y * y, zz = z * z;
+		const float xy = x * y, xz = x * z, yz = y * z;
+		const float wx = w * x, wy = w * y, wz = w * z;
+		const float scaleX = trs.scale[0][i], scaleY = trs.scale[1][i], scaleZ = trs.scale[2][i];
+
+		matrix.rows[0][0] = (1.0f - 2.0f * (yy + zz)) * scaleX;
+		matrix.rows[0][1] = 2.0f * (xy - wz) * scaleY;
+		matrix.rows[0][2] = 2.0f * (xz + wy) * scaleZ;
+		matrix.rows[0][3] = trs.translation[0][i];
+		matrix.rows[1][0] = 2.0f * (xy + wz) * scaleX;
+		matrix.rows[1][1] = (1.0f - 2.0f * (xx + zz)) * scaleY;
+		matrix.rows[1][2] = 2.0f * (yz - wx) * scaleZ;
+		matrix.rows[1][3] = trs.translation[1][i];
+		matrix.rows[2][0] = 2.0f * (xz - wy) * scaleX;
+		matrix.rows[2][1] = 2.0f * (yz + wx) * scaleY;
+		matrix.rows[2][2] = (1.0f - 2.0f * (xx + yy)) * scaleZ;
+		matrix.rows[2][3] = trs.translation[2][i];
+	}
+
+#ifdef TRANSFORM_SSE2
+	// A register holds the same element of four matrices
+	struct Sse2
+	{
+		using Vector = __m128;
+		static constexpr std::size_t WIDTH = 4;
+
+		static Vector set(float value) { return _mm_set1_ps(value); }
+		static Vector load(const float* values) { return _mm_loadu_ps(values); }
+		static Vector add(Vector left, Vector right) { return _mm_add_ps(left, right); }
+		static Vector sub(Vector left, Vector right) { return _mm_sub_ps(left, right); }
+		static Vector mul(Vector left, Vector right) { return _mm_mul_ps(left, right); }
+
+		// One row of each matrix to the four elements of that row
+		static void loadRow(const TransformKernels::AffineMatrix* const* matrices, int row, Vector* columns)
+		{
+			columns[0] = _mm_load_ps(matrices[0]->rows[row]);
+			columns[1] = _mm_load_ps(matrices[1]->rows[row]);
+			columns[2] = _mm_load_ps(matrices[2]->rows[row]);
+			columns[3] = _mm_load_ps(matrices[3]->rows[row]);
+			_MM_TRANSPOSE4_PS(columns[0], columns[1], columns[2], columns[3]);
+		}
+
+		// The four elements of a row back to the row of each of the consecutive matrices
+		static void storeRow(Vector column0, Vector column1, Vector column2, Vector column3, TransformKernels::AffineMatrix* matrices, int row)
+		{
+			_MM_TRANSPOSE4_PS(column0, column1, column2, column3);
+			_mm_store_ps(matrices[0].rows[row], column0);
+			_mm_store_ps(matrices[1].rows[row], column1);
+			_mm_store_ps(matrices[2].rows[row], column2);
+			_mm_store_ps(matrices[3].rows[row], column3);
+		}
+	};
+#endif
+
+#ifdef TRANSFORM_AVX2
+	// Eight matrices, as two halves of four for the transpositions
+	struct Avx2
+	{
+		using Vector = __m256;
+		static constexpr std::size_t WIDTH = 8;
+
+		static Vector set(float value) { return _mm256_set1_ps(value); }
+		static Vector load(const float* values) { return _mm256_loadu_ps(values); }
+		static Vector add(Vector left, Vector right) { return _mm256_add_ps(left, right); }
+		static Vector sub(Vector left, Vector right) { return _mm256_sub_ps(left, right); }
+		static Vector mul(Vector left, Vector right) { return _mm256_mul_ps(left, right); }
+
+		static void loadRow(const TransformKernels::AffineMatrix* const* matrices, int row, Vector* columns)
+		{
+			__m128 low[4], high[4];
+			Sse2::loadRow(matrices, row, low);
+			Sse2::loadRow(matrices + 4, row, high);
+			for (int column = 0; column < 4; ++column)
+			{
+				columns[column] = _mm256_insertf128_ps(_mm256_castps128_ps256(low[column]), high[column], 1);
+			}
+		}
+
+		static void storeRow(Vector column0, Vector column1, Vector column2, Vector column3, TransformKernels::AffineMatrix* matrices, int row)
+		{
+			Sse2::storeRow(_mm256_castps256_ps128(column0), _mm256_castps256_ps128(column1), _mm256_castps256_ps128(column2), _mm256_castps256_ps128(column3), matrices, row);
+			Sse2::storeRow(_mm256_extractf128_ps(column0, 1), _mm256_extractf128_ps(column1, 1), _mm256_extractf128_ps(column2, 1), _mm256_extractf128_ps(column3, 1), matrices + 4, row);
+		}
+	};
+#endif
+
+	// Same terms as composeTrsScalar, for the WIDTH objects from i
+	template<typename Simd>
+	void composeLocals(const TransformKernels::TrsStreams& trs, std::size_t i, typename Simd::Vector local[3][4])
+	{
+		using Vector = typename Simd::Vector;
+		const Vector two = Simd::set(2.0f);
+		const Vector one = Simd::set(1.0f);
+		const Vector x = Simd::load(&trs.orientation[0][i]);
+		const Vector y = Simd::load(&trs.orientation[1][i]);
+		const Vector z = Simd::load(&trs.orientation[2][i]);
+		const Vector w = Simd::load(&trs.orientation[3][i]);
+		const Vector xx = Simd::mul(x, x), yy = Simd::mul(y, y), zz = Simd::mul(z, z);
+		const Vector xy = Simd::mul(x, y), xz = Simd::mul(x, z), yz = Simd::mul(y, z);
+		const Vector wx = Simd::mul(w, x), wy = Simd::mul(w, y), wz = Simd::mul(w, z);
+		const Vector scaleX = Simd::load(&trs.scale[0][i]);
+		const Vector scaleY = Simd::load(&trs.scale[1][i]);
+		const Vector scaleZ = Simd::load(&trs.scale[2][i]);
+
+		local[0][0] = Simd::mul(Simd::sub(one, Simd::mul(two, Simd::add(yy, zz))), scaleX);
+		local[0][1] = Simd::mul(Simd::mul(two, Simd::sub(xy, wz)), scaleY);
+		local[0][2] = Simd::mul(Simd::mul(two, Simd::add(xz, wy)), scaleZ);
+		local[0][3] = Simd::load(&trs.translation[0][i]);
+		local[1][0] = Simd::mul(Simd::mul(two, Simd::add(xy, wz)), scaleX);
+		local[1][1] = Simd::mul(Simd::sub(one, Simd::mul(two, Simd::add(xx, zz))), scaleY);
+		local[1][2] = Simd::mul(Simd::mul(two, Simd::sub(yz, wx)), scaleZ);
+		local[1][3] = Simd::load(&trs.translation[1][i]);
+		local[2][0] = Simd::mul(Simd::mul(two, Simd::sub(xz, wy)), scaleX);
+		local[2][1] = Simd::mul(Simd::mul(two, Simd::add(yz, wx)), scaleY);
+		local[2][2] = Simd::mul(Simd::sub(one, Simd::mul(two, Simd::add(xx, yy))), scaleZ);
+		local[2][3] = Simd::load(&trs.translation[2][i]);
+	}
+
+	// Returns the first object left for a narrower kernel
+	template<typename Simd>
+	std::size_t composeTrsBatches(const TransformKernels::TrsStreams& trs, std::size_t begin, std::size_t i, std::size_t end, TransformKernels::AffineMatrix* matrices)
+	{
+		for (; i + Simd::WIDTH <= end; i += Simd::WIDTH)
+		{
+			typename Simd::Vector local[3][4];
+			composeLocals<Simd>(trs, i, local);
+			for (int row = 0; row < 3; ++row)
+			{
+				Simd::storeRow(local[row][0], local[row][1], local[row][2], local[row][3], matrices + (i - begin), row);
+			}
+		}
+		return i;
+	}
+
+	template<typename Simd>
+	std::size_t composeWorldBatches(const uint32_t* parents, const TransformKernels::TrsStreams& trs, std::size_t i, std::size_t end, TransformKernels::AffineMatrix* worlds)
+	{
+		using Vector = typename Simd::Vector;
+		for (; i + Simd::WIDTH <= end; i += Simd::WIDTH)
+		{
+			const TransformKernels::AffineMatrix* parentMatrices[Simd::WIDTH];
+			bool parentInBatch = false;
+			for (std::size_t lane = 0; lane < Simd::WIDTH; ++lane)
+			{
+				const uint32_t parent = parents[i + lane];
+				parentMatrices[lane] = parent == NO_PARENT ? &IDENTITY : &worlds[parent];
+				parentInBatch |= parent != NO_PARENT && parent >= i;
+			}
+
+			Vector local[3][4];
+			composeLocals<Simd>(trs, i, local);
+
+			if (parentInBatch)
+			{
+				// In depth-first order a first child follows its parent: the world matrices of the batch one after the other
+				TransformKernels::AffineMatrix localMatrices[Simd::WIDTH];
+				for (int row = 0; row < 3; ++row)
+				{
+					Simd::storeRow(local[row][0], local[row][1], local[row][2], local[row][3], localMatrices, row);
+				}
+				for (std::size_t lane = 0; lane < Simd::WIDTH; ++lane)
+				{
+					worlds[i + lane] = TransformKernels::multiply(*parentMatrices[lane], localMatrices[lane]);
+				}
+				continue;
+			}
+
+			for (int row = 0; row < 3; ++row)
+			{
+				// A row of the world matrix is the rows of the local one weighted by the elements of the parent one
+				Vector parentRow[4];
+				Simd::loadRow(parentMatrices, row, parentRow);
+				Vector world[4];
+				for (int column = 0; column < 4; ++column)
+				{
+					world[column] = Simd::add(Simd::add(Simd::mul(parentRow[0], local[0][column]), Simd::mul(parentRow[1], local[1][column])),
+						Simd::mul(parentRow[2], local[2][column]));
+				}
+				world[3] = Simd::add(world[3], parentRow[3]);
+				Simd::storeRow(world[0], world[1], world[2], world[3], worlds + i, row);
+			}
+		}
+		return i;
+	}
+}
+
+void TransformKernels::TrsStreams::resize(std::size_t count)
+{
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		translation[axis].resize(count, 0.0f);
+		scale[axis].resize(count, 1.0f);
+	}
+	for (int axis = 0; axis < 4; ++axis)
+	{
+		orientation[axis].resize(count, axis == 3 ? 1.0f : 0.0f);
+	}
+}
+
+void TransformKernels::TrsStreams::set(std::size_t index, const glm::vec3& newTranslation, const glm::quat& newOrientation, const glm::vec3& newScale)
+{
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		translation[axis][index] = newTranslation[axis];
+		scale[axis][index] = newScale[axis];
+	}
+	for (int axis = 0; axis < 4; ++axis)
+	{
+		orientation[axis][index] = newOrientation[axis];
+	}
+}
+
+const char* TransformKernels::instructionSet()
+{
+#if defined(TRANSFORM_AVX2)
+	return "AVX2";
+#elif defined(TRANSFORM_SSE2)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
+
+void TransformKernels::composeTrs(const TrsStreams& trs, std::size_t begin, std::size_t end, AffineMatrix* matrices)
+{
+	std::size_t i = begin;
+#ifdef TRANSFORM_AVX2
+	i = composeTrsBatches<Avx2>(trs, begin, i, end, matrices);
+#endif
+#ifdef TRANSFORM_SSE2
+	i = composeTrsBatches<Sse2>(trs, begin, i, end, matrices);
+#endif
+	for (; i < end; ++i)
+	{
+		composeTrsScalar(trs, i, matrices[i - begin]);
+	}
+}
+
+TransformKernels::AffineMatrix TransformKernels::multiply(const AffineMatrix& left, const AffineMatrix& right)
+{
+	AffineMatrix result;
+#ifdef TRANSFORM_SSE2
+	// A row of the result is the rows of the right matrix weighted by the elements of the left one
+	const __m128 right0 = _mm_load_ps(right.rows[0]);
+	const __m128 right1 = _mm_load_ps(right.rows[1]);
+	const __m128 right2 = _mm_load_ps(right.rows[2]);
+	const __m128 right3 = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+	for (int row = 0; row < 3; ++row)
+	{
+		const __m128 leftRow = _mm_load_ps(left.rows[row]);
+		__m128 sum = _mm_mul_ps(_mm_shuffle_ps(leftRow, leftRow, _MM_SHUFFLE(0, 0, 0, 0)), right0);
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_shuffle_ps(leftRow, leftRow, _MM_SHUFFLE(1, 1, 1, 1)), right1));
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_shuffle_ps(leftRow, leftRow, _MM_SHUFFLE(2, 2, 2, 2)), right2));
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_shuffle_ps(leftRow, leftRow, _MM_SHUFFLE(3, 3, 3, 3)), right3));
+		_mm_store_ps(result.rows[row], sum);
+	}
+#else
+	for (int row = 0; row < 3; ++row)
+	{
+		for (int column = 0; column < 4; ++column)
+		{
+			result.rows[row][column] = left.rows[row][0] * right.rows[0][column] + left.rows[row][1] * right.rows[1][column]
+				+ left.rows[row][2] * right.rows[2][column] + (column == 3 ? left.rows[row][3] : 0.0f);
+		}
+	}
+#endif
+	return result;
+}
+
+void TransformKernels::composeWorlds(const uint32_t* parents, const TrsStreams& trs, AffineMatrix* worlds, std::size_t begin, std::size_t end)
+{
+	std::size_t i = begin;
+#ifdef TRANSFORM_AVX2
+	i = composeWorldBatches<Avx2>(parents, trs, i, end, worlds);
+#endif
+#ifdef TRANSFORM_SSE2
+	i = composeWorldBatches<Sse2>(parents, trs, i, end, worlds);
+#endif
+	for (; i < end; ++i)
+	{
+		AffineMatrix localMatrix;
+		composeTrsScalar(trs, i, localMatrix);
+		const uint32_t parent = parents[i];
+		worlds[i] = parent == NO_PARENT ? localMatrix : multiply(worlds[parent], localMatrix);
+	}
+}
+
+glm::mat4 TransformKernels::toMat4(const AffineMatrix& matrix)
+{
+	glm::mat4 result;
+#ifdef TRANSFORM_SSE2
+	__m128 row0 = _mm_load_ps(matrix.rows[0]);
+	__m128 row1 = _mm_load_ps(matrix.rows[1]);
+	__m128 row2 = _mm_load_ps(matrix.rows[2]);
+	__m128 row3 = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+	_MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+	_mm_storeu_ps(&result[0][0], row0);
+	_mm_storeu_ps(&result[1][0], row1);
+	_mm_storeu_ps(&result[2][0], row2);
+	_mm_storeu_ps(&result[3][0], row3);
+#else
+	for (int column = 0; column < 4; ++column)
+	{
+		result[column] = glm::vec4(matrix.rows[0][column], matrix.rows[1][column], matrix.rows[2][column], column == 3 ? 1.0f : 0.0f);
+	}
+#endif
+	return result;
+}
+
+TransformKernels::AffineMatrix TransformKernels::fromMat4(const glm::mat4& matrix)
+{
+	AffineMatrix result;
+	for (int row = 0; row < 3; ++row)
+	{
+		for (int column = 0; column < 4; ++column)
+			result.rows[row][column] = matrix[column][row];
+	}
+	return result;
+}
+
+bool TransformKernels::uniformScale(const glm::mat3& linear)
+{
+	const float length0 = glm::dot(linear[0], linear[0]);
+	const float tolerance = UNIFORM_SCALE_TOLERANCE * length0;
+	return length0 > 0.0f
+		&& std::abs(glm::dot(linear[1], linear[1]) - length0) <= tolerance && std::abs(glm::dot(linear[2], linear[2]) - length0) <= tolerance
+		&& std::abs(glm::dot(linear[0], linear[1])) <= tolerance && std::abs(glm::dot(linear[0], linear[2])) <= tolerance
+		&& std::abs(glm::dot(linear[1], linear[2])) <= tolerance;
+}
+
+glm::mat3 TransformKernels::normalMatrix(const glm::mat3& linear)
+{
+	if (uniformScale(linear))
+	{
+		// A rotation scaled by s: the inverse transpose is the rotation over s, the matrix over s squared
+		return linear * (1.0f / glm::dot(linear[0], linear[0]));
+	}
+
+	const glm::vec3 cofactor0 = glm::cross(linear[1], linear[2]);
+	const float determinant = glm::dot(linear[0], cofactor0);
+	if (determinant == 0.0f)
+	{
+		// Flattened by a null scale, no normal is right: left as they are
+		return glm::mat3(1.0f);
+	}
+	return glm::mat3(cofactor0, glm::cross(linear[2], linear[0]), glm::cross(linear[0], linear[1])) * (1.0f / determinant);
+}
+
+TransformKernels::CheckResult TransformKernels::check(std::size_t count)
+{
+	std::mt19937 generator(1234u);
+	std::uniform_real_distribution<float> position(-10.0f, 10.0f);
+	std::normal_distribution<float> component(0.0f, 1.0f);
+	std::uniform_real_distribution<float> scale(0.1f, 4.0f);
+
+	TrsStreams trs;
+	trs.resize(count);
+	std::vector<glm::mat4> expected(count);
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		const glm::vec3 translation(position(generator), position(generator), position(generator));
+		// Uniform over the rotations
+		const glm::quat orientation = glm::normalize(glm::quat(component(generator), component(generator), component(generator), component(generator)));
+		// Every other one uniformly scaled, for both ways of computing the normal matrix
+		const glm::vec3 objectScale = i % 2 == 0 ? glm::vec3(scale(generator)) : glm::vec3(scale(generator), scale(generator), scale(generator));
+		trs.set(i, translation, orientation, objectScale);
+
+		glm::mat4 matrix = glm::translate(glm::mat4(1.0f), translation);
+		matrix = matrix * glm::mat4_cast(orientation);
+		expected[i] = glm::scale(matrix, objectScale);
+	}
+
+	std::vector<AffineMatrix> matrices(count);
+	composeTrs(trs, 0, count, matrices.data());
+
+	const auto maxDifference = [](const glm::mat4& left, const glm::mat4& right)
+	{
+		float difference = 0.0f;
+		for (int column = 0; column < 4; ++column)
+		{
+			const glm::vec4 columnDifference = glm::abs(left[column] - right[column]);
+			difference = std::max({ difference, columnDifference.x, columnDifference.y, columnDifference.z, columnDifference.w });
+		}
+		return difference;
+	};
+
+	CheckResult result;
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		result.composeError = std::max(result.composeError, maxDifference(toMat4(matrices[i]), expected[i]));
+
+		// Products and normal matrices from the glm matrices, not to count the rounding of the composition twice
+		const std::size_t other = (i * 7 + 3) % count;
+		const glm::mat4 product = toMat4(multiply(fromMat4(expected[i]), fromMat4(expected[other])));
+		result.multiplyError = std::max(result.multiplyError, maxDifference(product, expected[i] * expected[other]));
+
+		const glm::mat3 linear(expected[i]);
+		const glm::mat3 normal = normalMatrix(linear);
+		const glm::mat3 expectedNormal = glm::inverseTranspose(linear);
+		result.normalError = std::max(result.normalError, maxDifference(glm::mat4(normal), glm::mat4(expectedNormal)));
+	}
+
+	// Every other node the child of the previous one, as a first child in depth-first order: in the same batch
+	std::vector<uint32_t> parents(count, NO_PARENT);
+	std::vector<glm::mat4> expectedWorlds(count);
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		if (i > 0)
+			parents[i] = static_cast<uint32_t>(i % 2 == 1 ? i - 1 : std::uniform_int_distribution<std::size_t>(0, i - 1)(generator));
+		expectedWorlds[i] = parents[i] == NO_PARENT ? expected[i] : expectedWorlds[parents[i]] * expected[i];
+	}
+
+	std::vector<AffineMatrix> worlds(count);
+	composeWorlds(parents.data(), trs, worlds.data(), 0, count);
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		const float largest = std::max(maxDifference(expectedWorlds[i], glm::mat4(0.0f)), 1.0f);
+		result.worldError = std::max(result.worldError, maxDifference(toMat4(worlds[i]), expectedWorlds[i]) / largest);
+	}
+	return result;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#ifndef TRANSFORMKERNELS_H
+#define TRANSFORMKERNELS_H
+
+/**
+ * @file TransformKernels.h
+ *
+ * @brief Model matrices built straight from translations, orientations and scales, four or eight objects at a time with SSE2 or AVX2.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include <glm/mat3x3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Without SSE2 every kernel has a scalar version giving the same matrices, up to the rounding. The AVX2 one is
+// only built when the compiler targets it, -mavx2 or /arch:AVX2, and takes eight objects where SSE2 takes four
+namespace TransformKernels
+{
+	// Upper rows of a model matrix, the last one is always (0, 0, 0, 1): a row per register
+	struct alignas(16) AffineMatrix
+	{
+		float rows[3][4];
+	};
+
+	// Local transforms one component per array, loaded four or eight objects at a time
+	struct TrsStreams
+	{
+		std::vector<float> translation[3];
+		std::vector<float> orientation[4];  // Unit quaternion, x, y, z then w
+		std::vector<float> scale[3];
+
+		void resize(std::size_t count);
+		void set(std::size_t index, const glm::vec3& translation, const glm::quat& orientation, const glm::vec3& scale);
+	};
+
+	struct CheckResult
+	{
+		float composeError = 0.0f;      // Largest difference with glm over random transforms
+		float multiplyError = 0.0f;
+		float worldError = 0.0f;        // Relative to the largest element, they grow with the depth
+		float normalError = 0.0f;
+	};
+
+	/**
+	 * "AVX2", "SSE2" or "scalar", the widest kernels of the build.
+	 */
+	const char* instructionSet();
+
+	/**
+	 * Translation, then the rotation of the quaternion and scale, as Transform::computeModelMatrix. No sine nor cosine, for the objects [begin, end).
+	 */
+	void composeTrs(const TrsStreams& trs, std::size_t begin, std::size_t end, AffineMatrix* matrices);
+
+	AffineMatrix multiply(const AffineMatrix& left, const AffineMatrix& right);
+
+	/**
+	 * worlds[i] = worlds[parents[i]] * the local matrix of i over [begin, end), in order: the parents come first.
+	 * The local matrices are composed in registers and multiplied four or eight at a time, never stored.
+	 */
+	void composeWorlds(const uint32_t* parents, const TrsStreams& trs, AffineMatrix* worlds, std::size_t begin, std::size_t end);
+
+	glm::mat4 toMat4(const AffineMatrix& matrix);
+	AffineMatrix fromMat4(const glm::mat4& matrix);
+
+	/**
+	 * Whether the columns of a linear part are orthogonal and of the same length: a rotation, possibly mirrored,
+	 * times a uniform scale. It then transforms the normals as its inverse transpose does, up to their length.
+	 */
+	bool uniformScale(const glm::mat3& linear);
+
+	/**
+	 * Inverse transpose of a linear part: a rescale when its columns are orthogonal and of the same length,
+	 * otherwise the cofactors over the determinant, without a general inverse. The identity when it is singular.
+	 */
+	glm::mat3 normalMatrix(const glm::mat3& linear);
+
+	/**
+	 * Compare the kernels with glm over count random transforms, the world matrices over a random hierarchy of them.
+	 */
+	CheckResult check(std::size_t count);
+}
+
+#endif
@@ -0,0 +1,52 @@
+/**
+ * @file TransformKernelsCheck.cpp
+ *
+ * @brief The transform kernels against glm, run after every build: fails on a mismatch.
+ *
+ * Usage:
+ *   TransformKernelsCheck [transform count (default 100003)]
+ *
+ * The count is odd so the SSE2 and scalar tails run after the wider batches.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#include <cstdlib>
+#include <iostream>
+
+#include "TransformKernels.h"
+
+namespace
+{
+	// Only the rounding may differ: the elements stay under a few hundred, the world matrices are compared relatively
+	const float MATRIX_TOLERANCE = 1e-4f;
+	const float NORMAL_TOLERANCE = 1e-3f;
+
+	bool passes(const char* name, float error, float tolerance)
+	{
+		const bool passed = error <= tolerance;
+		std::cout << "  " << name << ": " << error << (passed ? "" : " FAILED") << std::endl;
+		return passed;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const std::size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100003;
+	if (count == 0)
+	{
+		std::cerr << "Usage: TransformKernelsCheck [transform count]" << std::endl;
+		return 1;
+	}
+
+	std::cout << "Transform kernels (" << TransformKernels::instructionSet() << ") against glm over " << count << " transforms" << std::endl;
+	const auto result = TransformKernels::check(count);
+
+	bool passed = passes("compose", result.composeError, MATRIX_TOLERANCE);
+	passed = passes("multiply", result.multiplyError, MATRIX_TOLERANCE) && passed;
+	passed = passes("worlds", result.worldError, MATRIX_TOLERANCE) && passed;
+	passed = passes("normals", result.normalError, NORMAL_TOLERANCE) && passed;
+	return passed ? 0 : 1;
+}
@@ -8,14 +8,35 @@
  * William Lebel
  */
 
-#version 400 core
+#version 430 core
 uniform mat4 mvMatrix;
 uniform mat4 projMatrix;
+uniform mat4 viewMatrix;
+
+// Per-object data of ObjectDataBuffer
+struct ObjectData
+{
+    mat4 modelMatrix;
+    uint materialIndex;   // In the MaterialRegistry
+    uint uniformScale;    // Not 0 when the model matrix transforms the normals as well
+};
+
+layout(std430, binding = 3) readonly buffer Objects { ObjectData objects[]; };
+
+uniform int uObject;      // Slot of the draw, -1 when the uniforms are set instead
 
 in vec4 vPosition;
 
+// Written the same way as textureShader.vert: the depth pre-pass relies on both giving the same depths
+invariant gl_Position;
+
 void main()
 {
-  gl_Position = projMatrix * mvMatrix * vPosition;
+  mat4 modelView = mvMatrix;
+  if (uObject >= 0)
+  {
+    modelView = viewMatrix * objects[uObject].modelMatrix;
+  }
+  gl_Position = projMatrix * (modelView * vPosition);
 }
 
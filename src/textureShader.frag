@@ -8,7 +8,7 @@
  * William Lebel
  */
 
-#version 400 core
+#version 430 core
 
 uniform mat4 viewMatrix;
 
@@ -26,15 +26,46 @@ uniform float uKn;
 uniform sampler2D uTex;
 uniform sampler2D uNormalsTex;
 
+// Point lights binned by LightClusters: the cell of a fragment gives a range of its light indices
+struct PointLight
+{
+    vec4 positionRadius;   // View space
+    vec4 colorIntensity;
+};
+
+layout(std430, binding = 0) readonly buffer PointLights { PointLight lights[]; };
+layout(std430, binding = 1) readonly buffer LightClusters { uvec2 clusters[]; };   // Offset and count
+layout(std430, binding = 2) readonly buffer LightIndices { uint lightIndices[]; };
+
+// Colors of the MaterialRegistry
+struct MaterialRecord
+{
+    vec4 ambiantColor;
+    vec4 diffuseColor;
+    vec4 specularColor;
+    vec4 parameters;      // x: specular term
+};
+
+layout(std430, binding = 4) readonly buffer Materials { MaterialRecord materials[]; };
+
+uniform ivec3 uClusterCount;      // 0 when there are no point lights
+uniform vec2 uClusterTileSize;
+uniform float uClusterDepthScale;
+uniform float uClusterDepthBias;
+uniform bool uShowLightCount;
+
 in vec2 fUV;
 in vec3 fNormal;
 in vec3 fTangent;
 in vec3 fBitangent;
 in vec3 fPosition;
+flat in int fMaterial;
 
 out vec4 fColor;
 
 float distanceSquared(vec3 left, vec3 right);
+vec3 clusteredLights(vec3 normal, vec3 viewDirection, vec3 kd, vec3 ks, float n, out uint lightCount);
+vec3 lightCountColor(uint lightCount);
 
 void main()
 {
@@ -43,15 +74,27 @@ void main()
 	if (length(fTangent) > 0.1)
 	{
 		mat3 tbn = mat3(normalize(fTangent), normalize(fBitangent), normalize(fNormal));
-		vec3 normalFromTexture = texture(uNormalsTex, fUV).rgb * 2.0 - vec3(1.0);
+		// Only x and y are read: the cooked normal maps are two channel (BC5) textures
+		vec3 normalFromTexture;
+		normalFromTexture.xy = texture(uNormalsTex, fUV).rg * 2.0 - vec2(1.0);
+		normalFromTexture.z = sqrt(max(0.0, 1.0 - dot(normalFromTexture.xy, normalFromTexture.xy)));
 		nNormal = normalize(tbn * normalFromTexture);
 	}
 
     vec3 viewDir = normalize(-fPosition);
 	vec4 ka = uKa;
-    vec3 kd = uKd.rgb * max(0, min((uSpecular * -2) + 2, 1));
-    vec3 ks = uKs.rgb * max(0, min(uSpecular * 2, 1));
+	vec4 kdColor = uKd;
+	vec4 ksColor = uKs;
 	float n = uKn;
+	if (fMaterial >= 0)
+	{
+		ka = materials[fMaterial].ambiantColor;
+		kdColor = materials[fMaterial].diffuseColor;
+		ksColor = materials[fMaterial].specularColor;
+		n = materials[fMaterial].parameters.x;
+	}
+    vec3 kd = kdColor.rgb * max(0, min((uSpecular * -2) + 2, 1));
+    vec3 ks = ksColor.rgb * max(0, min(uSpecular * 2, 1));
 
     //Direction light
     vec4 lightDir = normalize(vec4(-uDLightOri,0.0));
@@ -80,10 +123,67 @@ void main()
 
     vec4 plResult =  lightColor * vec4(kd * diffuse + ks * specular, 1) * lightIntensity;
 
+    uint lightCount = 0;
+    vec4 clResult = vec4(clusteredLights(nNormal, nViewDirection, kd, ks, n, lightCount), 0);
+
 	// Retrive color from the texture
     vec4 texColor = texture(uTex, fUV);
 
-    fColor = (ka + dlResult + plResult) * texColor;
+    fColor = (ka + dlResult + plResult + clResult) * texColor;
+    if (uShowLightCount)
+    {
+        fColor = vec4(mix(fColor.rgb * 0.2, lightCountColor(lightCount), lightCount > 0 ? 0.8 : 0.0), 1.0);
+    }
+}
+
+vec3 clusteredLights(vec3 normal, vec3 viewDirection, vec3 kd, vec3 ks, float n, out uint lightCount)
+{
+    lightCount = 0;
+    if (uClusterCount.z == 0)
+    {
+        return vec3(0.0);
+    }
+
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy / uClusterTileSize), ivec2(0), uClusterCount.xy - 1);
+    int slice = clamp(int(floor(log(-fPosition.z) * uClusterDepthScale + uClusterDepthBias)), 0, uClusterCount.z - 1);
+    uvec2 cluster = clusters[tile.x + uClusterCount.x * (tile.y + uClusterCount.y * slice)];
+    lightCount = cluster.y;
+
+    vec3 result = vec3(0.0);
+    for (uint i = 0; i < cluster.y; ++i)
+    {
+        PointLight light = lights[lightIndices[cluster.x + i]];
+        vec3 toLight = light.positionRadius.xyz - fPosition;
+        float radius = light.positionRadius.w;
+        float lightDistanceSquared = dot(toLight, toLight);
+        if (lightDistanceSquared >= radius * radius)
+        {
+            continue;
+        }
+
+        // Same inverse square as the camera light, brought smoothly to 0 at the radius
+        float window = 1.0 - (lightDistanceSquared * lightDistanceSquared) / (radius * radius * radius * radius);
+        float attenuation = window * window / max(lightDistanceSquared, 1.0);
+
+        vec3 lightDirection = toLight * inversesqrt(max(lightDistanceSquared, 1e-8));
+        float diffuse = max(0.0, dot(normal, lightDirection));
+        float specular = 0.0;
+        if (diffuse > 0.0)
+        {
+            vec3 reflectedVector = reflect(-lightDirection, normal);
+            specular = pow(max(0.0, dot(viewDirection, reflectedVector)), n);
+        }
+
+        result += light.colorIntensity.rgb * light.colorIntensity.w * attenuation * (kd * diffuse + ks * specular);
+    }
+    return result;
+}
+
+// Blue for a few lights, green, then red from 32
+vec3 lightCountColor(uint lightCount)
+{
+    float t = clamp(float(lightCount) / 32.0, 0.0, 1.0);
+    return t < 0.5 ? mix(vec3(0.0, 0.0, 1.0), vec3(0.0, 1.0, 0.0), t * 2.0) : mix(vec3(0.0, 1.0, 0.0), vec3(1.0, 0.0, 0.0), t * 2.0 - 1.0);
 }
 
 float distanceSquared(vec3 left, vec3 right)
@@ -8,11 +8,24 @@
  * William Lebel
  */
 
-#version 400 core
+#version 430 core
 
 uniform mat4 mvMatrix;
 uniform mat4 projMatrix;
 uniform mat3 normalMatrix;
+uniform mat4 viewMatrix;
+
+// Per-object data of ObjectDataBuffer
+struct ObjectData
+{
+    mat4 modelMatrix;
+    uint materialIndex;   // In the MaterialRegistry
+    uint uniformScale;    // Not 0 when the model matrix transforms the normals as well
+};
+
+layout(std430, binding = 3) readonly buffer Objects { ObjectData objects[]; };
+
+uniform int uObject;      // Slot of the draw, -1 when the uniforms are set instead
 
 in vec4 vPosition;
 in vec3 vNormal;
@@ -24,16 +37,32 @@ out vec3 fNormal;
 out vec3 fTangent;
 out vec3 fBitangent;
 out vec3 fPosition;
+flat out int fMaterial;   // -1 for the colors of the uniforms
+
+// Written the same way as constantShader.vert: the depth pre-pass relies on both giving the same depths
+invariant gl_Position;
 
 void main()
 {
-	vec4 vEyeCoord = mvMatrix * vPosition;
+	mat4 modelView = mvMatrix;
+	mat3 normalModelView = normalMatrix;
+	fMaterial = -1;
+	if (uObject >= 0)
+	{
+		// A rotation times a uniform scale needs no inverse, the normal is normalized below
+		modelView = viewMatrix * objects[uObject].modelMatrix;
+		mat3 model = mat3(objects[uObject].modelMatrix);
+		normalModelView = mat3(viewMatrix) * (objects[uObject].uniformScale != 0u ? model : transpose(inverse(model)));
+		fMaterial = int(objects[uObject].materialIndex);
+	}
+
+	vec4 vEyeCoord = modelView * vPosition;
 	gl_Position = projMatrix * vEyeCoord;
 
 	fPosition = vEyeCoord.xyz;
 
-	fNormal = normalize(normalMatrix * vNormal);
-	fTangent = normalize(mat3(mvMatrix) * vTangent); 
+	fNormal = normalize(normalModelView * vNormal);
+	fTangent = normalize(mat3(modelView) * vTangent); 
 
 	fTangent = normalize(fTangent - dot(fTangent, fNormal) * fNormal);
 
@@ -0,0 +1,242 @@
+/**
+ * @file AssetPacker.cpp
+ *
+ * @brief Offline creation of the asset pack mapped by the application at startup.
+ *
+ * Usage:
+ *   AssetPacker <output pack> <input directory or file>...
+ *
+ * Directories are not searched recursively and only files with an asset extension are kept.
+ * When two inputs have the same file name, the last one wins (the cooked textures can override the sources).
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "AssetPack.h"
+
+namespace
+{
+	const std::vector<std::string> ASSET_EXTENSIONS = { ".jpg", ".png", ".ctex", ".vert", ".frag", ".obj", ".mtl", ".meshcache", ".glb" };
+
+	// Already compressed, or uploaded straight from the mapped pack (.glb): deflating them costs time for nothing
+	const std::vector<std::string> STORED_EXTENSIONS = { ".jpg", ".png", ".glb" };
+
+	// Keep the deflated version only if it saves at least 1/8 of the size
+	const int MIN_SAVING_DIVISOR = 8;
+
+	struct Input
+	{
+		std::string name;
+		std::vector<char> content;
+	};
+
+	bool hasExtension(const std::filesystem::path& path, const std::vector<std::string>& extensions)
+	{
+		return std::find(extensions.begin(), extensions.end(), path.extension().string()) != extensions.end();
+	}
+
+	bool readFile(const std::filesystem::path& path, std::vector<char>& outContent)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file.is_open())
+		{
+			std::cerr << "Unable to read " << path.string() << std::endl;
+			return false;
+		}
+		outContent.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		return true;
+	}
+
+	bool collect(const std::string& argument, std::map<std::string, Input>& inputs)
+	{
+		const std::filesystem::path path(argument);
+		std::error_code error;
+
+		std::vector<std::filesystem::path> files;
+		if (std::filesystem::is_directory(path, error))
+		{
+			for (const auto& entry : std::filesystem::directory_iterator(path, error))
+			{
+				if (entry.is_regular_file(error) && hasExtension(entry.path(), ASSET_EXTENSIONS))
+				{
+					files.push_back(entry.path());
+				}
+			}
+		}
+		else
+		{
+			files.push_back(path);
+		}
+
+		for (const auto& file : files)
+		{
+			Input input;
+			input.name = file.filename().string();
+			if (!readFile(file, input.content))
+			{
+				return false;
+			}
+			inputs[input.name] = std::move(input);
+		}
+		return true;
+	}
+
+	uint64_t align(uint64_t offset)
+	{
+		return (offset + AssetPack::ALIGNMENT - 1) / AssetPack::ALIGNMENT * AssetPack::ALIGNMENT;
+	}
+
+	bool pack(const std::string& outputPath, const std::map<std::string, Input>& inputs)
+	{
+		struct Blob
+		{
+			std::vector<char> stored;
+			uint64_t size = 0;
+			uint64_t offset = 0;
+			uint32_t flags = 0;
+		};
+
+		std::vector<AssetPack::Entry> entries;
+		std::string names;
+		std::map<uint64_t, Blob> blobs;
+		std::vector<uint64_t> blobOrder;
+		uint64_t inputSize = 0;
+		std::size_t duplicateCount = 0;
+
+		for (const auto& [name, input] : inputs)
+		{
+			AssetPack::Entry entry;
+			entry.nameHash = AssetPack::hash(name);
+			entry.contentHash = AssetPack::hash(input.content.data(), input.content.size());
+			entry.size = input.content.size();
+			entry.nameOffset = static_cast<uint32_t>(names.size());
+			entry.nameLength = static_cast<uint32_t>(name.size());
+			names += name;
+			inputSize += input.content.size();
+
+			auto blob = blobs.find(entry.contentHash);
+			if (blob != blobs.end())
+			{
+				if (blob->second.size != entry.size)
+				{
+					std::cerr << "Content hash collision for " << name << std::endl;
+					return false;
+				}
+				++duplicateCount;
+			}
+			else
+			{
+				Blob newBlob;
+				newBlob.size = entry.size;
+				newBlob.stored = input.content;
+
+				if (!hasExtension(name, STORED_EXTENSIONS) && !input.content.empty())
+				{
+					int deflatedLength = 0;
+					unsigned char* deflated = stbi_zlib_compress(reinterpret_cast<unsigned char*>(const_cast<char*>(input.content.data())),
+						static_cast<int>(input.content.size()), &deflatedLength, 9);
+					if (deflated != nullptr && deflatedLength < static_cast<int>(input.content.size() - input.content.size() / MIN_SAVING_DIVISOR))
+					{
+						newBlob.stored.assign(deflated, deflated + deflatedLength);
+						newBlob.flags = AssetPack::COMPRESSED;
+					}
+					STBIW_FREE(deflated);
+				}
+
+				blob = blobs.emplace(entry.contentHash, std::move(newBlob)).first;
+				blobOrder.push_back(entry.contentHash);
+			}
+
+			entry.storedSize = blob->second.stored.size();
+			entry.flags = blob->second.flags;
+			entries.push_back(entry);
+		}
+
+		std::sort(entries.begin(), entries.end(),
+			[](const AssetPack::Entry& a, const AssetPack::Entry& b) { return a.nameHash < b.nameHash; });
+
+		AssetPack::Header header;
+		header.entryCount = static_cast<uint32_t>(entries.size());
+		header.tocOffset = align(sizeof(AssetPack::Header));
+		header.namesOffset = align(header.tocOffset + entries.size() * sizeof(AssetPack::Entry));
+		header.dataOffset = align(header.namesOffset + names.size());
+
+		// Blobs are laid out in name order so that a startup loading everything reads the file front to back
+		uint64_t offset = header.dataOffset;
+		for (const auto contentHash : blobOrder)
+		{
+			Blob& blob = blobs[contentHash];
+			blob.offset = offset;
+			offset = align(offset + blob.stored.size());
+		}
+		header.fileSize = offset;
+
+		for (auto& entry : entries)
+		{
+			entry.offset = blobs[entry.contentHash].offset;
+		}
+
+		std::vector<char> file(static_cast<std::size_t>(header.fileSize), 0);
+		std::memcpy(file.data(), &header, sizeof(header));
+		std::memcpy(file.data() + header.tocOffset, entries.data(), entries.size() * sizeof(AssetPack::Entry));
+		std::memcpy(file.data() + header.namesOffset, names.data(), names.size());
+		for (const auto& [contentHash, blob] : blobs)
+		{
+			std::copy(blob.stored.begin(), blob.stored.end(), file.begin() + static_cast<std::ptrdiff_t>(blob.offset));
+		}
+
+		std::ofstream output(outputPath, std::ios::binary | std::ios::trunc);
+		if (!output.is_open())
+		{
+			std::cerr << "Unable to open " << outputPath << " for writing" << std::endl;
+			return false;
+		}
+		output.write(file.data(), static_cast<std::streamsize>(file.size()));
+		if (!output)
+		{
+			std::cerr << "Unable to write " << outputPath << std::endl;
+			return false;
+		}
+
+		std::cout << "Packed " << entries.size() << " assets (" << duplicateCount << " duplicates) in " << outputPath
+			<< ": " << inputSize / 1024 << " KB -> " << header.fileSize / 1024 << " KB" << std::endl;
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const std::vector<std::string> arguments(argv + 1, argv + argc);
+	if (arguments.size() < 2)
+	{
+		std::cerr << "Usage: AssetPacker <output pack> <input directory or file>..." << std::endl;
+		return 1;
+	}
+
+	std::map<std::string, Input> inputs;
+	for (auto it = arguments.begin() + 1; it != arguments.end(); ++it)
+	{
+		if (!collect(*it, inputs))
+		{
+			return 1;
+		}
+	}
+
+	return pack(arguments[0], inputs) ? 0 : 1;
+}
@@ -0,0 +1,160 @@
+/**
+ * @file ObjParserBenchmark.cpp
+ *
+ * @brief Throughput of OBJLoader::Loader on a generated OBJ file.
+ *
+ * Usage:
+ *   ObjParserBenchmark [size in MB (default 1024)] [generated file (default objParserBenchmark.obj)] [--keep]
+ *
+ * The file is a grid of quads split in groups, with positions, uvs and normals on every corner,
+ * close to what CAD exports produce. It is deleted once parsed unless --keep is given.
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "OBJLoader.h"
+#include "ThreadPool.h"
+
+namespace
+{
+	// Rows of the grid written before switching to another group
+	const int ROWS_PER_GROUP = 64;
+	const int COLUMNS = 1024;
+
+	bool generate(const std::string& path, std::size_t targetSize)
+	{
+		FILE* file = std::fopen(path.c_str(), "wb");
+		if (file == nullptr)
+		{
+			std::cerr << "Unable to open " << path << " for writing" << std::endl;
+			return false;
+		}
+
+		std::size_t size = 0;
+		std::vector<char> buffer;
+		auto write = [&](const char* format, auto... values)
+		{
+			char line[256];
+			const int length = std::snprintf(line, sizeof(line), format, values...);
+			buffer.insert(buffer.end(), line, line + length);
+			size += static_cast<std::size_t>(length);
+		};
+		auto flush = [&]()
+		{
+			std::fwrite(buffer.data(), 1, buffer.size(), file);
+			buffer.clear();
+		};
+
+		write("# Generated by ObjParserBenchmark\n");
+
+		// Every row adds COLUMNS + 1 vertices, and the quads between it and the previous one
+		long long vertexCount = 0;
+		for (int row = 0; size < targetSize; ++row)
+		{
+			if (row % ROWS_PER_GROUP == 0)
+			{
+				write("g group%d\nusemtl (Default)\n", row / ROWS_PER_GROUP);
+			}
+
+			for (int column = 0; column <= COLUMNS; ++column)
+			{
+				const float x = column * 0.01f;
+				const float z = row * 0.01f;
+				const float y = 0.1f * ((column * 7 + row * 13) % 17) / 17.0f;
+				write("v %.6f %.6f %.6f\n", x, y, z);
+				write("vt %.6f %.6f\n", column / float(COLUMNS), (row % 1024) / 1024.0f);
+				write("vn %.6f %.6f %.6f\n", 0.0f, 1.0f, 0.0f);
+			}
+			vertexCount += COLUMNS + 1;
+
+			if (row > 0)
+			{
+				const long long previousRow = vertexCount - 2 * (COLUMNS + 1) + 1;
+				const long long currentRow = vertexCount - (COLUMNS + 1) + 1;
+				for (int column = 0; column < COLUMNS; ++column)
+				{
+					const long long a = previousRow + column, b = previousRow + column + 1;
+					const long long c = currentRow + column + 1, d = currentRow + column;
+					write("f %lld/%lld/%lld %lld/%lld/%lld %lld/%lld/%lld %lld/%lld/%lld\n", a, a, a, b, b, b, c, c, c, d, d, d);
+				}
+			}
+
+			if (buffer.size() > (1 << 24))
+			{
+				flush();
+			}
+		}
+		flush();
+
+		std::fclose(file);
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::size_t megabytes = 1024;
+	std::string path = "objParserBenchmark.obj";
+	bool keep = false;
+
+	int position = 0;
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string argument = argv[i];
+		if (argument == "--keep")
+			keep = true;
+		else if (position++ == 0)
+			megabytes = std::max<std::size_t>(1, std::stoul(argument));
+		else
+			path = argument;
+	}
+
+	std::error_code error;
+	if (!std::filesystem::exists(path, error))
+	{
+		std::cout << "Generating " << megabytes << " MB in " << path << std::endl;
+		if (!generate(path, megabytes * 1024 * 1024))
+		{
+			return 1;
+		}
+	}
+
+	const double fileMegabytes = static_cast<double>(std::filesystem::file_size(path, error)) / (1024.0 * 1024.0);
+	std::cout << "Parsing with " << ThreadPool::instance().threadCount() + 1 << " threads" << std::endl;
+
+	const auto startTime = std::chrono::steady_clock::now();
+	OBJLoader::Loader loader;
+	const bool loaded = loader.loadFile(path);
+	const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - startTime;
+
+	std::size_t vertexCount = 0;
+	for (const auto& mesh : loader.getMeshes())
+	{
+		vertexCount += mesh.vertices.size();
+	}
+
+	if (loaded)
+	{
+		std::cout << fileMegabytes << " MB, " << loader.getMeshes().size() << " meshes, " << vertexCount / 3 << " triangles in "
+			<< duration.count() << " s: " << fileMegabytes / duration.count() << " MB/s" << std::endl;
+	}
+
+	if (!keep)
+	{
+		std::filesystem::remove(path, error);
+	}
+	return loaded ? 0 : 1;
+}
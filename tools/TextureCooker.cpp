@@ -0,0 +1,228 @@
+/**
+ * @file TextureCooker.cpp
+ *
+ * @brief Offline conversion of the object textures to block-compressed textures with pre-filtered mip chains.
+ *
+ * Usage:
+ *   TextureCooker --all <assets directory> <output directory>
+ *   TextureCooker [--normals] <input image> <output file>
+ *
+ * Martin Johnson
+ * Billy-Joe Lacasse
+ * William Lebel
+ */
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#include <stb_image_resize.h>
+#define STB_DXT_IMPLEMENTATION
+#include <stb_dxt.h>
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "CookedTexture.h"
+#include "ObjectTextures.h"
+
+namespace
+{
+	struct Image
+	{
+		int width = 0;
+		int height = 0;
+		std::vector<unsigned char> rgba;
+	};
+
+	bool hasTransparency(const Image& image)
+	{
+		for (std::size_t i = 3; i < image.rgba.size(); i += 4)
+		{
+			if (image.rgba[i] != 255)
+				return true;
+		}
+		return false;
+	}
+
+	void renormalize(Image& image)
+	{
+		// Averaging unit vectors shortens them, bring every texel of the mip back on the sphere
+		for (std::size_t i = 0; i < image.rgba.size(); i += 4)
+		{
+			float x = image.rgba[i] / 255.0f * 2.0f - 1.0f;
+			float y = image.rgba[i + 1] / 255.0f * 2.0f - 1.0f;
+			float z = image.rgba[i + 2] / 255.0f * 2.0f - 1.0f;
+			const float length = std::sqrt(x * x + y * y + z * z);
+			if (length > 1e-6f)
+			{
+				x /= length;
+				y /= length;
+				z /= length;
+			}
+
+			image.rgba[i] = static_cast<unsigned char>(std::lround((x * 0.5f + 0.5f) * 255.0f));
+			image.rgba[i + 1] = static_cast<unsigned char>(std::lround((y * 0.5f + 0.5f) * 255.0f));
+			image.rgba[i + 2] = static_cast<unsigned char>(std::lround((z * 0.5f + 0.5f) * 255.0f));
+		}
+	}
+
+	Image downsample(const Image& source, bool isNormalMap)
+	{
+		Image mip;
+		mip.width = std::max(source.width / 2, 1);
+		mip.height = std::max(source.height / 2, 1);
+		mip.rgba.resize(static_cast<std::size_t>(mip.width) * mip.height * 4);
+
+		// Colors are filtered in linear space, normals are already linear data
+		const auto colorSpace = isNormalMap ? STBIR_COLORSPACE_LINEAR : STBIR_COLORSPACE_SRGB;
+		stbir_resize_uint8_generic(source.rgba.data(), source.width, source.height, 0,
+			mip.rgba.data(), mip.width, mip.height, 0,
+			4, 3, 0, STBIR_EDGE_CLAMP, STBIR_FILTER_MITCHELL, colorSpace, nullptr);
+
+		if (isNormalMap)
+		{
+			renormalize(mip);
+		}
+
+		return mip;
+	}
+
+	std::vector<unsigned char> compress(const Image& image, CookedTexture::Format format)
+	{
+		std::vector<unsigned char> blocks(CookedTexture::levelSize(format, static_cast<uint32_t>(image.width), static_cast<uint32_t>(image.height)));
+
+		unsigned char* destination = blocks.data();
+		for (int blockY = 0; blockY < image.height; blockY += 4)
+		{
+			for (int blockX = 0; blockX < image.width; blockX += 4)
+			{
+				// Blocks on the right and top borders are padded by repeating the last texel
+				unsigned char rgba[16 * 4];
+				unsigned char rg[16 * 2];
+				for (int y = 0; y < 4; ++y)
+				{
+					for (int x = 0; x < 4; ++x)
+					{
+						const int sourceX = std::min(blockX + x, image.width - 1);
+						const int sourceY = std::min(blockY + y, image.height - 1);
+						const unsigned char* texel = &image.rgba[(static_cast<std::size_t>(sourceY) * image.width + sourceX) * 4];
+						std::copy(texel, texel + 4, &rgba[(y * 4 + x) * 4]);
+						std::copy(texel, texel + 2, &rg[(y * 4 + x) * 2]);
+					}
+				}
+
+				switch (format)
+				{
+				case CookedTexture::Format::BC1:
+					stb_compress_dxt_block(destination, rgba, 0, STB_DXT_HIGHQUAL);
+					break;
+				case CookedTexture::Format::BC3:
+					stb_compress_dxt_block(destination, rgba, 1, STB_DXT_HIGHQUAL);
+					break;
+				case CookedTexture::Format::BC5:
+					stb_compress_bc5_block(destination, rg);
+					break;
+				}
+				destination += CookedTexture::blockSize(format);
+			}
+		}
+
+		return blocks;
+	}
+
+	bool cook(const std::string& inputPath, const std::string& outputPath, bool isNormalMap)
+	{
+		// Same orientation as the textures loaded at runtime
+		stbi_set_flip_vertically_on_load(true);
+
+		Image image;
+		int channels;
+		unsigned char* data = stbi_load(inputPath.c_str(), &image.width, &image.height, &channels, STBI_rgb_alpha);
+		if (data == nullptr)
+		{
+			std::cerr << "Unable to load " << inputPath << std::endl;
+			return false;
+		}
+		image.rgba.assign(data, data + static_cast<std::size_t>(image.width) * image.height * 4);
+		stbi_image_free(data);
+
+		CookedTexture::Texture texture;
+		texture.format = isNormalMap ? CookedTexture::Format::BC5
+			: hasTransparency(image) ? CookedTexture::Format::BC3
+			: CookedTexture::Format::BC1;
+
+		std::size_t uncompressedSize = 0;
+		std::vector<std::vector<unsigned char>> levelBlocks;
+		while (true)
+		{
+			uncompressedSize += image.rgba.size();
+			levelBlocks.push_back(compress(image, texture.format));
+
+			CookedTexture::MipLevel level;
+			level.width = static_cast<uint32_t>(image.width);
+			level.height = static_cast<uint32_t>(image.height);
+			level.blocks = levelBlocks.back().data();
+			level.byteSize = static_cast<uint32_t>(levelBlocks.back().size());
+			texture.mipLevels.push_back(level);
+			if (image.width == 1 && image.height == 1)
+				break;
+
+			image = downsample(image, isNormalMap);
+		}
+
+		if (!CookedTexture::write(outputPath, texture))
+		{
+			return false;
+		}
+
+		std::size_t cookedSize = 0;
+		for (const auto& level : texture.mipLevels)
+		{
+			cookedSize += level.byteSize;
+		}
+
+		std::cout << "Cooked " << inputPath << " -> " << outputPath
+			<< " (" << texture.mipLevels.size() << " mips, " << uncompressedSize / 1024 << " KB -> " << cookedSize / 1024 << " KB)" << std::endl;
+		return true;
+	}
+
+	bool cookAll(const std::string& assetsDirectory, const std::string& outputDirectory)
+	{
+		std::error_code error;
+		std::filesystem::create_directories(outputDirectory, error);
+
+		bool success = true;
+		for (auto i = 0; i < NUMBER_OF_OBJECT_TEXTURES; ++i)
+		{
+			success &= cook(assetsDirectory + OBJECT_TEXTURE_PATH[i], outputDirectory + CookedTexture::cookedFileName(OBJECT_TEXTURE_PATH[i]), false);
+			success &= cook(assetsDirectory + OBJECT_TEXTURE_NORMALS_PATH[i], outputDirectory + CookedTexture::cookedFileName(OBJECT_TEXTURE_NORMALS_PATH[i]), true);
+		}
+		return success;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const std::vector<std::string> arguments(argv + 1, argv + argc);
+
+	if (arguments.size() == 3 && arguments[0] == "--all")
+	{
+		return cookAll(arguments[1], arguments[2]) ? 0 : 1;
+	}
+	if (arguments.size() == 3 && arguments[0] == "--normals")
+	{
+		return cook(arguments[1], arguments[2], true) ? 0 : 1;
+	}
+	if (arguments.size() == 2)
+	{
+		return cook(arguments[0], arguments[1], false) ? 0 : 1;
+	}
+
+	std::cerr << "Usage: TextureCooker --all <assets directory> <output directory>" << std::endl;
+	std::cerr << "       TextureCooker [--normals] <input image> <output file>" << std::endl;
+	return 1;
+}